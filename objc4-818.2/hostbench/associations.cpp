@@ -0,0 +1,456 @@
+/*
+ * associations.cpp
+ * Associated object benchmarks.
+ *
+ * objc-references.mm is not part of the host build, so this copies its
+ * maps and the get, set and remove paths of
+ * _object_get_associative_reference, _object_set_associative_reference
+ * and _object_remove_assocations, minus retaining and releasing the
+ * values. Keep this in sync with objc-references.mm.
+ *
+ * AssociationsGlobalLock and AssociationsStriped compare one global
+ * associations lock against the table striped by object address. Each
+ * thread works on its own objects, as category code attaching state to
+ * unrelated objects does. Every iteration sets an association, reads
+ * it range(0) times and removes it. "contended" is the fraction of lock
+ * acquisitions that found the lock already held.
+ *
+ * The Inline and TwoLevel benchmarks compare ObjectAssociations, which
+ * keeps an object's first association inline, against the old
+ * per-object ObjectAssociationMap. range(0) objects each get range(1)
+ * associations. "bytes_per_object" is the table memory divided by the
+ * object count: the AssociationsHashMap buckets plus any
+ * ObjectAssociationMap and its buckets.
+ */
+
+#include "sidetable.h"
+#include "bench.h"
+
+class ObjcAssociation {
+    uintptr_t _policy;
+    id _value;
+public:
+    ObjcAssociation(uintptr_t policy, id value) : _policy(policy), _value(value) {}
+    ObjcAssociation() : _policy(0), _value(nil) {}
+    ObjcAssociation(const ObjcAssociation &other) = default;
+    ObjcAssociation &operator=(const ObjcAssociation &other) = default;
+    ObjcAssociation(ObjcAssociation &&other) : ObjcAssociation() {
+        swap(other);
+    }
+
+    void swap(ObjcAssociation &other) {
+        std::swap(_policy, other._policy);
+        std::swap(_value, other._value);
+    }
+
+    uintptr_t policy() const { return _policy; }
+    id value() const { return _value; }
+};
+
+typedef objc::DenseMap<const void *, ObjcAssociation> ObjectAssociationMap;
+
+// Copy of ObjectAssociations, plus getMemorySize().
+class ObjectAssociations {
+    const void *_key;
+    ObjcAssociation _association;
+    ObjectAssociationMap *_map;
+
+    static const void *emptyKey() {
+        return objc::DenseMapInfo<const void *>::getEmptyKey();
+    }
+
+public:
+    ObjectAssociations() : _key(emptyKey()), _association(), _map(nil) {}
+    ObjectAssociations(ObjectAssociations &&other) : ObjectAssociations() {
+        swap(other);
+    }
+    ObjectAssociations(const ObjectAssociations &other) = delete;
+    ObjectAssociations &operator=(ObjectAssociations &&other) {
+        swap(other);
+        return *this;
+    }
+    ~ObjectAssociations() { delete _map; }
+
+    void swap(ObjectAssociations &other) {
+        std::swap(_key, other._key);
+        _association.swap(other._association);
+        std::swap(_map, other._map);
+    }
+
+    size_t size() const {
+        if (slowpath(_map)) return _map->size();
+        return _key != emptyKey() ? 1 : 0;
+    }
+
+    ObjcAssociation *find(const void *key) {
+        if (fastpath(!_map)) {
+            return (_key == key  &&  key != emptyKey()) ? &_association : nil;
+        }
+        auto it = _map->find(key);
+        return it != _map->end() ? &it->second : nil;
+    }
+
+    std::pair<ObjcAssociation *, bool>
+    try_emplace(const void *key, ObjcAssociation &&association) {
+        if (fastpath(!_map)) {
+            if (_key == emptyKey()) {
+                _key = key;
+                _association.swap(association);
+                return { &_association, true };
+            }
+            if (_key == key) return { &_association, false };
+            _map = new ObjectAssociationMap();
+            _map->try_emplace(_key, std::move(_association));
+            _key = emptyKey();
+        }
+        auto result = _map->try_emplace(key, std::move(association));
+        return { &result.first->second, result.second };
+    }
+
+    bool erase(const void *key, ObjcAssociation &removed) {
+        if (fastpath(!_map)) {
+            if (_key != key  ||  key == emptyKey()) return false;
+            removed.swap(_association);
+            _key = emptyKey();
+            return true;
+        }
+        auto it = _map->find(key);
+        if (it == _map->end()) return false;
+        removed.swap(it->second);
+        _map->erase(it);
+        return true;
+    }
+
+    size_t getMemorySize() const {
+        if (!_map) return 0;
+        return sizeof(*_map) + _map->getMemorySize();
+    }
+};
+
+// The old layout: every object with associations has its own
+// ObjectAssociationMap, behind the ObjectAssociations interface.
+class TwoLevelAssociations {
+    ObjectAssociationMap _map;
+
+public:
+    TwoLevelAssociations() = default;
+    TwoLevelAssociations(TwoLevelAssociations &&other) = default;
+
+    void swap(TwoLevelAssociations &other) { _map.swap(other._map); }
+    size_t size() const { return _map.size(); }
+
+    ObjcAssociation *find(const void *key) {
+        auto it = _map.find(key);
+        return it != _map.end() ? &it->second : nil;
+    }
+
+    std::pair<ObjcAssociation *, bool>
+    try_emplace(const void *key, ObjcAssociation &&association) {
+        auto result = _map.try_emplace(key, std::move(association));
+        return { &result.first->second, result.second };
+    }
+
+    bool erase(const void *key, ObjcAssociation &removed) {
+        auto it = _map.find(key);
+        if (it == _map.end()) return false;
+        removed.swap(it->second);
+        _map.erase(it);
+        return true;
+    }
+
+    size_t getMemorySize() const { return _map.getMemorySize(); }
+};
+
+template <typename RefsT>
+struct AssociationsStripe {
+    typedef RefsT Refs;
+
+    spinlock_t slock;
+    objc::DenseMap<DisguisedPtr<objc_object>, Refs> associations;
+
+    void lock() { slock.lock(); }
+    void unlock() { slock.unlock(); }
+    void forceReset() { slock.forceReset(); }
+};
+
+// The old AssociationsManager: every object shares one lock and map.
+template <typename Refs>
+struct GlobalAssociations {
+    typedef AssociationsStripe<Refs> Stripe;
+    Stripe stripe;
+    Stripe& operator[] (const void *) { return stripe; }
+};
+
+template <typename Refs>
+struct StripedAssociations : StripedMap<AssociationsStripe<Refs>> {
+    typedef AssociationsStripe<Refs> Stripe;
+};
+
+static thread_local size_t Acquires, Contended;
+
+template <typename Stripe>
+static void lockStripe(Stripe& stripe)
+{
+    Acquires++;
+    if (stripe.slock.tryLock()) return;
+    Contended++;
+    stripe.lock();
+}
+
+template <typename Table>
+static id getAssociation(Table& table, objc_object *object, const void *key)
+{
+    auto& stripe = table[object];
+    id value = nil;
+    lockStripe(stripe);
+    auto i = stripe.associations.find(object);
+    if (i != stripe.associations.end()) {
+        ObjcAssociation *found = i->second.find(key);
+        if (found) value = found->value();
+    }
+    stripe.unlock();
+    return value;
+}
+
+template <typename Table>
+static void setAssociation(Table& table, objc_object *object,
+                           const void *key, id value)
+{
+    typedef typename Table::Stripe Stripe;
+    Stripe& stripe = table[object];
+    DisguisedPtr<objc_object> disguised{object};
+    ObjcAssociation association{1, value};
+    lockStripe(stripe);
+    if (value) {
+        auto refs = stripe.associations.try_emplace(disguised,
+                                                    typename Stripe::Refs{});
+        auto result = refs.first->second.try_emplace(key, std::move(association));
+        if (!result.second) association.swap(*result.first);
+    } else {
+        auto refs = stripe.associations.find(disguised);
+        if (refs != stripe.associations.end()) {
+            if (refs->second.erase(key, association)  &&
+                refs->second.size() == 0)
+            {
+                stripe.associations.erase(refs);
+            }
+        }
+    }
+    stripe.unlock();
+}
+
+template <typename Table>
+static void removeAssociations(Table& table, objc_object *object)
+{
+    typedef typename Table::Stripe Stripe;
+    Stripe& stripe = table[object];
+    typename Stripe::Refs refs{};
+    lockStripe(stripe);
+    auto i = stripe.associations.find(object);
+    if (i != stripe.associations.end()) {
+        refs.swap(i->second);
+        stripe.associations.erase(i);
+    }
+    stripe.unlock();
+}
+
+static const char Key1 = 0, Key2 = 0;
+static const char Keys[64] = { };
+
+
+// Global lock vs. striped table, many threads.
+
+static GlobalAssociations<ObjectAssociations> *Global;
+static StripedAssociations<ObjectAssociations> *Striped;
+static HostObjects *Objects;
+
+enum { ObjectsPerThread = 256 };
+
+static void AssociationsSetup(bench::State &)
+{
+    Global = new GlobalAssociations<ObjectAssociations>();
+    Striped = new StripedAssociations<ObjectAssociations>();
+    Objects = new HostObjects(ObjectsPerThread * 16);
+}
+
+static void AssociationsTeardown(bench::State &)
+{
+    delete Global;
+    Global = nullptr;
+    delete Striped;
+    Striped = nullptr;
+    delete Objects;
+    Objects = nullptr;
+}
+
+template <typename Table>
+static void GetSetRemove(bench::State &state, Table& table)
+{
+    size_t reads = (size_t)state.range(0);
+    size_t base = ObjectsPerThread * state.threadIndex();
+    id value = (id)(*Objects)[0];
+    size_t i = 0;
+    Acquires = Contended = 0;
+
+    for (auto _ : state) {
+        objc_object *obj = (*Objects)[base + i];
+        setAssociation(table, obj, &Key1, value);
+        setAssociation(table, obj, &Key2, value);
+        for (size_t r = 0; r < reads; r++) {
+            bench::DoNotOptimize(getAssociation(table, obj, &Key1));
+        }
+        setAssociation(table, obj, &Key2, nil);
+        removeAssociations(table, obj);
+        if (++i == ObjectsPerThread) i = 0;
+    }
+    state.setItemsProcessed(state.iterations() * (reads + 4));
+    // Counters are summed over threads.
+    state.setCounter("contended",
+                     (double)Contended / Acquires / state.threads());
+}
+
+static void AssociationsGlobalLock(bench::State &state)
+{
+    GetSetRemove(state, *Global);
+}
+BENCHMARK(AssociationsGlobalLock)
+    ->Setup(AssociationsSetup)->Teardown(AssociationsTeardown)
+    ->Arg(1)->Arg(16)->ThreadRange(1, 16);
+
+static void AssociationsStriped(bench::State &state)
+{
+    GetSetRemove(state, *Striped);
+}
+BENCHMARK(AssociationsStriped)
+    ->Setup(AssociationsSetup)->Teardown(AssociationsTeardown)
+    ->Arg(1)->Arg(16)->ThreadRange(1, 16);
+
+
+// Inline first association vs. two-level map, one thread.
+
+template <typename Refs>
+static StripedAssociations<Refs> *Layout;
+
+template <typename Refs>
+static void LayoutSetup(bench::State &state)
+{
+    Layout<Refs> = new StripedAssociations<Refs>();
+    Objects = new HostObjects((size_t)state.range(0));
+}
+
+template <typename Refs>
+static void LayoutTeardown(bench::State &)
+{
+    delete Layout<Refs>;
+    Layout<Refs> = nullptr;
+    delete Objects;
+    Objects = nullptr;
+}
+
+template <typename Refs>
+static void setBytesPerObject(bench::State &state)
+{
+    auto& table = *Layout<Refs>;
+    size_t bytes = 0;
+    for (unsigned int s = 0; s < table.stripeCount(); s++) {
+        auto& associations = table.stripe(s).associations;
+        bytes += associations.getMemorySize();
+        for (auto& refs : associations) bytes += refs.second.getMemorySize();
+    }
+    state.setCounter("bytes_per_object", (double)bytes / Objects->count);
+}
+
+// Every object has range(1) associations. Read one of them per
+// iteration.
+template <typename Refs>
+static void LayoutGet(bench::State &state)
+{
+    auto& table = *Layout<Refs>;
+    size_t count = Objects->count;
+    size_t keys = (size_t)state.range(1);
+    id value = (id)(*Objects)[0];
+
+    for (size_t i = 0; i < count; i++) {
+        for (size_t k = 0; k < keys; k++) {
+            setAssociation(table, (*Objects)[i], &Keys[k], value);
+        }
+    }
+    setBytesPerObject<Refs>(state);
+
+    size_t i = 0, k = 0;
+    for (auto _ : state) {
+        bench::DoNotOptimize(getAssociation(table, (*Objects)[i], &Keys[k]));
+        if (++i == count) i = 0;
+        if (++k == keys) k = 0;
+    }
+    state.setItemsProcessed(state.iterations());
+
+    for (size_t i = 0; i < count; i++) {
+        removeAssociations(table, (*Objects)[i]);
+    }
+}
+
+// Give an object range(1) associations and remove them again.
+template <typename Refs>
+static void LayoutSetRemove(bench::State &state)
+{
+    auto& table = *Layout<Refs>;
+    size_t count = Objects->count;
+    size_t keys = (size_t)state.range(1);
+    id value = (id)(*Objects)[0];
+
+    size_t i = 0;
+    for (auto _ : state) {
+        objc_object *obj = (*Objects)[i];
+        for (size_t k = 0; k < keys; k++) {
+            setAssociation(table, obj, &Keys[k], value);
+        }
+        removeAssociations(table, obj);
+        if (++i == count) i = 0;
+    }
+    state.setItemsProcessed(state.iterations() * (keys + 1));
+}
+
+static void LayoutArgs(bench::Benchmark *b)
+{
+    for (int64_t keys : { 1, 2, 8 }) {
+        b->Args({ 4096, keys });
+        b->Args({ 262144, keys });
+    }
+}
+
+static void AssociationsTwoLevelGet(bench::State &state)
+{
+    LayoutGet<TwoLevelAssociations>(state);
+}
+BENCHMARK(AssociationsTwoLevelGet)
+    ->Setup(LayoutSetup<TwoLevelAssociations>)
+    ->Teardown(LayoutTeardown<TwoLevelAssociations>)
+    ->Apply(LayoutArgs);
+
+static void AssociationsInlineGet(bench::State &state)
+{
+    LayoutGet<ObjectAssociations>(state);
+}
+BENCHMARK(AssociationsInlineGet)
+    ->Setup(LayoutSetup<ObjectAssociations>)
+    ->Teardown(LayoutTeardown<ObjectAssociations>)
+    ->Apply(LayoutArgs);
+
+static void AssociationsTwoLevelSetRemove(bench::State &state)
+{
+    LayoutSetRemove<TwoLevelAssociations>(state);
+}
+BENCHMARK(AssociationsTwoLevelSetRemove)
+    ->Setup(LayoutSetup<TwoLevelAssociations>)
+    ->Teardown(LayoutTeardown<TwoLevelAssociations>)
+    ->Apply(LayoutArgs);
+
+static void AssociationsInlineSetRemove(bench::State &state)
+{
+    LayoutSetRemove<ObjectAssociations>(state);
+}
+BENCHMARK(AssociationsInlineSetRemove)
+    ->Setup(LayoutSetup<ObjectAssociations>)
+    ->Teardown(LayoutTeardown<ObjectAssociations>)
+    ->Apply(LayoutArgs);
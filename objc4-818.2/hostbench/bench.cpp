@@ -0,0 +1,268 @@
+/*
+ * bench.cpp
+ * Benchmark registration, calibration and reporting for bench.h.
+ *
+ * Usage: objc-hostbench [--filter=SUBSTRING] [--min-time=SECONDS] [--list]
+ *
+ * --min-time=0 runs every benchmark exactly once with one iteration;
+ * the ctest smoke test uses it to check that every benchmark still runs.
+ */
+
+#include "objc-private.h"
+#include "bench.h"
+
+#include <atomic>
+#include <thread>
+
+namespace bench {
+
+static std::vector<Benchmark *> &registry()
+{
+    static std::vector<Benchmark *> benchmarks;
+    return benchmarks;
+}
+
+void State::startTimer()
+{
+    mStart = nanoseconds();
+}
+
+void State::stopTimer()
+{
+    if (mStart) mElapsed += nanoseconds() - mStart;
+    mStart = 0;
+}
+
+void State::pauseTiming()
+{
+    stopTimer();
+}
+
+void State::resumeTiming()
+{
+    startTimer();
+}
+
+void State::setCounter(const char *name, double value)
+{
+    for (auto &counter : mCounters) {
+        if (counter.first == name) {
+            counter.second = value;
+            return;
+        }
+    }
+    mCounters.emplace_back(name, value);
+}
+
+
+Benchmark::Benchmark(const char *name, Function fn)
+    : mName(name), mFunction(fn)
+{
+    registry().push_back(this);
+}
+
+Benchmark *Benchmark::Arg(int64_t a)
+{
+    mArgs.push_back({a});
+    return this;
+}
+
+Benchmark *Benchmark::Args(std::initializer_list<int64_t> a)
+{
+    mArgs.push_back(std::vector<int64_t>(a));
+    return this;
+}
+
+Benchmark *Benchmark::Range(int64_t lo, int64_t hi, int64_t mult)
+{
+    for (int64_t a = lo; a < hi; a *= mult) mArgs.push_back({a});
+    mArgs.push_back({hi});
+    return this;
+}
+
+Benchmark *Benchmark::Threads(int n)
+{
+    mThreads.push_back(n);
+    return this;
+}
+
+Benchmark *Benchmark::ThreadRange(int lo, int hi)
+{
+    for (int n = lo; n < hi; n *= 2) mThreads.push_back(n);
+    mThreads.push_back(hi);
+    return this;
+}
+
+Benchmark *Benchmark::Iterations(size_t n)
+{
+    mIterations = n;
+    return this;
+}
+
+Benchmark *Benchmark::Setup(Function fn)
+{
+    mSetup = fn;
+    return this;
+}
+
+Benchmark *Benchmark::Teardown(Function fn)
+{
+    mTeardown = fn;
+    return this;
+}
+
+Benchmark *Benchmark::Apply(void (*fn)(Benchmark *))
+{
+    fn(this);
+    return this;
+}
+
+
+class Runner {
+    double mMinTime = 0.25;
+    const char *mFilter = nullptr;
+
+    struct Result {
+        size_t iterations;
+        uint64_t wall;
+        uint64_t items;
+        uint64_t bytes;
+        std::vector<std::pair<std::string, double>> counters;
+        std::string label;
+    };
+
+    Result runOnce(Benchmark *b, const std::vector<int64_t> &args,
+                   int threads, size_t iterations)
+    {
+        State setupState(iterations, args, threads, 0);
+        if (b->mSetup) b->mSetup(setupState);
+
+        std::vector<State> states;
+        states.reserve(threads);
+        for (int t = 0; t < threads; t++) {
+            states.emplace_back(iterations, args, threads, t);
+        }
+
+        if (threads == 1) {
+            b->mFunction(states[0]);
+        } else {
+            std::atomic<int> ready{0};
+            std::atomic<bool> go{false};
+            std::vector<std::thread> workers;
+            for (int t = 0; t < threads; t++) {
+                workers.emplace_back([&, t]{
+                    ready.fetch_add(1);
+                    while (!go.load(std::memory_order_acquire)) { }
+                    b->mFunction(states[t]);
+                });
+            }
+            while (ready.load() != threads) { }
+            go.store(true, std::memory_order_release);
+            for (auto &w : workers) w.join();
+        }
+
+        if (b->mTeardown) b->mTeardown(setupState);
+
+        Result r{iterations, 0, 0, 0, {}, {}};
+        for (auto &s : states) {
+            if (s.mElapsed > r.wall) r.wall = s.mElapsed;
+            r.items += s.mItems;
+            r.bytes += s.mBytes;
+            for (auto &c : s.mCounters) {
+                bool found = false;
+                for (auto &rc : r.counters) {
+                    if (rc.first == c.first) {
+                        rc.second += c.second;
+                        found = true;
+                    }
+                }
+                if (!found) r.counters.push_back(c);
+            }
+            if (r.label.empty()) r.label = s.mLabel;
+        }
+        if (r.wall == 0) r.wall = 1;
+        return r;
+    }
+
+    void report(const std::string &name, const Result &r)
+    {
+        double nsPerIter = (double)r.wall / (double)r.iterations;
+        printf("%-56s %10zu %12.1f ns", name.c_str(), r.iterations, nsPerIter);
+        if (r.items) {
+            printf(" %12.3fM items/s", r.items / (r.wall / 1e9) / 1e6);
+        }
+        if (r.bytes) {
+            printf(" %10.1f MB/s", r.bytes / (r.wall / 1e9) / (1024.0 * 1024.0));
+        }
+        for (auto &c : r.counters) {
+            printf(" %s=%.6g", c.first.c_str(), c.second);
+        }
+        if (!r.label.empty()) printf(" %s", r.label.c_str());
+        printf("\n");
+        fflush(stdout);
+    }
+
+  public:
+    Runner(int argc, char **argv)
+    {
+        for (int i = 1; i < argc; i++) {
+            if (0 == strncmp(argv[i], "--filter=", 9)) {
+                mFilter = argv[i] + 9;
+            } else if (0 == strncmp(argv[i], "--min-time=", 11)) {
+                mMinTime = atof(argv[i] + 11);
+            } else if (0 == strcmp(argv[i], "--list")) {
+                for (auto *b : registry()) printf("%s\n", b->mName);
+                exit(0);
+            } else {
+                fprintf(stderr, "usage: %s [--filter=SUBSTRING] "
+                        "[--min-time=SECONDS] [--list]\n", argv[0]);
+                exit(2);
+            }
+        }
+    }
+
+    int run()
+    {
+        printf("%-56s %10s %15s\n", "Benchmark", "Iterations", "Time");
+        for (auto *b : registry()) {
+            if (mFilter && !strstr(b->mName, mFilter)) continue;
+
+            auto argSets = b->mArgs;
+            if (argSets.empty()) argSets.push_back({});
+            auto threadCounts = b->mThreads;
+            if (threadCounts.empty()) threadCounts.push_back(1);
+
+            for (auto &args : argSets) {
+                for (int threads : threadCounts) {
+                    std::string name = b->mName;
+                    for (int64_t a : args) name += "/" + std::to_string(a);
+                    if (b->mThreads.size()) {
+                        name += "/threads:" + std::to_string(threads);
+                    }
+
+                    size_t iterations = b->mIterations ? b->mIterations : 1;
+                    Result r = runOnce(b, args, threads, iterations);
+                    while (!b->mIterations  &&  r.wall < mMinTime * 1e9  &&
+                           iterations < 1000000000)
+                    {
+                        double scale = mMinTime * 1e9 * 1.4 / r.wall;
+                        if (scale < 2) scale = 2;
+                        if (scale > 10) scale = 10;
+                        iterations = (size_t)(iterations * scale);
+                        r = runOnce(b, args, threads, iterations);
+                    }
+                    report(name, r);
+                }
+            }
+        }
+        return 0;
+    }
+};
+
+}
+
+int main(int argc, char **argv)
+{
+    bench::Runner runner(argc, argv);
+    return runner.run();
+}
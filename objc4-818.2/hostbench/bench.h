@@ -0,0 +1,153 @@
+/*
+ * bench.h
+ * Minimal benchmark driver for the host build of the runtime.
+ *
+ * The interface follows Google Benchmark closely enough that a
+ * benchmark can move between the two with only mechanical edits:
+ *
+ *   static void DenseMapFind(bench::State &state) {
+ *       ... setup using state.range(0) ...
+ *       for (auto _ : state) {
+ *           ... timed work ...
+ *       }
+ *       state.setItemsProcessed(state.iterations());
+ *   }
+ *   BENCHMARK(DenseMapFind)->Arg(16)->Arg(1024)->Threads(1)->Threads(8);
+ *
+ * Each benchmark runs once per (args, threads) combination. With more
+ * than one thread every thread runs the function with its own State;
+ * state.threadIndex() distinguishes them. Setup/Teardown hooks run once
+ * per combination on the main thread, outside the timed region.
+ *
+ * Counters named with setCounter() are summed over threads and
+ * printed after the timing columns. Use them for non-time results
+ * such as bytes held or probe lengths.
+ */
+
+#ifndef _OBJC_HOSTBENCH_H_
+#define _OBJC_HOSTBENCH_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <utility>
+
+namespace bench {
+
+class State {
+    friend class Runner;
+
+    size_t mMaxIterations;
+    size_t mRemaining;
+    std::vector<int64_t> mArgs;
+    int mThreads;
+    int mThreadIndex;
+    uint64_t mItems = 0;
+    uint64_t mBytes = 0;
+    uint64_t mStart = 0;
+    uint64_t mElapsed = 0;
+    uint64_t mPausedAt = 0;
+    std::vector<std::pair<std::string, double>> mCounters;
+    std::string mLabel;
+
+    void startTimer();
+    void stopTimer();
+
+  public:
+    State(size_t iterations, const std::vector<int64_t> &args,
+          int threads, int threadIndex)
+        : mMaxIterations(iterations), mRemaining(iterations),
+          mArgs(args), mThreads(threads), mThreadIndex(threadIndex) { }
+
+    // User-provided so `for (auto _ : state)` is not an unused variable.
+    struct Value { Value() { } ~Value() { } };
+
+    class iterator {
+        State *mState;
+      public:
+        explicit iterator(State *state) : mState(state) { }
+        Value operator * () const { return Value(); }
+        iterator& operator ++ () { return *this; }
+        bool operator != (const iterator &) const {
+            if (mState->mRemaining > 0) {
+                mState->mRemaining--;
+                return true;
+            }
+            mState->stopTimer();
+            return false;
+        }
+    };
+
+    iterator begin() { startTimer(); return iterator(this); }
+    iterator end() { return iterator(this); }
+
+    // Bracket untimed work inside the benchmark loop.
+    void pauseTiming();
+    void resumeTiming();
+
+    int64_t range(size_t i = 0) const {
+        return i < mArgs.size() ? mArgs[i] : 0;
+    }
+    size_t iterations() const { return mMaxIterations; }
+    int threads() const { return mThreads; }
+    int threadIndex() const { return mThreadIndex; }
+
+    void setItemsProcessed(uint64_t n) { mItems = n; }
+    void setBytesProcessed(uint64_t n) { mBytes = n; }
+    void setLabel(const char *label) { mLabel = label; }
+    void setCounter(const char *name, double value);
+};
+
+typedef void (*Function)(State &);
+
+class Benchmark {
+    friend class Runner;
+
+    const char *mName;
+    Function mFunction;
+    Function mSetup = nullptr;
+    Function mTeardown = nullptr;
+    std::vector<std::vector<int64_t>> mArgs;
+    std::vector<int> mThreads;
+    size_t mIterations = 0;
+
+  public:
+    Benchmark(const char *name, Function fn);
+
+    Benchmark *Arg(int64_t a);
+    Benchmark *Args(std::initializer_list<int64_t> a);
+    // Powers of `mult` from lo to hi inclusive.
+    Benchmark *Range(int64_t lo, int64_t hi, int64_t mult = 8);
+    Benchmark *Threads(int n);
+    // Threads(1), Threads(2), ... doubling up to and including hi.
+    Benchmark *ThreadRange(int lo, int hi);
+    // Run exactly this many iterations instead of calibrating.
+    Benchmark *Iterations(size_t n);
+    Benchmark *Setup(Function fn);
+    Benchmark *Teardown(Function fn);
+    // Call fn(this), for argument sets shared by several benchmarks.
+    Benchmark *Apply(void (*fn)(Benchmark *));
+};
+
+// Prevent the compiler from discarding a computed value.
+template <typename T>
+static inline void DoNotOptimize(T const &value) {
+    asm volatile("" : : "r,m"(value) : "memory");
+}
+
+static inline void ClobberMemory() {
+    asm volatile("" : : : "memory");
+}
+
+}
+
+#define BENCHMARK_CONCAT2(a, b) a ## b
+#define BENCHMARK_CONCAT(a, b) BENCHMARK_CONCAT2(a, b)
+
+#define BENCHMARK(fn)                                                   \
+    static ::bench::Benchmark *BENCHMARK_CONCAT(_bench_, __LINE__)      \
+        __attribute__((used)) =                                         \
+        (new ::bench::Benchmark(#fn, fn))
+
+#endif
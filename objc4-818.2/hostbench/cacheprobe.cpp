@@ -0,0 +1,111 @@
+/*
+ * cacheprobe.cpp
+ * Method cache probe benchmarks: the runtime's linear bucket scan
+ * against a grouped control-byte scan (see cachetables.h).
+ *
+ * Arguments are {capacity, occupancy %, colliding %}. Colliding SELs
+ * come in clusters of four that are a multiple of the capacity apart,
+ * so each cluster lands on one bucket under cache_hash()'s plain mask.
+ * The probes counter is buckets examined per lookup for LinearCache
+ * and 16-byte groups examined for GroupCache.
+ */
+
+#include "cachetables.h"
+#include "bench.h"
+
+#include <algorithm>
+#include <random>
+
+// SELs are addresses in the selector string tables, a couple of dozen
+// bytes apart.
+static std::vector<SEL> makeSels(mask_t capacity, size_t count,
+                                 unsigned collidingPercent, uintptr_t base)
+{
+    std::vector<SEL> sels;
+    size_t colliding = count * collidingPercent / 100;
+    for (size_t i = 0; i < count; i++) {
+        uintptr_t value;
+        if (i < colliding) {
+            value = base + 0x10000000 + (i / 4) * 24 + (i % 4) * capacity;
+        } else {
+            value = base + i * 24;
+        }
+        sels.push_back((SEL)value);
+    }
+    std::shuffle(sels.begin(), sels.end(), std::mt19937(1));
+    return sels;
+}
+
+static IMP impFor(SEL sel)
+{
+    return (IMP)((uintptr_t)sel ^ 1);
+}
+
+template <typename Cache>
+static void CacheLookup(bench::State &state, bool hit)
+{
+    mask_t capacity = (mask_t)state.range(0);
+    size_t count = capacity * state.range(1) / 100;
+    unsigned colliding = (unsigned)state.range(2);
+
+    Cache cache(capacity);
+    std::vector<SEL> present = makeSels(capacity, count, colliding, 0x100000000);
+    for (SEL sel : present) cache.insert(sel, impFor(sel));
+    std::vector<SEL> absent = makeSels(capacity, count, colliding, 0x300000000);
+    const std::vector<SEL> &sels = hit ? present : absent;
+
+    size_t probes = 0;
+    size_t i = 0;
+    for (auto _ : state) {
+        IMP imp = cache.lookup(sels[i], &probes);
+        bench::DoNotOptimize(imp);
+        if (++i == sels.size()) i = 0;
+    }
+
+    // Check the results outside the timed region.
+    size_t ignored = 0;
+    for (SEL sel : sels) {
+        if (cache.lookup(sel, &ignored) != (hit ? impFor(sel) : nil)) {
+            state.setLabel("WRONG RESULT");
+        }
+    }
+
+    state.setItemsProcessed(state.iterations());
+    state.setCounter("probes", (double)probes / state.iterations());
+}
+
+static void LinearCacheHit(bench::State &state)
+{
+    CacheLookup<LinearCache>(state, true);
+}
+
+static void LinearCacheMiss(bench::State &state)
+{
+    CacheLookup<LinearCache>(state, false);
+}
+
+static void GroupCacheHit(bench::State &state)
+{
+    CacheLookup<GroupCache>(state, true);
+}
+
+static void GroupCacheMiss(bench::State &state)
+{
+    CacheLookup<GroupCache>(state, false);
+}
+
+static void CacheProbeArgs(bench::Benchmark *b)
+{
+    for (int64_t capacity : { 1024, 32768 }) {
+        for (int64_t occupancy : { 50, 75, 87 }) {
+            for (int64_t colliding : { 0, 25, 75 }) {
+                b->Args({ capacity, occupancy, colliding });
+            }
+        }
+    }
+}
+
+BENCHMARK(LinearCacheHit)->Apply(CacheProbeArgs);
+BENCHMARK(GroupCacheHit)->Apply(CacheProbeArgs);
+BENCHMARK(LinearCacheMiss)->Apply(CacheProbeArgs);
+BENCHMARK(GroupCacheMiss)->Apply(CacheProbeArgs);
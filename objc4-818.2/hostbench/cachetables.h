@@ -0,0 +1,171 @@
+/*
+ * cachetables.h
+ * Method cache layouts for the cache probe benchmarks.
+ *
+ * LinearCache is the runtime's cache_t bucket array as objc_msgSend and
+ * cache_t::insert see it: {sel, imp} buckets indexed by cache_hash(),
+ * scanned one bucket at a time with cache_next(). Keep it in sync with
+ * objc-cache.mm.
+ *
+ * GroupCache is a SwissTable-style alternative. A control byte per bucket
+ * holds a 7-bit fingerprint of the SEL (or EMPTY), and lookups compare 16
+ * control bytes at once (SSE2 on x86_64, a scalar loop elsewhere) before
+ * touching any bucket. The control bytes for the first group are mirrored
+ * past the end so a group load never wraps.
+ *
+ * GroupCache is not a cache_t representation. objc_msgSend and
+ * cache_getImp read bucket_t directly in every objc-msg-*.s, so adopting
+ * it would mean rewriting CacheLookup for each architecture. These
+ * benchmarks measure whether that would pay off.
+ */
+
+#ifndef _OBJC_HOSTBENCH_CACHETABLES_H_
+#define _OBJC_HOSTBENCH_CACHETABLES_H_
+
+#include "objc-private.h"
+
+#if __SSE2__
+#include <emmintrin.h>
+#endif
+
+typedef uint32_t mask_t;
+
+class LinearCache {
+    struct bucket_t {
+        SEL sel;
+        IMP imp;
+    };
+
+    bucket_t *mBuckets;
+    mask_t mMask;
+
+#if __arm64__
+    // arm64 scans downwards and mixes the SEL for preoptimized caches.
+    static mask_t hash(SEL sel, mask_t mask) {
+        uintptr_t value = (uintptr_t)sel;
+        value ^= value >> 7;
+        return (mask_t)(value & mask);
+    }
+    static mask_t next(mask_t i, mask_t mask) { return i ? i-1 : mask; }
+#else
+    static mask_t hash(SEL sel, mask_t mask) {
+        return (mask_t)((uintptr_t)sel & mask);
+    }
+    static mask_t next(mask_t i, mask_t mask) { return (i+1) & mask; }
+#endif
+
+  public:
+    explicit LinearCache(mask_t capacity) : mMask(capacity - 1) {
+        mBuckets = (bucket_t *)calloc(capacity, sizeof(bucket_t));
+    }
+    ~LinearCache() { free(mBuckets); }
+
+    mask_t capacity() const { return mMask + 1; }
+
+    void insert(SEL sel, IMP imp) {
+        mask_t i = hash(sel, mMask);
+        while (mBuckets[i].sel) i = next(i, mMask);
+        mBuckets[i] = { sel, imp };
+    }
+
+    // objc_msgSend's CacheLookup: stop at the SEL or at an empty bucket.
+    // *probes counts buckets examined.
+    IMP lookup(SEL sel, size_t *probes) const {
+        mask_t i = hash(sel, mMask);
+        for (;;) {
+            (*probes)++;
+            SEL s = mBuckets[i].sel;
+            if (s == sel) return mBuckets[i].imp;
+            if (!s) return nil;
+            i = next(i, mMask);
+        }
+    }
+};
+
+class GroupCache {
+    static constexpr unsigned GroupSize = 16;
+    static constexpr uint8_t Empty = 0x80;
+
+    struct bucket_t {
+        SEL sel;
+        IMP imp;
+    };
+
+    uint8_t *mCtrl;         // capacity + GroupSize control bytes
+    bucket_t *mBuckets;
+    mask_t mMask;
+
+    static uintptr_t hash(SEL sel) {
+        // SELs are string addresses; their low bits cluster. Multiply to
+        // spread them, then take the position from the middle bits and
+        // the fingerprint from the top.
+        return (uintptr_t)sel * 0x9E3779B97F4A7C15ull;
+    }
+    static mask_t position(uintptr_t h) { return (mask_t)(h >> 16); }
+    static uint8_t fingerprint(uintptr_t h) { return (uint8_t)(h >> 57); }
+
+    // Bit i set if ctrl[i] == byte, for the 16 bytes at ctrl.
+    static uint32_t match(const uint8_t *ctrl, uint8_t byte) {
+#if __SSE2__
+        __m128i group = _mm_loadu_si128((const __m128i *)ctrl);
+        return (uint32_t)_mm_movemask_epi8(
+            _mm_cmpeq_epi8(group, _mm_set1_epi8((char)byte)));
+#else
+        uint32_t bits = 0;
+        for (unsigned i = 0; i < GroupSize; i++) {
+            bits |= (uint32_t)(ctrl[i] == byte) << i;
+        }
+        return bits;
+#endif
+    }
+
+    void setCtrl(mask_t i, uint8_t byte) {
+        mCtrl[i] = byte;
+        if (i < GroupSize) mCtrl[mMask + 1 + i] = byte;
+    }
+
+  public:
+    explicit GroupCache(mask_t capacity) {
+        if (capacity < GroupSize) capacity = GroupSize;
+        mMask = capacity - 1;
+        mCtrl = (uint8_t *)malloc(capacity + GroupSize);
+        memset(mCtrl, Empty, capacity + GroupSize);
+        mBuckets = (bucket_t *)calloc(capacity, sizeof(bucket_t));
+    }
+    ~GroupCache() { free(mCtrl); free(mBuckets); }
+
+    mask_t capacity() const { return mMask + 1; }
+
+    void insert(SEL sel, IMP imp) {
+        uintptr_t h = hash(sel);
+        mask_t pos = position(h) & mMask;
+        for (mask_t step = GroupSize; ; step += GroupSize) {
+            uint32_t empty = match(mCtrl + pos, Empty);
+            if (empty) {
+                mask_t i = (pos + __builtin_ctz(empty)) & mMask;
+                mBuckets[i] = { sel, imp };
+                setCtrl(i, fingerprint(h));
+                return;
+            }
+            pos = (pos + step) & mMask;  // triangular probing over groups
+        }
+    }
+
+    // *probes counts groups examined.
+    IMP lookup(SEL sel, size_t *probes) const {
+        uintptr_t h = hash(sel);
+        uint8_t fp = fingerprint(h);
+        mask_t pos = position(h) & mMask;
+        for (mask_t step = GroupSize; ; step += GroupSize) {
+            (*probes)++;
+            for (uint32_t bits = match(mCtrl + pos, fp); bits; bits &= bits-1) {
+                mask_t i = (pos + __builtin_ctz(bits)) & mMask;
+                if (mBuckets[i].sel == sel) return mBuckets[i].imp;
+            }
+            if (match(mCtrl + pos, Empty)) return nil;
+            pos = (pos + step) & mMask;
+        }
+    }
+};
+
+#endif
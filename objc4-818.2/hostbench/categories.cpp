@@ -0,0 +1,200 @@
+/*
+ * categories.cpp
+ * Category attachment benchmarks: many categories on one class.
+ *
+ * objc-runtime-new.mm is not part of the host build. This copies
+ * list_array_tt::attachLists as it was, which reallocated the class's
+ * array to the exact new size on every call, and as it is now, which
+ * grows it with room to spare, plus the cache flush attachCategories
+ * does for a realized class. Keep this in sync with
+ * objc-runtime-new.h and objc-runtime-new.mm.
+ *
+ * The argument is the number of categories. CategoryAttachEach attaches
+ * them one call at a time to a class with exact-size arrays, as
+ * load_categories_nolock did. CategoryAttachEachSpare does the same with
+ * spare capacity: the case of categories arriving one image at a time.
+ * CategoryAttachBatched attaches them in one call, as
+ * attachPendingCategories now does for categories of the same load.
+ * The copies counter is list pointers copied per category and flushes
+ * is cache flushes per category.
+ */
+
+#include "objc-private.h"
+#include "bench.h"
+
+#include <vector>
+
+enum {
+    MethodsPerCategory = 4,
+    Subclasses = 16,
+    CacheBytes = 1024,
+};
+
+struct HostMethodList {
+    uint32_t count;
+    void *methods[MethodsPerCategory];
+};
+
+struct HostArray {
+    uint32_t count;
+    HostMethodList *lists[0];
+
+    static size_t byteSize(uint32_t count) {
+        return sizeof(HostArray) + count * sizeof(HostMethodList *);
+    }
+};
+
+// list_array_tt without pointer signing: a single list or an array.
+struct HostListArray {
+    HostMethodList *list = nullptr;
+    HostArray *array = nullptr;
+
+    ~HostListArray() { free(array); }
+
+    uint32_t count() const {
+        return array ? array->count : (list ? 1 : 0);
+    }
+    HostMethodList *at(uint32_t i) const {
+        return array ? array->lists[i] : list;
+    }
+};
+
+static size_t Copies;
+static size_t Flushes;
+
+template <bool Spare>
+static void attachLists(HostListArray &a, HostMethodList * const *addedLists,
+                        uint32_t addedCount)
+{
+    if (addedCount == 0) return;
+
+    if (a.array) {
+        uint32_t oldCount = a.array->count;
+        uint32_t newCount = oldCount + addedCount;
+        HostArray *oldArray = a.array;
+        HostArray *newArray;
+        if (!Spare) {
+            newArray = (HostArray *)malloc(HostArray::byteSize(newCount));
+        } else if (malloc_size(oldArray) < HostArray::byteSize(newCount)) {
+            newArray = (HostArray *)
+                malloc(HostArray::byteSize(newCount + newCount / 2));
+        } else {
+            newArray = oldArray;
+        }
+        for (int i = oldCount - 1; i >= 0; i--)
+            newArray->lists[i + addedCount] = oldArray->lists[i];
+        for (unsigned i = 0; i < addedCount; i++)
+            newArray->lists[i] = addedLists[i];
+        newArray->count = newCount;
+        Copies += newCount;
+        if (newArray != oldArray) {
+            free(oldArray);
+            a.array = newArray;
+        }
+    }
+    else if (!a.list  &&  addedCount == 1) {
+        a.list = addedLists[0];
+    }
+    else {
+        uint32_t newCount = (a.list ? 1 : 0) + addedCount;
+        a.array = (HostArray *)malloc(HostArray::byteSize(newCount));
+        a.array->count = newCount;
+        if (a.list) a.array->lists[addedCount] = a.list;
+        for (unsigned i = 0; i < addedCount; i++)
+            a.array->lists[i] = addedLists[i];
+        a.list = nullptr;
+        Copies += newCount;
+    }
+}
+
+// flushCaches(cls): the class and each of its subclasses lose their
+// caches.
+static void flushCaches(std::vector<char> &caches)
+{
+    memset(caches.data(), 0, caches.size());
+    bench::DoNotOptimize(caches.data());
+    Flushes++;
+}
+
+static std::vector<HostMethodList> *Categories;
+static HostMethodList BaseList;
+
+static void CategorySetup(bench::State &state)
+{
+    Categories = new std::vector<HostMethodList>(state.range(0));
+    for (auto &list : *Categories) list.count = MethodsPerCategory;
+    BaseList.count = MethodsPerCategory;
+}
+
+static void CategoryTeardown(bench::State &)
+{
+    delete Categories;
+}
+
+template <bool Spare>
+static void Attach(bench::State &state, bool batched)
+{
+    uint32_t n = (uint32_t)Categories->size();
+    std::vector<char> caches(CacheBytes * (Subclasses + 1));
+    std::vector<HostMethodList *> buffer(n);
+    bool correct = true;
+    Copies = 0;
+    Flushes = 0;
+
+    for (auto _ : state) {
+        HostListArray methods;
+        HostMethodList *base = &BaseList;
+        attachLists<Spare>(methods, &base, 1);
+
+        if (batched) {
+            // attachCategories fills its buffer back to front.
+            for (uint32_t i = 0; i < n; i++) {
+                buffer[n - 1 - i] = &(*Categories)[i];
+            }
+            attachLists<Spare>(methods, buffer.data(), n);
+            flushCaches(caches);
+        } else {
+            for (uint32_t i = 0; i < n; i++) {
+                HostMethodList *list = &(*Categories)[i];
+                attachLists<Spare>(methods, &list, 1);
+                flushCaches(caches);
+            }
+        }
+
+        // Newest category first, the class's own list last.
+        correct &= methods.count() == n + 1  &&
+            methods.at(0) == &(*Categories)[n - 1]  &&
+            methods.at(n) == &BaseList;
+        bench::DoNotOptimize(methods.array);
+    }
+
+    if (!correct) state.setLabel("WRONG RESULT");
+    size_t attached = (size_t)state.iterations() * n;
+    state.setItemsProcessed(attached);
+    state.setCounter("copies", (double)Copies / attached);
+    state.setCounter("flushes", (double)Flushes / attached);
+}
+
+static void CategoryAttachEach(bench::State &state)
+{
+    Attach<false>(state, false);
+}
+BENCHMARK(CategoryAttachEach)
+    ->Setup(CategorySetup)->Teardown(CategoryTeardown)
+    ->Arg(16)->Arg(500);
+
+static void CategoryAttachEachSpare(bench::State &state)
+{
+    Attach<true>(state, false);
+}
+BENCHMARK(CategoryAttachEachSpare)
+    ->Setup(CategorySetup)->Teardown(CategoryTeardown)
+    ->Arg(16)->Arg(500);
+
+static void CategoryAttachBatched(bench::State &state)
+{
+    Attach<true>(state, true);
+}
+BENCHMARK(CategoryAttachBatched)
+    ->Setup(CategorySetup)->Teardown(CategoryTeardown)
+    ->Arg(16)->Arg(500);
@@ -0,0 +1,64 @@
+/*
+ * densemap.cpp
+ * objc::DenseMap benchmarks, keyed the way RefcountMap and the
+ * associations map are: by disguised object pointer.
+ */
+
+#include "sidetable.h"
+#include "bench.h"
+
+static void DenseMapInsertErase(bench::State &state)
+{
+    size_t n = (size_t)state.range(0);
+    HostObjects objs(n);
+    RefcountMap map;
+
+    for (auto _ : state) {
+        for (size_t i = 0; i < n; i++) {
+            map[objs[i]] += SIDE_TABLE_RC_ONE;
+        }
+        for (size_t i = 0; i < n; i++) {
+            map.erase(objs[i]);
+        }
+    }
+    state.setItemsProcessed(state.iterations() * n * 2);
+}
+BENCHMARK(DenseMapInsertErase)->Range(16, 65536, 16);
+
+static void DenseMapFind(bench::State &state)
+{
+    size_t n = (size_t)state.range(0);
+    HostObjects objs(n);
+    RefcountMap map;
+    for (size_t i = 0; i < n; i++) {
+        map[objs[i]] = SIDE_TABLE_RC_ONE;
+    }
+
+    size_t i = 0;
+    for (auto _ : state) {
+        auto it = map.find(objs[i]);
+        bench::DoNotOptimize(it);
+        if (++i == n) i = 0;
+    }
+    state.setItemsProcessed(state.iterations());
+}
+BENCHMARK(DenseMapFind)->Range(16, 65536, 16);
+
+static void DenseSetCStringInsert(bench::State &state)
+{
+    size_t n = (size_t)state.range(0);
+    std::vector<std::string> names;
+    for (size_t i = 0; i < n; i++) {
+        names.push_back("selector" + std::to_string(i) + ":withObject:");
+    }
+
+    for (auto _ : state) {
+        objc::DenseSet<const char *> set;
+        for (auto &name : names) {
+            set.insert(name.c_str());
+        }
+        bench::DoNotOptimize(set);
+    }
+    state.setItemsProcessed(state.iterations() * n);
+}
+BENCHMARK(DenseSetCStringInsert)->Range(64, 16384, 16);
@@ -0,0 +1,417 @@
+/*
+ * methodlookup.cpp
+ * Method lookup benchmarks for method cache misses.
+ *
+ * objc-runtime-new.mm is not part of the host build, so this copies the
+ * search lookUpImpOrForward makes on a miss: getMethodNoSuper_nolock
+ * over each method list of each class up the superclass chain, with
+ * findMethodInSortedMethodList in each list. It also copies the
+ * OBJC_METHOD_INDEX table that replaces that search. Method lists hold
+ * method_t::big entries sorted by selector address, as fixupMethodList
+ * leaves them. Keep this in sync with objc-runtime-new.mm.
+ *
+ * range(0) is the number of classes below the root class, and range(1)
+ * the number of categories on each of them. Every lookup is for a
+ * selector some class in the chain implements, so most are found in
+ * the root class, as in real programs.
+ */
+
+#include "objc-private.h"
+#include "bench.h"
+
+#include <algorithm>
+#include <vector>
+
+enum {
+    RootMethods = 300,
+    ClassMethods = 30,
+    CategoryMethods = 8,
+};
+
+struct BigMethod {
+    SEL name;
+    const char *types;
+    IMP imp;
+};
+
+struct MethodList {
+    uint32_t count;
+    BigMethod *methods;
+};
+
+struct HostClass {
+    HostClass *superclass;
+    std::vector<MethodList> lists;  // categories first, then the class's own
+};
+
+
+// Method list search
+
+static BigMethod *findMethodInSortedMethodList(SEL key, const MethodList &list)
+{
+    BigMethod *first = list.methods;
+    BigMethod *base = first;
+    BigMethod *probe;
+
+    uintptr_t keyValue = (uintptr_t)key;
+    uint32_t count;
+
+    for (count = list.count; count != 0; count >>= 1) {
+        probe = base + (count >> 1);
+
+        uintptr_t probeValue = (uintptr_t)probe->name;
+
+        if (keyValue == probeValue) {
+            while (probe > first && keyValue == (uintptr_t)(probe - 1)->name) {
+                probe--;
+            }
+            return probe;
+        }
+
+        if (keyValue > probeValue) {
+            base = probe + 1;
+            count--;
+        }
+    }
+
+    return nullptr;
+}
+
+// The replacement, for long lists: a branchless lower bound, so the first
+// of several methods with the same name is found without backing up.
+// It prefetches both halves' next probes, which pays off only once the
+// list no longer fits in a few cache lines; see MethodListSearch below.
+enum { MethodListBranchlessMin = 1024 };
+
+static BigMethod *findMethodInLongSortedMethodList(SEL key, const MethodList &list)
+{
+    BigMethod *first = list.methods;
+    uintptr_t keyValue = (uintptr_t)key;
+    uint32_t count = list.count;
+    uint32_t lower = 0;
+
+    while (count > 1) {
+        uint32_t half = count >> 1;
+        __builtin_prefetch(&first[lower + half / 2]);
+        __builtin_prefetch(&first[lower + half + half / 2]);
+        lower = ((uintptr_t)first[lower + half].name < keyValue) ? lower + half : lower;
+        count -= half;
+    }
+    lower += ((uintptr_t)first[lower].name < keyValue);
+
+    if (lower < list.count  &&  (uintptr_t)first[lower].name == keyValue) {
+        return &first[lower];
+    }
+    return nullptr;
+}
+
+static BigMethod *findMethodInSortedMethodListHybrid(SEL key, const MethodList &list)
+{
+    if (list.count >= MethodListBranchlessMin) {
+        return findMethodInLongSortedMethodList(key, list);
+    }
+    return findMethodInSortedMethodList(key, list);
+}
+
+static BigMethod *walkLookup(HostClass *cls, SEL sel)
+{
+    for (HostClass *c = cls; c; c = c->superclass) {
+        for (auto &list : c->lists) {
+            if (BigMethod *m = findMethodInSortedMethodListHybrid(sel, list)) return m;
+        }
+    }
+    return nullptr;
+}
+
+
+// Method index
+
+struct method_index_t {
+    struct entry_t {
+        SEL sel;
+        BigMethod *meth;
+        HostClass *cls;
+    };
+
+    entry_t *entries;
+    uint32_t mask;
+
+    static uint32_t slot(SEL sel, uint32_t mask) {
+        return (uint32_t)(((uint64_t)(uintptr_t)sel * 0x9E3779B97F4A7C15ull) >> 32) & mask;
+    }
+
+    const entry_t *find(SEL sel) const {
+        for (uint32_t i = slot(sel, mask); ; i = (i + 1) & mask) {
+            const entry_t& e = entries[i];
+            if (e.sel == sel) return &e;
+            if (!e.sel) return nullptr;
+        }
+    }
+
+    void add(SEL sel, BigMethod *meth, HostClass *cls) {
+        uint32_t i = slot(sel, mask);
+        while (entries[i].sel) {
+            if (entries[i].sel == sel) return;
+            i = (i + 1) & mask;
+        }
+        entries[i] = { sel, meth, cls };
+    }
+
+    void build(HostClass *cls) {
+        uint32_t count = 0;
+        for (HostClass *c = cls; c; c = c->superclass) {
+            for (auto &list : c->lists) count += list.count;
+        }
+        uint32_t capacity = 16;
+        while (capacity < count * 2) capacity *= 2;
+        mask = capacity - 1;
+        entries = (entry_t *)calloc(capacity, sizeof(entry_t));
+        for (HostClass *c = cls; c; c = c->superclass) {
+            for (auto &list : c->lists) {
+                for (uint32_t i = 0; i < list.count; i++) {
+                    add(list.methods[i].name, &list.methods[i], c);
+                }
+            }
+        }
+    }
+};
+
+
+// Hierarchy
+
+static char *SelectorNames;
+static size_t SelectorCount;
+static std::vector<HostClass *> *Classes;
+static std::vector<SEL> *Selectors;   // every selector in the chain
+static method_index_t Index;
+
+static void addList(HostClass *cls, size_t count, size_t &nextSel)
+{
+    MethodList list;
+    list.count = (uint32_t)count;
+    list.methods = (BigMethod *)calloc(count, sizeof(BigMethod));
+    for (size_t i = 0; i < count; i++) {
+        // Selector addresses in a scrambled order, so every class's
+        // selectors are spread over the whole range as in real images.
+        size_t offset = nextSel++ * 7919 % SelectorCount;
+        list.methods[i].name = (SEL)(SelectorNames + offset);
+        Selectors->push_back(list.methods[i].name);
+    }
+    std::sort(list.methods, list.methods + count,
+              [](const BigMethod &a, const BigMethod &b) {
+        return (uintptr_t)a.name < (uintptr_t)b.name;
+    });
+    cls->lists.push_back(list);
+}
+
+static void HierarchySetup(bench::State &state)
+{
+    size_t depth = (size_t)state.range(0);
+    size_t categories = (size_t)state.range(1);
+    // Fewer than 7919, which is prime, so addList's offsets are distinct.
+    SelectorCount = RootMethods +
+        depth * (ClassMethods + categories * CategoryMethods);
+    SelectorNames = (char *)calloc(SelectorCount, 1);
+    Classes = new std::vector<HostClass *>();
+    Selectors = new std::vector<SEL>();
+
+    size_t sel = 0;
+    HostClass *superclass = nullptr;
+    for (size_t d = 0; d <= depth; d++) {
+        HostClass *cls = new HostClass();
+        cls->superclass = superclass;
+        if (d == 0) {
+            addList(cls, RootMethods, sel);
+        } else {
+            for (size_t c = 0; c < categories; c++) {
+                addList(cls, CategoryMethods, sel);
+            }
+            addList(cls, ClassMethods, sel);
+        }
+        Classes->push_back(cls);
+        superclass = cls;
+    }
+
+    // Look selectors up in a fixed pseudo-random order.
+    for (size_t i = 0; i < Selectors->size(); i++) {
+        std::swap((*Selectors)[i], (*Selectors)[(i * 7919) % Selectors->size()]);
+    }
+
+    Index.build(Classes->back());
+}
+
+static void HierarchyTeardown(bench::State &)
+{
+    for (HostClass *cls : *Classes) {
+        for (auto &list : cls->lists) free(list.methods);
+        delete cls;
+    }
+    delete Classes;
+    delete Selectors;
+    free(SelectorNames);
+    free(Index.entries);
+    Index.entries = nullptr;
+}
+
+static void HierarchyArgs(bench::Benchmark *b)
+{
+    b->Args({1, 0})->Args({4, 0})->Args({16, 0})
+     ->Args({4, 8})->Args({16, 8});
+}
+
+static void MethodLookupWalk(bench::State &state)
+{
+    HostClass *leaf = Classes->back();
+    size_t n = Selectors->size();
+    size_t i = 0;
+    for (auto _ : state) {
+        BigMethod *m = walkLookup(leaf, (*Selectors)[i]);
+        bench::DoNotOptimize(m->imp);
+        if (++i == n) i = 0;
+    }
+    state.setItemsProcessed(state.iterations());
+}
+BENCHMARK(MethodLookupWalk)
+    ->Setup(HierarchySetup)->Teardown(HierarchyTeardown)
+    ->Apply(HierarchyArgs);
+
+static void MethodLookupIndex(bench::State &state)
+{
+    size_t n = Selectors->size();
+    size_t i = 0;
+    for (auto _ : state) {
+        auto *entry = Index.find((*Selectors)[i]);
+        bench::DoNotOptimize(entry->meth->imp);
+        if (++i == n) i = 0;
+    }
+    state.setItemsProcessed(state.iterations());
+}
+BENCHMARK(MethodLookupIndex)
+    ->Setup(HierarchySetup)->Teardown(HierarchyTeardown)
+    ->Apply(HierarchyArgs);
+
+// The one-off cost of building an index, paid on a class's
+// MethodIndexMisses-th miss and again after each invalidation.
+static void MethodIndexBuild(bench::State &state)
+{
+    HostClass *leaf = Classes->back();
+    for (auto _ : state) {
+        method_index_t index;
+        index.build(leaf);
+        bench::DoNotOptimize(index.entries);
+        free(index.entries);
+    }
+    state.setItemsProcessed(state.iterations());
+}
+BENCHMARK(MethodIndexBuild)
+    ->Setup(HierarchySetup)->Teardown(HierarchyTeardown)
+    ->Apply(HierarchyArgs);
+
+
+// Searching one sorted method list of range(0) methods for selectors it
+// contains, as getMethodNoSuper_nolock does for each list. With
+// range(1) set, each search is in a different copy of the list, out of
+// enough copies to overflow the caches, as method lists usually are
+// when a lookup misses the method cache.
+
+enum { ColdBytes = 64 << 20 };
+
+static std::vector<MethodList> *SearchLists;
+static std::vector<SEL> *SearchKeys;
+
+static void SearchSetup(bench::State &state)
+{
+    size_t n = (size_t)state.range(0);
+    size_t copies = state.range(1) ? ColdBytes / (n * sizeof(BigMethod)) : 1;
+
+    // Spread the list's selectors among others, as in a real image.
+    SelectorCount = n * 8 + 1;
+    SelectorNames = (char *)calloc(SelectorCount, 1);
+    SearchKeys = new std::vector<SEL>();
+    MethodList list;
+    list.count = (uint32_t)n;
+    list.methods = (BigMethod *)calloc(n, sizeof(BigMethod));
+    for (size_t i = 0; i < n; i++) {
+        SEL sel = (SEL)(SelectorNames + (i * 7919 % SelectorCount));
+        list.methods[i].name = sel;
+        SearchKeys->push_back(sel);
+    }
+    std::sort(list.methods, list.methods + n,
+              [](const BigMethod &a, const BigMethod &b) {
+        return (uintptr_t)a.name < (uintptr_t)b.name;
+    });
+
+    SearchLists = new std::vector<MethodList>();
+    SearchLists->push_back(list);
+    for (size_t c = 1; c < copies; c++) {
+        MethodList copy = list;
+        copy.methods = (BigMethod *)malloc(n * sizeof(BigMethod));
+        memcpy(copy.methods, list.methods, n * sizeof(BigMethod));
+        SearchLists->push_back(copy);
+    }
+
+    // Look them up in an order the branch predictor cannot learn.
+    uint64_t seed = 0x2545F4914F6CDD1Dull;
+    for (size_t i = n; i > 1; i--) {
+        seed = seed * 6364136223846793005ull + 1442695040888963407ull;
+        std::swap((*SearchKeys)[i - 1], (*SearchKeys)[(seed >> 33) % i]);
+    }
+}
+
+static void SearchTeardown(bench::State &)
+{
+    for (auto &list : *SearchLists) free(list.methods);
+    delete SearchLists;
+    delete SearchKeys;
+    free(SelectorNames);
+}
+
+template <typename Search>
+static void SearchLoop(bench::State &state, Search search)
+{
+    size_t n = SearchKeys->size();
+    size_t lists = SearchLists->size();
+    size_t i = 0, l = 0;
+    for (auto _ : state) {
+        BigMethod *m = search((*SearchKeys)[i], (*SearchLists)[l]);
+        bench::DoNotOptimize(m->imp);
+        if (++i == n) i = 0;
+        // Stride through the copies so the hardware prefetcher can't follow.
+        l += 7919;
+        if (l >= lists) l %= lists;
+    }
+    state.setItemsProcessed(state.iterations());
+}
+
+static void SearchArgs(bench::Benchmark *b)
+{
+    for (int64_t n : {4, 16, 64, 256, 512, 1024, 4096}) b->Args({n, 0});
+    for (int64_t n : {4, 16, 64, 256, 512, 1024, 4096}) b->Args({n, 1});
+}
+
+static void MethodListSearchBinary(bench::State &state)
+{
+    SearchLoop(state, [](SEL sel, const MethodList &list) {
+        return findMethodInSortedMethodList(sel, list);
+    });
+}
+BENCHMARK(MethodListSearchBinary)
+    ->Setup(SearchSetup)->Teardown(SearchTeardown)->Apply(SearchArgs);
+
+static void MethodListSearchBranchless(bench::State &state)
+{
+    SearchLoop(state, [](SEL sel, const MethodList &list) {
+        return findMethodInLongSortedMethodList(sel, list);
+    });
+}
+BENCHMARK(MethodListSearchBranchless)
+    ->Setup(SearchSetup)->Teardown(SearchTeardown)->Apply(SearchArgs);
+
+static void MethodListSearchHybrid(bench::State &state)
+{
+    SearchLoop(state, [](SEL sel, const MethodList &list) {
+        return findMethodInSortedMethodListHybrid(sel, list);
+    });
+}
+BENCHMARK(MethodListSearchHybrid)
+    ->Setup(SearchSetup)->Teardown(SearchTeardown)->Apply(SearchArgs);
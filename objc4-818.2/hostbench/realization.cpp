@@ -0,0 +1,275 @@
+/*
+ * realization.cpp
+ * Class realization benchmarks: a launch that realizes every class.
+ *
+ * objc-runtime-new.mm is not part of the host build. This copies the
+ * parts of realizeClassWithoutSwift that dominate its cost for classes
+ * with methods: fixupMethodList's selector uniquing and sort of each
+ * class's base method list, plus allocating the rw data and linking
+ * the class to its superclass. Keep this in sync with
+ * objc-runtime-new.mm.
+ *
+ * RealizeLocked does all of it under runtimeLock, as the runtime did.
+ * RealizeFixupUnlocked fixes up the method lists of the class and its
+ * unrealized superclasses and metaclasses first, under per-list
+ * MethodListFixupLocks with runtimeLock dropped, as
+ * realizeClassMaybeSwiftMaybeRelock now does.
+ *
+ * Classes form disjoint chains of range(0) classes. Threads take
+ * classes from a shared shuffled list until all are realized; realizing
+ * a class realizes its superclasses first, so threads meet when they
+ * take classes of the same chain. The unlocked_ms counter is the time
+ * threads spent fixing up lists with runtimeLock dropped, summed over
+ * threads: the part of the launch that can run in parallel.
+ */
+
+#include "objc-private.h"
+#include "objc-sel-table.h"
+#include "bench.h"
+
+#include <algorithm>
+#include <atomic>
+#include <string>
+#include <vector>
+
+enum {
+    LaunchClasses = 20000,
+    MethodsPerClass = 24,
+    MethodNames = 8192,
+};
+
+struct BigMethod {
+    const char *name;
+    const char *types;
+    IMP imp;
+};
+
+struct MethodList {
+    uint32_t count;
+    bool fixedUp;
+    BigMethod *methods;
+};
+
+struct HostClassRW {
+    void *ext;
+    HostClassRW *firstSubclass;
+    HostClassRW *nextSibling;
+};
+
+struct HostClass {
+    HostClass *superclass;
+    HostClass *metaclass;
+    MethodList list;
+    std::atomic<HostClassRW *> rw;
+};
+
+static std::vector<std::string> *Names;
+static HostClass *Classes;        // LaunchClasses classes, then their metaclasses
+static std::vector<HostClass *> *Order;
+static std::atomic<size_t> Cursor;
+static thread_local uint64_t UnlockedNanoseconds;
+
+static mutex_t RuntimeLock;
+static mutex_t SelLock;
+static StripedMap<spinlock_t> FixupLocks;
+static objc::SelectorTable *Selectors;
+
+// sel_registerNameMaybeCopy: selLock only for new names.
+static const char *registerName(const char *name)
+{
+    uint64_t hash = objc::SelectorTable::hash(name);
+    const char *sel = Selectors->find(name, hash);
+    if (!sel) {
+        mutex_locker_t lock(SelLock);
+        sel = Selectors->find(name, hash);
+        if (!sel) {
+            Selectors->insert(name, hash);
+            sel = name;
+        }
+    }
+    return sel;
+}
+
+static void sortAndMarkMethodList(MethodList &list)
+{
+    std::stable_sort(list.methods, list.methods + list.count,
+                     [](const BigMethod &a, const BigMethod &b) {
+        return (uintptr_t)a.name < (uintptr_t)b.name;
+    });
+    list.fixedUp = true;
+}
+
+// Names are registered with the list's lock dropped, as the runtime
+// must not hold it while registering calls into dyld.
+static void fixupMethodListIfNeeded(MethodList &list)
+{
+    auto &lock = FixupLocks[&list];
+    mutex_locker_t locker(lock);
+    if (list.fixedUp) return;
+
+    const char *stackSels[64];
+    const char **sels = list.count <= 64
+        ? stackSels : (const char **)malloc(list.count * sizeof(*sels));
+    for (uint32_t i = 0; i < list.count; i++) {
+        sels[i] = list.methods[i].name;
+    }
+
+    lock.unlock();
+    for (uint32_t i = 0; i < list.count; i++) {
+        sels[i] = registerName(sels[i]);
+    }
+    lock.lock();
+
+    if (!list.fixedUp) {
+        for (uint32_t i = 0; i < list.count; i++) {
+            list.methods[i].name = sels[i];
+        }
+        sortAndMarkMethodList(list);
+    }
+    if (sels != stackSels) free(sels);
+}
+
+static HostClass *realizeClass(HostClass *cls)
+{
+    RuntimeLock.assertLocked();
+    if (!cls  ||  cls->rw.load(std::memory_order_relaxed)) return cls;
+
+    HostClassRW *rw = (HostClassRW *)calloc(1, sizeof(HostClassRW));
+    cls->rw.store(rw, std::memory_order_relaxed);
+
+    HostClass *supercls = realizeClass(cls->superclass);
+    realizeClass(cls->metaclass);
+    if (supercls) {
+        HostClassRW *superrw = supercls->rw.load(std::memory_order_relaxed);
+        rw->nextSibling = superrw->firstSubclass;
+        superrw->firstSubclass = rw;
+    }
+
+    fixupMethodListIfNeeded(cls->list);
+    return cls;
+}
+
+// Before realizing cls, fix up the lists realizeClass would, unlocked.
+static void fixupMethodListsBeforeRealizing(HostClass *cls)
+{
+    RuntimeLock.assertLocked();
+
+    enum { MaxLists = 16 };
+    MethodList *lists[MaxLists];
+    int count = 0;
+    for (HostClass *c = cls;
+         c  &&  !c->rw.load(std::memory_order_relaxed)  &&  count < MaxLists;
+         c = c->superclass)
+    {
+        if (!c->list.fixedUp) lists[count++] = &c->list;
+        HostClass *meta = c->metaclass;
+        if (meta  &&  !meta->rw.load(std::memory_order_relaxed)  &&
+            !meta->list.fixedUp  &&  count < MaxLists)
+        {
+            lists[count++] = &meta->list;
+        }
+    }
+    if (count == 0) return;
+
+    RuntimeLock.unlock();
+    uint64_t start = nanoseconds();
+    for (int i = 0; i < count; i++) fixupMethodListIfNeeded(*lists[i]);
+    UnlockedNanoseconds += nanoseconds() - start;
+    RuntimeLock.lock();
+}
+
+static void LaunchSetup(bench::State &state)
+{
+    size_t depth = (size_t)state.range(0);
+
+    Names = new std::vector<std::string>();
+    for (int i = 0; i < MethodNames; i++) {
+        Names->push_back("launchMethod" + std::to_string(i) + ":");
+    }
+
+    // Tables the SelectorTable grew out of are never freed.
+    Selectors = new objc::SelectorTable();
+    {
+        mutex_locker_t lock(SelLock);
+        Selectors->init(MethodNames);
+    }
+
+    Classes = new HostClass[LaunchClasses * 2]();
+    uint64_t seed = 0x9E3779B97F4A7C15ull;
+    auto next = [&]{
+        seed = seed * 6364136223846793005ull + 1442695040888963407ull;
+        return (uint32_t)(seed >> 33);
+    };
+    for (size_t i = 0; i < LaunchClasses * 2; i++) {
+        HostClass &cls = Classes[i];
+        bool isMeta = i >= LaunchClasses;
+        size_t index = isMeta ? i - LaunchClasses : i;
+        cls.metaclass = isMeta ? nullptr : &Classes[i + LaunchClasses];
+        cls.superclass = (index % depth == 0) ? nullptr : &Classes[i - 1];
+        cls.list.count = isMeta ? MethodsPerClass / 4 : MethodsPerClass;
+        cls.list.methods =
+            (BigMethod *)calloc(cls.list.count, sizeof(BigMethod));
+        for (uint32_t m = 0; m < cls.list.count; m++) {
+            cls.list.methods[m].name = (*Names)[next() % MethodNames].c_str();
+        }
+    }
+
+    Order = new std::vector<HostClass *>();
+    for (size_t i = 0; i < LaunchClasses; i++) Order->push_back(&Classes[i]);
+    for (size_t i = LaunchClasses; i > 1; i--) {
+        std::swap((*Order)[i - 1], (*Order)[next() % i]);
+    }
+    Cursor.store(0);
+}
+
+static void LaunchTeardown(bench::State &)
+{
+    for (size_t i = 0; i < LaunchClasses * 2; i++) {
+        free(Classes[i].list.methods);
+        free(Classes[i].rw.load());
+    }
+    delete[] Classes;
+    delete Order;
+    delete Names;
+    Selectors = nullptr;
+}
+
+template <typename Realize>
+static void Launch(bench::State &state, Realize realize)
+{
+    size_t realized = 0;
+    UnlockedNanoseconds = 0;
+    for (auto _ : state) {
+        size_t i;
+        while ((i = Cursor.fetch_add(1)) < LaunchClasses) {
+            realize((*Order)[i]);
+            realized++;
+        }
+    }
+    state.setItemsProcessed(realized);
+    state.setCounter("unlocked_ms", UnlockedNanoseconds / 1e6);
+}
+
+static void RealizeLocked(bench::State &state)
+{
+    Launch(state, [](HostClass *cls) {
+        mutex_locker_t lock(RuntimeLock);
+        realizeClass(cls);
+    });
+}
+BENCHMARK(RealizeLocked)
+    ->Setup(LaunchSetup)->Teardown(LaunchTeardown)
+    ->Arg(1)->Arg(8)->ThreadRange(1, 8)->Iterations(1);
+
+static void RealizeFixupUnlocked(bench::State &state)
+{
+    Launch(state, [](HostClass *cls) {
+        mutex_locker_t lock(RuntimeLock);
+        if (cls->rw.load(std::memory_order_relaxed)) return;
+        fixupMethodListsBeforeRealizing(cls);
+        realizeClass(cls);
+    });
+}
+BENCHMARK(RealizeFixupUnlocked)
+    ->Setup(LaunchSetup)->Teardown(LaunchTeardown)
+    ->Arg(1)->Arg(8)->ThreadRange(1, 8)->Iterations(1);
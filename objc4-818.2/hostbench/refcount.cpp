@@ -0,0 +1,141 @@
+/*
+ * refcount.cpp
+ * Retain count benchmarks: the nonpointer isa CAS against biased
+ * reference counting (see refcount.h).
+ *
+ * RetainReleaseLocal is the case biasing is for: one thread retaining
+ * and releasing objects it created. Handoff is the case it makes
+ * worse: thread 0 creates each object and hands its reference to
+ * thread 1, which retains and releases it range(0) times and then
+ * releases it. With biasing the final release queues the object back
+ * to its creator, which merges it and finds it dead.
+ */
+
+#include "refcount.h"
+#include "bench.h"
+
+#include <sched.h>
+
+template <typename RC>
+static void RetainReleaseLocal(bench::State &state)
+{
+    size_t n = (size_t)state.range(0);
+    std::vector<RC> objs(n);
+
+    size_t i = 0;
+    for (auto _ : state) {
+        objs[i].retain();
+        bench::DoNotOptimize(objs[i].release());
+        if (++i == n) i = 0;
+    }
+    state.setItemsProcessed(state.iterations() * 2);
+}
+
+static void IsaRetainReleaseLocal(bench::State &state)
+{
+    RetainReleaseLocal<IsaRefcount>(state);
+}
+BENCHMARK(IsaRetainReleaseLocal)->Arg(1)->Arg(1024);
+
+static void BiasedRetainReleaseLocal(bench::State &state)
+{
+    RetainReleaseLocal<BiasedRefcount>(state);
+}
+BENCHMARK(BiasedRetainReleaseLocal)->Arg(1)->Arg(1024);
+
+
+// Objects in flight between the two threads.
+template <typename RC>
+struct HandoffSlot {
+    RC rc;  // first, so a dead RC* is its slot
+    std::atomic<bool> full{false};
+    std::atomic<bool> free{true};
+};
+
+enum { HandoffSlots = 256 };
+
+template <typename RC>
+static HandoffSlot<RC> *HandoffPool;
+static std::atomic<size_t> HandoffDeaths;
+
+template <typename RC>
+static void kill(RC *rc)
+{
+    HandoffDeaths.fetch_add(1, std::memory_order_relaxed);
+    ((HandoffSlot<RC> *)rc)->free.store(true, std::memory_order_release);
+}
+
+template <typename RC>
+static void waitFree(HandoffSlot<RC>& slot)
+{
+    while (!slot.free.load(std::memory_order_acquire)) {
+        RC::drainMergeQueue(kill<RC>);
+        sched_yield();
+    }
+}
+
+template <typename RC>
+static void HandoffSetup(bench::State &)
+{
+    HandoffPool<RC> = new HandoffSlot<RC>[HandoffSlots];
+    HandoffDeaths = 0;
+}
+
+template <typename RC>
+static void HandoffTeardown(bench::State &)
+{
+    delete[] HandoffPool<RC>;
+    HandoffPool<RC> = nullptr;
+}
+
+template <typename RC>
+static void Handoff(bench::State &state)
+{
+    HandoffSlot<RC> *pool = HandoffPool<RC>;
+    size_t pairs = (size_t)state.range(0);
+    size_t i = 0;
+
+    if (state.threadIndex() == 0) {
+        for (auto _ : state) {
+            HandoffSlot<RC>& slot = pool[i++ % HandoffSlots];
+            waitFree(slot);
+            slot.free.store(false, std::memory_order_relaxed);
+            new (&slot.rc) RC();
+            slot.full.store(true, std::memory_order_release);
+            RC::drainMergeQueue(kill<RC>);
+        }
+        // Collect the last objects' final releases.
+        for (size_t s = 0; s < HandoffSlots; s++) waitFree(pool[s]);
+
+        state.setItemsProcessed(state.iterations());
+        if (HandoffDeaths != state.iterations()) state.setLabel("LEAKED");
+    } else {
+        for (auto _ : state) {
+            HandoffSlot<RC>& slot = pool[i++ % HandoffSlots];
+            while (!slot.full.load(std::memory_order_acquire)) sched_yield();
+            for (size_t p = 0; p < pairs; p++) {
+                slot.rc.retain();
+                bench::DoNotOptimize(slot.rc.release());
+            }
+            slot.full.store(false, std::memory_order_relaxed);
+            if (slot.rc.release()) kill(&slot.rc);
+        }
+    }
+}
+
+static void IsaHandoff(bench::State &state)
+{
+    Handoff<IsaRefcount>(state);
+}
+BENCHMARK(IsaHandoff)
+    ->Setup(HandoffSetup<IsaRefcount>)->Teardown(HandoffTeardown<IsaRefcount>)
+    ->Arg(0)->Arg(8)->Threads(2);
+
+static void BiasedHandoff(bench::State &state)
+{
+    Handoff<BiasedRefcount>(state);
+}
+BENCHMARK(BiasedHandoff)
+    ->Setup(HandoffSetup<BiasedRefcount>)
+    ->Teardown(HandoffTeardown<BiasedRefcount>)
+    ->Arg(0)->Arg(8)->Threads(2);
@@ -0,0 +1,198 @@
+/*
+ * refcount.h
+ * Retain count schemes for the refcount benchmarks.
+ *
+ * IsaRefcount is the nonpointer isa fast path of
+ * objc_object::rootRetain/rootRelease: a CAS loop adding or
+ * subtracting RC_ONE, with extra_rc == 0 meaning one reference. Side
+ * table overflow and underflow are left out; the benchmarks stay well
+ * inside extra_rc.
+ *
+ * BiasedRefcount is biased reference counting (Choi, Shull and
+ * Torrellas, PACT 2018). The thread that created the object counts its
+ * own retains and releases in a plain field. Other threads use an
+ * atomic shared count that also carries MERGED and QUEUED flags. When a
+ * non-owner release takes the shared count below zero, the object is
+ * queued for its owner, which merges its biased count into the shared
+ * count at its next drainMergeQueue(). Whichever operation leaves the
+ * count at zero with MERGED set and QUEUED clear deallocates.
+ *
+ * BiasedRefcount is not an objc_object retain count scheme, even as an
+ * opt-in mode with the unused isa bit marking biased objects:
+ *
+ * - References are interchangeable. A reference the owner counted in
+ *   its biased count can be released by any thread, so a non-owner can
+ *   never decide on its own that the object is dead. It has to queue
+ *   the object to its owner, and the dealloc waits for the owner's next
+ *   merge. -dealloc and weak references clearing at the last release
+ *   is behavior callers rely on, and a thread that never drains, or
+ *   exits, would hold the object forever.
+ * - Other threads still CAS the weakly_referenced, has_assoc and
+ *   has_sidetable_rc bits into the same isa word, so the owner can't
+ *   keep its count there with plain stores. The count has to live
+ *   somewhere the owner finds by address. That is a table lookup per
+ *   retain, and the table also has to check the owner, because the
+ *   address can be reused by an object that another thread owns.
+ */
+
+#ifndef _OBJC_HOSTBENCH_REFCOUNT_H_
+#define _OBJC_HOSTBENCH_REFCOUNT_H_
+
+#include "objc-private.h"
+
+#include <atomic>
+#include <mutex>
+#include <vector>
+
+class IsaRefcount {
+#if __x86_64__
+    static constexpr uintptr_t RC_ONE = 1ULL<<56;
+#else
+    static constexpr uintptr_t RC_ONE = 1ULL<<45;
+#endif
+    // nonpointer isa with a class and extra_rc == 0
+    static constexpr uintptr_t INITIAL = 0x001d800000001001ULL;
+
+    std::atomic<uintptr_t> mBits;
+
+  public:
+    IsaRefcount() : mBits(INITIAL) { }
+
+    void retain() {
+        uintptr_t oldBits = mBits.load(std::memory_order_relaxed);
+        while (!mBits.compare_exchange_weak(oldBits, oldBits + RC_ONE,
+                                            std::memory_order_relaxed))
+            ;
+    }
+
+    // Returns true if the object should be deallocated.
+    bool release() {
+        uintptr_t oldBits = mBits.load(std::memory_order_relaxed);
+        do {
+            if ((oldBits & ~(RC_ONE - 1)) == (INITIAL & ~(RC_ONE - 1))) {
+                return true;  // extra_rc was 0: last reference
+            }
+        } while (!mBits.compare_exchange_weak(oldBits, oldBits - RC_ONE,
+                                              std::memory_order_release));
+        return false;
+    }
+
+    // Nothing is ever queued for this scheme.
+    template <typename Fn>
+    static void drainMergeQueue(Fn) { }
+    template <typename Fn>
+    static void drainOwnerQueue(IsaRefcount *, Fn) { }
+};
+
+class BiasedRefcount {
+    static constexpr int64_t MERGED = 1;
+    static constexpr int64_t QUEUED = 2;
+    static constexpr int64_t ONE = 4;
+
+    struct ThreadState {
+        uint32_t id;
+        std::mutex lock;
+        std::vector<BiasedRefcount *> queue;  // objects to merge
+    };
+
+    // Leaked, so a queue outlives its thread for drainOwnerQueue().
+    static ThreadState& self() {
+        static std::atomic<uint32_t> nextID{1};
+        thread_local ThreadState *state = new ThreadState{nextID++, {}, {}};
+        return *state;
+    }
+
+    static int64_t count(int64_t shared) { return shared >> 2; }
+
+    ThreadState *mOwnerState;
+    std::atomic<uint32_t> mOwner;  // 0 once merged
+    uint32_t mBiased;              // owner thread only
+    std::atomic<int64_t> mShared;  // count * ONE | QUEUED | MERGED
+
+    // Fold the biased count into the shared count and set MERGED.
+    // Owner thread only. fromQueue clears QUEUED; while QUEUED is set
+    // only the queue drain may decide the object is dead, because the
+    // queue still points to it.
+    bool merge(bool fromQueue) {
+        int64_t biased = (int64_t)mBiased * ONE;
+        mBiased = 0;
+        mOwner.store(0, std::memory_order_relaxed);
+        int64_t old = mShared.load(std::memory_order_relaxed);
+        int64_t result;
+        do {
+            result = (old + biased) | MERGED;
+            if (fromQueue) result &= ~QUEUED;
+        } while (!mShared.compare_exchange_weak(old, result,
+                                                std::memory_order_acq_rel));
+        return count(result) == 0  &&  !(result & QUEUED);
+    }
+
+  public:
+    BiasedRefcount()
+        : mOwnerState(&self()), mOwner(self().id), mBiased(1), mShared(0) { }
+
+    void retain() {
+        if (mOwner.load(std::memory_order_relaxed) == self().id) {
+            mBiased++;
+        } else {
+            mShared.fetch_add(ONE, std::memory_order_relaxed);
+        }
+    }
+
+    // Returns true if the object should be deallocated.
+    bool release() {
+        if (mOwner.load(std::memory_order_relaxed) == self().id) {
+            if (--mBiased > 0) return false;
+            return merge(false);
+        }
+
+        int64_t old = mShared.load(std::memory_order_relaxed);
+        int64_t result;
+        do {
+            result = old - ONE;
+            if (!(old & MERGED)  &&  count(result) < 0) result |= QUEUED;
+        } while (!mShared.compare_exchange_weak(old, result,
+                                                std::memory_order_acq_rel));
+
+        if ((result & QUEUED)  &&  !(old & QUEUED)) {
+            // First time below zero: only the owner can tell whether
+            // this was the last reference.
+            std::lock_guard<std::mutex> guard(mOwnerState->lock);
+            mOwnerState->queue.push_back(this);
+            return false;
+        }
+        return (result & MERGED)  &&  !(result & QUEUED)  &&
+            count(result) == 0;
+    }
+
+    // Merge every object other threads queued for this thread, and
+    // call dead(rc) for each one with no references left. Also usable
+    // from another thread once the owner thread has exited.
+    template <typename Fn>
+    static void drainMergeQueue(Fn dead) {
+        drainMergeQueue(self(), dead);
+    }
+
+  private:
+    template <typename Fn>
+    static void drainMergeQueue(ThreadState& state, Fn dead) {
+        std::vector<BiasedRefcount *> queue;
+        {
+            std::lock_guard<std::mutex> guard(state.lock);
+            if (state.queue.empty()) return;
+            queue.swap(state.queue);
+        }
+        for (BiasedRefcount *rc : queue) {
+            if (rc->merge(true)) dead(rc);
+        }
+    }
+
+  public:
+    // drainMergeQueue for the thread that created rc.
+    template <typename Fn>
+    static void drainOwnerQueue(BiasedRefcount *rc, Fn dead) {
+        drainMergeQueue(*rc->mOwnerState, dead);
+    }
+};
+
+#endif
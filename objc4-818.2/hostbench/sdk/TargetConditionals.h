@@ -0,0 +1,26 @@
+// Host stand-in for the SDK's TargetConditionals.h.
+// The host build configures itself like macOS so that objc-config.h
+// selects the same SUPPORT_* settings as the Mac runtime.
+
+#ifndef __TARGETCONDITIONALS__
+#define __TARGETCONDITIONALS__
+
+#define TARGET_OS_MAC               1
+#define TARGET_OS_OSX               1
+#define TARGET_OS_IPHONE            0
+#define TARGET_OS_IOS               0
+#define TARGET_OS_WATCH             0
+#define TARGET_OS_TV                0
+#define TARGET_OS_BRIDGE            0
+#define TARGET_OS_MACCATALYST       0
+#define TARGET_OS_SIMULATOR         0
+#define TARGET_OS_EMBEDDED          0
+#define TARGET_OS_WIN32             0
+#define TARGET_OS_UNIX              0
+
+// objc-config.h tests clang features in #if; other compilers have none.
+#ifndef __has_feature
+#   define __has_feature(x) 0
+#endif
+
+#endif
@@ -0,0 +1,2 @@
+// Host stand-in for <libkern/OSAtomic.h>.
+// The portable data structures use std::atomic; nothing is declared here.
@@ -0,0 +1,20 @@
+// Host stand-in for <objc/objc-api.h>.
+
+#ifndef _OBJC_OBJC_API_H_
+#define _OBJC_OBJC_API_H_
+
+#include <sys/types.h>
+
+#if !defined(OBJC_EXTERN)
+#   if defined(__cplusplus)
+#       define OBJC_EXTERN extern "C"
+#   else
+#       define OBJC_EXTERN extern
+#   endif
+#endif
+
+#if !defined(OBJC_EXPORT)
+#   define OBJC_EXPORT OBJC_EXTERN __attribute__((visibility("default")))
+#endif
+
+#endif
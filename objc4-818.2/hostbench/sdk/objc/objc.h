@@ -0,0 +1,25 @@
+// Host stand-in for <objc/objc.h>.
+// objc-host.h has already defined id and Class; this supplies the
+// remaining basic types the portable data structures use.
+
+#ifndef _OBJC_OBJC_H_
+#define _OBJC_OBJC_H_
+
+#include <objc/objc-api.h>
+#include <stdbool.h>
+
+typedef struct objc_selector *SEL;
+typedef void (*IMP)(void /* id, SEL, ... */ );
+
+typedef bool BOOL;
+#define YES true
+#define NO  false
+
+#ifndef Nil
+#   define Nil nullptr
+#endif
+#ifndef nil
+#   define nil nullptr
+#endif
+
+#endif
@@ -0,0 +1,270 @@
+/*
+ * selectors.cpp
+ * sel_registerName benchmarks.
+ *
+ * objc-sel.mm is not part of the host build. SelRegisterLocked copies
+ * the old __sel_registerName: take selLock, then find-or-insert in a
+ * DenseSet of C strings. SelRegisterLockFree uses the runtime's
+ * objc::SelectorTable the way __sel_registerName now does.
+ *
+ * Every thread looks up names that are already registered, using its
+ * own copy of each string as callers building names at runtime do.
+ * With range(0) nonzero, thread 0 also registers a new name every
+ * range(0) lookups.
+ */
+
+#include "objc-private.h"
+#include "objc-sel-table.h"
+#include "objc-parallel.h"
+#include "DenseMapExtras.h"
+#include "bench.h"
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+enum { RegisteredNames = 4096, NewNames = 1 << 16 };
+
+static std::vector<std::string> *Registered;
+static std::vector<std::string> *Queries;
+static std::vector<std::string> *Extra;
+
+static mutex_t SelLock;
+static objc::DenseSet<const char *> *LockedSet;
+static objc::SelectorTable *LockFreeTable;
+
+static const char *registerLocked(const char *name)
+{
+    mutex_locker_t lock(SelLock);
+    auto it = LockedSet->insert(name);
+    return *it.first;
+}
+
+static const char *registerLockFree(const char *name)
+{
+    uint64_t hash = objc::SelectorTable::hash(name);
+    if (const char *found = LockFreeTable->find(name, hash)) return found;
+
+    mutex_locker_t lock(SelLock);
+    if (const char *found = LockFreeTable->find(name, hash)) return found;
+    LockFreeTable->insert(name, hash);
+    return name;
+}
+
+static void SelSetup(bench::State &)
+{
+    Registered = new std::vector<std::string>();
+    Queries = new std::vector<std::string>();
+    Extra = new std::vector<std::string>();
+    for (int i = 0; i < RegisteredNames; i++) {
+        Registered->push_back("setValue" + std::to_string(i) + ":forKey:");
+    }
+    // Same names, separate storage.
+    for (auto &name : *Registered) Queries->push_back(std::string(name));
+    for (int i = 0; i < NewNames; i++) {
+        Extra->push_back("dynamicProperty" + std::to_string(i));
+    }
+
+    LockedSet = new objc::DenseSet<const char *>();
+    LockFreeTable = new objc::SelectorTable();
+    mutex_locker_t lock(SelLock);
+    LockFreeTable->init(RegisteredNames);
+    for (auto &name : *Registered) {
+        LockedSet->insert(name.c_str());
+        LockFreeTable->insert(name.c_str(),
+                              objc::SelectorTable::hash(name.c_str()));
+    }
+}
+
+static void SelTeardown(bench::State &)
+{
+    delete LockedSet;
+    LockedSet = nullptr;
+    // Tables the SelectorTable grew out of are never freed.
+    LockFreeTable = nullptr;
+    delete Registered;
+    delete Queries;
+    delete Extra;
+}
+
+template <typename Register>
+static void Lookups(bench::State &state, Register reg)
+{
+    int64_t writeInterval = state.range(0);
+    bool writer = writeInterval  &&  state.threadIndex() == 0;
+    size_t i = (size_t)state.threadIndex() * 97 % RegisteredNames;
+    size_t extra = 0;
+    int64_t untilWrite = writeInterval;
+
+    for (auto _ : state) {
+        const char *sel = reg((*Queries)[i].c_str());
+        bench::DoNotOptimize(sel);
+        if (++i == RegisteredNames) i = 0;
+        if (writer  &&  --untilWrite == 0) {
+            untilWrite = writeInterval;
+            sel = reg((*Extra)[extra].c_str());
+            bench::DoNotOptimize(sel);
+            if (++extra == NewNames) extra = 0;
+        }
+    }
+    state.setItemsProcessed(state.iterations());
+}
+
+static void SelRegisterLocked(bench::State &state)
+{
+    Lookups(state, registerLocked);
+}
+BENCHMARK(SelRegisterLocked)
+    ->Setup(SelSetup)->Teardown(SelTeardown)
+    ->Arg(0)->Arg(1024)->ThreadRange(1, 64);
+
+static void SelRegisterLockFree(bench::State &state)
+{
+    Lookups(state, registerLockFree);
+}
+BENCHMARK(SelRegisterLockFree)
+    ->Setup(SelSetup)->Teardown(SelTeardown)
+    ->Arg(0)->Arg(1024)->ThreadRange(1, 64);
+
+
+// Registering the selector references of a newly loaded image.
+// range(0) references; one in four names is already registered, as
+// images share many selector names with the libraries they use, or
+// every name for the Registered variant. Names already registered are
+// not in the shared cache here, so builtin() always misses. The
+// capacity counter is the size of the table afterwards.
+
+enum { ExistingNames = 16384 };
+
+static std::vector<std::string> *ImageNames;
+static std::vector<const char *> *ImageRefs;
+static objc::SelectorTable *ImageTable;
+
+static void setupImage(size_t n, size_t existingEvery)
+{
+    ImageNames = new std::vector<std::string>();
+    ImageRefs = new std::vector<const char *>(n);
+    for (size_t i = 0; i < n; i++) {
+        if (i % existingEvery == 0) {
+            ImageNames->push_back("existingSelector" +
+                                  std::to_string(i / existingEvery % ExistingNames) + ":");
+        } else {
+            ImageNames->push_back("imageSelector" + std::to_string(i) + ":");
+        }
+    }
+}
+
+static void ImageSetup(bench::State &state)
+{
+    setupImage((size_t)state.range(0), 4);
+}
+
+static void RegisteredImageSetup(bench::State &state)
+{
+    setupImage((size_t)state.range(0), 1);
+}
+
+static void ImageTeardown(bench::State &)
+{
+    delete ImageNames;
+    delete ImageRefs;
+}
+
+// Untimed: a table holding only the existing names, and selrefs that
+// point at the image's own copies of its names.
+static void resetImage(bench::State &state)
+{
+    state.pauseTiming();
+    // Tables the SelectorTable grew out of are never freed.
+    ImageTable = new objc::SelectorTable();
+    ImageTable->init(ExistingNames);
+    for (int i = 0; i < ExistingNames; i++) {
+        std::string name = "existingSelector" + std::to_string(i) + ":";
+        ImageTable->insert(strdup(name.c_str()),
+                           objc::SelectorTable::hash(name.c_str()));
+    }
+    for (size_t i = 0; i < ImageRefs->size(); i++) {
+        (*ImageRefs)[i] = (*ImageNames)[i].c_str();
+    }
+    state.resumeTiming();
+}
+
+static const char *noBuiltin(const char *) { return nullptr; }
+static const char *imageAlloc(const char *name) { return name; }
+
+static void SelRegisterImageOneByOne(bench::State &state)
+{
+    for (auto _ : state) {
+        resetImage(state);
+        for (auto &ref : *ImageRefs) {
+            uint64_t hash = objc::SelectorTable::hash(ref);
+            const char *sel = ImageTable->find(ref, hash);
+            if (!sel) sel = noBuiltin(ref);
+            if (!sel) {
+                sel = imageAlloc(ref);
+                ImageTable->insert(sel, hash);
+            }
+            if (ref != sel) ref = sel;
+        }
+    }
+    state.setItemsProcessed(state.iterations() * ImageRefs->size());
+    state.setCounter("capacity", ImageTable->capacity());
+}
+BENCHMARK(SelRegisterImageOneByOne)
+    ->Setup(ImageSetup)->Teardown(ImageTeardown)
+    ->Arg(1000)->Arg(50000)->Iterations(20);
+
+static void SelRegisterImageBatch(bench::State &state)
+{
+    for (auto _ : state) {
+        resetImage(state);
+        ImageTable->insertAll(ImageRefs->data(), ImageRefs->size(),
+                              noBuiltin, imageAlloc);
+    }
+
+    // Every reference is now the registered name.
+    for (const char *ref : *ImageRefs) {
+        if (ImageTable->find(ref, objc::SelectorTable::hash(ref)) != ref) {
+            state.setLabel("WRONG RESULT");
+        }
+    }
+    state.setItemsProcessed(state.iterations() * ImageRefs->size());
+    state.setCounter("capacity", ImageTable->capacity());
+}
+BENCHMARK(SelRegisterImageBatch)
+    ->Setup(ImageSetup)->Teardown(ImageTeardown)
+    ->Arg(1000)->Arg(50000)->Iterations(20);
+
+static void SelRegisterImageBatchRegistered(bench::State &state)
+{
+    SelRegisterImageBatch(state);
+}
+BENCHMARK(SelRegisterImageBatchRegistered)
+    ->Setup(RegisteredImageSetup)->Teardown(ImageTeardown)
+    ->Arg(50000)->Iterations(20);
+
+// The same, with the names hashed first on range(1) threads, as
+// _read_images does with OBJC_READ_IMAGES_THREADS. Creating and
+// joining the threads is part of the time.
+static void SelRegisterImageParallelHash(bench::State &state)
+{
+    enum { Chunk = 2048 };
+    unsigned threads = (unsigned)state.range(1);
+    std::vector<uint64_t> hashes(ImageRefs->size());
+    for (auto _ : state) {
+        resetImage(state);
+        const char **refs = ImageRefs->data();
+        size_t n = ImageRefs->size();
+        objc::parallelFor((n + Chunk - 1) / Chunk, threads, [&](size_t j) {
+            size_t end = std::min(n, (j + 1) * Chunk);
+            for (size_t i = j * Chunk; i < end; i++) {
+                hashes[i] = objc::SelectorTable::hash(refs[i]);
+            }
+        });
+        ImageTable->insertAll(refs, n, noBuiltin, imageAlloc, hashes.data());
+    }
+    state.setItemsProcessed(state.iterations() * ImageRefs->size());
+}
+BENCHMARK(SelRegisterImageParallelHash)
+    ->Setup(ImageSetup)->Teardown(ImageTeardown)
+    ->Args({50000, 1})->Args({50000, 2})->Args({50000, 4})->Iterations(20);
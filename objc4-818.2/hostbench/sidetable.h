@@ -0,0 +1,77 @@
+/*
+ * sidetable.h
+ * Host copy of the SideTable layout from NSObject.mm.
+ *
+ * NSObject.mm itself is not part of the host build, so the benchmarks
+ * assemble the same structure from the real spinlock_t, RefcountMap
+ * (objc::DenseMap) and weak_table_t. Keep this in sync with NSObject.mm.
+ */
+
+#ifndef _OBJC_HOSTBENCH_SIDETABLE_H_
+#define _OBJC_HOSTBENCH_SIDETABLE_H_
+
+#include "objc-private.h"
+#include "objc-weak.h"
+#include "DenseMapExtras.h"
+
+// The order of these bits is important.
+#define SIDE_TABLE_WEAKLY_REFERENCED (1UL<<0)
+#define SIDE_TABLE_DEALLOCATING      (1UL<<1)  // MSB-ward of weak bit
+#define SIDE_TABLE_RC_ONE            (1UL<<2)  // MSB-ward of deallocating bit
+
+struct RefcountMapValuePurgeable {
+    static inline bool isPurgeable(size_t x) {
+        return x == 0;
+    }
+};
+
+typedef objc::DenseMap<DisguisedPtr<objc_object>,size_t,RefcountMapValuePurgeable> RefcountMap;
+
+// OBJC_PROFILE_SIDE_TABLES. The runtime's option table is not part of
+// the host build; stripedmap.cpp defines this.
+extern bool ProfileSideTables;
+
+struct SideTable {
+    spinlock_t slock;
+    RefcountMap refcnts;
+    weak_table_t weak_table;
+    uint64_t acquires;
+    uint64_t contended;
+
+    SideTable() : acquires(0), contended(0) {
+        memset(&weak_table, 0, sizeof(weak_table));
+    }
+
+    void lock() {
+        if (slowpath(ProfileSideTables)) lockProfiled();
+        else slock.lock();
+    }
+    void unlock() { slock.unlock(); }
+    void forceReset() { slock.forceReset(); }
+
+    bool lockProfiled() {
+        bool busy = !slock.tryLock();
+        if (busy) slock.lock();
+        acquires++;
+        if (busy) contended++;
+        return busy;
+    }
+};
+
+// A fixed pool of fake objects, 16-byte aligned like malloc'd objects.
+struct HostObjects {
+    objc_object *objects;
+    size_t count;
+
+    HostObjects(size_t n) : count(n) {
+        objects = (objc_object *)aligned_alloc(16, n * 16);
+        memset((void *)objects, 0, n * 16);
+    }
+    ~HostObjects() { free(objects); }
+
+    objc_object *operator [] (size_t i) const {
+        return (objc_object *)((char *)objects + i * 16);
+    }
+};
+
+#endif
@@ -0,0 +1,159 @@
+/*
+ * stripedmap.cpp
+ * DynamicStripedMap<SideTable> benchmarks: the side table retain/release
+ * and weak slow paths as seen by many threads at once.
+ *
+ * The storm benchmarks take {objects, stripes} and run at 1 to 16
+ * threads, as OBJC_SIDE_TABLE_STRIPES would configure the runtime.
+ * They lock through SideTable::lockProfiled() and report the fraction
+ * of acquisitions that found the stripe already held.
+ */
+
+#include "sidetable.h"
+#include "bench.h"
+
+bool ProfileSideTables;
+
+static DynamicStripedMap<SideTable> *SideTables;
+static HostObjects *Objects;
+
+static void SideTablesSetup(bench::State &state)
+{
+    SideTables = new DynamicStripedMap<SideTable>((unsigned int)state.range(1));
+    Objects = new HostObjects((size_t)state.range(0));
+}
+
+static void SideTablesTeardown(bench::State &)
+{
+    // SideTable is never destroyed by the runtime; leak it here too.
+    SideTables = nullptr;
+    delete Objects;
+    Objects = nullptr;
+}
+
+static void StripeArgs(bench::Benchmark *b)
+{
+    for (int64_t stripes : { 8, 64, 512, 4096 }) {
+        b->Args({ 4096, stripes });
+    }
+}
+
+static void StormArgs(bench::Benchmark *b)
+{
+    StripeArgs(b);
+    b->ThreadRange(1, 16);
+}
+
+static void setContention(bench::State &state, size_t contended,
+                          size_t acquires)
+{
+    // Counters are summed over threads.
+    state.setCounter("contended",
+                     (double)contended / acquires / state.threads());
+}
+
+// Each thread retains and releases its own slice of the objects, as
+// objects with an overflowed extra_rc would through sidetable_retain
+// and sidetable_release.
+static void SideTableRetainRelease(bench::State &state)
+{
+    size_t perThread = Objects->count / state.threads();
+    size_t base = perThread * state.threadIndex();
+    size_t contended = 0;
+    size_t i = 0;
+
+    for (auto _ : state) {
+        objc_object *obj = (*Objects)[base + i];
+        SideTable& table = (*SideTables)[obj];
+
+        contended += table.lockProfiled();
+        table.refcnts[obj] += SIDE_TABLE_RC_ONE;
+        table.unlock();
+
+        contended += table.lockProfiled();
+        auto it = table.refcnts.find(obj);
+        it->second -= SIDE_TABLE_RC_ONE;
+        table.unlock();
+
+        if (++i == perThread) i = 0;
+    }
+    state.setItemsProcessed(state.iterations() * 2);
+    setContention(state, contended, state.iterations() * 2);
+}
+BENCHMARK(SideTableRetainRelease)
+    ->Setup(SideTablesSetup)->Teardown(SideTablesTeardown)
+    ->Apply(StormArgs);
+
+// Each thread forms and destroys a weak reference to each of its own
+// objects, as objc_storeWeak does.
+static void SideTableWeakStorm(bench::State &state)
+{
+    size_t perThread = Objects->count / state.threads();
+    size_t base = perThread * state.threadIndex();
+    size_t contended = 0;
+    size_t i = 0;
+    id referrer = nil;
+
+    for (auto _ : state) {
+        id obj = (id)(*Objects)[base + i];
+        SideTable& table = (*SideTables)[obj];
+
+        contended += table.lockProfiled();
+        referrer = weak_register_no_lock(&table.weak_table, obj, &referrer,
+                                         DontCheckDeallocating);
+        table.unlock();
+
+        contended += table.lockProfiled();
+        weak_unregister_no_lock(&table.weak_table, obj, &referrer);
+        table.unlock();
+
+        if (++i == perThread) i = 0;
+    }
+    state.setItemsProcessed(state.iterations() * 2);
+    setContention(state, contended, state.iterations() * 2);
+}
+BENCHMARK(SideTableWeakStorm)
+    ->Setup(SideTablesSetup)->Teardown(SideTablesTeardown)
+    ->Apply(StormArgs);
+
+// All threads hammer a single object, so a single stripe.
+static void SideTableRetainReleaseHot(bench::State &state)
+{
+    objc_object *obj = (*Objects)[0];
+    SideTable& table = (*SideTables)[obj];
+
+    for (auto _ : state) {
+        table.lock();
+        table.refcnts[obj] += SIDE_TABLE_RC_ONE;
+        table.unlock();
+
+        table.lock();
+        table.refcnts[obj] -= SIDE_TABLE_RC_ONE;
+        table.unlock();
+    }
+    state.setItemsProcessed(state.iterations() * 2);
+}
+BENCHMARK(SideTableRetainReleaseHot)
+    ->Setup(SideTablesSetup)->Teardown(SideTablesTeardown)
+    ->Args({ 1, 0 })->ThreadRange(1, 16);
+
+// How evenly the stripe hash spreads 16-byte aligned objects: the
+// largest stripe's load relative to a perfect spread.
+static void StripeSpread(bench::State &state)
+{
+    unsigned int stripes = (unsigned int)state.range(1);
+    auto *map = new DynamicStripedMap<SideTable>(stripes);  // leaked
+    HostObjects objs((size_t)state.range(0));
+    std::vector<size_t> counts(map->stripeCount());
+
+    for (auto _ : state) {
+        std::fill(counts.begin(), counts.end(), 0);
+        for (size_t i = 0; i < objs.count; i++) {
+            counts[map->indexOf(objs[i])]++;
+        }
+    }
+    size_t most = *std::max_element(counts.begin(), counts.end());
+    state.setItemsProcessed(state.iterations() * objs.count);
+    state.setCounter("worst", (double)most * map->stripeCount() / objs.count);
+}
+BENCHMARK(StripeSpread)->Apply(StripeArgs);
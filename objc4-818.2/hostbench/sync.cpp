@@ -0,0 +1,198 @@
+/*
+ * sync.cpp
+ * @synchronized benchmarks.
+ *
+ * objc-sync.mm is not part of the host build, so this copies the
+ * uncontended objc_sync_enter / objc_sync_exit paths: the SyncData path
+ * through the fast cache and the sDataLists stripe, and the thin lock
+ * path through the ThinLocks word. thread_local stands in for the
+ * direct thread keys. Keep this in sync with objc-sync.mm.
+ *
+ * Each thread synchronizes on its own objects in turn, range(0) levels
+ * deep, as most @synchronized blocks never see a second thread.
+ */
+
+#include "sidetable.h"
+#include "bench.h"
+
+#include <atomic>
+
+
+// SyncData path
+
+struct SyncData {
+    SyncData *nextData;
+    objc_object *object;
+    std::atomic<int32_t> threadCount;
+    uint32_t idleWalks;
+    recursive_mutex_t mutex;
+};
+
+struct SyncList {
+    SyncData *data;
+    spinlock_t lock;
+
+    constexpr SyncList() : data(nullptr), lock() { }
+};
+
+static StripedMap<SyncList> *DataLists;
+
+static thread_local SyncData *FastData;
+static thread_local uintptr_t FastCount;
+
+static void fatEnter(objc_object *obj)
+{
+    SyncData *data = FastData;
+    if (data  &&  data->object == obj) {
+        FastCount++;
+        data->mutex.lock();
+        return;
+    }
+
+    // Objects get their SyncData in setup, so this always finds it.
+    SyncList& list = (*DataLists)[obj];
+    list.lock.lock();
+    for (data = list.data; data->object != obj; data = data->nextData) { }
+    data->threadCount++;
+    list.lock.unlock();
+
+    FastData = data;
+    FastCount = 1;
+    data->mutex.lock();
+}
+
+static void fatExit(objc_object *obj)
+{
+    SyncData *data = FastData;
+    ASSERT(data  &&  data->object == obj);
+    data->mutex.unlock();
+    if (--FastCount == 0) {
+        FastData = nullptr;
+        data->threadCount--;
+    }
+}
+
+
+// Thin lock path
+
+struct ThinLock {
+    std::atomic<uintptr_t> holder;
+    std::atomic<uint32_t> fatUsers;
+    mutex_t gate;
+
+    constexpr ThinLock() : holder(0), fatUsers(0), gate(fork_unsafe_lock) { }
+};
+
+static StripedMap<ThinLock> *ThinLocks;
+
+static thread_local objc_object *ThinObject;
+static thread_local uintptr_t ThinCount;
+
+static bool thinEnter(objc_object *obj)
+{
+    if (ThinCount) {
+        if (ThinObject != obj) return false;
+        ThinCount++;
+        return true;
+    }
+
+    ThinLock& thin = (*ThinLocks)[obj];
+    uintptr_t expected = 0;
+    if (!thin.holder.compare_exchange_strong(expected, (uintptr_t)obj)) {
+        return false;
+    }
+    if (slowpath(!thin.gate.tryLock())) {
+        thin.holder.store(0, std::memory_order_release);
+        return false;
+    }
+    if (slowpath(thin.fatUsers.load() != 0)) {
+        thin.gate.unlock();
+        thin.holder.store(0, std::memory_order_release);
+        return false;
+    }
+    ThinObject = obj;
+    ThinCount = 1;
+    return true;
+}
+
+static void thinExit(objc_object *obj)
+{
+    ASSERT(ThinCount  &&  ThinObject == obj);
+    if (--ThinCount == 0) {
+        ThinObject = nullptr;
+        ThinLock& thin = (*ThinLocks)[obj];
+        thin.gate.unlock();
+        thin.holder.store(0, std::memory_order_release);
+    }
+}
+
+
+static HostObjects *Objects;
+
+enum { ObjectsPerThread = 64 };
+
+static void SyncSetup(bench::State &)
+{
+    DataLists = new StripedMap<SyncList>();
+    ThinLocks = new StripedMap<ThinLock>();
+    Objects = new HostObjects(ObjectsPerThread * 16);
+    for (size_t i = 0; i < Objects->count; i++) {
+        objc_object *obj = (*Objects)[i];
+        SyncList& list = (*DataLists)[obj];
+        SyncData *data = new SyncData();
+        data->object = obj;
+        data->nextData = list.data;
+        list.data = data;
+    }
+}
+
+static void SyncTeardown(bench::State &)
+{
+    for (unsigned int i = 0; i < DataLists->stripeCount(); i++) {
+        SyncData *data = DataLists->stripe(i).data;
+        while (data) {
+            SyncData *next = data->nextData;
+            delete data;
+            data = next;
+        }
+    }
+    delete DataLists;
+    DataLists = nullptr;
+    delete ThinLocks;
+    ThinLocks = nullptr;
+    delete Objects;
+    Objects = nullptr;
+}
+
+template <typename Enter, typename Exit>
+static void EnterExit(bench::State &state, Enter enter, Exit exit)
+{
+    int64_t depth = state.range(0);
+    size_t base = ObjectsPerThread * state.threadIndex();
+    size_t i = 0;
+
+    for (auto _ : state) {
+        objc_object *obj = (*Objects)[base + i];
+        for (int64_t d = 0; d < depth; d++) enter(obj);
+        for (int64_t d = 0; d < depth; d++) exit(obj);
+        if (++i == ObjectsPerThread) i = 0;
+    }
+    state.setItemsProcessed(state.iterations() * depth);
+}
+
+static void SyncEnterExitSyncData(bench::State &state)
+{
+    EnterExit(state, fatEnter, fatExit);
+}
+BENCHMARK(SyncEnterExitSyncData)
+    ->Setup(SyncSetup)->Teardown(SyncTeardown)
+    ->Arg(1)->Arg(4)->ThreadRange(1, 16);
+
+static void SyncEnterExitThin(bench::State &state)
+{
+    // No other thread uses these objects, so thinEnter never fails.
+    EnterExit(state, thinEnter, thinExit);
+}
+BENCHMARK(SyncEnterExitThin)
+    ->Setup(SyncSetup)->Teardown(SyncTeardown)
+    ->Arg(1)->Arg(4)->ThreadRange(1, 16);
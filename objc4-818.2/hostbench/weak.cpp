@@ -0,0 +1,367 @@
+/*
+ * weak.cpp
+ * weak_table_t benchmarks: register, unregister and clear with
+ * varying numbers of referrers per referent, and clearing a referent
+ * with many referrers while other threads use the same table.
+ */
+
+#include "sidetable.h"
+#include "bench.h"
+
+#include <atomic>
+#include <chrono>
+#include <sched.h>
+
+static uint64_t nowNanoseconds()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>
+        (std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// Memory held for referent's weak variables, beyond its weak_entry_t.
+static void setBytesPerRef(bench::State &state, SideTable& table,
+                           id referent, size_t refs)
+{
+    size_t bytes = weak_referrer_bytes_no_lock(&table.weak_table, referent);
+    state.setCounter("bytes_per_ref", (double)bytes / refs);
+}
+
+// Register `refs` weak variables to one object, then unregister them.
+static void WeakRegisterUnregister(bench::State &state)
+{
+    size_t refs = (size_t)state.range(0);
+    HostObjects objs(1);
+    id referent = (id)objs[0];
+    std::vector<id> referrers(refs);
+    SideTable table;
+
+    for (auto _ : state) {
+        for (size_t i = 0; i < refs; i++) {
+            referrers[i] = weak_register_no_lock(&table.weak_table, referent,
+                                                 &referrers[i],
+                                                 DontCheckDeallocating);
+        }
+        for (size_t i = 0; i < refs; i++) {
+            weak_unregister_no_lock(&table.weak_table, referent,
+                                    &referrers[i]);
+        }
+    }
+    state.setItemsProcessed(state.iterations() * refs * 2);
+}
+BENCHMARK(WeakRegisterUnregister)->Arg(1)->Arg(4)->Arg(100)->Arg(100000);
+
+// Register `refs` weak variables to one object, then clear them all
+// as deallocation would.
+static void WeakRegisterClear(bench::State &state)
+{
+    size_t refs = (size_t)state.range(0);
+    HostObjects objs(1);
+    id referent = (id)objs[0];
+    std::vector<id> referrers(refs);
+    SideTable table;
+
+    for (auto _ : state) {
+        for (size_t i = 0; i < refs; i++) {
+            referrers[i] = weak_register_no_lock(&table.weak_table, referent,
+                                                 &referrers[i],
+                                                 DontCheckDeallocating);
+        }
+        weak_clear_no_lock(&table.weak_table, referent);
+    }
+    state.setItemsProcessed(state.iterations() * refs);
+
+    for (size_t i = 0; i < refs; i++) {
+        weak_register_no_lock(&table.weak_table, referent, &referrers[i],
+                              DontCheckDeallocating);
+    }
+    setBytesPerRef(state, table, referent, refs);
+    weak_clear_no_lock(&table.weak_table, referent);
+}
+BENCHMARK(WeakRegisterClear)->Arg(1)->Arg(4)->Arg(100)->Arg(100000);
+
+// One object keeps `refs` weak variables while one of them at a time
+// is unregistered and registered again, as observers come and go.
+static void WeakChurn(bench::State &state)
+{
+    size_t refs = (size_t)state.range(0);
+    HostObjects objs(1);
+    id referent = (id)objs[0];
+    std::vector<id> referrers(refs);
+    SideTable table;
+
+    for (size_t i = 0; i < refs; i++) {
+        referrers[i] = weak_register_no_lock(&table.weak_table, referent,
+                                             &referrers[i],
+                                             DontCheckDeallocating);
+    }
+    size_t i = 0;
+    for (auto _ : state) {
+        weak_unregister_no_lock(&table.weak_table, referent, &referrers[i]);
+        referrers[i] = weak_register_no_lock(&table.weak_table, referent,
+                                             &referrers[i],
+                                             DontCheckDeallocating);
+        if (++i == refs) i = 0;
+    }
+    state.setItemsProcessed(state.iterations() * 2);
+    setBytesPerRef(state, table, referent, refs);
+    weak_clear_no_lock(&table.weak_table, referent);
+}
+BENCHMARK(WeakChurn)->Arg(1)->Arg(4)->Arg(100)->Arg(100000);
+
+// Register `refs` weak variables, unregister all but one in 16, then
+// clear: a delegate that once had many observers. bytes_per_ref is
+// measured for the survivors.
+static void WeakUnregisterMostClear(bench::State &state)
+{
+    size_t refs = (size_t)state.range(0);
+    HostObjects objs(1);
+    id referent = (id)objs[0];
+    std::vector<id> referrers(refs);
+    SideTable table;
+
+    for (auto _ : state) {
+        for (size_t i = 0; i < refs; i++) {
+            referrers[i] = weak_register_no_lock(&table.weak_table, referent,
+                                                 &referrers[i],
+                                                 DontCheckDeallocating);
+        }
+        for (size_t i = 0; i < refs; i++) {
+            if (i % 16) {
+                weak_unregister_no_lock(&table.weak_table, referent,
+                                        &referrers[i]);
+            }
+        }
+        weak_clear_no_lock(&table.weak_table, referent);
+    }
+    state.setItemsProcessed(state.iterations() * refs * 2);
+
+    for (size_t i = 0; i < refs; i++) {
+        weak_register_no_lock(&table.weak_table, referent, &referrers[i],
+                              DontCheckDeallocating);
+    }
+    for (size_t i = 0; i < refs; i++) {
+        if (i % 16) {
+            weak_unregister_no_lock(&table.weak_table, referent, &referrers[i]);
+        }
+    }
+    setBytesPerRef(state, table, referent, (refs + 15) / 16);
+    weak_clear_no_lock(&table.weak_table, referent);
+}
+BENCHMARK(WeakUnregisterMostClear)->Arg(100)->Arg(100000);
+
+// The slowest single registration while one object gains `refs` weak
+// variables, in max_ns. Growing the referrer set happens inside one
+// registration.
+static void WeakRegisterWorst(bench::State &state)
+{
+    size_t refs = (size_t)state.range(0);
+    HostObjects objs(1);
+    id referent = (id)objs[0];
+    std::vector<id> referrers(refs);
+    SideTable table;
+    uint64_t worst = 0;
+
+    for (auto _ : state) {
+        for (size_t i = 0; i < refs; i++) {
+            uint64_t start = nowNanoseconds();
+            referrers[i] = weak_register_no_lock(&table.weak_table, referent,
+                                                 &referrers[i],
+                                                 DontCheckDeallocating);
+            uint64_t elapsed = nowNanoseconds() - start;
+            if (elapsed > worst) worst = elapsed;
+        }
+        weak_clear_no_lock(&table.weak_table, referent);
+    }
+    state.setItemsProcessed(state.iterations() * refs);
+    state.setCounter("max_ns", (double)worst);
+}
+BENCHMARK(WeakRegisterWorst)->Arg(100000);
+
+// Many referents with one weak variable each: exercises weak_table_t
+// probing, growth and compaction rather than weak_entry_t.
+static void WeakManyReferents(bench::State &state)
+{
+    size_t n = (size_t)state.range(0);
+    HostObjects objs(n);
+    std::vector<id> referrers(n);
+    SideTable table;
+
+    for (auto _ : state) {
+        for (size_t i = 0; i < n; i++) {
+            referrers[i] = weak_register_no_lock(&table.weak_table,
+                                                 (id)objs[i], &referrers[i],
+                                                 DontCheckDeallocating);
+        }
+        for (size_t i = 0; i < n; i++) {
+            weak_clear_no_lock(&table.weak_table, (id)objs[i]);
+        }
+    }
+    state.setItemsProcessed(state.iterations() * n * 2);
+}
+BENCHMARK(WeakManyReferents)->Range(64, 65536, 32);
+
+
+// test/weakrace.m as a benchmark. Thread 0 gives one object range(1)
+// weak variables and deallocates it; thread 1 destroys the same
+// variables at the same time, as objc_destroyWeak would. Any further
+// threads are bystanders registering and unregistering weak variables
+// to their own objects in the same SideTable. range(0) selects how the
+// deallocation clears: 0 is weak_clear_no_lock under the table lock,
+// 1 is weak_detach_no_lock and weak_clear_detached.
+//
+// hold_us is the longest the deallocation held the table lock;
+// stall_us is the longest a bystander waited for one register and
+// unregister.
+
+static SideTable *RaceTable;
+static HostObjects *RaceObjects;
+static id *RaceVars;
+static std::atomic<size_t> RaceCycle;
+static std::atomic<size_t> RaceDestroyed;
+static std::atomic<bool> RaceDone;
+static std::atomic<int> RaceBystandersDone;
+static std::atomic<uint64_t> RaceStall;
+
+static void WeakRaceSetup(bench::State &state)
+{
+    RaceTable = new SideTable;
+    RaceObjects = new HostObjects(state.threads());
+    RaceVars = new id[state.range(1)]();
+    RaceCycle = 0;
+    RaceDestroyed = 0;
+    RaceDone = false;
+    RaceBystandersDone = 0;
+    RaceStall = 0;
+}
+
+static void WeakRaceTeardown(bench::State &)
+{
+    delete RaceTable;
+    RaceTable = nullptr;
+    delete RaceObjects;
+    RaceObjects = nullptr;
+    delete[] RaceVars;
+    RaceVars = nullptr;
+}
+
+static void WeakRaceDeallocator(bench::State &state)
+{
+    SideTable& table = *RaceTable;
+    id obj = (id)(*RaceObjects)[0];
+    bool detach = state.range(0);
+    size_t refs = (size_t)state.range(1);
+    uint64_t maxHold = 0;
+    size_t cycle = 0;
+
+    for (auto _ : state) {
+        state.pauseTiming();
+        table.lock();
+        for (size_t i = 0; i < refs; i++) {
+            RaceVars[i] = weak_register_no_lock(&table.weak_table, obj,
+                                                &RaceVars[i],
+                                                DontCheckDeallocating);
+        }
+        table.unlock();
+        RaceCycle.store(++cycle, std::memory_order_release);
+        state.resumeTiming();
+
+        uint64_t start;
+        uint64_t hold;
+        table.lock();
+        start = nowNanoseconds();
+        if (!detach) {
+            weak_clear_no_lock(&table.weak_table, obj);
+            hold = nowNanoseconds() - start;
+            table.unlock();
+        } else {
+            weak_clearing_t *detached =
+                weak_detach_no_lock(&table.weak_table, obj);
+            hold = nowNanoseconds() - start;
+            table.unlock();
+            if (detached) {
+                weak_clear_detached(detached);
+                table.lock();
+                start = nowNanoseconds();
+                weak_release_detached_no_lock(&table.weak_table, detached);
+                uint64_t release = nowNanoseconds() - start;
+                if (release > hold) hold = release;
+                table.unlock();
+            }
+        }
+        if (hold > maxHold) maxHold = hold;
+
+        // The next cycle reuses the variables.
+        while (RaceDestroyed.load(std::memory_order_acquire) != cycle) {
+            sched_yield();
+        }
+    }
+    RaceDone = true;
+    while (RaceBystandersDone != state.threads() - 2) sched_yield();
+
+    state.setItemsProcessed(state.iterations() * refs);
+    state.setCounter("hold_us", maxHold / 1000.0);
+    state.setCounter("stall_us", RaceStall / 1000.0);
+}
+
+static void WeakRaceDestroyer(bench::State &state)
+{
+    SideTable& table = *RaceTable;
+    size_t refs = (size_t)state.range(1);
+    size_t cycle = 0;
+
+    for (auto _ : state) {
+        cycle++;
+        while (RaceCycle.load(std::memory_order_acquire) != cycle) {
+            sched_yield();
+        }
+        for (size_t i = 0; i < refs; i++) {
+            // storeWeak(&var, nil): skip variables already cleared.
+            id old = __atomic_load_n(&RaceVars[i], __ATOMIC_RELAXED);
+            if (!old) continue;
+            table.lock();
+            if (RaceVars[i] == old) {
+                weak_unregister_no_lock(&table.weak_table, old, &RaceVars[i]);
+                RaceVars[i] = nil;
+            }
+            table.unlock();
+        }
+        RaceDestroyed.store(cycle, std::memory_order_release);
+    }
+}
+
+static void WeakRaceBystander(bench::State &state)
+{
+    SideTable& table = *RaceTable;
+    id obj = (id)(*RaceObjects)[state.threadIndex()];
+    id var = nil;
+    uint64_t maxStall = 0;
+
+    while (!RaceDone) {
+        uint64_t start = nowNanoseconds();
+        table.lock();
+        var = weak_register_no_lock(&table.weak_table, obj, &var,
+                                    DontCheckDeallocating);
+        table.unlock();
+        table.lock();
+        weak_unregister_no_lock(&table.weak_table, obj, &var);
+        table.unlock();
+        uint64_t stall = nowNanoseconds() - start;
+        if (stall > maxStall) maxStall = stall;
+    }
+
+    uint64_t prev = RaceStall.load();
+    while (prev < maxStall  &&  !RaceStall.compare_exchange_weak(prev, maxStall))
+        ;
+    RaceBystandersDone++;
+}
+
+static void WeakRace(bench::State &state)
+{
+    switch (state.threadIndex()) {
+    case 0:  WeakRaceDeallocator(state); break;
+    case 1:  WeakRaceDestroyer(state); break;
+    default: WeakRaceBystander(state); break;
+    }
+}
+BENCHMARK(WeakRace)->Setup(WeakRaceSetup)->Teardown(WeakRaceTeardown)
+    ->Args({0, 100000})->Args({1, 100000})->Threads(2)->Threads(4);
@@ -39,6 +39,7 @@
 #include <map>
 #include <execinfo.h>
 #include "NSObject-internal.h"
+#include "objc-zalloc.h"
 //#include <os/feature_private.h>
 
 extern "C" {
@@ -119,6 +120,11 @@ static void _initializeSwiftRefcountingThenCallRelease(id objc) {
 
 namespace objc {
     extern int PageCountWarning;
+    extern unsigned int SideTableStripeCount;
+    extern unsigned int PoolPageCacheLimit;
+    extern unsigned int PoolFreePageLimit;
+    extern unsigned int AutoreleaseCoalescingWindow;
+    extern unsigned int RetainReleaseSamplePeriod;
 }
 
 namespace {
@@ -161,7 +167,7 @@ struct SideTable {
     weak_table_t weak_table; // 以 object ids为 keys,以 weak_entry_t 为 value 的哈希表,如果object ids有弱引用存在,则可从中找到对象的 weak_entry_t.
 
     // 构造函数,只做一件事,把 weak_table 的空间置为 0
-    SideTable() {
+    SideTable() : acquires(0), contended(0) {
         memset(&weak_table, 0, sizeof(weak_table));
     }
     // 析构函数(不能进行析构)
@@ -170,10 +176,27 @@ struct SideTable {
         _objc_fatal("Do not delete SideTable.");
     }
     // 三个函数正对应了 StripeMap 中模板抽象类型 T 的接口要求,三个函数的内部都是直接调用 slock 的对应函数
-    void lock() { slock.lock(); }
+    // OBJC_PROFILE_SIDE_TABLES counters, only written with slock held.
+    uint64_t acquires;
+    uint64_t contended;
+
+    void lock() {
+        if (slowpath(ProfileSideTables)) lockProfiled();
+        else slock.lock();
+    }
     void unlock() { slock.unlock(); }
     void forceReset() { slock.forceReset(); }
 
+    // Count the acquisition, and whether another thread held the lock.
+    // Returns true if it did.
+    bool lockProfiled() {
+        bool busy = !slock.tryLock();
+        if (busy) slock.lock();
+        acquires++;
+        if (busy) contended++;
+        return busy;
+    }
+
     // Address-ordered lock discipline for a pair of side tables.
     
     // HaveOld 和 HaveNew 分别表示 lock1 和 lock2 是否存在
@@ -209,6 +232,17 @@ template<>
 void SideTable::lockTwo<DoHaveOld, DoHaveNew>
     (SideTable *lock1, SideTable *lock2)
 {
+    if (slowpath(ProfileSideTables)) {
+        // Same order as spinlock_t::lockTwo.
+        if ((uintptr_t)lock1 < (uintptr_t)lock2) {
+            lock1->lockProfiled();
+            lock2->lockProfiled();
+        } else {
+            lock2->lockProfiled();
+            if (lock2 != lock1) lock1->lockProfiled();
+        }
+        return;
+    }
     spinlock_t::lockTwo(&lock1->slock, &lock2->slock);
 }
 
@@ -254,9 +288,11 @@ void SideTable::unlockTwo<DontHaveOld, DoHaveNew>
  SideTables 中则是取得的 T 是 SideTable
  */
 // ExplicitInit 内部_storage 数组长度是: alignas(Type) uint8_t _storage[sizeof(Type)];
-static objc::ExplicitInit<StripedMap<SideTable>> SideTablesMap;
+// OBJC_SIDE_TABLE_STRIPES chooses the stripe count, so SideTables is the
+// one DynamicStripedMap; the lock maps keep StripedMap's fixed count.
+static objc::ExplicitInit<DynamicStripedMap<SideTable>> SideTablesMap;
 
-static StripedMap<SideTable>& SideTables() {
+static DynamicStripedMap<SideTable>& SideTables() {
     return SideTablesMap.get();
 }
 
@@ -308,6 +344,65 @@ void SideTableLocksSucceedLocks(StripedMap<spinlock_t>& oldlocks) {
     }
 }
 
+
+/***********************************************************************
+* objc_getSideTableContention
+* Copies the OBJC_PROFILE_SIDE_TABLES counters of up to count stripes
+* into outStripes and returns the number of stripes.
+* Locking: acquires each side table lock in turn, uncounted
+**********************************************************************/
+unsigned int
+objc_getSideTableContention(objc_side_table_contention *outStripes,
+                            unsigned int count)
+{
+    auto& tables = SideTables();
+    unsigned int stripes = tables.stripeCount();
+    if (!outStripes) return stripes;
+
+    for (unsigned int i = 0; i < stripes && i < count; i++) {
+        SideTable& table = tables.stripe(i);
+        table.slock.lock();
+        outStripes[i].acquires = table.acquires;
+        outStripes[i].contended = table.contended;
+        table.slock.unlock();
+    }
+    return stripes;
+}
+
+
+/***********************************************************************
+* objc_dumpSideTableContention
+* Logs the OBJC_PROFILE_SIDE_TABLES counters of every stripe that has
+* been locked, then the totals.
+* Locking: acquires each side table lock in turn, uncounted
+**********************************************************************/
+void
+objc_dumpSideTableContention(void)
+{
+    unsigned int stripes = objc_getSideTableContention(nil, 0);
+    objc_side_table_contention *counts = (objc_side_table_contention *)
+        calloc(stripes, sizeof(objc_side_table_contention));
+    objc_getSideTableContention(counts, stripes);
+
+    uint64_t acquires = 0;
+    uint64_t contended = 0;
+    _objc_inform("SIDE TABLES: %u stripes%s", stripes,
+                 ProfileSideTables ? "" : " (OBJC_PROFILE_SIDE_TABLES is off)");
+    for (unsigned int i = 0; i < stripes; i++) {
+        if (counts[i].acquires == 0) continue;
+        acquires += counts[i].acquires;
+        contended += counts[i].contended;
+        _objc_inform("SIDE TABLES: stripe %4u: %llu acquires, "
+                     "%llu contended (%.2f%%)", i,
+                     counts[i].acquires, counts[i].contended,
+                     100.0 * counts[i].contended / counts[i].acquires);
+    }
+    _objc_inform("SIDE TABLES: total: %llu acquires, %llu contended (%.2f%%)",
+                 acquires, contended,
+                 acquires ? 100.0 * contended / acquires : 0.0);
+    free(counts);
+}
+
 // Call out to the _setWeaklyReferenced method on obj, if implemented.
 static void callSetWeaklyReferenced(id obj) {
     if (!obj)
@@ -930,7 +1025,8 @@ retry:
     // 从 weak_table 的 weak_entry_t 哈希表(或定长为 4 的内部数组）移除 src 的引用
     weak_unregister_no_lock(&table->weak_table, obj, src);
     // 把 dst 的弱引用注册到weak_table 的 weak_entry_t 哈希表(或定长为 4 的内部数组）中
-    weak_register_no_lock(&table->weak_table, obj, dst, DontCheckDeallocating);
+    // nil if obj's weak variables are being cleared outside the lock.
+    obj = weak_register_no_lock(&table->weak_table, obj, dst, DontCheckDeallocating);
     // *dst赋值
     *dst = obj;
     *src = nil;
@@ -973,6 +1069,8 @@ private:
 	static uint8_t const SCRIBBLE = 0xA3;  // 0xA3A3A3A3 after releasing
 	static size_t const COUNT = SIZE / sizeof(id);
     static size_t const MAX_FAULTS = 2;
+    // Entries releaseUntil() takes off a page at a time.
+    static unsigned int const ReleaseBatchSize = 64;
 
     // EMPTY_POOL_PLACEHOLDER is stored in TLS when exactly one pool is 
     // pushed and it has never contained any objects. This saves memory 
@@ -984,11 +1082,205 @@ private:
 
     // SIZE-sizeof(*this) bytes of contents follow
 
+    /*
+      Page allocation.
+      Pages are carved from SLAB_SIZE slabs, which are never unmapped.
+      A freed page goes on a lock-free free list and is handed out again
+      before any unused slab memory. Slab memory is only touched as pages
+      are carved, so a new slab costs address space, not memory.
+      The free list holds up to OBJC_POOL_FREE_PAGES pages. Its link
+      lives in the page, and a stale pop may read a page long after it
+      left the list, so pages on it must stay mapped and untouched by
+      madvise. A page freed beyond the limit is instead marked in its
+      slab's PoolSlab record, under PoolPageLock. Once every page of a
+      slab is marked, the whole slab is given back with madvise, which
+      keeps it mapped and works whatever the VM page size. Marked pages
+      are handed out after the free list and before new slab memory.
+      With OBJC_POOL_HUGE_PAGES every freed page goes on the free list,
+      since superpages can't be given back.
+      OBJC_DEBUG_POOL_ALLOCATION uses malloc instead so heap debuggers
+      can track every page.
+      Each thread also keeps up to OBJC_POOL_PAGE_CACHE empty children
+      of its hot page when a pool is popped (see popPage), so a thread
+      that repeatedly fills many pages rarely reaches the allocator.
+     */
+    static size_t const SLAB_SIZE = 2*1024*1024;
+    static size_t const SLAB_PAGES = SLAB_SIZE / SIZE;
+    static objc::AtomicQueue freePages;
+
+    // Freed pages of one slab that are not on the free list.
+    struct PoolSlab {
+        PoolSlab *next;
+        uintptr_t base;
+        uint32_t coldPages;
+        bool released;
+        uint64_t coldBits[SLAB_PAGES / 64];
+    };
+    // Slabs with pages freed beyond the free list limit.
+    // Guarded by PoolPageLock; records are never freed.
+    static PoolSlab *coldSlabs;
+    // Next uncarved page of the newest slab. SLAB_SIZE-aligned when the
+    // slab is used up; there is no slab yet when 0.
+    static std::atomic<uintptr_t> slabCursor;
+
+    // objc_getAutoreleasePoolPageStatistics counters.
+    static std::atomic<uint64_t> pagesAllocated;
+    static std::atomic<uint64_t> pagesRecycled;
+    static std::atomic<uint64_t> pagesReused;
+    static std::atomic<uint64_t> slabBytes;
+    static std::atomic<uint64_t> freePageCount;
+    static std::atomic<uint64_t> coldPageCount;
+    static std::atomic<uint64_t> releasedSlabCount;
+    static std::atomic<uint64_t> pagesReturned;
+    static std::atomic<uint64_t> autoreleases;
+    static std::atomic<uint64_t> coalescedAutoreleases;
+
+    static uintptr_t mapSlab()
+    {
+        vm_address_t addr = 0;
+        kern_return_t kr;
+#ifdef VM_FLAGS_SUPERPAGE_SIZE_2MB
+        if (PoolHugePages) {
+            kr = vm_map(mach_task_self(), &addr, SLAB_SIZE, SLAB_SIZE - 1,
+                        VM_FLAGS_ANYWHERE | VM_FLAGS_SUPERPAGE_SIZE_2MB,
+                        MEMORY_OBJECT_NULL, 0, FALSE,
+                        VM_PROT_DEFAULT, VM_PROT_ALL, VM_INHERIT_DEFAULT);
+            if (kr == KERN_SUCCESS) return addr;
+            addr = 0;
+        }
+#endif
+        kr = vm_map(mach_task_self(), &addr, SLAB_SIZE, SLAB_SIZE - 1,
+                    VM_FLAGS_ANYWHERE, MEMORY_OBJECT_NULL, 0, FALSE,
+                    VM_PROT_DEFAULT, VM_PROT_ALL, VM_INHERIT_DEFAULT);
+        if (kr != KERN_SUCCESS) {
+            _objc_fatal("autorelease pool page slab allocation failed (%d)", kr);
+        }
+        return addr;
+    }
+
+    static void *allocColdPage()
+    {
+        if (coldPageCount.load(std::memory_order_relaxed) == 0) return nil;
+
+        mutex_locker_t lock(PoolPageLock);
+
+        // Prefer a slab whose memory was not given back.
+        PoolSlab *slab = nil;
+        for (PoolSlab *s = coldSlabs; s; s = s->next) {
+            if (s->coldPages == 0) continue;
+            slab = s;
+            if (!s->released) break;
+        }
+        if (!slab) return nil;
+
+        if (slab->released) {
+            madvise((void *)slab->base, SLAB_SIZE, MADV_FREE_REUSE);
+            slab->released = false;
+            releasedSlabCount.fetch_sub(1, std::memory_order_relaxed);
+        }
+
+        for (size_t i = 0; i < SLAB_PAGES / 64; i++) {
+            if (uint64_t bits = slab->coldBits[i]) {
+                size_t index = i * 64 + __builtin_ctzll(bits);
+                slab->coldBits[i] = bits & (bits - 1);
+                slab->coldPages--;
+                coldPageCount.fetch_sub(1, std::memory_order_relaxed);
+                return (void *)(slab->base + index * SIZE);
+            }
+        }
+        _objc_fatal("autorelease pool slab %p has no free page marked",
+                    (void *)slab->base);
+    }
+
+    static void freeColdPage(void *p)
+    {
+        mutex_locker_t lock(PoolPageLock);
+
+        uintptr_t base = (uintptr_t)p & ~(uintptr_t)(SLAB_SIZE - 1);
+        PoolSlab *slab = coldSlabs;
+        while (slab  &&  slab->base != base) slab = slab->next;
+        if (!slab) {
+            slab = (PoolSlab *)calloc(1, sizeof(PoolSlab));
+            slab->base = base;
+            slab->next = coldSlabs;
+            coldSlabs = slab;
+        }
+
+        size_t index = ((uintptr_t)p - base) / SIZE;
+        slab->coldBits[index / 64] |= 1ULL << (index % 64);
+        slab->coldPages++;
+        coldPageCount.fetch_add(1, std::memory_order_relaxed);
+
+        if (slab->coldPages == SLAB_PAGES) {
+            madvise((void *)base, SLAB_SIZE, MADV_FREE_REUSABLE);
+            slab->released = true;
+            releasedSlabCount.fetch_add(1, std::memory_order_relaxed);
+            pagesReturned.fetch_add(SLAB_PAGES, std::memory_order_relaxed);
+        }
+    }
+
+    static void *allocPage()
+    {
+        pagesAllocated.fetch_add(1, std::memory_order_relaxed);
+        if (void *page = freePages.pop()) {
+            freePageCount.fetch_sub(1, std::memory_order_relaxed);
+            pagesRecycled.fetch_add(1, std::memory_order_relaxed);
+            return page;
+        }
+        if (void *page = allocColdPage()) {
+            pagesRecycled.fetch_add(1, std::memory_order_relaxed);
+            return page;
+        }
+
+        uintptr_t cursor = slabCursor.load(std::memory_order_relaxed);
+        while (true) {
+            if (cursor & (SLAB_SIZE - 1)) {
+                if (slabCursor.compare_exchange_weak(cursor, cursor + SIZE,
+                                                     std::memory_order_relaxed))
+                {
+                    return (void *)cursor;
+                }
+                continue;
+            }
+
+            // The newest slab is used up. Map another one.
+            uintptr_t slab = mapSlab();
+            if (slabCursor.compare_exchange_strong(cursor, slab + SIZE,
+                                                   std::memory_order_relaxed))
+            {
+                slabBytes.fetch_add(SLAB_SIZE, std::memory_order_relaxed);
+                return (void *)slab;
+            }
+            // Another thread mapped one first.
+            vm_deallocate(mach_task_self(), slab, SLAB_SIZE);
+        }
+    }
+
     static void * operator new(size_t size) {
-        return malloc_zone_memalign(malloc_default_zone(), SIZE, SIZE);
+        if (slowpath(DebugPoolAllocation)) {
+            return malloc_zone_memalign(malloc_default_zone(), SIZE, SIZE);
+        }
+        return allocPage();
+    }
+    static void freePage(void *p)
+    {
+        // The count is raised before the push so allocPage's decrement
+        // never overtakes it. Racing frees may overshoot the limit by
+        // a page or two.
+        if (freePageCount.load(std::memory_order_relaxed) >=
+                objc::PoolFreePageLimit  &&  !PoolHugePages)
+        {
+            return freeColdPage(p);
+        }
+        freePageCount.fetch_add(1, std::memory_order_relaxed);
+        freePages.push(p);
     }
+
     static void operator delete(void * p) {
-        return free(p);
+        if (slowpath(DebugPoolAllocation)) {
+            return free(p);
+        }
+        freePage(p);
     }
 
     inline void protect() {
@@ -1122,6 +1414,69 @@ private:
         return (next - begin() < (end() - begin()) / 2);
     }
 
+#if SUPPORT_AUTORELEASEPOOL_DEDUP_PTRS
+    /*
+      LRU coalescing looks for obj among the last
+      OBJC_AUTORELEASE_COALESCING_WINDOW entries of the current pool,
+      1 to CoalescingLanes of them. When the page has at least
+      CoalescingLanes entries above begin() they are compared in one
+      vector operation; otherwise one at a time.
+     */
+    static unsigned int const CoalescingLanes = 8;
+    typedef uint64_t CoalescingVector
+        __attribute__((vector_size(CoalescingLanes * sizeof(uint64_t))));
+
+    // Find the newest entry for obj within the window that is above the
+    // newest POOL_BOUNDARY and can take another count. The entry at
+    // begin() is never used. Returns its distance from topEntry in offset.
+    bool findCoalescingEntry(AutoreleasePoolEntry *topEntry, id obj,
+                             uintptr_t& offset)
+    {
+        uintptr_t avail = topEntry - (AutoreleasePoolEntry *)begin();
+        unsigned int window = objc::AutoreleaseCoalescingWindow;
+        if (avail < window) window = (unsigned int)avail;
+        if (window == 0) return false;
+
+        // Bit i describes the entry at offset i.
+        uint32_t matches = 0;
+        uint32_t boundaries = 0;
+        if (avail >= CoalescingLanes) {
+            // Lane i holds the entry at offset CoalescingLanes-1-i.
+            CoalescingVector entries;
+            memcpy(&entries, topEntry - (CoalescingLanes - 1), sizeof(entries));
+            CoalescingVector ptrs = entries & (((uint64_t)1 << 48) - 1);
+            auto hit = (ptrs == (uint64_t)(uintptr_t)obj)
+                & ((entries >> 48) < AutoreleasePoolEntry::maxCount);
+            auto boundary = (entries == 0);
+            for (unsigned int i = 0; i < CoalescingLanes; i++) {
+                matches |= (uint32_t)(hit[i] & 1) << (CoalescingLanes - 1 - i);
+                boundaries |= (uint32_t)(boundary[i] & 1) << (CoalescingLanes - 1 - i);
+            }
+        } else {
+            for (unsigned int i = 0; i < window; i++) {
+                AutoreleasePoolEntry *entry = topEntry - i;
+                matches |= (uint32_t)(entry->ptr == (uintptr_t)obj  &&
+                                      entry->count < AutoreleasePoolEntry::maxCount) << i;
+                boundaries |= (uint32_t)(*(id *)entry == POOL_BOUNDARY) << i;
+            }
+        }
+
+        uint32_t valid = (1u << window) - 1;
+        if (boundaries) valid &= (1u << __builtin_ctz(boundaries)) - 1;
+        matches &= valid;
+        if (!matches) return false;
+        offset = __builtin_ctz(matches);
+        return true;
+    }
+#endif
+
+    // OBJC_RECORD_AUTORELEASE_COALESCING counters.
+    static void noteAutorelease(bool coalesced)
+    {
+        autoreleases.fetch_add(1, std::memory_order_relaxed);
+        if (coalesced) coalescedAutoreleases.fetch_add(1, std::memory_order_relaxed);
+    }
+
     id *add(id obj)
     {
         ASSERT(!full());
@@ -1133,21 +1488,18 @@ private:
             if (!DisableAutoreleaseCoalescingLRU) {
                 if (!empty() && (obj != POOL_BOUNDARY)) {
                     AutoreleasePoolEntry *topEntry = (AutoreleasePoolEntry *)next - 1;
-                    for (uintptr_t offset = 0; offset < 4; offset++) {
+                    uintptr_t offset;
+                    if (findCoalescingEntry(topEntry, obj, offset)) {
                         AutoreleasePoolEntry *offsetEntry = topEntry - offset;
-                        if (offsetEntry <= (AutoreleasePoolEntry*)begin() || *(id *)offsetEntry == POOL_BOUNDARY) {
-                            break;
-                        }
-                        if (offsetEntry->ptr == (uintptr_t)obj && offsetEntry->count < AutoreleasePoolEntry::maxCount) {
-                            if (offset > 0) {
-                                AutoreleasePoolEntry found = *offsetEntry;
-                                memmove(offsetEntry, offsetEntry + 1, offset * sizeof(*offsetEntry));
-                                *topEntry = found;
-                            }
-                            topEntry->count++;
-                            ret = (id *)topEntry;  // need to reset ret
-                            goto done;
+                        if (offset > 0) {
+                            AutoreleasePoolEntry found = *offsetEntry;
+                            memmove(offsetEntry, offsetEntry + 1, offset * sizeof(*offsetEntry));
+                            *topEntry = found;
                         }
+                        topEntry->count++;
+                        ret = (id *)topEntry;  // need to reset ret
+                        if (slowpath(RecordAutoreleaseCoalescing)) noteAutorelease(true);
+                        goto done;
                     }
                 }
             } else {
@@ -1156,12 +1508,16 @@ private:
                     if (prevEntry->ptr == (uintptr_t)obj && prevEntry->count < AutoreleasePoolEntry::maxCount) {
                         prevEntry->count++;
                         ret = (id *)prevEntry;  // need to reset ret
+                        if (slowpath(RecordAutoreleaseCoalescing)) noteAutorelease(true);
                         goto done;
                     }
                 }
             }
         }
 #endif
+        if (slowpath(RecordAutoreleaseCoalescing)  &&  obj != POOL_BOUNDARY) {
+            noteAutorelease(false);
+        }
         ret = next;  // faster than `return next-1` because of aliasing
         *next++ = obj;
 #if SUPPORT_AUTORELEASEPOOL_DEDUP_PTRS
@@ -1182,7 +1538,15 @@ private:
     {
         // Not recursive: we don't want to blow out the stack 
         // if a thread accumulates a stupendous amount of garbage
-        
+
+        // Entries are taken off the top of the hot page a block at a
+        // time and released newest first with objc_releaseN, which skips
+        // POOL_BOUNDARY (nil) without branching, prefetches each object
+        // and locks each side table once per batch. Objects autoreleased
+        // by those releases land above the block and are released by
+        // the next one.
+        id batch[ReleaseBatchSize];
+
         while (this->next != stop) {
             // Restart from hotPage() every time, in case -release 
             // autoreleased more objects
@@ -1194,30 +1558,41 @@ private:
                 setHotPage(page);
             }
 
-            page->unprotect();
+            // stop is on this page; any hotter page is emptied.
+            id *limit = (page == this) ? stop : page->begin();
+            id *p = page->next;
+            unsigned int count = 0;
 #if SUPPORT_AUTORELEASEPOOL_DEDUP_PTRS
-            AutoreleasePoolEntry* entry = (AutoreleasePoolEntry*) --page->next;
-
-            // create an obj with the zeroed out top byte and release that
-            id obj = (id)entry->ptr;
-            int count = (int)entry->count;  // grab these before memset
-#else
-            id obj = *--page->next;
+            unsigned int extra = 0;
 #endif
-            memset((void*)page->next, SCRIBBLE, sizeof(*page->next));
-            page->protect();
 
-            if (obj != POOL_BOUNDARY) {
+            page->unprotect();
+            while (p != limit  &&  count < ReleaseBatchSize) {
 #if SUPPORT_AUTORELEASEPOOL_DEDUP_PTRS
-                // release count+1 times since it is count of the additional
-                // autoreleases beyond the first one
-                for (int i = 0; i < count + 1; i++) {
-                    objc_release(obj);
+                AutoreleasePoolEntry* entry = (AutoreleasePoolEntry*) --p;
+                // create an obj with the zeroed out top byte and release that
+                batch[count++] = (id)entry->ptr;
+                // entry->count is the number of additional autoreleases
+                // beyond the first one. End the block here so that they
+                // are released after everything newer.
+                if (entry->count) {
+                    extra = (unsigned int)entry->count;
+                    break;
                 }
 #else
-                objc_release(obj);
+                batch[count++] = *--p;
 #endif
             }
+            memset((void*)p, SCRIBBLE, (page->next - p) * sizeof(*p));
+            page->next = p;
+            page->protect();
+
+            objc_releaseN(batch, count);
+#if SUPPORT_AUTORELEASEPOOL_DEDUP_PTRS
+            for (unsigned int i = 0; i < extra; i++) {
+                objc_release(batch[count-1]);
+            }
+#endif
         }
 
         setHotPage(this);
@@ -1355,7 +1730,10 @@ private:
         ASSERT(page->full()  ||  DebugPoolAllocation);
 
         do {
-            if (page->child) page = page->child;
+            if (page->child) {
+                page = page->child;
+                pagesReused.fetch_add(1, std::memory_order_relaxed);
+            }
             else page = new AutoreleasePoolPage(page);
         } while (page->full());
 
@@ -1493,13 +1871,15 @@ public:
             page->kill();
             setHotPage(nil);
         } else if (page->child) {
-            // hysteresis: keep one empty child if page is more than half full
-            if (page->lessThanHalfFull()) {
-                page->child->kill();
-            }
-            else if (page->child->child) {
-                page->child->child->kill();
+            // hysteresis: keep up to OBJC_POOL_PAGE_CACHE empty children,
+            // one fewer if page is less than half full
+            unsigned int keep = objc::PoolPageCacheLimit;
+            if (keep  &&  page->lessThanHalfFull()) keep--;
+            AutoreleasePoolPage *last = page;
+            for (unsigned int i = 0; i < keep  &&  last->child; i++) {
+                last = last->child;
             }
+            if (last->child) last->child->kill();
         }
     }
 
@@ -1628,6 +2008,25 @@ public:
     }
 #endif
 
+    static void getStatistics(objc_autorelease_pool_page_stats *outStats)
+    {
+        outStats->allocated = pagesAllocated.load(std::memory_order_relaxed);
+        outStats->recycled = pagesRecycled.load(std::memory_order_relaxed);
+        outStats->reused = pagesReused.load(std::memory_order_relaxed);
+        uint64_t released =
+            releasedSlabCount.load(std::memory_order_relaxed);
+        outStats->freePages = freePageCount.load(std::memory_order_relaxed) +
+            coldPageCount.load(std::memory_order_relaxed) -
+            released * SLAB_PAGES;
+        outStats->returned = pagesReturned.load(std::memory_order_relaxed);
+        outStats->bytesHeld = slabBytes.load(std::memory_order_relaxed) -
+            released * SLAB_SIZE;
+        outStats->autoreleases = autoreleases.load(std::memory_order_relaxed);
+        outStats->coalesced =
+            coalescedAutoreleases.load(std::memory_order_relaxed);
+        outStats->bytesSaved = outStats->coalesced * sizeof(id);
+    }
+
     __attribute__((noinline, cold))
     static void printHiwat()
     {
@@ -1652,6 +2051,22 @@ public:
             _objc_inform("POOL HIGHWATER: new high water mark of %u "
                          "pending releases for thread %p:",
                          mark, objc_thread_self());
+            objc_autorelease_pool_page_stats stats;
+            getStatistics(&stats);
+            _objc_inform("POOL HIGHWATER: pages allocated %llu, recycled %llu, "
+                         "reused by their thread %llu, slab bytes held %llu, "
+                         "free pages kept %llu, returned %llu",
+                         stats.allocated, stats.recycled,
+                         stats.reused, stats.bytesHeld,
+                         stats.freePages, stats.returned);
+            if (RecordAutoreleaseCoalescing) {
+                _objc_inform("POOL HIGHWATER: autoreleases %llu, coalesced %llu "
+                             "(%.1f%%), %llu bytes saved",
+                             stats.autoreleases, stats.coalesced,
+                             stats.autoreleases
+                             ? 100.0 * stats.coalesced / stats.autoreleases : 0.0,
+                             stats.bytesSaved);
+            }
 #if SUPPORT_AUTORELEASEPOOL_DEDUP_PTRS
             if (sumOfExtraReleases > 0) {
                 _objc_inform("POOL HIGHWATER: extra sequential autoreleases of objects: %u",
@@ -1672,6 +2087,243 @@ public:
 #undef POOL_BOUNDARY
 };
 
+objc::AtomicQueue AutoreleasePoolPage::freePages;
+AutoreleasePoolPage::PoolSlab *AutoreleasePoolPage::coldSlabs;
+mutex_t PoolPageLock;
+std::atomic<uintptr_t> AutoreleasePoolPage::slabCursor;
+std::atomic<uint64_t> AutoreleasePoolPage::pagesAllocated;
+std::atomic<uint64_t> AutoreleasePoolPage::pagesRecycled;
+std::atomic<uint64_t> AutoreleasePoolPage::pagesReused;
+std::atomic<uint64_t> AutoreleasePoolPage::slabBytes;
+std::atomic<uint64_t> AutoreleasePoolPage::freePageCount;
+std::atomic<uint64_t> AutoreleasePoolPage::coldPageCount;
+std::atomic<uint64_t> AutoreleasePoolPage::releasedSlabCount;
+std::atomic<uint64_t> AutoreleasePoolPage::pagesReturned;
+std::atomic<uint64_t> AutoreleasePoolPage::autoreleases;
+std::atomic<uint64_t> AutoreleasePoolPage::coalescedAutoreleases;
+
+
+/***********************************************************************
+* Retain/release sampler
+* With OBJC_SAMPLE_RETAIN_RELEASE=N, every Nth retain count slow path
+* event on each thread is counted against the object's class, with a
+* weight of N. Each thread counts into its own RRSampler, so recording
+* takes no locks. objc_getRetainReleaseSamples() merges them on demand.
+*
+* Samplers are never freed. A thread that exits gives its sampler up
+* and the next thread to sample takes it over, keeping its counts.
+**********************************************************************/
+
+enum RRSampleEvent : unsigned int {
+    RRSampleRetainOverflow,
+    RRSampleReleaseUnderflow,
+    RRSampleSidetableRetain,
+    RRSampleSidetableRelease,
+    RRSampleAutorelease,
+    RRSampleEventCount
+};
+
+struct RRSampler {
+    // Open-addressed by class. The owning thread is the only writer;
+    // objc_getRetainReleaseSamples() reads while it runs.
+    static unsigned int const SlotCount = 256;
+    static unsigned int const MaxProbes = 16;
+
+    struct Slot {
+        std::atomic<Class> cls;
+        std::atomic<uint64_t> counts[RRSampleEventCount];
+    };
+
+    RRSampler *next;
+    std::atomic<bool> inUse;
+    unsigned int countdown;
+    Slot slots[SlotCount];
+    Slot other;  // classes that found no free slot
+
+    Slot& slotFor(Class cls) {
+        uintptr_t index = ((uintptr_t)cls >> 4) * 0x9E3779B97F4A7C15ull;
+        for (unsigned int probe = 0; probe < MaxProbes; probe++) {
+            Slot& slot = slots[(index + probe) & (SlotCount - 1)];
+            Class slotCls = slot.cls.load(std::memory_order_relaxed);
+            if (slotCls == cls) return slot;
+            if (!slotCls) {
+                slot.cls.store(cls, std::memory_order_release);
+                return slot;
+            }
+        }
+        return other;
+    }
+
+    void record(Class cls, RRSampleEvent event, uint64_t weight) {
+        auto& count = slotFor(cls).counts[event];
+        count.store(count.load(std::memory_order_relaxed) + weight,
+                    std::memory_order_relaxed);
+    }
+
+    static std::atomic<RRSampler *> all;
+
+    // Take over a sampler given up by an exited thread, or make one.
+    static RRSampler *acquire() {
+        for (RRSampler *s = all.load(std::memory_order_acquire); s; s = s->next) {
+            bool expected = false;
+            if (!s->inUse.load(std::memory_order_relaxed)  &&
+                s->inUse.compare_exchange_strong(expected, true,
+                                                 std::memory_order_acquire))
+            {
+                return s;
+            }
+        }
+
+        RRSampler *s = (RRSampler *)calloc(1, sizeof(RRSampler));
+        s->inUse.store(true, std::memory_order_relaxed);
+        RRSampler *head = all.load(std::memory_order_relaxed);
+        do {
+            s->next = head;
+        } while (!all.compare_exchange_weak(head, s, std::memory_order_release,
+                                            std::memory_order_relaxed));
+        return s;
+    }
+};
+
+std::atomic<RRSampler *> RRSampler::all;
+
+static NEVER_INLINE void
+sampleRetainRelease(objc_object *obj, RRSampleEvent event)
+{
+    unsigned int period = objc::RetainReleaseSamplePeriod;
+    _objc_pthread_data *data = _objc_fetch_pthread_data(true);
+    if (!data) return;
+
+    RRSampler *sampler = data->rrSampler;
+    if (!sampler) {
+        sampler = data->rrSampler = RRSampler::acquire();
+        sampler->countdown = period;
+    }
+    if (--sampler->countdown != 0) return;
+    sampler->countdown = period;
+    sampler->record(obj->ISA(), event, period);
+}
+
+static ALWAYS_INLINE void
+sampleRetainReleaseIfEnabled(objc_object *obj, RRSampleEvent event)
+{
+    if (slowpath(objc::RetainReleaseSamplePeriod)) {
+        sampleRetainRelease(obj, event);
+    }
+}
+
+void _destroyRetainReleaseSampler(struct RRSampler *sampler)
+{
+    if (sampler) sampler->inUse.store(false, std::memory_order_release);
+}
+
+
+/***********************************************************************
+* objc_getRetainReleaseSamples
+* Merges every thread's OBJC_SAMPLE_RETAIN_RELEASE counts by class and
+* copies up to count classes into outSamples, busiest first.
+* Returns the number of classes.
+* Locking: none. Counts recorded during the merge may be missed.
+**********************************************************************/
+static uint64_t
+totalSamples(const objc_retain_release_samples& s)
+{
+    return s.retainOverflows + s.releaseUnderflows +
+        s.sidetableRetains + s.sidetableReleases + s.autoreleases;
+}
+
+unsigned int
+objc_getRetainReleaseSamples(objc_retain_release_samples *outSamples,
+                             unsigned int count)
+{
+    objc::DenseMap<Class, unsigned int> indexes;
+    unsigned int used = 0;
+    unsigned int allocated = 0;
+    objc_retain_release_samples *merged = nil;
+
+    auto merge = [&](Class cls, RRSampler::Slot& slot) {
+        uint64_t c[RRSampleEventCount];
+        bool any = false;
+        for (unsigned int e = 0; e < RRSampleEventCount; e++) {
+            c[e] = slot.counts[e].load(std::memory_order_relaxed);
+            any |= (c[e] != 0);
+        }
+        if (!any) return;
+
+        auto it = indexes.try_emplace(cls, used);
+        if (it.second) {
+            if (used == allocated) {
+                allocated = allocated ? allocated * 2 : 64;
+                merged = (objc_retain_release_samples *)
+                    realloc(merged, allocated * sizeof(*merged));
+            }
+            bzero(&merged[used], sizeof(*merged));
+            merged[used].cls = cls;
+            used++;
+        }
+        objc_retain_release_samples& out = merged[it.first->second];
+        out.retainOverflows += c[RRSampleRetainOverflow];
+        out.releaseUnderflows += c[RRSampleReleaseUnderflow];
+        out.sidetableRetains += c[RRSampleSidetableRetain];
+        out.sidetableReleases += c[RRSampleSidetableRelease];
+        out.autoreleases += c[RRSampleAutorelease];
+    };
+
+    for (RRSampler *s = RRSampler::all.load(std::memory_order_acquire);
+         s;
+         s = s->next)
+    {
+        for (auto& slot : s->slots) {
+            Class cls = slot.cls.load(std::memory_order_acquire);
+            if (cls) merge(cls, slot);
+        }
+        merge(Nil, s->other);
+    }
+
+    std::sort(merged, merged + used,
+              [](const objc_retain_release_samples& a,
+                 const objc_retain_release_samples& b) {
+        return totalSamples(a) > totalSamples(b);
+    });
+
+    if (outSamples) {
+        memcpy(outSamples, merged, MIN(count, used) * sizeof(*merged));
+    }
+    free(merged);
+    return used;
+}
+
+
+/***********************************************************************
+* objc_dumpRetainReleaseSamples
+* Logs the merged OBJC_SAMPLE_RETAIN_RELEASE counts, busiest class first.
+* Locking: none
+**********************************************************************/
+void
+objc_dumpRetainReleaseSamples(void)
+{
+    unsigned int count = objc_getRetainReleaseSamples(nil, 0);
+    objc_retain_release_samples *samples = (objc_retain_release_samples *)
+        calloc(count, sizeof(objc_retain_release_samples));
+    count = MIN(count, objc_getRetainReleaseSamples(samples, count));
+
+    _objc_inform("RETAIN/RELEASE SAMPLES: %u classes, period %u%s", count,
+                 objc::RetainReleaseSamplePeriod,
+                 objc::RetainReleaseSamplePeriod
+                 ? "" : " (OBJC_SAMPLE_RETAIN_RELEASE is off)");
+    for (unsigned int i = 0; i < count; i++) {
+        objc_retain_release_samples& s = samples[i];
+        _objc_inform("RETAIN/RELEASE SAMPLES: %-40s %10llu total: "
+                     "%llu retain overflows, %llu release underflows, "
+                     "%llu side table retains, %llu side table releases, "
+                     "%llu autoreleases",
+                     s.cls ? s.cls->nameForLogging() : "(other classes)",
+                     totalSamples(s), s.retainOverflows, s.releaseUnderflows,
+                     s.sidetableRetains, s.sidetableReleases, s.autoreleases);
+    }
+    free(samples);
+}
+
 /***********************************************************************
 * Slow paths for inline control
 **********************************************************************/
@@ -1681,6 +2333,7 @@ public:
 NEVER_INLINE id 
 objc_object::rootRetain_overflow(bool tryRetain)
 {
+    sampleRetainReleaseIfEnabled(this, RRSampleRetainOverflow);
     return rootRetain(tryRetain, RRVariant::Full);
 }
 
@@ -1688,6 +2341,7 @@ objc_object::rootRetain_overflow(bool tryRetain)
 NEVER_INLINE uintptr_t
 objc_object::rootRelease_underflow(bool performDealloc)
 {
+    sampleRetainReleaseIfEnabled(this, RRSampleReleaseUnderflow);
     return rootRelease(performDealloc, RRVariant::Full);
 }
 
@@ -1706,12 +2360,13 @@ objc_object::clearDeallocating_slow()
     
     // 在全局的 SideTables 中,以 this 为 key,找到对应的 SideTable 表
     SideTable& table = SideTables()[this];
+    weak_clearing_t *detached = nil;
     // 加锁
     table.lock();
     // 如果对象被弱引用
     if (isa.weakly_referenced) {
         // 在 SideTable 的 weak_table中对 this 进行清理功能
-        weak_clear_no_lock(&table.weak_table, (id)this);
+        detached = weak_detach_no_lock(&table.weak_table, (id)this);
     }
     // 如果引用计数溢出到 SideTable->refcnts 中保存
     if (isa.has_sidetable_rc) {
@@ -1720,6 +2375,13 @@ objc_object::clearDeallocating_slow()
     }
     // 解锁
     table.unlock();
+
+    if (slowpath(detached)) {
+        weak_clear_detached(detached);
+        table.lock();
+        weak_release_detached_no_lock(&table.weak_table, detached);
+        table.unlock();
+    }
 }
 
 #endif
@@ -1729,6 +2391,7 @@ id
 objc_object::rootAutorelease2()
 {
     ASSERT(!isTaggedPointer());
+    sampleRetainReleaseIfEnabled(this, RRSampleAutorelease);
     return AutoreleasePoolPage::autorelease((id)this);
 }
 
@@ -1904,16 +2567,24 @@ objc_object::sidetable_retain(bool locked)
 #if SUPPORT_NONPOINTER_ISA
     ASSERT(!isa.nonpointer);
 #endif
+    sampleRetainReleaseIfEnabled(this, RRSampleSidetableRetain);
     SideTable& table = SideTables()[this];
     
     if (!locked) table.lock();
+    sidetable_retain_nolock(table);
+    table.unlock();
+
+    return (id)this;
+}
+
+
+void
+objc_object::sidetable_retain_nolock(SideTable& table)
+{
     size_t& refcntStorage = table.refcnts[this];
     if (! (refcntStorage & SIDE_TABLE_RC_PINNED)) {
         refcntStorage += SIDE_TABLE_RC_ONE;
     }
-    table.unlock();
-
-    return (id)this;
 }
 
 
@@ -2036,11 +2707,25 @@ objc_object::sidetable_release(bool locked, bool performDealloc)
 #if SUPPORT_NONPOINTER_ISA
     ASSERT(!isa.nonpointer);
 #endif
+    sampleRetainReleaseIfEnabled(this, RRSampleSidetableRelease);
     SideTable& table = SideTables()[this];
 
+    if (!locked) table.lock();
+    bool do_dealloc = sidetable_release_nolock(table);
+    table.unlock();
+    if (do_dealloc  &&  performDealloc) {
+        ((void(*)(objc_object *, SEL))objc_msgSend)(this, @selector(dealloc));
+    }
+    return do_dealloc;
+}
+
+
+// Returns true if the object should now be deallocated.
+bool
+objc_object::sidetable_release_nolock(SideTable& table)
+{
     bool do_dealloc = false;
 
-    if (!locked) table.lock();
     auto it = table.refcnts.try_emplace(this, SIDE_TABLE_DEALLOCATING);
     auto &refcnt = it.first->second;
     if (it.second) {
@@ -2052,10 +2737,6 @@ objc_object::sidetable_release(bool locked, bool performDealloc)
     } else if (! (refcnt & SIDE_TABLE_RC_PINNED)) {
         refcnt -= SIDE_TABLE_RC_ONE;
     }
-    table.unlock();
-    if (do_dealloc  &&  performDealloc) {
-        ((void(*)(objc_object *, SEL))objc_msgSend)(this, @selector(dealloc));
-    }
     return do_dealloc;
 }
 
@@ -2073,6 +2754,7 @@ objc_object::sidetable_clearDeallocating()
     // (fixme warn or abort if extra retain count == 0 ?)
     // (fixme 如果额外保留计数== 0，则发出警告或中止 ?)
     
+    weak_clearing_t *detached = nil;
     // 加锁
     table.lock();
     // 从 refcnts 中取出 this 对应的 BucketT（由 BucketT 构建的迭代器)
@@ -2081,16 +2763,23 @@ objc_object::sidetable_clearDeallocating()
     // 如果找到了
     if (it != table.refcnts.end()) {
         // ->second 取出 ValueT，最后一位是有无弱引用的标志位
-        // 如果要释放的对象被弱引用了，通过weak_clear_no_lock函数将指向该对象的弱引用指针置为nil
+        // 如果要释放的对象被弱引用了，通过weak_detach_no_lock函数将指向该对象的弱引用指针置为nil
         if (it->second & SIDE_TABLE_WEAKLY_REFERENCED) {
             // 在 SideTable 的 weak_table中对 this 进行清理功能
-            weak_clear_no_lock(&table.weak_table, (id)this);
+            detached = weak_detach_no_lock(&table.weak_table, (id)this);
         }
         // 把 this 对应的 BucketT "移除"（标记为移除）
         table.refcnts.erase(it);
     }
     // 解锁
     table.unlock();
+
+    if (slowpath(detached)) {
+        weak_clear_detached(detached);
+        table.lock();
+        weak_release_detached_no_lock(&table.weak_table, detached);
+        table.unlock();
+    }
 }
 
 
@@ -2128,11 +2817,149 @@ objc_autorelease(id obj)
 }
 
 
+/***********************************************************************
+* objc_retainN / objc_releaseN
+* Retain or release an array of objects, RRBatchSize at a time:
+* 1. Drop nil and tagged pointers without branching and prefetch the
+*    isa of every object left.
+* 2. Objects with nonpointer isa or RR overrides take the same path
+*    as objc_retain() / objc_release(). The rest keep their retain
+*    counts only in the side tables; set them aside sorted by stripe.
+* 3. Lock each stripe once for all of its set-aside objects.
+*    Releases send -dealloc only after the stripe is unlocked.
+**********************************************************************/
+enum { RRBatchSize = 32 };
+
+// Copy the non-nil, non-tagged objects of objs[0..count) to out and
+// return how many there are.
+static ALWAYS_INLINE unsigned int
+rrBatchGather(id const *objs, size_t count, objc_object **out)
+{
+    unsigned int n = 0;
+    for (size_t i = 0; i < count; i++) {
+        objc_object *obj = objs[i];
+        out[n] = obj;
+        n += !obj->isTaggedPointerOrNil();
+    }
+    for (unsigned int i = 0; i < n; i++) {
+        __builtin_prefetch(out[i], 1);
+    }
+    return n;
+}
+
+// Insert obj into objs[0..n), which is kept sorted by stripe.
+static ALWAYS_INLINE void
+rrBatchDefer(objc_object **objs, unsigned int *stripes, unsigned int& n,
+             objc_object *obj)
+{
+    unsigned int stripe = SideTables().indexOf(obj);
+    unsigned int i = n++;
+    while (i > 0  &&  stripes[i-1] > stripe) {
+        objs[i] = objs[i-1];
+        stripes[i] = stripes[i-1];
+        i--;
+    }
+    objs[i] = obj;
+    stripes[i] = stripe;
+}
+
+void
+objc_retainN(id const *objs, size_t count)
+{
+    objc_object *batch[RRBatchSize];
+    objc_object *side[RRBatchSize];
+    unsigned int stripes[RRBatchSize];
+
+    for (size_t base = 0; base < count; base += RRBatchSize) {
+        unsigned int n = rrBatchGather(objs + base,
+                                       std::min(count - base, (size_t)RRBatchSize),
+                                       batch);
+        unsigned int sideCount = 0;
+        for (unsigned int i = 0; i < n; i++) {
+            objc_object *obj = batch[i];
+            if (slowpath(obj->sidetableRR())) {
+                // Sampled here, as in sidetable_retain, rather than
+                // under the table lock.
+                sampleRetainReleaseIfEnabled(obj, RRSampleSidetableRetain);
+                rrBatchDefer(side, stripes, sideCount, obj);
+            } else {
+                obj->retain();
+            }
+        }
+
+        for (unsigned int i = 0; i < sideCount; ) {
+            unsigned int stripe = stripes[i];
+            SideTable& table = SideTables().stripe(stripe);
+            table.lock();
+            do {
+                side[i++]->sidetable_retain_nolock(table);
+            } while (i < sideCount  &&  stripes[i] == stripe);
+            table.unlock();
+        }
+    }
+}
+
+void
+objc_releaseN(id const *objs, size_t count)
+{
+    objc_object *batch[RRBatchSize];
+    objc_object *side[RRBatchSize];
+    unsigned int stripes[RRBatchSize];
+
+    for (size_t base = 0; base < count; base += RRBatchSize) {
+        unsigned int n = rrBatchGather(objs + base,
+                                       std::min(count - base, (size_t)RRBatchSize),
+                                       batch);
+        unsigned int sideCount = 0;
+        for (unsigned int i = 0; i < n; i++) {
+            objc_object *obj = batch[i];
+            if (slowpath(obj->sidetableRR())) {
+                // Sampled here, as in sidetable_release, rather than
+                // under the table lock.
+                sampleRetainReleaseIfEnabled(obj, RRSampleSidetableRelease);
+                rrBatchDefer(side, stripes, sideCount, obj);
+            } else {
+                obj->release();
+            }
+        }
+
+        for (unsigned int i = 0; i < sideCount; ) {
+            unsigned int stripe = stripes[i];
+            unsigned int first = i;
+            SideTable& table = SideTables().stripe(stripe);
+            table.lock();
+            do {
+                // Keep only the objects that need -dealloc.
+                if (!side[i]->sidetable_release_nolock(table)) side[i] = nil;
+                i++;
+            } while (i < sideCount  &&  stripes[i] == stripe);
+            table.unlock();
+
+            for (unsigned int j = first; j < i; j++) {
+                if (side[j]) {
+                    ((void(*)(objc_object *, SEL))objc_msgSend)(side[j], @selector(dealloc));
+                }
+            }
+        }
+    }
+}
+
+
 // OBJC2
 #else
 // not OBJC2
 
 
+void objc_retainN(id const *objs, size_t count)
+{
+    for (size_t i = 0; i < count; i++) [objs[i] retain];
+}
+
+void objc_releaseN(id const *objs, size_t count)
+{
+    for (size_t i = 0; i < count; i++) [objs[i] release];
+}
+
 id objc_retain(id obj) { return [obj retain]; }
 void objc_release(id obj) { [obj release]; }
 id objc_autorelease(id obj) { return [obj autorelease]; }
@@ -2407,6 +3234,12 @@ _objc_autoreleasePoolPrint(void)
     AutoreleasePoolPage::printAll();
 }
 
+void
+objc_getAutoreleasePoolPageStatistics(objc_autorelease_pool_page_stats *outStats)
+{
+    AutoreleasePoolPage::getStatistics(outStats);
+}
+
 
 // Same as objc_release but suitable for tail-calling 
 // if you need the value back and don't want to push a frame before this point.
@@ -2494,7 +3327,8 @@ void arr_init(void)
     // 自动释放池的初始化
     AutoreleasePoolPage::init();
     // 初始化全局的 SideTablesMap表,其中有 weak 的存放
-    SideTablesMap.init();
+    // OBJC_SIDE_TABLE_STRIPES may ask for a non-default stripe count.
+    SideTablesMap.init(objc::SideTableStripeCount);
     // 关联函数相关AssociationsManager的初始化
     _objc_associations_init();
 }
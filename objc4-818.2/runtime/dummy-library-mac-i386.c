@@ -349,8 +349,20 @@ void sel_getUid(void) {}
 void sel_isEqual(void) {}
 void sel_isMapped(void) {}
 void sel_registerName(void) {}
+void class_getImpCacheStatistics(void) {}
 void objc_cache_buckets(void) {}
 void objc_cache_bytesForCapacity(void) {}
 void objc_cache_capacity(void) {}
+void objc_cache_garbageByteSize(void) {}
 void objc_cache_occupied(void) {}
 void objc_copyClassesForImage(void) {}
+void objc_dumpImpCacheStatistics(void) {}
+void objc_dumpRetainReleaseSamples(void) {}
+void objc_dumpSideTableContention(void) {}
+void objc_dumpSyncDataStatistics(void) {}
+void objc_getAutoreleasePoolPageStatistics(void) {}
+void objc_getRetainReleaseSamples(void) {}
+void objc_getSideTableContention(void) {}
+void objc_getSyncDataStatistics(void) {}
+void objc_releaseN(void) {}
+void objc_retainN(void) {}
@@ -52,6 +52,23 @@
  * that could have had access to the garbage has finished or moved past the 
  * cache lookup stage, so it is safe to free the memory.
  *
+ * Concurrent fills: lookUpImpOrForward() does not hold the lock while it 
+ * writes the new entry. cache_t::beginInsert() grows the cache if needed 
+ * and reserves one entry while the lock is held; cache_t::finishInsert() 
+ * then claims an empty bucket with a compare-and-swap after the lock is 
+ * dropped. Every insert claims buckets this way, so locked and unlocked 
+ * fillers can race on the same table. The table an unlocked filler writes 
+ * to may become garbage before it is done. 
+ *
+ * Garbage epochs: garbage is stamped with the cache epoch it was created 
+ * in, and each unlocked filler is counted against the epoch it started 
+ * in. The epoch only advances once every filler from the epoch before the 
+ * current one has finished, so garbage two epochs old can no longer be 
+ * reached by any filler. Collection frees that garbage as soon as 
+ * objc_msgSend is known to be out of it, and leaves newer garbage for the 
+ * next collection instead of giving up on all of it. Fillers never block 
+ * collection for longer than their own lock-free insert takes.
+ *
  * All functions that modify cache data or structures must acquire the 
  * cacheUpdateLock to prevent interference from concurrent modifications.
  * The function that frees cache garbage must acquire the cacheUpdateLock 
@@ -68,6 +85,8 @@
  * cache_t::eraseNolock        (caller must hold the lock)
  * cache_t::collectNolock      (caller must hold the lock)
  * cache_t::insert             (acquires lock)
+ * cache_t::beginInsert        (caller must hold the lock)
+ * cache_t::finishInsert       (lock NOT held; counted in cacheFillers[])
  * cache_t::destroy            (acquires lock)
  *
  * UNPROTECTED cache readers (NOT thread-safe; used for debug info only)
@@ -155,6 +174,14 @@ enum {
     MAX_CACHE_SIZE       = (1 << MAX_CACHE_SIZE_LOG2),
     FULL_UTILIZATION_CACHE_SIZE_LOG2 = 3,
     FULL_UTILIZATION_CACHE_SIZE = (1 << FULL_UTILIZATION_CACHE_SIZE_LOG2),
+#if CACHE_MASK_STORAGE == CACHE_MASK_STORAGE_OUTLINED
+    // OBJC_ADAPTIVE_CACHE_GROWTH may go past MAX_CACHE_SIZE for classes
+    // that keep filling it. Packed masks can't represent anything bigger.
+    ADAPTIVE_MAX_CACHE_SIZE_LOG2 = 20,
+#else
+    ADAPTIVE_MAX_CACHE_SIZE_LOG2 = MAX_CACHE_SIZE_LOG2,
+#endif
+    ADAPTIVE_MAX_CACHE_SIZE = (1 << ADAPTIVE_MAX_CACHE_SIZE_LOG2),
 };
 
 static int _collecting_in_critical(void);
@@ -373,6 +400,58 @@ void bucket_t::set(bucket_t *base, SEL newSel, IMP newImp, Class cls)
 
 #endif
 
+#if __arm64__
+
+bool bucket_t::claim(bucket_t *base, SEL newSel, IMP newImp, Class cls)
+{
+    static_assert(offsetof(bucket_t,_imp) == 0 &&
+                  offsetof(bucket_t,_sel) == sizeof(void *),
+                  "bucket_t layout doesn't match arm64 bucket_t::claim()");
+#if __LP64__
+    typedef __uint128_t pair_t;
+#else
+    typedef uint64_t pair_t;
+#endif
+    static_assert(sizeof(pair_t) == sizeof(bucket_t),
+                  "bucket_t must be two words");
+
+    // Swap imp and sel in together, as set() does with STP, so no observer
+    // sees one without the other. Empty buckets are all zero.
+    pair_t expected = 0;
+    pair_t desired = ((pair_t)(uintptr_t)newSel << (8 * sizeof(uintptr_t))) |
+        (pair_t)encodeImp(base, newImp, newSel, cls);
+    return __atomic_compare_exchange_n((pair_t *)this, &expected, desired,
+                                       false, __ATOMIC_RELAXED,
+                                       __ATOMIC_RELAXED);
+}
+
+#else
+
+bool bucket_t::claim(bucket_t *base, SEL newSel, IMP newImp, Class cls)
+{
+    // The imp word is the claim. objc_msgSend may see the new imp with a
+    // NULL sel, which is a miss; set()'s ordering argument applies from
+    // there. A filler that loses the race moves on to the next bucket.
+    uintptr_t expected = 0;
+    uintptr_t newIMP = encodeImp(base, newImp, newSel, cls);
+    if (!_imp.compare_exchange_strong(expected, newIMP,
+                                      memory_order_relaxed))
+    {
+        return false;
+    }
+#ifdef __arm__
+    mega_barrier();
+    _sel.store(newSel, memory_order_relaxed);
+#elif __x86_64__ || __i386__
+    _sel.store(newSel, memory_order_release);
+#else
+#error Don't know how to do bucket_t::claim on this architecture.
+#endif
+    return true;
+}
+
+#endif
+
 void cache_t::initializeToEmpty()
 {
     _bucketsAndMaybeMask.store((uintptr_t)&_objc_empty_cache, std::memory_order_relaxed);
@@ -779,7 +858,7 @@ void cache_t::reallocate(mask_t oldCapacity, mask_t newCapacity, bool freeOld)
 }
 
 
-void cache_t::bad_cache(id receiver, SEL sel)
+void cache_t::bad_cache(id receiver, SEL sel, bucket_t *probed, mask_t probedMask)
 {
     // Log in separate steps in case the logging itself causes a crash.
     _objc_inform_now_and_on_crash
@@ -814,6 +893,13 @@ void cache_t::bad_cache(id receiver, SEL sel)
 #else
 #error Unknown cache mask storage type.
 #endif
+    if (probed) {
+        // A concurrent fill probes the table that was current when its
+        // slot was reserved, which a flush may since have replaced.
+        _objc_inform_now_and_on_crash
+            ("probed buckets %p, mask 0x%x, %zu bytes",
+             probed, probedMask, malloc_size(probed));
+    }
     _objc_inform_now_and_on_crash
         ("selector '%s'", sel_getName(sel));
     _objc_inform_now_and_on_crash
@@ -823,28 +909,162 @@ void cache_t::bad_cache(id receiver, SEL sel)
          "invalid object, or a memory error somewhere else.");
 }
 
-void cache_t::insert(SEL sel, IMP imp, id receiver)
+/***********************************************************************
+* Per-class cache statistics.
+* Recorded for OBJC_RECORD_CACHE_STATISTICS and used by the 
+* OBJC_ADAPTIVE_CACHE_GROWTH policy. They live in a side table rather than 
+* in cache_t so the class layout doesn't change. Each class's entry is 
+* allocated once and freed by cache_t::destroy(). Unlocked fillers add 
+* their probe counts through the pointer in cache_fill_t.
+* Locking: runtimeLock must be held to find or create an entry, and for 
+* every field except probes and maxProbe.
+**********************************************************************/
+#if CONFIG_CACHE_STATISTICS
+
+struct cache_stats_t {
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t flushes;
+    uint64_t growths;
+    std::atomic<uint64_t> probes;
+    std::atomic<uint32_t> maxProbe;
+    uint32_t workingSet;
+};
+
+namespace objc {
+    static objc::LazyInitDenseMap<Class, cache_stats_t *> cacheStatistics;
+}
+
+static inline bool cacheStatisticsEnabled()
 {
-    runtimeLock.assertLocked();
+    return RecordCacheStatistics || AdaptiveCacheGrowth;
+}
 
-    // Never cache before +initialize is done
-    if (slowpath(!cls()->isInitialized())) {
-        return;
+static void recordProbes(cache_stats_t *stats, uint32_t probes)
+{
+    stats->probes.fetch_add(probes, std::memory_order_relaxed);
+    uint32_t max = stats->maxProbe.load(std::memory_order_relaxed);
+    while (probes > max  &&
+           !stats->maxProbe.compare_exchange_weak(max, probes,
+                                                  std::memory_order_relaxed))
+        ;
+}
+
+// Smallest capacity that holds workingSet entries plus one more
+// without growing, clamped to ADAPTIVE_MAX_CACHE_SIZE.
+static unsigned cacheCapacityForWorkingSet(uint32_t workingSet)
+{
+    unsigned capacity = INIT_CACHE_SIZE;
+    while (capacity < ADAPTIVE_MAX_CACHE_SIZE  &&
+           workingSet + 1 + CACHE_END_MARKER > cache_fill_ratio(capacity))
+    {
+        capacity *= 2;
     }
+    return capacity;
+}
 
-    if (isConstantOptimizedCache()) {
-        _objc_fatal("cache_t::insert() called with a preoptimized cache for %s",
-                    cls()->nameForLogging());
+#endif
+
+cache_stats_t *cache_t::stats(bool create) const
+{
+#if CONFIG_CACHE_STATISTICS
+    runtimeLock.assertLocked();
+
+    if (fastpath(!cacheStatisticsEnabled())) return nil;
+
+    auto *map = objc::cacheStatistics.get(create);
+    if (!map) return nil;
+
+    if (!create) {
+        auto it = map->find(cls());
+        return it == map->end() ? nil : it->second;
     }
 
-#if DEBUG_TASK_THREADS
-    return _collecting_in_critical();
+    auto &stats = (*map)[cls()];
+    if (!stats) stats = new cache_stats_t();
+    return stats;
 #else
-#if CONFIG_USE_CACHE_LOCK
-    mutex_locker_t lock(cacheUpdateLock);
+    return nil;
 #endif
+}
 
-    ASSERT(sel != 0 && cls()->isInitialized());
+// The cache's current contents are about to be discarded by a flush,
+// or by growth if growing is set. Only flushes count towards
+// OBJC_ADAPTIVE_CACHE_GROWTH; a class whose cache merely fills up
+// keeps the usual doubling policy.
+void cache_t::recordDiscard(__unused cache_stats_t *stats,
+                            __unused bool growing) const
+{
+#if CONFIG_CACHE_STATISTICS
+    if (fastpath(!stats)) return;
+    if (growing) stats->growths++;
+    else stats->flushes++;
+    if (occupied() > stats->workingSet) stats->workingSet = occupied();
+#endif
+}
+
+// A runtime lookup found its entry in this cache.
+void cache_t::recordHit()
+{
+#if CONFIG_CACHE_STATISTICS
+    if (auto *stats = this->stats(false)) stats->hits++;
+#endif
+}
+
+bool cache_t::copyStatisticsNolock(struct objc_imp_cache_stats *outStats) const
+{
+#if CONFIG_CACHE_STATISTICS
+    auto *stats = this->stats(false);
+    if (!stats) return false;
+
+    outStats->hits = stats->hits;
+    outStats->misses = stats->misses;
+    outStats->flushes = stats->flushes;
+    outStats->growths = stats->growths;
+    outStats->probes = stats->probes.load(std::memory_order_relaxed);
+    outStats->maxProbe = stats->maxProbe.load(std::memory_order_relaxed);
+    outStats->workingSet = stats->workingSet;
+    outStats->capacity = isConstantOptimizedCache() ? 0 : capacity();
+    return true;
+#else
+    return false;
+#endif
+}
+
+void cache_t::printStatisticsNolock()
+{
+#if CONFIG_CACHE_STATISTICS
+    runtimeLock.assertLocked();
+
+    auto *map = objc::cacheStatistics.get(false);
+    if (!map) return;
+
+    for (auto &entry : *map) {
+        Class c = entry.first;
+        objc_imp_cache_stats stats;
+        if (!c->cache.copyStatisticsNolock(&stats)) continue;
+        _objc_inform("CACHE STATISTICS: %sclass %s: %llu hits, %llu misses, "
+                     "%llu flushes, %llu growths, %.2f probes/miss (max %u), "
+                     "working set %u, capacity %u",
+                     c->isMetaClass() ? "meta" : "", c->nameForLogging(),
+                     stats.hits, stats.misses, stats.flushes, stats.growths,
+                     stats.misses ? (double)stats.probes / stats.misses : 0.0,
+                     stats.maxProbe, stats.workingSet, stats.capacity);
+    }
+#endif
+}
+
+// Make room for one more entry, growing the cache if needed, and count it
+// as occupied. Returns the table and mask the entry must be claimed in,
+// and this class's statistics if any are being recorded.
+ALWAYS_INLINE
+bucket_t *cache_t::reserve(mask_t &outMask, cache_stats_t *&outStats)
+{
+    cache_stats_t *stats = this->stats(true);
+    outStats = stats;
+#if CONFIG_CACHE_STATISTICS
+    if (slowpath(stats)) stats->misses++;
+#endif
 
     // Use the cache as-is if until we exceed our expected fill ratio.
     mask_t newOccupied = occupied() + 1;
@@ -852,6 +1072,14 @@ void cache_t::insert(SEL sel, IMP imp, id receiver)
     if (slowpath(isConstantEmptyCache())) {
         // Cache is read-only. Replace it.
         if (!capacity) capacity = INIT_CACHE_SIZE;
+#if CONFIG_CACHE_STATISTICS
+        if (slowpath(AdaptiveCacheGrowth && stats && stats->flushes >= 2)) {
+            // Flushed twice already: start out big enough to hold what
+            // this class used last time.
+            capacity = std::max(capacity,
+                                cacheCapacityForWorkingSet(stats->workingSet));
+        }
+#endif
         reallocate(oldCapacity, capacity, /* freeOld */false);
     }
     else if (fastpath(newOccupied + CACHE_END_MARKER <= cache_fill_ratio(capacity))) {
@@ -867,33 +1095,172 @@ void cache_t::insert(SEL sel, IMP imp, id receiver)
         if (capacity > MAX_CACHE_SIZE) {
             capacity = MAX_CACHE_SIZE;
         }
+        recordDiscard(stats, /* growing */true);
+#if CONFIG_CACHE_STATISTICS
+        if (slowpath(AdaptiveCacheGrowth && stats && stats->flushes >= 2)) {
+            // Grow straight to the largest working set seen instead of
+            // doubling (and dropping every entry) on the way there. A
+            // class that fills MAX_CACHE_SIZE again goes past it where
+            // the mask allows, instead of flushing and refilling forever.
+            capacity = std::max(capacity,
+                                cacheCapacityForWorkingSet(stats->workingSet));
+        }
+#endif
         reallocate(oldCapacity, capacity, true);
     }
 
-    bucket_t *b = buckets();
-    mask_t m = capacity - 1;
+    // Reserving before claiming keeps an empty slot for every filler
+    // still in flight. A filler that finds its sel already cached leaves
+    // the count one high until the next reallocate; that only makes
+    // growth slightly early.
+    incrementOccupied();
+    outMask = capacity - 1;
+    return buckets();
+}
+
+// Scan for the first unused slot and claim it, unless some other thread
+// has already cached sel. Returns false only if there is no empty slot.
+bool cache_t::claim(bucket_t *b, mask_t m, SEL sel, IMP imp,
+                    __unused cache_stats_t *stats)
+{
     mask_t begin = cache_hash(sel, m);
     mask_t i = begin;
+    uint32_t probes = 0;
+    bool ok = false;
 
-    // Scan for the first unused slot and insert there.
-    // There is guaranteed to be an empty slot.
     do {
-        if (fastpath(b[i].sel() == 0)) {
-            incrementOccupied();
-            b[i].set<Atomic, Encoded>(b, sel, imp, cls());
-            return;
+        SEL s = b[i].sel();
+        if (fastpath(s == 0)) {
+            if (fastpath(b[i].claim(b, sel, imp, cls()))) {
+                ok = true;
+                break;
+            }
+            // Lost the race for this slot. Keep looking.
         }
-        if (b[i].sel() == sel) {
+        else if (s == sel) {
             // The entry was added to the cache by some other thread
             // before we grabbed the cacheUpdateLock.
-            return;
+            ok = true;
+            break;
         }
+        probes++;
     } while (fastpath((i = cache_next(i, m)) != begin));
 
+#if CONFIG_CACHE_STATISTICS
+    if (slowpath(stats)) recordProbes(stats, probes);
+#else
+    (void)probes;
+#endif
+    return ok;
+}
+
+void cache_t::insert(SEL sel, IMP imp, id receiver)
+{
+    runtimeLock.assertLocked();
+
+    // Never cache before +initialize is done
+    if (slowpath(!cls()->isInitialized())) {
+        return;
+    }
+
+    if (isConstantOptimizedCache()) {
+        _objc_fatal("cache_t::insert() called with a preoptimized cache for %s",
+                    cls()->nameForLogging());
+    }
+
+#if DEBUG_TASK_THREADS
+    return _collecting_in_critical();
+#else
+#if CONFIG_USE_CACHE_LOCK
+    mutex_locker_t lock(cacheUpdateLock);
+#endif
+
+    ASSERT(sel != 0 && cls()->isInitialized());
+
+    mask_t m;
+    cache_stats_t *stats;
+    bucket_t *b = reserve(m, stats);
+
+    // There is guaranteed to be an empty slot.
+    if (fastpath(claim(b, m, sel, imp, stats))) return;
+
     bad_cache(receiver, (SEL)sel);
 #endif // !DEBUG_TASK_THREADS
 }
 
+
+/***********************************************************************
+* Concurrent cache fills.
+* lookUpImpOrForward() calls beginInsert() with runtimeLock held, drops
+* the lock, then calls finishInsert(). Only beginInsert() can resize the
+* cache. The entry is written into the table that was current when the
+* method lookup ran, so a flush that happens in between discards it along
+* with the old table rather than letting a stale IMP into the new one.
+**********************************************************************/
+
+// Current garbage epoch. Only changes with runtimeLock held.
+static uintptr_t cacheEpoch;
+
+// Number of threads between beginInsert() and the end of finishInsert(),
+// indexed by the parity of the epoch they started in.
+static std::atomic<unsigned> cacheFillers[2];
+
+// Returns true if fill must be completed with finishInsert() after
+// runtimeLock is dropped. Returns false if the entry was inserted
+// already, or if it should not be cached.
+bool cache_t::beginInsert(SEL sel, IMP imp, id receiver, cache_fill_t &fill)
+{
+    runtimeLock.assertLocked();
+
+#if CONFIG_USE_CACHE_LOCK  ||  DEBUG_TASK_THREADS
+    // The locked path takes cacheUpdateLock and DEBUG_TASK_THREADS 
+    // never caches; neither is worth a second path.
+    insert(sel, imp, receiver);
+    return false;
+#else
+    if (slowpath(DisableConcurrentCacheFill)) {
+        insert(sel, imp, receiver);
+        return false;
+    }
+
+    // Never cache before +initialize is done
+    if (slowpath(!cls()->isInitialized())) {
+        return false;
+    }
+
+    if (isConstantOptimizedCache()) {
+        _objc_fatal("cache_t::insert() called with a preoptimized cache for %s",
+                    cls()->nameForLogging());
+    }
+
+    ASSERT(sel != 0);
+
+    fill.buckets = reserve(fill.mask, fill.stats);
+    fill.sel = sel;
+    fill.imp = imp;
+    fill.receiver = receiver;
+
+    // Counted before runtimeLock is dropped, so garbage made from this
+    // table will be stamped with this epoch or a later one.
+    fill.epoch = cacheEpoch;
+    cacheFillers[fill.epoch & 1].fetch_add(1, std::memory_order_relaxed);
+    return true;
+#endif
+}
+
+void cache_t::finishInsert(const cache_fill_t &fill)
+{
+    runtimeLock.assertUnlocked();
+
+    bool ok = claim(fill.buckets, fill.mask, fill.sel, fill.imp, fill.stats);
+    cacheFillers[fill.epoch & 1].fetch_sub(1, std::memory_order_release);
+
+    // beginInsert() reserved a slot, so the table can't be full.
+    if (slowpath(!ok)) {
+        bad_cache(fill.receiver, fill.sel, fill.buckets, fill.mask);
+    }
+}
+
 void cache_t::copyCacheNolock(objc_imp_cache_entry *buffer, int len)
 {
 #if CONFIG_USE_CACHE_LOCK
@@ -959,6 +1326,8 @@ void cache_t::eraseNolock(const char *func)
         auto oldBuckets = buckets();
         auto buckets = emptyBucketsForCapacity(capacity);
 
+        recordDiscard(stats(false), /* growing */false);
+
         setBucketsAndMask(buckets, capacity - 1); // also clears occupied
         collect_free(oldBuckets, capacity);
     }
@@ -976,6 +1345,16 @@ void cache_t::destroy()
         if (PrintCaches) recordDeadCache(capacity());
         free(buckets());
     }
+
+#if CONFIG_CACHE_STATISTICS
+    if (auto *map = objc::cacheStatistics.get(false)) {
+        auto it = map->find(cls());
+        if (it != map->end()) {
+            delete it->second;
+            map->erase(it);
+        }
+    }
+#endif
 }
 
 
@@ -1176,8 +1555,14 @@ static size_t garbage_byte_size = 0;
 // do not empty the garbage until garbage_byte_size gets at least this big
 static size_t garbage_threshold = 32*1024;
 
+struct garbage_ref_t {
+    bucket_t *buckets;
+    mask_t capacity;
+    uintptr_t epoch;   // cacheEpoch when this became garbage
+};
+
 // table of refs to free
-static bucket_t **garbage_refs = 0;
+static garbage_ref_t *garbage_refs = 0;
 
 // current number of refs in garbage_refs
 static size_t garbage_count = 0;
@@ -1198,16 +1583,16 @@ static void _garbage_make_room(void)
     if (first)
     {
         first = 0;
-        garbage_refs = (bucket_t**)
-            malloc(INIT_GARBAGE_COUNT * sizeof(void *));
+        garbage_refs = (garbage_ref_t *)
+            malloc(INIT_GARBAGE_COUNT * sizeof(garbage_ref_t));
         garbage_max = INIT_GARBAGE_COUNT;
     }
 
     // Double the table if it is full
     else if (garbage_count == garbage_max)
     {
-        garbage_refs = (bucket_t**)
-            realloc(garbage_refs, garbage_max * 2 * sizeof(void *));
+        garbage_refs = (garbage_ref_t *)
+            realloc(garbage_refs, garbage_max * 2 * sizeof(garbage_ref_t));
         garbage_max *= 2;
     }
 }
@@ -1232,11 +1617,59 @@ void cache_t::collect_free(bucket_t *data, mask_t capacity)
 
     _garbage_make_room ();
     garbage_byte_size += cache_t::bytesForCapacity(capacity);
-    garbage_refs[garbage_count++] = data;
+    garbage_refs[garbage_count++] = { data, capacity, cacheEpoch };
     cache_t::collectNolock(false);
 }
 
 
+/***********************************************************************
+* _garbage_advance_epoch.  Start a new garbage epoch if every unlocked 
+* filler that started before the current epoch has finished. 
+* Returns the current epoch. Garbage stamped at least two epochs before 
+* it is unreachable from unlocked fillers.
+* wait: wait until the epoch can be advanced.
+* A waiter spins with a CPU pause hint for GARBAGE_EPOCH_SPINS rounds, 
+* then depresses its priority for 1 ms at a time so a preempted filler 
+* can run. An older filler holds no locks and does no more than one 
+* claim() probe of at most mask+1 buckets, so the wait is bounded by 
+* that probe plus however long the scheduler keeps the filler off-core; 
+* in practice that is a few microseconds, or one depress interval when 
+* the filler was preempted.
+* Cache locks: cacheUpdateLock must be held by the caller.
+**********************************************************************/
+#define GARBAGE_EPOCH_SPINS 128
+
+static uintptr_t _garbage_advance_epoch(bool wait)
+{
+#if CONFIG_USE_CACHE_LOCK
+    cacheUpdateLock.assertLocked();
+#else
+    runtimeLock.assertLocked();
+#endif
+
+    // New fillers only join cacheFillers[cacheEpoch & 1], so the other 
+    // counter only goes down.
+    auto &older = cacheFillers[(cacheEpoch + 1) & 1];
+    unsigned spins = 0;
+    while (older.load(std::memory_order_acquire) != 0) {
+        if (!wait) return cacheEpoch;
+        if (spins < GARBAGE_EPOCH_SPINS) {
+            spins++;
+#if __x86_64__  ||  __i386__
+            __builtin_ia32_pause();
+#elif __arm64__  ||  __arm__
+            __builtin_arm_yield();
+#endif
+        } else {
+            // runtimeLock is held, so don't sleep on anything the filler
+            // might need; just get out of its way.
+            thread_switch(MACH_PORT_NULL, SWITCH_OPTION_DEPRESS, 1);
+        }
+    }
+    return ++cacheEpoch;
+}
+
+
 /***********************************************************************
 * cache_collect.  Try to free accumulated dead caches.
 * collectALot tries harder to free memory.
@@ -1255,6 +1688,20 @@ void cache_t::collectNolock(bool collectALot)
         return;
     }
 
+    // Retire unlocked fillers. Garbage is safe from them two epochs on,
+    // so try to advance twice. collectALot waits for them instead.
+    uintptr_t epoch = _garbage_advance_epoch(collectALot);
+    epoch = _garbage_advance_epoch(collectALot);
+
+    if (garbage_count > 0  &&  garbage_refs[0].epoch + 2 > epoch) {
+        // The oldest garbage may still be in use by an unlocked filler.
+        if (PrintCaches) {
+            _objc_inform ("CACHES: not collecting; "
+                          "cache fills in progress");
+        }
+        return;
+    }
+
     // Synchronize collection with objc_msgSend and other cache readers
     if (!collectALot) {
         if (_collecting_in_critical ()) {
@@ -1273,25 +1720,32 @@ void cache_t::collectNolock(bool collectALot)
             ;
     }
 
-    // No cache readers in progress - garbage is now deletable
+    // No cache readers in progress - garbage older than two epochs
+    // is now deletable
 
     // Log our progress
     if (PrintCaches) {
         cache_collections++;
-        _objc_inform ("CACHES: COLLECTING %zu bytes (%zu allocations, %zu collections)", garbage_byte_size, cache_allocations, cache_collections);
+        _objc_inform ("CACHES: COLLECTING %zu bytes (%zu allocations, %zu collections, epoch %lu)", garbage_byte_size, cache_allocations, cache_collections, (unsigned long)epoch);
     }
     
-    // Dispose all refs now in the garbage
+    // Dispose all refs old enough, keeping the rest in order.
     // Erase each entry so debugging tools don't see stale pointers.
-    while (garbage_count--) {
-        auto dead = garbage_refs[garbage_count];
-        garbage_refs[garbage_count] = nil;
-        free(dead);
+    size_t kept = 0;
+    for (size_t i = 0; i < garbage_count; i++) {
+        auto dead = garbage_refs[i];
+        garbage_refs[i] = {};
+        if (dead.epoch + 2 <= epoch) {
+            garbage_byte_size -= cache_t::bytesForCapacity(dead.capacity);
+            free(dead.buckets);
+        } else {
+            garbage_refs[kept++] = dead;
+        }
     }
     
-    // Clear the garbage count and total size indicator
-    garbage_count = 0;
-    garbage_byte_size = 0;
+    // Update the garbage count; garbage_byte_size now counts only the
+    // refs that were kept
+    garbage_count = kept;
 
     if (PrintCaches) {
         size_t i;
@@ -1575,5 +2029,10 @@ OBJC_EXPORT unsigned objc_cache_capacity(const struct cache_t * _Nonnull cache)
     return cache->capacity();
 }
 
+OBJC_EXPORT size_t objc_cache_garbageByteSize(void) {
+    mutex_locker_t lock(runtimeLock);
+    return garbage_byte_size;
+}
+
 // __OBJC2__
 #endif
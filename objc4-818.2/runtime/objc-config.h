@@ -208,6 +208,15 @@
 // the cache lock would need to be used again
 #define CONFIG_USE_CACHE_LOCK 0
 
+// Define CONFIG_CACHE_STATISTICS to support per-class method cache 
+// counters (OBJC_RECORD_CACHE_STATISTICS) and the adaptive cache growth 
+// policy that uses them (OBJC_ADAPTIVE_CACHE_GROWTH). Either option must 
+// still be set at launch for anything to be recorded.
+// Build with -DCONFIG_CACHE_STATISTICS=0 to compile all of it out.
+#ifndef CONFIG_CACHE_STATISTICS
+#   define CONFIG_CACHE_STATISTICS 1
+#endif
+
 // Determine how the method cache stores IMPs.
 #define CACHE_IMP_ENCODING_NONE 1 // Method cache contains raw IMP.
 #define CACHE_IMP_ENCODING_ISA_XOR 2 // Method cache contains ISA ^ IMP.
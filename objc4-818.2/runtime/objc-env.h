@@ -37,6 +37,9 @@ OPTION( DebugPoolAllocation,      OBJC_DEBUG_POOL_ALLOCATION,      "halt when au
 OPTION( DebugDuplicateClasses,    OBJC_DEBUG_DUPLICATE_CLASSES,    "halt when multiple classes with the same name are present")
 OPTION( DebugDontCrash,           OBJC_DEBUG_DONT_CRASH,           "halt the process by exiting instead of crashing")
 OPTION( DebugPoolDepth,           OBJC_DEBUG_POOL_DEPTH,           "log fault when at least a set number of autorelease pages has been allocated")
+OPTION( PoolPageCache,            OBJC_POOL_PAGE_CACHE,            "keep up to this many empty autorelease pool pages per thread after a pop instead of the default 1")
+OPTION( PoolHugePages,            OBJC_POOL_HUGE_PAGES,            "map autorelease pool page slabs with 2 MiB superpages where supported")
+OPTION( PoolFreePages,            OBJC_POOL_FREE_PAGES,            "keep up to this many freed autorelease pool pages on the free list instead of the default 256, and return each slab whose pages are all freed to the system")
 
 OPTION( DisableVtables,           OBJC_DISABLE_VTABLES,            "disable vtable dispatch")
 OPTION( DisablePreopt,            OBJC_DISABLE_PREOPTIMIZATION,    "disable preoptimization courtesy of dyld shared cache")
@@ -46,5 +49,16 @@ OPTION( DisableNonpointerIsa,     OBJC_DISABLE_NONPOINTER_ISA,     "disable non-
 OPTION( DisableInitializeForkSafety, OBJC_DISABLE_INITIALIZE_FORK_SAFETY, "disable safety checks for +initialize after fork")
 OPTION( DisableFaults,            OBJC_DISABLE_FAULTS,             "disable os faults")
 OPTION( DisablePreoptCaches,      OBJC_DISABLE_PREOPTIMIZED_CACHES, "disable preoptimized caches")
+OPTION( DisableConcurrentCacheFill, OBJC_DISABLE_CONCURRENT_CACHE_FILL, "fill method caches only while holding the runtime lock")
+
+OPTION( RecordCacheStatistics,    OBJC_RECORD_CACHE_STATISTICS,    "record per-class method cache hits, misses, flushes and probe lengths")
+OPTION( AdaptiveCacheGrowth,      OBJC_ADAPTIVE_CACHE_GROWTH,      "size method caches from their observed working sets after the second flush")
+OPTION( MethodIndex,              OBJC_METHOD_INDEX,               "look methods up in a per-class index of the whole superclass chain once a class keeps missing its cache")
+OPTION( ReadImagesThreads,        OBJC_READ_IMAGES_THREADS,        "hash the selector references of images outside the shared cache on this many threads while reading them")
+OPTION( SideTableStripes,         OBJC_SIDE_TABLE_STRIPES,         "use this many side table stripes instead of the default (a power of two, 2 to 4096)")
+OPTION( ProfileSideTables,        OBJC_PROFILE_SIDE_TABLES,        "count side table lock acquisitions and contention per stripe")
+OPTION( SampleRetainRelease,      OBJC_SAMPLE_RETAIN_RELEASE,      "count every Nth retain count overflow, underflow, side table retain or release, and autorelease per class on each thread")
 OPTION( DisableAutoreleaseCoalescing, OBJC_DISABLE_AUTORELEASE_COALESCING, "disable coalescing of autorelease pool pointers")
 OPTION( DisableAutoreleaseCoalescingLRU, OBJC_DISABLE_AUTORELEASE_COALESCING_LRU, "disable coalescing of autorelease pool pointers using look back N strategy")
+OPTION( CoalescingWindow,         OBJC_AUTORELEASE_COALESCING_WINDOW, "look back this many autorelease pool entries for coalescing instead of the default 4 (1 to 8)")
+OPTION( RecordAutoreleaseCoalescing, OBJC_RECORD_AUTORELEASE_COALESCING, "count autoreleases and how many were coalesced into an existing pool entry")
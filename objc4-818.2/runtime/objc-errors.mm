@@ -27,7 +27,31 @@
 
 #include "objc-private.h"
 
-#if TARGET_OS_WIN32
+#if OBJC_HOST_BUILD
+
+void _objc_inform(const char *fmt, ...)
+{
+    va_list ap;
+    va_start(ap, fmt);
+    fprintf(stderr, "objc[%d]: ", getpid());
+    vfprintf(stderr, fmt, ap);
+    fputc('\n', stderr);
+    va_end(ap);
+}
+
+void _objc_fatal(const char *fmt, ...)
+{
+    va_list ap;
+    va_start(ap, fmt);
+    fprintf(stderr, "objc[%d]: ", getpid());
+    vfprintf(stderr, fmt, ap);
+    fputc('\n', stderr);
+    va_end(ap);
+
+    abort();
+}
+
+#elif TARGET_OS_WIN32
 
 #include <conio.h>
 
@@ -288,6 +312,8 @@ void _objc_inform_now_and_on_crash(const char *fmt, ...)
 #endif
 
 
+#if !OBJC_HOST_BUILD
+
 BREAKPOINT_FUNCTION( 
     void _objc_warn_deprecated(void)
 );
@@ -303,3 +329,5 @@ void _objc_inform_deprecated(const char *oldf, const char *newf)
     }
     _objc_warn_deprecated();
 }
+
+#endif
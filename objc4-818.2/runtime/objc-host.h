@@ -0,0 +1,99 @@
+/*
+ * Copyright (c) 2021 Apple Inc.  All Rights Reserved.
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ *
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this
+ * file.
+ *
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ *
+ * @APPLE_LICENSE_HEADER_END@
+ */
+
+/***********************************************************************
+* objc-host.h
+* Host-portable subset of objc-private.h.
+*
+* OBJC_HOST_BUILD compiles the runtime's self-contained data structures
+* (objc::DenseMap, StripedMap, weak_table_t) on hosts without dyld,
+* Mach or libplatform so they can be benchmarked and regression-tested
+* there. See hostbench/ and CMakeLists.txt.
+*
+* objc_object here is a stand-in: an isa word and nothing else. Host
+* objects are never tagged, never deallocating, and their classes never
+* have custom retain/release.
+**********************************************************************/
+
+#ifndef _OBJC_HOST_H_
+#define _OBJC_HOST_H_
+
+#if !OBJC_HOST_BUILD
+#error objc-host.h is only for OBJC_HOST_BUILD
+#endif
+
+#include <cstddef>  // for nullptr_t
+#include <stdint.h>
+#include <assert.h>
+
+#ifdef NDEBUG
+#define ASSERT(x) (void)sizeof(!(x))
+#else
+#define ASSERT(x) assert(x)
+#endif
+
+#define ASSERT_THIS_NOT_NULL ASSERT(this)
+
+struct objc_class;
+struct objc_object;
+
+typedef struct objc_class *Class;
+typedef struct objc_object *id;
+
+#include "objc-os.h"
+
+struct objc_object {
+    Class isa;
+
+    Class ISA(bool authenticated = false);
+    Class getIsa() { return ISA(); }
+
+    bool isTaggedPointer() { return false; }
+    bool isTaggedPointerOrNil();
+
+    bool rootIsDeallocating() { return false; }
+};
+
+struct objc_class : objc_object {
+    bool hasCustomRR() { return false; }
+};
+
+inline Class objc_object::ISA(bool) { return isa; }
+
+static inline bool _objc_isTaggedPointerOrNil(const void *ptr) { return !ptr; }
+
+inline bool objc_object::isTaggedPointerOrNil() {
+    return _objc_isTaggedPointerOrNil(this);
+}
+
+static inline const char *object_getClassName(id obj __unused) {
+    return "<host object>";
+}
+
+__BEGIN_DECLS
+
+extern void _objc_inform(const char *fmt, ...) __attribute__((cold, format(printf, 1, 2)));
+
+__END_DECLS
+
+#endif /* _OBJC_HOST_H_ */
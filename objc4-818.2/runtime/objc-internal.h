@@ -183,6 +183,101 @@ objc_imp_cache_entry *_Nullable
 class_copyImpCache(Class _Nonnull cls, int * _Nullable outCount)
     OBJC_AVAILABLE(10.15, 13.0, 13.0, 6.0, 5.0);
 
+// Method cache counters recorded when OBJC_RECORD_CACHE_STATISTICS or
+// OBJC_ADAPTIVE_CACHE_GROWTH is set. Hits only count cache lookups made
+// by the runtime's own method lookup, not objc_msgSend's.
+typedef struct objc_imp_cache_stats {
+    uint64_t hits;
+    uint64_t misses;        // entries filled
+    uint64_t flushes;       // times a non-empty cache was flushed
+    uint64_t growths;       // times a full cache was replaced by a larger one
+    uint64_t probes;        // buckets scanned past the first, over all fills
+    uint32_t maxProbe;      // longest single scan past the first bucket
+    uint32_t workingSet;    // most entries in the cache when it was flushed or grown
+    uint32_t capacity;
+} objc_imp_cache_stats;
+
+// Returns false if nothing has been recorded for cls.
+OBJC_EXPORT
+bool
+class_getImpCacheStatistics(Class _Nonnull cls,
+                            objc_imp_cache_stats * _Nonnull outStats)
+    OBJC_AVAILABLE(12.0, 15.0, 15.0, 8.0, 6.0);
+
+// Logs the counters for every class with any recorded.
+OBJC_EXPORT
+void
+objc_dumpImpCacheStatistics(void)
+    OBJC_AVAILABLE(12.0, 15.0, 15.0, 8.0, 6.0);
+
+// Side table lock counters recorded when OBJC_PROFILE_SIDE_TABLES is set.
+typedef struct objc_side_table_contention {
+    uint64_t acquires;
+    uint64_t contended;     // acquisitions that found the lock held
+} objc_side_table_contention;
+
+// Copies the counters of up to count stripes and returns the number
+// of stripes. Pass NULL to get only the number of stripes.
+OBJC_EXPORT
+unsigned int
+objc_getSideTableContention(objc_side_table_contention * _Nullable outStripes,
+                            unsigned int count)
+    OBJC_AVAILABLE(12.0, 15.0, 15.0, 8.0, 6.0);
+
+// Logs the counters of every stripe that has been locked.
+OBJC_EXPORT
+void
+objc_dumpSideTableContention(void)
+    OBJC_AVAILABLE(12.0, 15.0, 15.0, 8.0, 6.0);
+
+// Retain count events of one class sampled when OBJC_SAMPLE_RETAIN_RELEASE
+// is set. Each count is the number of samples times the sampling period.
+typedef struct objc_retain_release_samples {
+    Class _Nullable cls;        // Nil for classes that found a thread's table full
+    uint64_t retainOverflows;   // inline retain count spilled to the side table
+    uint64_t releaseUnderflows; // inline retain count refilled from the side table
+    uint64_t sidetableRetains;  // retains of objects without nonpointer isa
+    uint64_t sidetableReleases; // releases of objects without nonpointer isa
+    uint64_t autoreleases;      // objects added to an autorelease pool
+} objc_retain_release_samples;
+
+// Merges every thread's samples, copies up to count classes busiest
+// first, and returns the number of classes. Pass NULL to get only the
+// number of classes.
+OBJC_EXPORT
+unsigned int
+objc_getRetainReleaseSamples(objc_retain_release_samples * _Nullable outSamples,
+                             unsigned int count)
+    OBJC_AVAILABLE(12.0, 15.0, 15.0, 8.0, 6.0);
+
+// Logs the merged samples, busiest class first.
+OBJC_EXPORT
+void
+objc_dumpRetainReleaseSamples(void)
+    OBJC_AVAILABLE(12.0, 15.0, 15.0, 8.0, 6.0);
+
+// @synchronized lock records in one stripe of the SyncData lists.
+typedef struct objc_sync_data_stats {
+    uint32_t live;          // records on the list
+    uint32_t idle;          // live records no thread is using
+    uint64_t reused;        // idle records handed to another object
+    uint64_t reclaimed;     // idle records freed
+} objc_sync_data_stats;
+
+// Copies the counters of up to count stripes and returns the number
+// of stripes. Pass NULL to get only the number of stripes.
+OBJC_EXPORT
+unsigned int
+objc_getSyncDataStatistics(objc_sync_data_stats * _Nullable outStripes,
+                           unsigned int count)
+    OBJC_AVAILABLE(12.0, 15.0, 15.0, 8.0, 6.0);
+
+// Logs the counters of every stripe that has allocated a record.
+OBJC_EXPORT
+void
+objc_dumpSyncDataStatistics(void)
+    OBJC_AVAILABLE(12.0, 15.0, 15.0, 8.0, 6.0);
+
 OBJC_EXPORT
 unsigned long
 sel_hash(SEL _Nullable sel)
@@ -932,6 +1027,18 @@ objc_autorelease(id _Nullable obj)
     __asm__("_objc_autorelease")
     OBJC_AVAILABLE(10.7, 5.0, 9.0, 1.0, 2.0);
 
+// Retain or release each of count objects, as a loop calling
+// objc_retain() or objc_release() would. nil and tagged pointers
+// are skipped. Objects whose counts live in the side tables are
+// grouped so that each side table is locked once per batch.
+OBJC_EXPORT void
+objc_retainN(id _Nullable const * _Nonnull objs, size_t count)
+    OBJC_AVAILABLE(12.0, 15.0, 15.0, 8.0, 6.0);
+
+OBJC_EXPORT void
+objc_releaseN(id _Nullable const * _Nonnull objs, size_t count)
+    OBJC_AVAILABLE(12.0, 15.0, 15.0, 8.0, 6.0);
+
 // Prepare a value at +1 for return through a +0 autoreleasing convention.
 OBJC_EXPORT id _Nullable
 objc_autoreleaseReturnValue(id _Nullable obj)
@@ -1004,6 +1111,24 @@ OBJC_EXPORT void
 _objc_autoreleasePoolPrint(void)
     OBJC_AVAILABLE(10.7, 5.0, 9.0, 1.0, 2.0);
 
+// Autorelease pool page counters, for the whole process.
+typedef struct objc_autorelease_pool_page_stats {
+    uint64_t allocated;     // pages handed out by the page allocator
+    uint64_t recycled;      // of those, pages that had been freed before
+    uint64_t reused;        // spare pages reused by the thread that kept them
+    uint64_t bytesHeld;     // slab memory in use or kept, less slabs returned
+    uint64_t freePages;     // freed pages kept for reuse
+    uint64_t returned;      // freed pages returned to the system by slab
+    // Recorded only when OBJC_RECORD_AUTORELEASE_COALESCING is set.
+    uint64_t autoreleases;  // objects added to a pool
+    uint64_t coalesced;     // of those, merged into an existing entry
+    uint64_t bytesSaved;    // pool entries not used thanks to coalescing
+} objc_autorelease_pool_page_stats;
+
+OBJC_EXPORT void
+objc_getAutoreleasePoolPageStatistics(objc_autorelease_pool_page_stats * _Nonnull outStats)
+    OBJC_AVAILABLE(12.0, 15.0, 15.0, 8.0, 6.0);
+
 OBJC_EXPORT BOOL
 objc_should_deallocate(id _Nonnull object)
     OBJC_AVAILABLE(10.7, 5.0, 9.0, 1.0, 2.0);
@@ -1226,6 +1351,7 @@ OBJC_EXPORT struct bucket_t * _Nonnull objc_cache_buckets(const struct cache_t *
 OBJC_EXPORT size_t objc_cache_bytesForCapacity(uint32_t cap);
 OBJC_EXPORT uint32_t objc_cache_occupied(const struct cache_t * _Nonnull cache);
 OBJC_EXPORT unsigned objc_cache_capacity(const struct cache_t * _Nonnull cache);
+OBJC_EXPORT size_t objc_cache_garbageByteSize(void);
 
 #if CONFIG_USE_PREOPT_CACHES
 
@@ -34,5 +34,6 @@
 
 extern mutex_t runtimeLock;
 extern mutex_t DemangleCacheLock;
+extern StripedMap<spinlock_t> MethodListFixupLocks;
 
 #endif
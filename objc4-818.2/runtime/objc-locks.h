@@ -44,7 +44,7 @@ extern recursive_mutex_t loadMethodLock;
 extern mutex_t crashlog_lock;
 extern spinlock_t objcMsgLogLock;
 extern mutex_t AltHandlerDebugLock;
-extern mutex_t AssociationsManagerLock;
+extern mutex_t PoolPageLock;
 extern StripedMap<spinlock_t> PropertyLocks;
 extern StripedMap<spinlock_t> StructLocks;
 extern StripedMap<spinlock_t> CppObjectLocks;
@@ -59,6 +59,16 @@ extern void SideTableLocksSucceedLock(const void *oldlock);
 extern void SideTableLocksPrecedeLocks(StripedMap<spinlock_t>& newlocks);
 extern void SideTableLocksSucceedLocks(StripedMap<spinlock_t>& oldlocks);
 
+// Associated object locks are striped by object, in objc-references.mm.
+extern void AssociationsLockAll();
+extern void AssociationsUnlockAll();
+extern void AssociationsForceResetAll();
+extern void AssociationsDefineLockOrder();
+extern void AssociationsLocksPrecedeLock(const void *newlock);
+extern void AssociationsLocksSucceedLock(const void *oldlock);
+extern void AssociationsLocksSucceedLocks(StripedMap<spinlock_t>& oldlocks);
+extern void AssociationsLocksPrecedeSideTableLocks();
+
 #if __OBJC2__
 #include "objc-locks-new.h"
 #else
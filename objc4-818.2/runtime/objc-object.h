@@ -980,6 +980,20 @@ objc_object::rootRetainCount()
 }
 
 
+// True if retain and release would go straight to sidetable_retain
+// and sidetable_release: a raw isa, no RR override, and not a class.
+inline bool
+objc_object::sidetableRR()
+{
+    ASSERT(!isTaggedPointer());
+
+    isa_t bits = __c11_atomic_load((_Atomic uintptr_t *)&isa.bits, __ATOMIC_RELAXED);
+    if (bits.nonpointer) return false;
+    Class cls = bits.getDecodedClass(false);
+    return !cls->hasCustomRR()  &&  !cls->isMetaClass();
+}
+
+
 // SUPPORT_NONPOINTER_ISA
 #else
 // not SUPPORT_NONPOINTER_ISA
@@ -1248,6 +1262,14 @@ objc_object::rootRetainCount()
 }
 
 
+inline bool
+objc_object::sidetableRR()
+{
+    ASSERT(!isTaggedPointer());
+    return !ISA()->hasCustomRR();
+}
+
+
 // not SUPPORT_NONPOINTER_ISA
 #endif
 
@@ -103,7 +103,104 @@ static inline uintptr_t mask16ShiftBits(uint16_t mask)
 }
 }
 
-#if TARGET_OS_MAC
+#if OBJC_HOST_BUILD
+
+// Host-portable build of the runtime's data structures (see hostbench/).
+// Only the locks, TLS and allocation primitives those structures need
+// are provided; nothing here talks to dyld or Mach.
+
+#   include <stdio.h>
+#   include <stdlib.h>
+#   include <stdint.h>
+#   include <stdarg.h>
+#   include <string.h>
+#   include <strings.h>
+#   include <errno.h>
+#   include <assert.h>
+#   include <limits.h>
+#   include <unistd.h>
+#   include <pthread.h>
+#   include <malloc.h>
+#   include <time.h>
+#   include <sys/cdefs.h>
+#   include <sys/param.h>
+#   include <sys/mman.h>
+
+#   ifndef __unused
+#       define __unused __attribute__((unused))
+#   endif
+
+#define ALWAYS_INLINE inline __attribute__((always_inline))
+#define NEVER_INLINE __attribute__((noinline))
+
+#define fastpath(x) (__builtin_expect(bool(x), 1))
+#define slowpath(x) (__builtin_expect(bool(x), 0))
+
+
+static ALWAYS_INLINE uintptr_t
+addc(uintptr_t lhs, uintptr_t rhs, uintptr_t carryin, uintptr_t *carryout)
+{
+    uintptr_t sum;
+    bool c1 = __builtin_add_overflow(lhs, rhs, &sum);
+    bool c2 = __builtin_add_overflow(sum, carryin, &sum);
+    *carryout = c1 | c2;
+    return sum;
+}
+
+static ALWAYS_INLINE uintptr_t
+subc(uintptr_t lhs, uintptr_t rhs, uintptr_t carryin, uintptr_t *carryout)
+{
+    uintptr_t diff;
+    bool c1 = __builtin_sub_overflow(lhs, rhs, &diff);
+    bool c2 = __builtin_sub_overflow(diff, carryin, &diff);
+    *carryout = c1 | c2;
+    return diff;
+}
+
+static ALWAYS_INLINE
+uintptr_t
+LoadExclusive(uintptr_t *src)
+{
+    return __atomic_load_n(src, __ATOMIC_RELAXED);
+}
+
+static ALWAYS_INLINE
+bool
+StoreExclusive(uintptr_t *dst, uintptr_t *oldvalue, uintptr_t value)
+{
+    return __atomic_compare_exchange_n(dst, oldvalue, value, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED);
+}
+
+static ALWAYS_INLINE
+bool
+StoreReleaseExclusive(uintptr_t *dst, uintptr_t *oldvalue, uintptr_t value)
+{
+    return __atomic_compare_exchange_n(dst, oldvalue, value, true, __ATOMIC_RELEASE, __ATOMIC_RELAXED);
+}
+
+static ALWAYS_INLINE
+void
+ClearExclusive(uintptr_t *dst __unused)
+{
+}
+
+#   if __cplusplus
+#       include <vector>
+#       include <algorithm>
+#       include <functional>
+        using namespace std;
+#   endif
+
+#   define PRIVATE_EXTERN __attribute__((visibility("hidden")))
+
+/* Use this for functions that are intended to be breakpoint hooks.
+   If you do not, the compiler may optimize them away.
+   BREAKPOINT_FUNCTION( void stop_on_error(void) ); */
+#   define BREAKPOINT_FUNCTION(prototype)                             \
+    OBJC_EXTERN __attribute__((noinline, used, visibility("hidden"))) \
+    prototype { asm(""); }
+
+#elif TARGET_OS_MAC
 
 #   define OS_UNFAIR_LOCK_INLINE 1
 
@@ -379,7 +476,231 @@ extern void _objc_fatal_with_reason(uint64_t reason, uint64_t flags,
 #endif
 
 
-#if TARGET_OS_WIN32
+#if OBJC_HOST_BUILD
+
+// OS compatibility
+
+static inline uint64_t nanoseconds() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC_RAW, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+static inline size_t malloc_size(const void *p) {
+    return malloc_usable_size((void *)p);
+}
+
+// Nothing is mapped read-only on the host, so strdupIfMutable() always copies.
+static inline bool _dyld_is_memory_immutable(const void *, size_t) {
+    return false;
+}
+
+// Internal data types
+
+typedef pthread_t objc_thread_t;
+
+static __inline int thread_equal(objc_thread_t t1, objc_thread_t t2) {
+    return pthread_equal(t1, t2);
+}
+
+__attribute__((const))
+static inline pthread_t objc_thread_self()
+{
+    return pthread_self();
+}
+
+typedef pthread_key_t tls_key_t;
+
+static inline tls_key_t tls_create(void (*dtor)(void*)) {
+    tls_key_t k;
+    pthread_key_create(&k, dtor);
+    return k;
+}
+static inline void *tls_get(tls_key_t k) {
+    return pthread_getspecific(k);
+}
+static inline void tls_set(tls_key_t k, void *value) {
+    pthread_setspecific(k, value);
+}
+
+
+template <bool Debug> class mutex_tt;
+template <bool Debug> class monitor_tt;
+template <bool Debug> class recursive_mutex_tt;
+
+// objc-lockdebug.mm is not part of the host build.
+#define LOCKDEBUG 0
+
+using spinlock_t = mutex_tt<LOCKDEBUG>;
+using mutex_t = mutex_tt<LOCKDEBUG>;
+using monitor_t = monitor_tt<LOCKDEBUG>;
+using recursive_mutex_t = recursive_mutex_tt<LOCKDEBUG>;
+
+struct fork_unsafe_lock_t {
+    constexpr fork_unsafe_lock_t() = default;
+};
+constexpr fork_unsafe_lock_t fork_unsafe_lock;
+
+#include "objc-lockdebug.h"
+
+// os_unfair_lock is a futex-style lock with adaptive spinning;
+// glibc's default pthread mutex is the closest host equivalent.
+template <bool Debug>
+class mutex_tt : nocopy_t {
+    pthread_mutex_t mLock;
+ public:
+    constexpr mutex_tt() : mLock(PTHREAD_MUTEX_INITIALIZER) { }
+
+    constexpr mutex_tt(__unused const fork_unsafe_lock_t unsafe) : mLock(PTHREAD_MUTEX_INITIALIZER) { }
+
+    void lock() {
+        pthread_mutex_lock(&mLock);
+    }
+
+    bool tryLock() {
+        return pthread_mutex_trylock(&mLock) == 0;
+    }
+
+    void unlock() {
+        pthread_mutex_unlock(&mLock);
+    }
+
+    void forceReset() {
+        mLock = pthread_mutex_t PTHREAD_MUTEX_INITIALIZER;
+    }
+
+    void assertLocked() { }
+
+    void assertUnlocked() { }
+
+
+    // Address-ordered lock discipline for a pair of locks.
+
+    static void lockTwo(mutex_tt *lock1, mutex_tt *lock2) {
+        if ((uintptr_t)lock1 < (uintptr_t)lock2) {
+            lock1->lock();
+            lock2->lock();
+        } else {
+            lock2->lock();
+            if (lock2 != lock1) lock1->lock();
+        }
+    }
+
+    static void unlockTwo(mutex_tt *lock1, mutex_tt *lock2) {
+        lock1->unlock();
+        if (lock2 != lock1) lock2->unlock();
+    }
+
+    // Scoped lock and unlock
+    class locker : nocopy_t {
+        mutex_tt& lock;
+    public:
+        locker(mutex_tt& newLock)
+            : lock(newLock) { lock.lock(); }
+        ~locker() { lock.unlock(); }
+    };
+
+    // Either scoped lock and unlock, or NOP.
+    class conditional_locker : nocopy_t {
+        mutex_tt& lock;
+        bool didLock;
+    public:
+        conditional_locker(mutex_tt& newLock, bool shouldLock)
+            : lock(newLock), didLock(shouldLock)
+        {
+            if (shouldLock) lock.lock();
+        }
+        ~conditional_locker() { if (didLock) lock.unlock(); }
+    };
+};
+
+using mutex_locker_t = mutex_tt<LOCKDEBUG>::locker;
+using conditional_mutex_locker_t = mutex_tt<LOCKDEBUG>::conditional_locker;
+
+
+template <bool Debug>
+class recursive_mutex_tt : nocopy_t {
+    pthread_mutex_t mLock;
+
+  public:
+    constexpr recursive_mutex_tt()
+        : mLock(PTHREAD_RECURSIVE_MUTEX_INITIALIZER_NP) { }
+
+    constexpr recursive_mutex_tt(__unused const fork_unsafe_lock_t unsafe)
+        : mLock(PTHREAD_RECURSIVE_MUTEX_INITIALIZER_NP) { }
+
+    void lock() { pthread_mutex_lock(&mLock); }
+
+    void unlock() { pthread_mutex_unlock(&mLock); }
+
+    void forceReset() {
+        mLock = pthread_mutex_t PTHREAD_RECURSIVE_MUTEX_INITIALIZER_NP;
+    }
+
+    bool tryLock() { return pthread_mutex_trylock(&mLock) == 0; }
+
+    bool tryUnlock() { return pthread_mutex_unlock(&mLock) == 0; }
+
+    void assertLocked() { }
+
+    void assertUnlocked() { }
+};
+
+
+template <bool Debug>
+class monitor_tt {
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+
+  public:
+    constexpr monitor_tt()
+        : mutex(PTHREAD_MUTEX_INITIALIZER), cond(PTHREAD_COND_INITIALIZER) { }
+
+    monitor_tt(__unused const fork_unsafe_lock_t unsafe)
+        : mutex(PTHREAD_MUTEX_INITIALIZER), cond(PTHREAD_COND_INITIALIZER) { }
+
+    void enter()
+    {
+        int err = pthread_mutex_lock(&mutex);
+        if (err) _objc_fatal("pthread_mutex_lock failed (%d)", err);
+    }
+
+    void leave()
+    {
+        int err = pthread_mutex_unlock(&mutex);
+        if (err) _objc_fatal("pthread_mutex_unlock failed (%d)", err);
+    }
+
+    void wait()
+    {
+        int err = pthread_cond_wait(&cond, &mutex);
+        if (err) _objc_fatal("pthread_cond_wait failed (%d)", err);
+    }
+
+    void notify()
+    {
+        int err = pthread_cond_signal(&cond);
+        if (err) _objc_fatal("pthread_cond_signal failed (%d)", err);
+    }
+
+    void notifyAll()
+    {
+        int err = pthread_cond_broadcast(&cond);
+        if (err) _objc_fatal("pthread_cond_broadcast failed (%d)", err);
+    }
+
+    void forceReset()
+    {
+        mutex = pthread_mutex_t PTHREAD_MUTEX_INITIALIZER;
+        cond = pthread_cond_t PTHREAD_COND_INITIALIZER;
+    }
+
+    void assertLocked() { }
+
+    void assertUnlocked() { }
+};
+
+#elif TARGET_OS_WIN32
 
 // Compiler compatibility
 
@@ -769,6 +1090,14 @@ class mutex_tt : nocopy_t {
             (&mLock, (os_unfair_lock_options_t)opts);
     }
 
+    bool tryLock() {
+        if (os_unfair_lock_trylock(&mLock)) {
+            lockdebug_mutex_lock(this);
+            return true;
+        }
+        return false;
+    }
+
     void unlock() {
         lockdebug_mutex_unlock(this);
 
@@ -1064,7 +1393,7 @@ ustrdupMaybeNil(const uint8_t *str)
 //     dyld_program_sdk_at_least(dyld_platform_version_bridgeOS_ ## b))
 
 
-#ifndef __BUILDING_OBJCDT__
+#if !defined(__BUILDING_OBJCDT__) && !OBJC_HOST_BUILD
 // fork() safety requires careful tracking of all locks.
 // Our custom lock types check this in debug builds.
 // Disallow direct use of all other lock types.
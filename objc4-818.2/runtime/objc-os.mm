@@ -802,7 +802,8 @@ static void defineLockOrder()
 #endif
     lockdebug_lock_precedes_lock(&objcMsgLogLock, &crashlog_lock);
     lockdebug_lock_precedes_lock(&AltHandlerDebugLock, &crashlog_lock);
-    lockdebug_lock_precedes_lock(&AssociationsManagerLock, &crashlog_lock);
+    lockdebug_lock_precedes_lock(&PoolPageLock, &crashlog_lock);
+    AssociationsLocksPrecedeLock(&crashlog_lock);
     SideTableLocksPrecedeLock(&crashlog_lock);
     PropertyLocks.precedeLock(&crashlog_lock);
     StructLocks.precedeLock(&crashlog_lock);
@@ -826,20 +827,21 @@ static void defineLockOrder()
 #endif
     lockdebug_lock_precedes_lock(&loadMethodLock, &objcMsgLogLock);
     lockdebug_lock_precedes_lock(&loadMethodLock, &AltHandlerDebugLock);
-    lockdebug_lock_precedes_lock(&loadMethodLock, &AssociationsManagerLock);
+    lockdebug_lock_precedes_lock(&loadMethodLock, &PoolPageLock);
+    AssociationsLocksSucceedLock(&loadMethodLock);
     SideTableLocksSucceedLock(&loadMethodLock);
     PropertyLocks.succeedLock(&loadMethodLock);
     StructLocks.succeedLock(&loadMethodLock);
     CppObjectLocks.succeedLock(&loadMethodLock);
 
-    // PropertyLocks and CppObjectLocks and AssociationManagerLock 
+    // PropertyLocks and CppObjectLocks and AssociationsLocks 
     // precede everything because they are held while objc_retain() 
     // or C++ copy are called.
     // (StructLocks do not precede everything because it calls memmove only.)
     auto PropertyAndCppObjectAndAssocLocksPrecedeLock = [&](const void *lock) {
         PropertyLocks.precedeLock(lock);
         CppObjectLocks.precedeLock(lock);
-        lockdebug_lock_precedes_lock(&AssociationsManagerLock, lock);
+        AssociationsLocksPrecedeLock(lock);
     };
 #if __OBJC2__
     PropertyAndCppObjectAndAssocLocksPrecedeLock(&runtimeLock);
@@ -860,10 +862,10 @@ static void defineLockOrder()
 
     SideTableLocksSucceedLocks(PropertyLocks);
     SideTableLocksSucceedLocks(CppObjectLocks);
-    SideTableLocksSucceedLock(&AssociationsManagerLock);
+    AssociationsLocksPrecedeSideTableLocks();
 
-    PropertyLocks.precedeLock(&AssociationsManagerLock);
-    CppObjectLocks.precedeLock(&AssociationsManagerLock);
+    AssociationsLocksSucceedLocks(PropertyLocks);
+    AssociationsLocksSucceedLocks(CppObjectLocks);
     
 #if __OBJC2__
     lockdebug_lock_precedes_lock(&classInitLock, &runtimeLock);
@@ -880,6 +882,10 @@ static void defineLockOrder()
     lockdebug_lock_precedes_lock(&runtimeLock, &cacheUpdateLock);
 #endif
     lockdebug_lock_precedes_lock(&runtimeLock, &DemangleCacheLock);
+    // Method lists are fixed up with or without runtimeLock,
+    // and fixing one up registers selectors.
+    MethodListFixupLocks.succeedLock(&runtimeLock);
+    MethodListFixupLocks.precedeLock(&selLock);
 #else
     // Runtime operations may occur inside SideTable locks
     // (such as storeWeak calling getMethodImplementation)
@@ -898,9 +904,13 @@ static void defineLockOrder()
 
     // Striped locks use address order internally.
     SideTableDefineLockOrder();
+    AssociationsDefineLockOrder();
     PropertyLocks.defineLockOrder();
     StructLocks.defineLockOrder();
     CppObjectLocks.defineLockOrder();
+#if __OBJC2__
+    MethodListFixupLocks.defineLockOrder();
+#endif
 }
 // LOCKDEBUG
 #endif
@@ -917,11 +927,12 @@ void _objc_atfork_prepare()
     loadMethodLock.lock();
     PropertyLocks.lockAll();
     CppObjectLocks.lockAll();
-    AssociationsManagerLock.lock();
+    AssociationsLockAll();
     SideTableLockAll();
     classInitLock.enter();
 #if __OBJC2__
     runtimeLock.lock();
+    MethodListFixupLocks.lockAll();
     DemangleCacheLock.lock();
 #else
     methodListLock.lock();
@@ -935,6 +946,7 @@ void _objc_atfork_prepare()
 #endif
     objcMsgLogLock.lock();
     AltHandlerDebugLock.lock();
+    PoolPageLock.lock();
     StructLocks.lockAll();
     crashlog_lock.lock();
 
@@ -949,8 +961,9 @@ void _objc_atfork_parent()
     CppObjectLocks.unlockAll();
     StructLocks.unlockAll();
     PropertyLocks.unlockAll();
-    AssociationsManagerLock.unlock();
+    AssociationsUnlockAll();
     AltHandlerDebugLock.unlock();
+    PoolPageLock.unlock();
     objcMsgLogLock.unlock();
     crashlog_lock.unlock();
     loadMethodLock.unlock();
@@ -961,6 +974,7 @@ void _objc_atfork_parent()
     SideTableUnlockAll();
 #if __OBJC2__
     DemangleCacheLock.unlock();
+    MethodListFixupLocks.unlockAll();
     runtimeLock.unlock();
 #else
     impLock.unlock();
@@ -985,8 +999,9 @@ void _objc_atfork_child()
     CppObjectLocks.forceResetAll();
     StructLocks.forceResetAll();
     PropertyLocks.forceResetAll();
-    AssociationsManagerLock.forceReset();
+    AssociationsForceResetAll();
     AltHandlerDebugLock.forceReset();
+    PoolPageLock.forceReset();
     objcMsgLogLock.forceReset();
     crashlog_lock.forceReset();
     loadMethodLock.forceReset();
@@ -997,6 +1012,7 @@ void _objc_atfork_child()
     SideTableForceResetAll();
 #if __OBJC2__
     DemangleCacheLock.forceReset();
+    MethodListFixupLocks.forceResetAll();
     runtimeLock.forceReset();
 #else
     impLock.forceReset();
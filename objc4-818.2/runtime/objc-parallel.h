@@ -0,0 +1,93 @@
+/*
+ * Copyright (c) 2021 Apple Inc.  All Rights Reserved.
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ *
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this
+ * file.
+ *
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ *
+ * @APPLE_LICENSE_HEADER_END@
+ */
+
+/**
+ * @file objc-parallel.h
+ *
+ * Running independent pieces of work on short-lived threads.
+ *
+ * There is no pool: threads are created for one call and joined before
+ * it returns, so nothing is left running in processes that never use
+ * it. The work runs while the caller holds its locks - _read_images
+ * holds runtimeLock and dyld's lock - so it must not take locks, call
+ * into dyld, or send messages. Reading and hashing image data is fine.
+ */
+
+#ifndef _OBJC_PARALLEL_H
+#define _OBJC_PARALLEL_H
+
+#include <atomic>
+#include <cstddef>
+#include <pthread.h>
+
+namespace objc {
+
+enum { ParallelMaxThreads = 64 };
+
+// Calls fn(i) once for every i in [0, count), on up to threadCount
+// threads counting the caller, and returns when every call is done.
+// If a thread can't be created the others do its share.
+template <typename Fn>
+void parallelFor(size_t count, unsigned threadCount, const Fn& fn)
+{
+    struct Work {
+        const Fn& fn;
+        size_t count;
+        std::atomic<size_t> next;
+
+        Work(const Fn& f, size_t n) : fn(f), count(n), next(0) { }
+
+        void run() {
+            size_t i;
+            while ((i = next.fetch_add(1, std::memory_order_relaxed)) < count) {
+                fn(i);
+            }
+        }
+
+        static void *start(void *arg) {
+            ((Work *)arg)->run();
+            return nullptr;
+        }
+    };
+
+    if (threadCount > ParallelMaxThreads) threadCount = ParallelMaxThreads;
+    if (threadCount > count) threadCount = (unsigned)count;
+
+    Work work(fn, count);
+    pthread_t threads[ParallelMaxThreads];
+    unsigned started = 0;
+    for (unsigned t = 1; t < threadCount; t++) {
+        if (pthread_create(&threads[started], nullptr, &Work::start, &work) == 0) {
+            started++;
+        }
+    }
+    work.run();
+    // Joining also makes the workers' writes visible to the caller.
+    for (unsigned t = 0; t < started; t++) {
+        pthread_join(threads[t], nullptr);
+    }
+}
+
+} // namespace objc
+
+#endif
@@ -30,6 +30,11 @@
 
 #include "objc-config.h"
 
+#if OBJC_HOST_BUILD
+// The host build compiles only the self-contained data structures below.
+#   include "objc-host.h"
+#else
+
 /* Isolate ourselves from the definitions of id and Class in the compiler 
  * and public headers.
  */
@@ -173,6 +178,14 @@ public:
     bool rootReleaseShouldDealloc();
     uintptr_t rootRetainCount();
 
+    // Batched retain/release for objc_retainN and objc_releaseN.
+    // sidetableRR() is true if retain and release go straight to the
+    // side table with no override to call. The _nolock calls expect
+    // the caller to hold table, this object's side table.
+    bool sidetableRR();
+    void sidetable_retain_nolock(SideTable& table);
+    bool sidetable_release_nolock(SideTable& table);
+
     // Implementation of dealloc methods
     bool rootIsDeallocating();
     void clearDeallocating();
@@ -589,6 +602,8 @@ extern bool didCallDyldNotifyRegister;
 /* selectors */
 extern void sel_init(size_t selrefCount);
 extern SEL sel_registerNameNoLock(const char *str, bool copy);
+extern SEL sel_registerNameMaybeCopy(const char *str, bool copy);
+extern size_t sel_registerImageSelectorsNoLock(SEL *sels, size_t count, bool copy, const uint64_t *hashes = nil);
 
 extern SEL SEL_cxx_construct;
 extern SEL SEL_cxx_destruct;
@@ -724,6 +739,7 @@ typedef struct {
     const char **classNameLookups;  // for objc_getClass() hooks
     unsigned classNameLookupsAllocated;
     unsigned classNameLookupsUsed;
+    struct RRSampler *rrSampler;  // for OBJC_SAMPLE_RETAIN_RELEASE
 
     // If you add new fields here, don't forget to update 
     // _objc_pthread_destroyspecific()
@@ -745,6 +761,9 @@ extern char *encoding_copyArgumentType(const char *t, unsigned int index);
 // sync.h
 extern void _destroySyncCache(struct SyncCache *cache);
 
+// NSObject.mm
+extern void _destroyRetainReleaseSampler(struct RRSampler *sampler);
+
 // arr
 extern void arr_init(void);
 extern id objc_autoreleaseReturnValue(id obj);
@@ -824,6 +843,8 @@ extern Class _class_getClassForIvar(Class cls, Ivar ivar);
 
 __END_DECLS
 
+#endif // !OBJC_HOST_BUILD
+
 
 #ifndef STATIC_ASSERT
 #   define STATIC_ASSERT(x) _STATIC_ASSERT2(x, __LINE__)
@@ -879,7 +900,7 @@ __attribute__((aligned(1))) typedef   int16_t unaligned_int16_t;
 
 // Global operator new and delete. We must not use any app overrides.
 // This ALSO REQUIRES each of these be in libobjc's unexported symbol list.
-#if __cplusplus && !defined(TEST_OVERRIDES_NEW)
+#if __cplusplus && !defined(TEST_OVERRIDES_NEW) && !OBJC_HOST_BUILD
 #pragma clang diagnostic push
 #pragma clang diagnostic ignored "-Winline-new-delete"
 #include <new>
@@ -933,96 +954,113 @@ enum { CacheLineSize = 64 };
  根据下面源码实现 Lock 的部分,发现抽象类型 T 必须支持 lock/unlock/forceReset/lockdebu_lock_precedes_lock 函数接口.已知 struct SideTable 都有提供.
 
  */
-template<typename T>
-class StripedMap {
-#if TARGET_OS_IPHONE && !TARGET_OS_SIMULATOR
-    // iphone, 同时也标明 SideTables 中只有 8 张 SideTable
-    enum { StripeCount = 8 };
+// Fibonacci hashing: multiply by 2^N/phi and keep the top shift bits.
+// Unlike a shift-and-xor of the low bits this spreads nearby allocations
+// over every stripe at any power-of-two stripe count.
+static inline unsigned int stripeIndexForPointer(const void *p, unsigned int shift)
+{
+    uintptr_t addr = reinterpret_cast<uintptr_t>(p);
+#if __LP64__
+    return (unsigned int)((addr * 0x9E3779B97F4A7C15ULL) >> (64 - shift));
 #else
-    // mac/simulator 有 64 张 SideTable
-    enum { StripeCount = 64 };
+    return (unsigned int)((addr * 0x9E3779B9U) >> (32 - shift));
 #endif
+}
 
-    struct PaddedT {
-        // CacheLineSize = 64
-        // T value 64 字节对齐
-        T value alignas(CacheLineSize);
-    };
-    // 长度 8/64的 PaddedT 数组, PaddedT 是一个仅有一个成员变量的结构体, 且该成员变量是 64 位对齐的. (即可表示 SideTable 结构体需要是 64 字节对齐,如果把PaddedT舍弃的话,即 array 可直接砍成一个SideTable)
-    PaddedT array[StripeCount];
-
-    // hash 函数, 通过指针获取到哈希值. 这里是获得 objc_objcet 指针的哈希值
-    static unsigned int indexForPointer(const void *p) {
-        // 把指针 p 转换成 unsigned long
-        // reinterpret_cast<new_type>(expression): c++ 里面的强制类型转换符
-        uintptr_t addr = reinterpret_cast<uintptr_t>(p);
-        // addr 右移 4 位的值 与 addr 右移 9 位的值进行异或,然后对结果进行StripeCount取模. 防止数组越界
-        return ((addr >> 4) ^ (addr >> 9)) % StripeCount;
-    }
+// Lock shortcuts shared by StripedMap and DynamicStripedMap.
+// Map provides stripe(i) and stripeCount().
+template<typename Map>
+class StripedMapLocks {
+    Map& map() { return *static_cast<Map *>(this); }
 
  public:
-    // hash 取值: 取得对象所在的 SideTable
-    T& operator[] (const void *p) { 
-        return array[indexForPointer(p)].value; 
-    }
-    // 原型 const_cast<type_id>(expression)
-    // const_cast 该运算符用来修饰 const 或 volatile 属性
-    // 除了 const 或 volatile 修饰之外,type_id 和 expression 的类型是一样的
-    // 即把一个不可变类型转化为可变类型: const int b => int b
-    // - 常量指针被转化为非常量的指针,并且仍然指向原来的对象
-    // - 常量引用被转化位非常量的引用,并且仍然指向原来的对象
-    // - const_cast 一般用于修饰指针.如果 const char *p
-    
-    // 把 this 转化为 StripedMap<T>, 然后调用上面的[],得到 T&
-    const T& operator[] (const void *p) const {
-        return const_cast<StripedMap<T>>(this)[p]; 
-    }
-    
     // Shortcuts for StripedMaps of locks.
     // 循环给 arry 中的元素 value 加锁.
     // iOS 下, SideTable 为例的话,循环对 8 张 SideTable 加锁
     // struct SideTable 成员变量: spinlock_slock, lock 函数实现是: void lock() { slock.lock()'}
     void lockAll() {
-        for (unsigned int i = 0; i < StripeCount; i++) {
-            array[i].value.lock();
+        for (unsigned int i = 0; i < map().stripeCount(); i++) {
+            map().stripe(i).lock();
         }
     }
     // 同上 解锁
     void unlockAll() {
-        for (unsigned int i = 0; i < StripeCount; i++) {
-            array[i].value.unlock();
+        for (unsigned int i = 0; i < map().stripeCount(); i++) {
+            map().stripe(i).unlock();
         }
     }
     // 同上 重置锁
     void forceResetAll() {
-        for (unsigned int i = 0; i < StripeCount; i++) {
-            array[i].value.forceReset();
+        for (unsigned int i = 0; i < map().stripeCount(); i++) {
+            map().stripe(i).forceReset();
         }
     }
     // 对 arry 中元素的 loick 定义锁顺序?
     void defineLockOrder() {
-        for (unsigned int i = 1; i < StripeCount; i++) {
-            lockdebug_lock_precedes_lock(&array[i-1].value, &array[i].value);
+        for (unsigned int i = 1; i < map().stripeCount(); i++) {
+            lockdebug_lock_precedes_lock(&map().stripe(i-1), &map().stripe(i));
         }
     }
 
     void precedeLock(const void *newlock) {
         // assumes defineLockOrder is also called
         // 假定 defineLockOrder 已经被调用过
-        lockdebug_lock_precedes_lock(&array[StripeCount-1].value, newlock);
+        lockdebug_lock_precedes_lock(&map().stripe(map().stripeCount()-1), newlock);
     }
 
     void succeedLock(const void *oldlock) {
         // assumes defineLockOrder is also called
         // 假定 defineLockOrder 已经被调用过
-        lockdebug_lock_precedes_lock(oldlock, &array[0].value);
+        lockdebug_lock_precedes_lock(oldlock, &map().stripe(0));
     }
     
     // T 是 spinlock_t 时,根据指定下标 从 StripedMap<spinlock_t> -> array 中获取spinlock_t
     const void *getLock(int i) {
-        if (i < StripeCount) return &array[i].value;
+        if (i < (int)map().stripeCount()) return &map().stripe(i);
         else return nil;
     }
+};
+
+template<typename T>
+class StripedMap : public StripedMapLocks<StripedMap<T>> {
+#if TARGET_OS_IPHONE && !TARGET_OS_SIMULATOR
+    // iphone, 同时也标明 SideTables 中只有 8 张 SideTable
+    enum { StripeShift = 3 };
+#else
+    // mac/simulator 有 64 张 SideTable
+    enum { StripeShift = 6 };
+#endif
+
+ public:
+    enum { StripeCount = 1 << StripeShift };
+
+ private:
+    struct PaddedT {
+        // CacheLineSize = 64
+        // T value 64 字节对齐
+        T value alignas(CacheLineSize);
+    };
+    // 长度 8/64的 PaddedT 数组, PaddedT 是一个仅有一个成员变量的结构体, 且该成员变量是 64 位对齐的. (即可表示 SideTable 结构体需要是 64 字节对齐,如果把PaddedT舍弃的话,即 array 可直接砍成一个SideTable)
+    PaddedT array[StripeCount];
+
+ public:
+    // hash 取值: 取得对象所在的 SideTable
+    T& operator[] (const void *p) { 
+        return array[stripeIndexForPointer(p, StripeShift)].value; 
+    }
+    // 把 this 转化为 StripedMap<T>, 然后调用上面的[],得到 T&
+    const T& operator[] (const void *p) const {
+        return const_cast<StripedMap<T>>(this)[p]; 
+    }
+
+    static constexpr unsigned int stripeCount() { return StripeCount; }
+
+    static unsigned int indexOf(const void *p) {
+        return stripeIndexForPointer(p, StripeShift);
+    }
+
+    // Stripe i, for walking every stripe.
+    T& stripe(unsigned int i) { return array[i].value; }
     
     // 构造函数,在 DEBUG 模式下会验证 T 是否是 64 位对齐
 #if DEBUG
@@ -1039,6 +1077,65 @@ class StripedMap {
 #endif
 };
 
+// DynamicStripedMap<T> is a StripedMap<T> whose stripe count is chosen 
+// when it is constructed, for SideTables and OBJC_SIDE_TABLE_STRIPES. 
+// The stripes are a cache-line aligned heap block that is never freed, 
+// so only use it with ExplicitInit. Each lookup costs a load of the 
+// array and shift more than StripedMap's.
+template<typename T>
+class DynamicStripedMap : public StripedMapLocks<DynamicStripedMap<T>> {
+ public:
+    // Bounds for the stripe count.
+    enum { MinStripeCount = 2, MaxStripeCount = 4096 };
+
+ private:
+    struct PaddedT {
+        T value alignas(CacheLineSize);
+    };
+
+    PaddedT *array;
+    unsigned int stripeShift;
+
+ public:
+    T& operator[] (const void *p) { 
+        return array[stripeIndexForPointer(p, stripeShift)].value; 
+    }
+    const T& operator[] (const void *p) const {
+        return const_cast<DynamicStripedMap<T>>(this)[p]; 
+    }
+
+    unsigned int stripeCount() const { return 1U << stripeShift; }
+
+    unsigned int indexOf(const void *p) const {
+        return stripeIndexForPointer(p, stripeShift);
+    }
+
+    // Stripe i, for walking every stripe.
+    T& stripe(unsigned int i) { return array[i].value; }
+
+    // Use count stripes, rounded up to a power of two and clamped to 
+    // [MinStripeCount, MaxStripeCount]. Zero means StripedMap's count.
+    explicit DynamicStripedMap(unsigned int count) {
+        if (count == 0) count = StripedMap<T>::StripeCount;
+        if (count < MinStripeCount) count = MinStripeCount;
+        if (count > MaxStripeCount) count = MaxStripeCount;
+        unsigned int shift = 0;
+        while ((1U << shift) < count) shift++;
+
+        void *block;
+        if (posix_memalign(&block, CacheLineSize,
+                           sizeof(PaddedT) << shift) != 0) {
+            _objc_fatal("DynamicStripedMap: could not allocate %u stripes",
+                        1U << shift);
+        }
+        array = (PaddedT *)block;
+        stripeShift = shift;
+        for (unsigned int i = 0; i < stripeCount(); i++) {
+            new (&array[i]) PaddedT();
+        }
+    }
+};
+
 /*
  template <typename T> class DisguisedPtr 是在 objc-private.h 中定义的一个模板工具类,主要功能是把 T 指针(T 类型变量的地址)转化位一个 unsigned long,实现指针到证整数的相互映射,起到指针伪装的作用,使指针隐藏于系统工具中(如 leak 工具).
  在818 源码中全局搜索DisguisedPtr,发现抽象类型 T,仅作为 objc_object 和 objc_object *使用.而抽象类型 T 是 objc_object *时,用于隐藏__weak 变量的地址.
@@ -1111,12 +1208,15 @@ class DisguisedPtr {
 
 // fixme type id is weird and not identical to objc_object*
 // fixme 类型 id 很奇怪，与 objc_object* 不同
+// Under OBJC_HOST_BUILD id *is* objc_object*, so these would recurse.
+#if !OBJC_HOST_BUILD
 static inline bool operator == (DisguisedPtr<objc_object> lhs, id rhs) {
     return lhs == (objc_object *)rhs;
 }
 static inline bool operator != (DisguisedPtr<objc_object> lhs, id rhs) {
     return lhs != (objc_object *)rhs;
 }
+#endif
 
 
 // Storage for a thread-safe chained hook function.
@@ -1284,11 +1384,15 @@ static uint32_t ptr_hash(uint32_t key)
 
 
 
+#if !OBJC_HOST_BUILD
+
 // Lock declarations
 #include "objc-locks.h"
 
 // Inlined parts of objc_object's implementation
 #include "objc-object.h"
 
+#endif
+
 #endif /* _OBJC_PRIVATE_H_ */
 
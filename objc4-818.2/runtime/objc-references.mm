@@ -42,9 +42,6 @@ enum {
     OBJC_ASSOCIATION_SYSTEM_OBJECT      = _OBJC_ASSOCIATION_SYSTEM_OBJECT, // 1 << 16
 };
 
-// 全局的自旋锁(互斥锁)
-spinlock_t AssociationsManagerLock;
-
 namespace objc {
 
 class ObjcAssociation {
@@ -112,51 +109,150 @@ public:
 
 // ObjectAssociationMap 是以const void *为 key,ObjcAssociation为 value的哈希表
 typedef DenseMap<const void *, ObjcAssociation> ObjectAssociationMap;
-// AssociationsHashMap 是以 DisguisedPtr<objc_object> 为 key,ObjectAssociationMap为 value 的哈希表.
+
+// The associations of one object. Most objects have exactly one, so the
+// first is stored inline and finding it is a key compare. An
+// ObjectAssociationMap is allocated for the second, and from then on
+// holds all of them.
+class ObjectAssociations {
+    const void *_key;            // inline association's key, or EmptyKey
+    ObjcAssociation _association;
+    ObjectAssociationMap *_map;  // every association, once there are two
+
+    // The key DenseMap reserves for empty buckets, so never a real key.
+    static const void *emptyKey() {
+        return DenseMapInfo<const void *>::getEmptyKey();
+    }
+
+public:
+    ObjectAssociations() : _key(emptyKey()), _association(), _map(nil) {}
+    ObjectAssociations(ObjectAssociations &&other) : ObjectAssociations() {
+        swap(other);
+    }
+    ObjectAssociations(const ObjectAssociations &other) = delete;
+    ObjectAssociations &operator=(ObjectAssociations &&other) {
+        swap(other);
+        return *this;
+    }
+    ~ObjectAssociations() { delete _map; }
+
+    void swap(ObjectAssociations &other) {
+        std::swap(_key, other._key);
+        _association.swap(other._association);
+        std::swap(_map, other._map);
+    }
+
+    size_t size() const {
+        if (slowpath(_map)) return _map->size();
+        return _key != emptyKey() ? 1 : 0;
+    }
+
+    // 返回 key 对应的 ObjcAssociation,不存在则返回 nil
+    ObjcAssociation *find(const void *key) {
+        if (fastpath(!_map)) {
+            return (_key == key  &&  key != emptyKey()) ? &_association : nil;
+        }
+        auto it = _map->find(key);
+        return it != _map->end() ? &it->second : nil;
+    }
+
+    // Like DenseMap::try_emplace: if key is new, moves association in
+    // and leaves it empty. Otherwise returns the existing association.
+    std::pair<ObjcAssociation *, bool>
+    try_emplace(const void *key, ObjcAssociation &&association) {
+        if (fastpath(!_map)) {
+            if (_key == emptyKey()) {
+                _key = key;
+                _association.swap(association);
+                return { &_association, true };
+            }
+            if (_key == key) return { &_association, false };
+            _map = new ObjectAssociationMap();
+            _map->try_emplace(_key, std::move(_association));
+            _key = emptyKey();
+        }
+        auto result = _map->try_emplace(key, std::move(association));
+        return { &result.first->second, result.second };
+    }
+
+    // Removes key's association and swaps it into removed.
+    bool erase(const void *key, ObjcAssociation &removed) {
+        if (fastpath(!_map)) {
+            if (_key != key  ||  key == emptyKey()) return false;
+            removed.swap(_association);
+            _key = emptyKey();
+            return true;
+        }
+        auto it = _map->find(key);
+        if (it == _map->end()) return false;
+        removed.swap(it->second);
+        _map->erase(it);
+        return true;
+    }
+
+    // Calls fn(key, association) for each association.
+    template <typename Fn>
+    void forEach(Fn fn) {
+        if (slowpath(_map)) {
+            for (auto &ref: *_map) fn(ref.first, ref.second);
+        } else if (_key != emptyKey()) {
+            fn(_key, _association);
+        }
+    }
+};
+
+// AssociationsHashMap 是以 DisguisedPtr<objc_object> 为 key,ObjectAssociations为 value 的哈希表.
 // DisguisedPtr<objc_object> 可以理解为把 objc_object 地址变成一个证书.可以参考DisguisedPtr的注释
-typedef DenseMap<DisguisedPtr<objc_object>, ObjectAssociationMap> AssociationsHashMap;
+typedef DenseMap<DisguisedPtr<objc_object>, ObjectAssociations> AssociationsHashMap;
+
+// One stripe of the associations table: a lock and the
+// AssociationsHashMap for the objects that hash to it. Like SideTable,
+// the lock comes first so the stripe's address is its lock's address.
+struct AssociationsStripe {
+    spinlock_t slock;
+    AssociationsHashMap associations;
+
+    void lock() { slock.lock(); }
+    void unlock() { slock.unlock(); }
+    void forceReset() { slock.forceReset(); }
+};
 
-// class AssociationsManager manages a lock / hash table singleton pair.
-// AssociationsManager 管理一个 lock/哈希表的单例pair
-// Allocating an instance acquires the lock
-// 分配实例获取锁
+static ExplicitInit<StripedMap<AssociationsStripe>> AssociationsStripes;
+
+// class AssociationsManager manages a lock / hash table pair.
+// Allocating an instance acquires the lock of the stripe that holds
+// object's associations, so threads working on objects in different
+// stripes do not contend.
 
 class AssociationsManager {
-    // Convenience class for Dense Maps & Sets
-    // template <typename Key, typename Value>
-    // class ExplicitInitDenseMap : public ExplicitInit<DenseMap<Key, Value>> { };
-    // Storage 模板类名
-    using Storage = ExplicitInitDenseMap<DisguisedPtr<objc_object>, ObjectAssociationMap>;
-    // 静态变量 _mapStorage,用于存储 AssociationsHashMap 数据
-    static Storage _mapStorage;
+    AssociationsStripe &_stripe;
 
 public:
-    // 构造函数,获取全局的 AssociationsManagerLock 加锁
-    AssociationsManager()   { AssociationsManagerLock.lock(); }
-    // 析构函数,获取全局的 AssociationsManagerLock 解锁
-    ~AssociationsManager()  { AssociationsManagerLock.unlock(); }
+    // 构造函数,获取 object 所在 stripe 的锁并加锁
+    AssociationsManager(const void *object)
+        : _stripe(AssociationsStripes.get()[object])
+    {
+        _stripe.lock();
+    }
+    // 析构函数,解锁
+    ~AssociationsManager()  { _stripe.unlock(); }
     
-    // 返回内部保存的 AssociationsHashMap
+    // 返回 object 所在 stripe 的 AssociationsHashMap
     AssociationsHashMap &get() {
-        return _mapStorage.get();
+        return _stripe.associations;
     }
     
-    // init 初始化函数实现,只是调用 storage 的 init 函数
+    // init 初始化函数实现,初始化所有 stripe
     static void init() {
-        _mapStorage.init();
+        AssociationsStripes.init();
     }
 };
 
-// 其实这里有点想不明白，明明 AssociationsManager 已经定义了公开函数 get 获取内部 _mapStorage 的数据，
-
-// 为什么这里在类定义外面还写了这句代码 ？
-AssociationsManager::Storage AssociationsManager::_mapStorage;
-
 /*
  总结:
- 1. 通过 AssociationsManager 的 get 函数获取一个全局唯一的 AssociationsHashMap
- 2. 根据原始对象的 DisguisedPtr<objc_object> 从 AssociationsHashMap 获取 ObjectAssociationMap
- 3. 根据指定的关联 key(const void *) 从 ObjectAssociationMap 获取 ObjcAssociation
+ 1. 通过 AssociationsManager 的 get 函数获取对象所在 stripe 的 AssociationsHashMap
+ 2. 根据原始对象的 DisguisedPtr<objc_object> 从 AssociationsHashMap 获取 ObjectAssociations
+ 3. 根据指定的关联 key(const void *) 从 ObjectAssociations 获取 ObjcAssociation
  4. ObjcAssociation 的两个成员变量,保存对象的关联策略 _policy 和关联值 _value
  */
 } // namespace objc
@@ -169,6 +265,48 @@ _objc_associations_init()
     AssociationsManager::init();
 }
 
+// The associations locks are buried like the SideTable locks.
+// These manipulate all of them for fork() and lockdebug.
+void AssociationsLockAll() {
+    AssociationsStripes.get().lockAll();
+}
+
+void AssociationsUnlockAll() {
+    AssociationsStripes.get().unlockAll();
+}
+
+void AssociationsForceResetAll() {
+    AssociationsStripes.get().forceResetAll();
+}
+
+void AssociationsDefineLockOrder() {
+    AssociationsStripes.get().defineLockOrder();
+}
+
+void AssociationsLocksPrecedeLock(const void *newlock) {
+    AssociationsStripes.get().precedeLock(newlock);
+}
+
+void AssociationsLocksSucceedLock(const void *oldlock) {
+    AssociationsStripes.get().succeedLock(oldlock);
+}
+
+void AssociationsLocksSucceedLocks(StripedMap<spinlock_t>& oldlocks) {
+    int i = 0;
+    const void *oldlock;
+    while ((oldlock = oldlocks.getLock(i++))) {
+        AssociationsStripes.get().succeedLock(oldlock);
+    }
+}
+
+void AssociationsLocksPrecedeSideTableLocks() {
+    int i = 0;
+    const void *newlock;
+    while ((newlock = AssociationsStripes.get().getLock(i++))) {
+        SideTableLocksSucceedLock(newlock);
+    }
+}
+
 id
 _object_get_associative_reference(id object, const void *key)
 {
@@ -176,20 +314,20 @@ _object_get_associative_reference(id object, const void *key)
     ObjcAssociation association{};
 
     {
-        // 创建 manager 临时变量，枷锁
-        AssociationsManager manager;
-        // 获取全局唯一的AssociationsHashMap
+        // 创建 manager 临时变量，给 object 所在的 stripe 加锁
+        AssociationsManager manager{object};
+        // 获取 object 所在 stripe 的 AssociationsHashMap
         AssociationsHashMap &associations(manager.get());
-        // 从全局的 AssociationsHashMap 中取得对象对应的 ObjectAssociationMap
+        // 从 AssociationsHashMap 中取得对象对应的 ObjectAssociations
         AssociationsHashMap::iterator i = associations.find((objc_object *)object);
         if (i != associations.end()) {
-            // 如果 ObjectAssociationMap 存在
-            ObjectAssociationMap &refs = i->second;
-            // 从 ObjectAssocationMap 中取得 key 对应的 ObjcAssociation
-            ObjectAssociationMap::iterator j = refs.find(key);
-            if (j != refs.end()) {
+            // 如果 ObjectAssociations 存在
+            ObjectAssociations &refs = i->second;
+            // 从 ObjectAssociations 中取得 key 对应的 ObjcAssociation
+            ObjcAssociation *found = refs.find(key);
+            if (found) {
                 // 如果存在
-                association = j->second;
+                association = *found;
                 // 根据关联策略判断是否需要对 _value 执行 retain 操作
                 association.retainReturnedValue();
             }
@@ -226,18 +364,18 @@ _object_set_associative_reference(id object, const void *key, id value, uintptr_
     {
         // 创建 manager 临时变量
         // 这里还有一步连带操作
-        // 在其构造函数中 AssociationsManagerLock.lock() 加锁
-        AssociationsManager manager;
-        // 获取全局的 AssociationsHashMap
+        // 在其构造函数中给 object 所在的 stripe 加锁
+        AssociationsManager manager{object};
+        // 获取 object 所在 stripe 的 AssociationsHashMap
         AssociationsHashMap &associations(manager.get());
         
         // 如果 value 存在
         if (value) {
             // 这里 DenseMap 对我们而言是一个黑盒，这里只要看 try_emplace 函数
             
-            // 在全局 AssociationsHashMap 中尝试插入 <DisguisedPtr<objc_object>, ObjectAssociationMap>
+            // 在 AssociationsHashMap 中尝试插入 <DisguisedPtr<objc_object>, ObjectAssociations>
             // 返回值类型是 std::pair<iterator, bool>
-            auto refs_result = associations.try_emplace(disguised, ObjectAssociationMap{});
+            auto refs_result = associations.try_emplace(disguised, ObjectAssociations{});
             // 如果新插入成功
             if (refs_result.second) {
                 /* it's the first association we make */
@@ -254,7 +392,7 @@ _object_set_associative_reference(id object, const void *key, id value, uintptr_
                 // 替换
                 // 如果之前有旧值的话把旧值的成员变量交换到 association
                 // 然后在 函数执行结束时把旧值根据对应的策略判断执行 release
-                association.swap(result.first->second);
+                association.swap(*result.first);
             }
         } else {
             // value 为 nil 的情况，表示要把之前的关联对象置为 nil
@@ -262,12 +400,9 @@ _object_set_associative_reference(id object, const void *key, id value, uintptr_
             auto refs_it = associations.find(disguised);
             if (refs_it != associations.end()) {
                 auto &refs = refs_it->second;
-                auto it = refs.find(key);
-                if (it != refs.end()) {
-                    association.swap(it->second);
-                    // 清除指定的关联对象
-                    refs.erase(it);
-                    // 如果当前 object 的关联对象为空了，则同时从全局的 AssociationsHashMap
+                // 清除指定的关联对象,旧值交换到 association
+                if (refs.erase(key, association)) {
+                    // 如果当前 object 的关联对象为空了，则同时从 AssociationsHashMap
                     // 中移除该对象
                     if (refs.size() == 0) {
                         associations.erase(refs_it);
@@ -278,7 +413,7 @@ _object_set_associative_reference(id object, const void *key, id value, uintptr_
         }
         // 析构 mananger 临时变量
         // 这里还有一步连带操作
-        // 在其析构函数中 AssociationsManagerLock.unlock() 解锁
+        // 在其析构函数中给 stripe 解锁
     }
 
     // Call setHasAssociatedObjects outside the lock, since this
@@ -305,15 +440,15 @@ _object_set_associative_reference(id object, const void *key, id value, uintptr_
 void
 _object_remove_assocations(id object, bool deallocating)
 {
-    // 对象对应的 ObjectAssociationMap
-    ObjectAssociationMap refs{};
+    // 对象对应的 ObjectAssociations
+    ObjectAssociations refs{};
 
     {
         // 创建临时变量 manager，枷锁
-        AssociationsManager manager;
-        // 从 manager 中获取全局唯一的AssociationsHashMap
+        AssociationsManager manager{object};
+        // 从 manager 中获取 object 所在 stripe 的 AssociationsHashMap
         AssociationsHashMap &associations(manager.get());
-        // 取得对象的对应 ObjectAssociationMap，里面包含所有的 (key, ObjcAssociation)
+        // 取得对象的对应 ObjectAssociations，里面包含所有的 (key, ObjcAssociation)
         AssociationsHashMap::iterator i = associations.find((objc_object *)object);
         if (i != associations.end()) {
             // 把 i->second 的内容都转入 refs 对象中
@@ -325,19 +460,19 @@ _object_remove_assocations(id object, bool deallocating)
             // 如果不在 dealloc, 也就是对象不在释放的情况下
             if (!deallocating) {
                 //  遍历对象对应的关联对象哈希表中所有的 ObjcAssociation
-                for (auto &ref: refs) {
-                    // ref.second是ObjcAssociation类型对象{policy, value}
+                refs.forEach([&](const void *key, ObjcAssociation &ref) {
+                    // ref是ObjcAssociation类型对象{policy, value}
                     // 这里是比对关联策略释放,如果当前策略是OBJC_ASSOCIATION_SYSTEM_OBJECT
-                    if (ref.second.policy() & OBJC_ASSOCIATION_SYSTEM_OBJECT) {
+                    if (ref.policy() & OBJC_ASSOCIATION_SYSTEM_OBJECT) {
                         // 重新将关联策略是OBJC_ASSOCIATION_SYSTEM_OBJECT的对象插入
-                        i->second.insert(ref);
+                        i->second.try_emplace(key, ObjcAssociation{ref});
                         didReInsert = true;
                     }
-                }
+                });
             }
             // 如果没有重新插入关联策略为OBJC_ASSOCIATION_SYSTEM_OBJECT的对象
             if (!didReInsert)
-                // 从全局 AssociationsHashMap 移除对象的 ObjectAssociationMap
+                // 从 AssociationsHashMap 移除对象的 ObjectAssociations
                 associations.erase(i);
         }
     }
@@ -349,21 +484,21 @@ _object_remove_assocations(id object, bool deallocating)
 
     // release everything (outside of the lock).
     // 遍历对象对应的关联对象哈希表中所有的ObjcAssociation类对象
-    for (auto &i: refs) {
-        // i.second是ObjcAssociation类型对象{policy, value}，且关联策略是OBJC_ASSOCIATION_SYSTEM_OBJECT
-        if (i.second.policy() & OBJC_ASSOCIATION_SYSTEM_OBJECT) {
+    refs.forEach([&](const void *, ObjcAssociation &ref) {
+        // ref是ObjcAssociation类型对象{policy, value}，且关联策略是OBJC_ASSOCIATION_SYSTEM_OBJECT
+        if (ref.policy() & OBJC_ASSOCIATION_SYSTEM_OBJECT) {
             // If we are not deallocating, then RELEASE_LATER associations don't get released.
             // 如果不调用deallocating，那么 RELEASE_LATER 关联就不会被释放。
             // 如果正在释放对象
             if (deallocating)
                 // dealloc的时候，OBJC_ASSOCIATION_SYSTEM_OBJECT的关联对象，
                 // 先放入laterRefs 稍后释放，否则不处理。
-                laterRefs.append(&i.second);
+                laterRefs.append(&ref);
         } else {
             // 释放非OBJC_ASSOCIATION_SYSTEM_OBJECT的关联对象
-            i.second.releaseHeldValue();
+            ref.releaseHeldValue();
         }
-    }
+    });
     // 遍历上一步存入策略为OBJC_ASSOCIATION_SYSTEM_OBJECT的对象
     for (auto *later: laterRefs) {
         // dealloc 的情况下释放OBJC_ASSOCIATION_SYSTEM_OBJECT的关联对象
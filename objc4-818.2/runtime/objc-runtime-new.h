@@ -295,6 +295,25 @@ public:
 
     template <Atomicity, IMPEncoding>
     void set(bucket_t *base, SEL newSel, IMP newImp, Class cls);
+
+    // Like set<Atomic, Encoded>, but only if the bucket is still empty.
+    // Returns false if another thread claimed it first.
+    bool claim(bucket_t *base, SEL newSel, IMP newImp, Class cls);
+};
+
+// Per-class counters for OBJC_RECORD_CACHE_STATISTICS. See objc-cache.mm.
+struct cache_stats_t;
+
+// A cache insert reserved by cache_t::beginInsert() while holding
+// runtimeLock and completed by cache_t::finishInsert() without it.
+struct cache_fill_t {
+    bucket_t *buckets;
+    mask_t mask;
+    SEL sel;
+    IMP imp;
+    id receiver;
+    uintptr_t epoch;
+    cache_stats_t *stats;
 };
 
 /* dyld_shared_cache_builder and obj-C agree on these definitions */
@@ -445,13 +464,17 @@ private:
     void setBucketsAndMask(struct bucket_t *newBuckets, mask_t newMask);
 
     void reallocate(mask_t oldCapacity, mask_t newCapacity, bool freeOld);
+    bucket_t *reserve(mask_t &outMask, cache_stats_t *&outStats);
+    bool claim(bucket_t *b, mask_t m, SEL sel, IMP imp, cache_stats_t *stats);
+    cache_stats_t *stats(bool create) const;
+    void recordDiscard(cache_stats_t *stats, bool growing) const;
     void collect_free(bucket_t *oldBuckets, mask_t oldCapacity);
 
     static bucket_t *emptyBuckets();
     static bucket_t *allocateBuckets(mask_t newCapacity);
     static bucket_t *emptyBucketsForCapacity(mask_t capacity, bool allocate = true);
     static struct bucket_t * endMarker(struct bucket_t *b, uint32_t cap);
-    void bad_cache(id receiver, SEL sel) __attribute__((noreturn, cold));
+    void bad_cache(id receiver, SEL sel, bucket_t *probed = nil, mask_t probedMask = 0) __attribute__((noreturn, cold));
 
 public:
     // The following four fields are public for objcdt's use only.
@@ -486,6 +509,11 @@ public:
 #endif
 
     void insert(SEL sel, IMP imp, id receiver);
+    bool beginInsert(SEL sel, IMP imp, id receiver, cache_fill_t &fill);
+    void finishInsert(const cache_fill_t &fill);
+    void recordHit();
+    bool copyStatisticsNolock(struct objc_imp_cache_stats *outStats) const;
+    static void printStatisticsNolock();
     void copyCacheNolock(objc_imp_cache_entry *buffer, int len);
     void destroy();
     void eraseNolock(const char *func);
@@ -1504,26 +1532,32 @@ class list_array_tt {
             uint32_t oldCount = array()->count;
             // 新数组长度 = 原有长度 + 新增的 count
             uint32_t newCount = oldCount + addedCount;
-            
-            // 根据 newCount 开辟空间,类型是 array_t *
-            array_t *newArray = (array_t *)malloc(array_t::byteSize(newCount));
-            // 更新 array 长度
-            newArray->count = newCount;
-            array()->count = newCount;
-            
+
+            // Arrays grow with room to spare, so a class that gains
+            // categories one image at a time isn't reallocated and
+            // copied every time. malloc_size is 0 for memory malloc
+            // doesn't own, so such an array is always copied.
+            array_t *oldArray = array();
+            array_t *newArray = oldArray;
+            if (malloc_size(oldArray) < array_t::byteSize(newCount)) {
+                newArray = (array_t *)
+                    malloc(array_t::byteSize(newCount + newCount / 2));
+            }
+
             // 把方法列表向后移动,给 addedList 留出 addedCount 的空间
-            // 遍历原有数据中 List 数据,将其放在 newArray数组 addedCount 之后的位置
+            // Elements are assigned one by one, back to front, because
+            // Ptr may be signed with its address.
             for (int i = oldCount - 1; i >= 0; i--)
-                // 从最后一个开始存取
-                newArray->lists[i + addedCount] = array()->lists[i];
+                newArray->lists[i + addedCount] = oldArray->lists[i];
             // 把 addedLists 中的数据复制到 newArray->lists 起始的内存空间内
             for (unsigned i = 0; i < addedCount; i++)
                 newArray->lists[i] = addedLists[i];
-            
-            // 释放原有 array()
-            free(array());
-            // 更新数组
-            setArray(newArray);
+            newArray->count = newCount;
+
+            if (newArray != oldArray) {
+                free(oldArray);
+                setArray(newArray);
+            }
             validate();
         }
         // 如果类中有方法,第一次进来是主类的方法列表
@@ -33,6 +33,8 @@
 #include "objc-runtime-new.h"
 #include "objc-file.h"
 #include "objc-zalloc.h"
+#include "objc-parallel.h"
+#include "objc-sel-table.h"
 #include <Block.h>
 #include <objc/message.h>
 #include <mach/shared_region.h>
@@ -48,6 +50,7 @@ static method_t *search_method_list(const method_list_t *mlist, SEL sel);
 template<typename T> static bool method_lists_contains_any(T *mlists, T *end,
         SEL sels[], size_t selcount);
 static void flushCaches(Class cls, const char *func, bool (^predicate)(Class c));
+static void flushMethodIndexes(Class cls);
 static void initializeTaggedPointerObfuscator(void);
 #if SUPPORT_FIXUP
 static void fixupMessageRef(message_ref_t *msg);
@@ -74,6 +77,9 @@ static void attachCategories(Class cls, const struct locstamped_category_t *cats
 **********************************************************************/
 mutex_t runtimeLock;
 mutex_t selLock;
+// Serializes fixing up a method list, which may happen with or
+// without runtimeLock. Striped by method list.
+StripedMap<spinlock_t> MethodListFixupLocks;
 #if CONFIG_USE_CACHE_LOCK
 mutex_t cacheUpdateLock;
 #endif
@@ -356,8 +362,8 @@ bool method_list_t::isFixedUp() const {
 
 // 设置固定
 void method_list_t::setFixedUp() {
-    // 加锁
-    runtimeLock.assertLocked();
+    // Callers hold the list's MethodListFixupLocks stripe, or own a
+    // new list no other thread can see yet. runtimeLock need not be held.
     // 如果当前已经是固定的,断言
     ASSERT(!isFixedUp());
     // 通过容器大小 | 3 设置是否是固定的
@@ -1356,23 +1362,15 @@ static bool isBundleClass(Class cls)
 }
 
 
-static void 
-fixupMethodList(method_list_t *mlist, bool bundleCopy, bool sort)
+/***********************************************************************
+* sortAndMarkMethodList
+* Sorts the uniqued selectors of mlist, and marks it fixed up.
+* Locking: mlist's MethodListFixupLocks stripe must be held by the caller.
+**********************************************************************/
+static void
+sortAndMarkMethodList(method_list_t *mlist, bool sort)
 {
-    runtimeLock.assertLocked();
-    ASSERT(!mlist->isFixedUp());
-
-    // fixme lock less in attachMethodLists ?
-    // dyld3 may have already uniqued, but not sorted, the list
-    if (!mlist->isUniqued()) {
-        mutex_locker_t lock(selLock);
-    
-        // Unique selectors in list.
-        for (auto& meth : *mlist) {
-            const char *name = sel_cname(meth.name());
-            meth.setName(sel_registerNameNoLock(name, bundleCopy));
-        }
-    }
+    MethodListFixupLocks[mlist].assertLocked();
 
     // Sort by selector address.
     // 按照 sel 地址排序
@@ -1395,6 +1393,85 @@ fixupMethodList(method_list_t *mlist, bool bundleCopy, bool sort)
     }
 }
 
+
+/***********************************************************************
+* fixupMethodList
+* Uniques and sorts the selectors of mlist, and marks it fixed up.
+* Uniquing may call into dyld to look up builtin selectors.
+* Locking: runtimeLock and mlist's MethodListFixupLocks stripe must be
+*   held by the caller. map_images holds dyld's lock while it waits for
+*   a stripe, and only runtimeLock keeps it out here.
+**********************************************************************/
+static void 
+fixupMethodList(method_list_t *mlist, bool bundleCopy, bool sort)
+{
+    runtimeLock.assertLocked();
+    MethodListFixupLocks[mlist].assertLocked();
+    ASSERT(!mlist->isFixedUp());
+
+    // dyld3 may have already uniqued, but not sorted, the list
+    if (!mlist->isUniqued()) {
+        // Unique selectors in list. Most are registered already and
+        // are found without selLock.
+        for (auto& meth : *mlist) {
+            const char *name = sel_cname(meth.name());
+            meth.setName(sel_registerNameMaybeCopy(name, bundleCopy));
+        }
+    }
+
+    sortAndMarkMethodList(mlist, sort);
+}
+
+
+/***********************************************************************
+* fixupMethodListIfNeeded
+* Fixes up mlist unless another thread already has.
+* Always takes the list's lock, even if mlist looks fixed up, so the
+* caller sees the sorted entries another thread wrote.
+* The selectors are registered with the lock dropped: registering may
+* call into dyld, and map_images holds dyld's lock and runtimeLock
+* while it waits for this lock in prepareMethodLists.
+* Locking: acquires mlist's MethodListFixupLocks stripe.
+*   runtimeLock need not be held.
+**********************************************************************/
+static void
+fixupMethodListIfNeeded(method_list_t *mlist, bool bundleCopy, bool sort)
+{
+    auto& lock = MethodListFixupLocks[mlist];
+    mutex_locker_t locker(lock);
+    if (mlist->isFixedUp()) return;
+    if (mlist->isUniqued()) {
+        // dyld3 uniqued it; nothing to register.
+        return sortAndMarkMethodList(mlist, sort);
+    }
+
+    // Only the thread that fixes the list up writes its names, and
+    // it does so with the lock held, so a copy taken here stays valid
+    // until the list is marked fixed up.
+    uint32_t count = mlist->count;
+    SEL stackSels[64];
+    SEL *sels = count <= 64 ? stackSels : (SEL *)malloc(count * sizeof(SEL));
+    for (uint32_t i = 0; i < count; i++) {
+        sels[i] = mlist->get(i).name();
+    }
+
+    lock.unlock();
+    for (uint32_t i = 0; i < count; i++) {
+        sels[i] = sel_registerNameMaybeCopy(sel_cname(sels[i]), bundleCopy);
+    }
+    lock.lock();
+
+    if (!mlist->isFixedUp()) {
+        // Another thread may have uniqued the names in the meantime,
+        // but they are uniqued to the same selectors.
+        for (uint32_t i = 0; i < count; i++) {
+            mlist->get(i).setName(sels[i]);
+        }
+        sortAndMarkMethodList(mlist, sort);
+    }
+    if (sels != stackSels) free(sels);
+}
+
 // cls: 类
 // addedLists 方法列表
 // addedCount:
@@ -1449,13 +1526,9 @@ prepareMethodLists(Class cls, method_list_t **addedLists, int addedCount,
         // 这里涉及到: struct method_list_t : entsize_list_tt<method_t, method_list_t, 0x3> { ... }
         
         // // 它的 FlagMask 默认是 0x3(0b11)
-        if (!mlist->isFixedUp()) {
-            // 大概是指把方法列表 fixup uniqued and sorted
-            // Mark method list as uniqued and sorted
-            // mlist->setFixedUp();
-
-            fixupMethodList(mlist, methodsFromBundle, true/*sort*/);
-        }
+        // 大概是指把方法列表 fixup uniqued and sorted
+        // Mark method list as uniqued and sorted
+        fixupMethodListIfNeeded(mlist, methodsFromBundle, true/*sort*/);
     }
 
     // If the class is initialized, then scan for method implementations
@@ -1527,76 +1600,90 @@ attachCategories(Class cls, const locstamped_category_t *cats_list, uint32_t cat
 
     /*
      * Only a few classes have more than 64 categories during launch.
-     * This uses a little stack, and avoids malloc.
+     * Up to that many lists of each kind use a little stack; more
+     * use one allocation sized for all of them. Either way each kind
+     * is attached with a single attachLists call, so the class's
+     * arrays are reallocated and its caches flushed once per call
+     * however many categories there are.
      *
      * Categories must be added in the proper order, which is back
-     * to front. To do that with the chunking, we iterate cats_list
-     * from front to back, build up the local buffers backwards,
-     * and call attachLists on the chunks. attachLists prepends the
-     * lists, so the final result is in the expected order.
+     * to front. attachLists prepends the lists it is given in order,
+     * so we iterate cats_list from front to back and fill the buffers
+     * from the back.
      */
     constexpr uint32_t ATTACH_BUFSIZ = 64;
-    method_list_t   *mlists[ATTACH_BUFSIZ];
-    property_list_t *proplists[ATTACH_BUFSIZ];
-    protocol_list_t *protolists[ATTACH_BUFSIZ];
+    method_list_t   *mlistsBuf[ATTACH_BUFSIZ];
+    property_list_t *proplistsBuf[ATTACH_BUFSIZ];
+    protocol_list_t *protolistsBuf[ATTACH_BUFSIZ];
+
+    bool isMeta = (flags & ATTACH_METACLASS);
+    auto rwe = cls->data()->extAllocIfNeeded();
+
+    uint32_t mtotal = 0;
+    uint32_t proptotal = 0;
+    uint32_t protototal = 0;
+    for (uint32_t i = 0; i < cats_count; i++) {
+        auto& entry = cats_list[i];
+        if (entry.cat->methodsForMeta(isMeta)) mtotal++;
+        if (entry.cat->propertiesForMeta(isMeta, entry.hi)) proptotal++;
+        if (entry.cat->protocolsForMeta(isMeta)) protototal++;
+    }
+
+    method_list_t **mlists = mtotal <= ATTACH_BUFSIZ ? mlistsBuf :
+        (method_list_t **)malloc(mtotal * sizeof(*mlists));
+    property_list_t **proplists = proptotal <= ATTACH_BUFSIZ ? proplistsBuf :
+        (property_list_t **)malloc(proptotal * sizeof(*proplists));
+    protocol_list_t **protolists = protototal <= ATTACH_BUFSIZ ? protolistsBuf :
+        (protocol_list_t **)malloc(protototal * sizeof(*protolists));
 
     uint32_t mcount = 0;
     uint32_t propcount = 0;
     uint32_t protocount = 0;
     bool fromBundle = NO;
-    bool isMeta = (flags & ATTACH_METACLASS);
-    auto rwe = cls->data()->extAllocIfNeeded();
 
     for (uint32_t i = 0; i < cats_count; i++) {
         auto& entry = cats_list[i];
 
         method_list_t *mlist = entry.cat->methodsForMeta(isMeta);
         if (mlist) {
-            if (mcount == ATTACH_BUFSIZ) {
-                prepareMethodLists(cls, mlists, mcount, NO, fromBundle, __func__);
-                rwe->methods.attachLists(mlists, mcount);
-                mcount = 0;
-            }
-            mlists[ATTACH_BUFSIZ - ++mcount] = mlist;
+            mlists[mtotal - ++mcount] = mlist;
             fromBundle |= entry.hi->isBundle();
         }
 
         property_list_t *proplist =
             entry.cat->propertiesForMeta(isMeta, entry.hi);
         if (proplist) {
-            if (propcount == ATTACH_BUFSIZ) {
-                rwe->properties.attachLists(proplists, propcount);
-                propcount = 0;
-            }
-            proplists[ATTACH_BUFSIZ - ++propcount] = proplist;
+            proplists[proptotal - ++propcount] = proplist;
         }
 
         protocol_list_t *protolist = entry.cat->protocolsForMeta(isMeta);
         if (protolist) {
-            if (protocount == ATTACH_BUFSIZ) {
-                rwe->protocols.attachLists(protolists, protocount);
-                protocount = 0;
-            }
-            protolists[ATTACH_BUFSIZ - ++protocount] = protolist;
+            protolists[protototal - ++protocount] = protolist;
         }
     }
+    ASSERT(mcount == mtotal  &&  propcount == proptotal  &&
+           protocount == protototal);
 
     if (mcount > 0) {
-        prepareMethodLists(cls, mlists + ATTACH_BUFSIZ - mcount, mcount,
-                           NO, fromBundle, __func__);
-        rwe->methods.attachLists(mlists + ATTACH_BUFSIZ - mcount, mcount);
+        prepareMethodLists(cls, mlists, mcount, NO, fromBundle, __func__);
+        rwe->methods.attachLists(mlists, mcount);
         if (flags & ATTACH_EXISTING) {
             flushCaches(cls, __func__, [](Class c){
                 // constant caches have been dealt with in prepareMethodLists
                 // if the class still is constant here, it's fine to keep
                 return !c->cache.isConstantOptimizedCache();
             });
+            flushMethodIndexes(cls);
         }
     }
 
-    rwe->properties.attachLists(proplists + ATTACH_BUFSIZ - propcount, propcount);
+    rwe->properties.attachLists(proplists, propcount);
 
-    rwe->protocols.attachLists(protolists + ATTACH_BUFSIZ - protocount, protocount);
+    rwe->protocols.attachLists(protolists, protocount);
+
+    if (mlists != mlistsBuf) free(mlists);
+    if (proplists != proplistsBuf) free(proplists);
+    if (protolists != protolistsBuf) free(protolists);
 }
 
 
@@ -3182,6 +3269,59 @@ static Class realizeSwiftClass(Class cls)
 }
 
 
+/***********************************************************************
+* fixupMethodListsBeforeRealizing
+* Fixes up the base method lists of cls and of its unrealized
+* superclasses and metaclasses with runtimeLock dropped. Uniquing and
+* sorting those lists is most of the cost of realizing a class with
+* methods; done here, threads realizing unrelated classes do it in
+* parallel, and methodizeClass later finds the lists fixed up.
+* The rest of realization writes the class tables, subclass lists and
+* category attachments, and stays under runtimeLock.
+* cls may have been realized by another thread on return.
+* Locking: runtimeLock must be held on entry and is held on exit.
+*   It is dropped if any list needs fixing up.
+**********************************************************************/
+static void
+fixupMethodListsBeforeRealizing(Class cls, mutex_t& lock)
+{
+    lock.assertLocked();
+
+    enum { MaxLists = 16 };
+    method_list_t *lists[MaxLists];
+    bool fromBundle[MaxLists];
+    int count = 0;
+
+    auto add = [&](Class c) {
+        if (count == MaxLists) return;
+        auto ro = (const class_ro_t *)c->data();
+        // Future classes have their rw data already; leave them be.
+        if (ro->flags & RO_FUTURE) return;
+        method_list_t *mlist = ro->baseMethods();
+        if (mlist  &&  !mlist->isFixedUp()) {
+            lists[count] = mlist;
+            fromBundle[count] = ro->flags & RO_FROM_BUNDLE;
+            count++;
+        }
+    };
+
+    for (Class c = cls; c  &&  !c->isRealized()  &&  count < MaxLists;
+         c = remapClass(c->getSuperclass()))
+    {
+        add(c);
+        Class meta = remapClass(c->ISA());
+        if (meta  &&  !meta->isRealized()) add(meta);
+    }
+    if (count == 0) return;
+
+    lock.unlock();
+    for (int i = 0; i < count; i++) {
+        fixupMethodListIfNeeded(lists[i], fromBundle[i], true/*sort*/);
+    }
+    lock.lock();
+}
+
+
 /***********************************************************************
 * realizeClassMaybeSwift (MaybeRelock / AndUnlock / AndLeaveLocked)
 * Realize a class that might be a Swift class.
@@ -3199,8 +3339,10 @@ realizeClassMaybeSwiftMaybeRelock(Class cls, mutex_t& lock, bool leaveLocked)
     lock.assertLocked();
 
     if (!cls->isSwiftStable_ButAllowLegacyForNow()) {
-        // Non-Swift class. Realize it now with the lock still held.
+        // Non-Swift class. Fix up its method lists with the lock dropped,
+        // then realize it with the lock held.
         // fixme wrong in the future for objc subclasses of swift classes
+        fixupMethodListsBeforeRealizing(cls, lock);
         realizeClassWithoutSwift(cls, nil);
         if (!leaveLocked) lock.unlock();
     } else {
@@ -3414,10 +3556,12 @@ void _objc_flush_caches(Class cls)
         flushCaches(cls, __func__, [](Class c){
             return !c->cache.isConstantOptimizedCache();
         });
+        flushMethodIndexes(cls);
         if (cls && !cls->isMetaClass() && !cls->isRootClass()) {
             flushCaches(cls->ISA(), __func__, [](Class c){
                 return !c->cache.isConstantOptimizedCache();
             });
+            flushMethodIndexes(cls->ISA());
         } else {
             // cls is a root class or root metaclass. Its metaclass is itself
             // or a subclass so the metaclass caches were already flushed.
@@ -3458,8 +3602,39 @@ map_images(unsigned count, const char * const paths[],
     return map_images_nolock(count, paths, mhdrs);
 }
 
+// Categories for classes that are already realized, collected by
+// load_categories_nolock and attached by attachPendingCategories so that
+// each class gets all of its new categories in one attachCategories call.
+using PendingCategories = objc::DenseMap<Class, category_list>;
+
+static void addPendingCategory(PendingCategories &pending,
+                               locstamped_category_t lc, Class cls)
+{
+    auto result = pending.try_emplace(cls, lc);
+    if (!result.second) {
+        result.first->second.append(lc);
+    }
+}
+
+static void attachPendingCategories(PendingCategories &pending)
+{
+    runtimeLock.assertLocked();
+
+    for (auto &entry : pending) {
+        Class cls = entry.first;
+        category_list &list = entry.second;
+        int flags = ATTACH_EXISTING;
+        if (cls->isMetaClass()) flags |= ATTACH_METACLASS;
+        attachCategories(cls, list.array(), list.count(), flags);
+    }
+    pending.clear();
+}
+
 // 加载 mh 对应的分类
-static void load_categories_nolock(header_info *hi) {
+// Categories for realized classes are added to pending; the caller
+// attaches them with attachPendingCategories once it is done with
+// every image.
+static void load_categories_nolock(header_info *hi, PendingCategories &pending) {
     // hi 中是否有分类的类属性列表
     bool hasClassProperties = hi->info()->hasCategoryClassProperties();
 
@@ -3543,7 +3718,7 @@ static void load_categories_nolock(header_info *hi) {
                 {
                     if (cls->isRealized()) {
                         // 该类已实现，则重建类的方法列表等
-                        attachCategories(cls, &lc, 1, ATTACH_EXISTING);
+                        addPendingCategory(pending, lc, cls);
                     } else {
                         // 这里可以理解为构建 cls 与它的 category 的一个映射
                         // 可参考上节 UnattachedCategories 解析
@@ -3560,7 +3735,7 @@ static void load_categories_nolock(header_info *hi) {
                 {
                     if (cls->ISA()->isRealized()) {
                         // 该元类已实现，则重建该元类的方法列表等
-                        attachCategories(cls->ISA(), &lc, 1, ATTACH_EXISTING | ATTACH_METACLASS);
+                        addPendingCategory(pending, lc, cls->ISA());
                     } else {
                         // 这里可以理解为构建 cls 与它的 category 的一个映射
                         // 可参考上节 UnattachedCategories 解析
@@ -3582,9 +3757,11 @@ static void load_categories_nolock(header_info *hi) {
 static void loadAllCategories() {
     mutex_locker_t lock(runtimeLock);
 
+    PendingCategories pending;
     for (auto *hi = FirstHeader; hi != NULL; hi = hi->getNext()) {
-        load_categories_nolock(hi);
+        load_categories_nolock(hi, pending);
     }
+    attachPendingCategories(pending);
 }
 
 /***********************************************************************
@@ -3971,6 +4148,74 @@ readProtocol(protocol_t *newproto, Class protocol_class,
     }
 }
 
+namespace objc {
+    extern unsigned int ReadImagesThreadCount;
+}
+
+// Don't start threads for fewer selector references than this;
+// creating them costs more than hashing the names.
+enum { ParallelSelectorRefsMin = 8192 };
+
+/***********************************************************************
+* hashSelectorRefs
+* With OBJC_READ_IMAGES_THREADS, hash the names of the selector
+* references of every image that needs them fixed up, on that many
+* threads. Returns a buffer of the hashes, image by image in hList
+* order, and sets *outOffsets to each image's offset into it; or
+* returns nil if the option is off or there are too few references to
+* be worth it. Nothing is allocated in that case. Otherwise the caller
+* frees both buffers.
+* Locking: runtimeLock must be held by the caller. The worker threads
+*   take no locks.
+**********************************************************************/
+static uint64_t *
+hashSelectorRefs(header_info **hList, uint32_t hCount, size_t **outOffsets)
+{
+    runtimeLock.assertLocked();
+    *outOffsets = nil;
+    if (objc::ReadImagesThreadCount < 2) return nil;
+
+    size_t total = 0;
+    for (uint32_t h = 0; h < hCount; h++) {
+        if (hList[h]->hasPreoptimizedSelectors()) continue;
+        size_t count;
+        _getObjc2SelectorRefs(hList[h], &count);
+        total += count;
+    }
+    if (total < ParallelSelectorRefsMin) return nil;
+
+    // Hand out the references in chunks that don't span images.
+    enum { Chunk = 2048 };
+    struct Job { SEL *sels; uint64_t *hashes; size_t count; };
+    uint64_t *hashes = (uint64_t *)malloc(total * sizeof(uint64_t));
+    size_t *offsets = (size_t *)malloc(hCount * sizeof(size_t));
+    Job *jobs = (Job *)malloc((total / Chunk + hCount) * sizeof(Job));
+    size_t jobCount = 0;
+    size_t offset = 0;
+    for (uint32_t h = 0; h < hCount; h++) {
+        offsets[h] = offset;
+        if (hList[h]->hasPreoptimizedSelectors()) continue;
+        size_t count;
+        SEL *sels = _getObjc2SelectorRefs(hList[h], &count);
+        for (size_t i = 0; i < count; i += Chunk) {
+            jobs[jobCount++] = Job{sels + i, hashes + offset + i,
+                                   std::min(count - i, (size_t)Chunk)};
+        }
+        offset += count;
+    }
+
+    objc::parallelFor(jobCount, objc::ReadImagesThreadCount, [jobs](size_t j) {
+        const Job& job = jobs[j];
+        for (size_t i = 0; i < job.count; i++) {
+            job.hashes[i] = objc::SelectorTable::hash(sel_cname(job.sels[i]));
+        }
+    });
+
+    free(jobs);
+    *outOffsets = offsets;
+    return hashes;
+}
+
 /***********************************************************************
 * _read_images
 * Perform initial processing of the headers in the linked 
@@ -4093,6 +4338,15 @@ void _read_images(header_info **hList, uint32_t hCount, int totalClasses, int un
     }
 
     // Fix up @selector references
+    // Hashing the names is the part of fixing up selector references
+    // that can run in parallel. Registering them stays in image order,
+    // so the same copy of each name becomes the selector either way.
+    size_t *selHashOffsets;
+    uint64_t *selHashes = hashSelectorRefs(hList, hCount, &selHashOffsets);
+    if (selHashes) {
+        ts.log("IMAGE TIMES: hash selector references");
+    }
+
     // 修复 sel 应用
     // 静态的未修复的 sels
     static size_t UnfixedSelectors;
@@ -4108,20 +4362,22 @@ void _read_images(header_info **hList, uint32_t hCount, int totalClasses, int un
             SEL *sels = _getObjc2SelectorRefs(hi, &count);
             // 更新未修复的 sel 的数量
             UnfixedSelectors += count;
-            // 循环 sel
-            for (i = 0; i < count; i++) {
-                // 获取sel 名称
-                const char *name = sel_cname(sels[i]);
-                // 根据 name 注册 SEL
-                SEL sel = sel_registerNameNoLock(name, isBundle);
-                // 调整 sel 对应的位置
-                if (sels[i] != sel) {
-                    sels[i] = sel;
-                }
+            // 一次注册整个 image 的 sel, 并调整 sel 对应的位置
+            uint64_t start = PrintImageTimes ? nanoseconds() : 0;
+            size_t added = sel_registerImageSelectorsNoLock(sels, count, isBundle,
+                selHashes ? selHashes + selHashOffsets[hIndex] : nil);
+            if (PrintImageTimes  &&  count) {
+                _objc_inform("IMAGE TIMES: %.2f ms: %zu selector references, "
+                             "%zu new selectors in %s",
+                             (nanoseconds() - start) / 1000000.0,
+                             count, added, hi->fname());
             }
         }
     }
 
+    free(selHashes);
+    free(selHashOffsets);
+
     ts.log("IMAGE TIMES: fix up selector references");
 
     // Discover classes. Fix up unresolved future classes. Mark bundle classes.
@@ -4305,10 +4561,12 @@ void _read_images(header_info **hList, uint32_t hCount, int totalClasses, int un
     
     // 是否已完成启动时存在的categories 的初始附加. 其实就是 load_images 有没有调用
     if (didInitialAttachCategories) {
+        PendingCategories pending;
         for (EACH_HEADER) {
             // 加载 mh 对应的分类
-            load_categories_nolock(hi);
+            load_categories_nolock(hi, pending);
         }
+        attachPendingCategories(pending);
     }
 
     ts.log("IMAGE TIMES: discover categories");
@@ -4850,8 +5108,13 @@ fixupProtocolMethodList(protocol_t *proto, method_list_t *mlist,
     if (mlist->isFixedUp()) return;
 
     const char **extTypes = proto->extendedMethodTypes();
-    fixupMethodList(mlist, true/*always copy for simplicity*/,
-                    !extTypes/*sort if no extended method types*/);
+    {
+        // Protocol method lists are only fixed up with runtimeLock
+        // held, but fixupMethodList wants the list's lock too.
+        mutex_locker_t lock(MethodListFixupLocks[mlist]);
+        fixupMethodList(mlist, true/*always copy for simplicity*/,
+                        !extTypes/*sort if no extended method types*/);
+    }
     
     if (extTypes && !mlist->isSmallList()) {
         // Sort method list and extended method types together.
@@ -5740,6 +6003,38 @@ class_copyImpCache(Class cls, int *outCount)
 }
 
 
+/***********************************************************************
+ * class_getImpCacheStatistics
+ * Copies the method cache counters recorded for cls into *outStats.
+ * Returns false if none have been recorded, either because neither
+ * OBJC_RECORD_CACHE_STATISTICS nor OBJC_ADAPTIVE_CACHE_GROWTH is set or
+ * because cls has not filled its cache yet.
+ * Locking: acquires runtimeLock
+ **********************************************************************/
+bool
+class_getImpCacheStatistics(Class cls, objc_imp_cache_stats *outStats)
+{
+    mutex_locker_t lock(runtimeLock);
+
+    bzero(outStats, sizeof(*outStats));
+    return cls->cache.copyStatisticsNolock(outStats);
+}
+
+
+/***********************************************************************
+ * objc_dumpImpCacheStatistics
+ * Logs the recorded method cache counters of every class.
+ * Locking: acquires runtimeLock
+ **********************************************************************/
+void
+objc_dumpImpCacheStatistics(void)
+{
+    mutex_locker_t lock(runtimeLock);
+
+    cache_t::printStatisticsNolock();
+}
+
+
 /***********************************************************************
 * objc_copyProtocolList
 * Returns pointers to all protocols.
@@ -6546,17 +6841,64 @@ findMethodInSortedMethodList(SEL key, const method_list_t *list, const getNameFu
     return nil;
 }
 
+// Long lists - a few classes have thousands of methods - outgrow the L1
+// cache, and the search above then stalls on mispredicted probes into
+// cold lines. Search them with a branchless lower bound instead, which
+// lands on the first occurrence of the key without rewinding, and
+// prefetch both of the next possible probes.
+// Shorter lists are faster with the search above (hostbench/methodlookup.cpp).
+#define METHOD_LIST_BRANCHLESS_MIN 1024
+
+template<class getNameFunc>
+ALWAYS_INLINE static method_t *
+findMethodInLongSortedMethodList(SEL key, const method_list_t *list, const getNameFunc &getName)
+{
+    ASSERT(list);
+
+    auto first = list->begin();
+    uintptr_t keyValue = (uintptr_t)key;
+    uint32_t count = list->count;
+    uint32_t lower = 0;
+
+    while (count > 1) {
+        uint32_t half = count >> 1;
+        __builtin_prefetch(&*(first + (lower + half / 2)));
+        __builtin_prefetch(&*(first + (lower + half + half / 2)));
+        uintptr_t probeValue = (uintptr_t)getName(*(first + (lower + half)));
+        lower = (probeValue < keyValue) ? lower + half : lower;
+        count -= half;
+    }
+    lower += ((uintptr_t)getName(*(first + lower)) < keyValue);
+
+    if (lower < list->count  &&
+        keyValue == (uintptr_t)getName(*(first + lower)))
+    {
+        return &*(first + lower);
+    }
+    return nil;
+}
+
+template<class getNameFunc>
+ALWAYS_INLINE static method_t *
+findMethodInSortedMethodListOfAnySize(SEL key, const method_list_t *list, const getNameFunc &getName)
+{
+    if (slowpath(list->count >= METHOD_LIST_BRANCHLESS_MIN)) {
+        return findMethodInLongSortedMethodList(key, list, getName);
+    }
+    return findMethodInSortedMethodList(key, list, getName);
+}
+
 ALWAYS_INLINE static method_t *
 findMethodInSortedMethodList(SEL key, const method_list_t *list)
 {
     if (list->isSmallList()) {
         if (CONFIG_SHARED_CACHE_RELATIVE_DIRECT_SELECTORS && objc::inSharedCache((uintptr_t)list)) {
-            return findMethodInSortedMethodList(key, list, [](method_t &m) { return m.getSmallNameAsSEL(); });
+            return findMethodInSortedMethodListOfAnySize(key, list, [](method_t &m) { return m.getSmallNameAsSEL(); });
         } else {
-            return findMethodInSortedMethodList(key, list, [](method_t &m) { return m.getSmallNameAsSELRef(); });
+            return findMethodInSortedMethodListOfAnySize(key, list, [](method_t &m) { return m.getSmallNameAsSELRef(); });
         }
     } else {
-        return findMethodInSortedMethodList(key, list, [](method_t &m) { return m.big().name; });
+        return findMethodInSortedMethodListOfAnySize(key, list, [](method_t &m) { return m.big().name; });
     }
 }
 
@@ -6681,6 +7023,142 @@ getMethodNoSuper_nolock(Class cls, SEL sel)
 }
 
 
+/***********************************************************************
+* Method index
+* With OBJC_METHOD_INDEX set, a class whose method lookups keep missing
+* its cache gets an index of every method it responds to, its own and
+* its superclasses'. lookUpImpOrForward() then finds the method with one
+* hash probe instead of searching every method list of every class up
+* the superclass chain.
+*
+* Each entry points at the method_t that getMethodNoSuper_nolock() would
+* return at the first class in the chain that has one, so changing an
+* IMP needs no invalidation. Adding methods or categories, or changing a
+* superclass, drops the indexes of the class and all its subclasses.
+*
+* An index holds every method of the whole chain, so it is only built
+* once a class has missed MethodIndexMisses times, and never for a
+* chain that uses constant optimized caches.
+* Locking: runtimeLock must be held
+**********************************************************************/
+enum { MethodIndexMisses = 4 };
+
+struct method_index_t {
+    struct entry_t {
+        SEL sel;
+        method_t *meth;
+        Class cls;  // the class meth belongs to
+    };
+
+    entry_t *entries;   // nil until built
+    uint32_t mask;
+    uint16_t misses;
+    bool unindexable;
+
+    static uint32_t slot(SEL sel, uint32_t mask) {
+        return (uint32_t)(((uint64_t)(uintptr_t)sel * 0x9E3779B97F4A7C15ull) >> 32) & mask;
+    }
+
+    const entry_t *find(SEL sel) const {
+        for (uint32_t i = slot(sel, mask); ; i = (i + 1) & mask) {
+            const entry_t& e = entries[i];
+            if (e.sel == sel) return &e;
+            if (!e.sel) return nil;
+        }
+    }
+
+    // The first method found for a selector wins, as in the walk.
+    void add(SEL sel, method_t *meth, Class cls) {
+        uint32_t i = slot(sel, mask);
+        while (entries[i].sel) {
+            if (entries[i].sel == sel) return;
+            i = (i + 1) & mask;
+        }
+        entries[i] = { sel, meth, cls };
+    }
+
+    bool build(Class cls) {
+        uint32_t count = 0;
+        unsigned attempts = unreasonableClassCount();
+        for (Class c = cls; c; c = c->getSuperclass()) {
+            if (c->cache.isConstantOptimizedCache(/* strict */true)) {
+                return false;
+            }
+            if (slowpath(--attempts == 0)) {
+                _objc_fatal("Memory corruption in class list.");
+            }
+            auto const methods = c->data()->methods();
+            for (auto mlists = methods.beginLists(), end = methods.endLists();
+                 mlists != end;
+                 ++mlists)
+            {
+                count += (*mlists)->count;
+            }
+        }
+
+        // At most half full.
+        uint32_t capacity = 16;
+        while (capacity < count * 2) capacity *= 2;
+        mask = capacity - 1;
+        entries = (entry_t *)calloc(capacity, sizeof(entry_t));
+
+        for (Class c = cls; c; c = c->getSuperclass()) {
+            auto const methods = c->data()->methods();
+            for (auto mlists = methods.beginLists(), end = methods.endLists();
+                 mlists != end;
+                 ++mlists)
+            {
+                for (auto& meth : **mlists) add(meth.name(), &meth, c);
+            }
+        }
+        return true;
+    }
+};
+
+static objc::LazyInitDenseMap<Class, method_index_t> methodIndexes;
+
+// Returns cls's index, building it if cls has now missed often enough,
+// or nil if cls has none.
+static method_index_t *
+methodIndexFor(Class cls)
+{
+    runtimeLock.assertLocked();
+
+    auto& index = (*methodIndexes.get(true))[cls];
+    if (index.entries) return &index;
+    if (index.unindexable  ||  ++index.misses < MethodIndexMisses) return nil;
+    if (!index.build(cls)) {
+        index.unindexable = true;
+        return nil;
+    }
+    return &index;
+}
+
+// Drop the indexes of cls and its subclasses. Nil drops every index.
+static void
+flushMethodIndexes(Class cls)
+{
+    runtimeLock.assertLocked();
+
+    auto *map = methodIndexes.get(false);
+    if (!map  ||  map->empty()) return;
+
+    if (!cls) {
+        for (auto& entry : *map) free(entry.second.entries);
+        map->clear();
+        return;
+    }
+    foreach_realized_class_and_subclass(cls, ^(Class c) {
+        auto it = map->find(c);
+        if (it != map->end()) {
+            free(it->second.entries);
+            map->erase(it);
+        }
+        return true;
+    });
+}
+
+
 /***********************************************************************
 * getMethod_nolock
 * fixme
@@ -6877,9 +7355,12 @@ resolveMethod_locked(id inst, SEL sel, Class cls, int behavior)
 * Log this method call. If the logger permits it, fill the method cache.
 * cls is the method whose cache should be filled. 
 * implementer is the class that owns the implementation in question.
+* Returns true if the fill must be completed with 
+* cls->cache.finishInsert(fill) after runtimeLock is released.
 **********************************************************************/
-static void
-log_and_fill_cache(Class cls, IMP imp, SEL sel, id receiver, Class implementer)
+static bool
+log_and_fill_cache(Class cls, IMP imp, SEL sel, id receiver, Class implementer,
+                   cache_fill_t &fill)
 {
 #if SUPPORT_MESSAGE_LOGGING
     if (slowpath(objcMsgLogEnabled && implementer)) {
@@ -6887,10 +7368,13 @@ log_and_fill_cache(Class cls, IMP imp, SEL sel, id receiver, Class implementer)
                                       cls->nameForLogging(),
                                       implementer->nameForLogging(), 
                                       sel);
-        if (!cacheIt) return;
+        if (!cacheIt) return false;
+        // Keep logging and filling under one lock hold.
+        cls->cache.insert(sel, imp, receiver);
+        return false;
     }
 #endif
-    cls->cache.insert(sel, imp, receiver);
+    return cls->cache.beginInsert(sel, imp, receiver, fill);
 }
 
 
@@ -7034,6 +7518,18 @@ IMP lookUpImpOrForward(id inst, SEL sel, Class cls, int behavior)
     // The only codepath calling into this without having performed some
     // kind of cache lookup is class_getInstanceMethod().
 
+    if (slowpath(MethodIndex)  &&  cls->isInitialized()) {
+        if (method_index_t *index = methodIndexFor(cls)) {
+            if (auto *entry = index->find(sel)) {
+                imp = entry->meth->imp(false);
+                curClass = entry->cls;
+                goto done;
+            }
+            imp = forward_imp;
+            goto resolve;
+        }
+    }
+
     for (unsigned attempts = unreasonableClassCount();;) {
         if (curClass->cache.isConstantOptimizedCache(/* strict */true)) {
 #if CONFIG_USE_PREOPT_CACHES
@@ -7072,12 +7568,13 @@ IMP lookUpImpOrForward(id inst, SEL sel, Class cls, int behavior)
         }
         if (fastpath(imp)) {
             // Found the method in a superclass. Cache it in this class.
+            curClass->cache.recordHit();
             goto done;
         }
     }
 
     // No implementation found. Try method resolver once.
-
+ resolve:
     if (slowpath(behavior & LOOKUP_RESOLVER)) {
         behavior ^= LOOKUP_RESOLVER;
         return resolveMethod_locked(inst, sel, cls, behavior);
@@ -7090,10 +7587,18 @@ IMP lookUpImpOrForward(id inst, SEL sel, Class cls, int behavior)
             cls = cls->cache.preoptFallbackClass();
         }
 #endif
-        log_and_fill_cache(cls, imp, sel, inst, curClass);
+        // The cache slot is reserved under runtimeLock but written after
+        // it is released, so concurrent misses don't serialize on the fill.
+        cache_fill_t fill;
+        if (log_and_fill_cache(cls, imp, sel, inst, curClass, fill)) {
+            runtimeLock.unlock();
+            cls->cache.finishInsert(fill);
+            goto done_unlocked;
+        }
     }
  done_unlock:
     runtimeLock.unlock();
+ done_unlocked:
     if (slowpath((behavior & LOOKUP_NIL) && imp == forward_imp)) {
         return nil;
     }
@@ -7634,6 +8139,7 @@ addMethods_finish(Class cls, method_list_t *newlist)
         // if the class still is constant here, it's fine to keep
         return !c->cache.isConstantOptimizedCache();
     });
+    flushMethodIndexes(cls);
 }
 
 
@@ -8428,6 +8934,7 @@ static void free_class(Class cls)
     auto ro = rw->ro();
 
     cls->cache.destroy();
+    flushMethodIndexes(cls);
 
     if (rwe) {
         for (auto& meth : rwe->methods) {
@@ -9136,6 +9643,8 @@ static Class setSuperclass(Class cls, Class newSuper)
     // Flush subclass's method caches.
     flushCaches(cls, __func__, [](Class c){ return true; });
     flushCaches(cls->ISA(), __func__, [](Class c){ return true; });
+    flushMethodIndexes(cls);
+    flushMethodIndexes(cls->ISA());
 
     return oldSuper;
 }
@@ -90,6 +90,12 @@ const option_t Settings[] = {
 
 namespace objc {
     int PageCountWarning = 50;  // Default value if the environment variable is not set
+    unsigned int SideTableStripeCount = 0;  // 0 means StripedMap's default
+    unsigned int PoolPageCacheLimit = 1;
+    unsigned int PoolFreePageLimit = 256;
+    unsigned int AutoreleaseCoalescingWindow = 4;
+    unsigned int RetainReleaseSamplePeriod = 0;  // 0 means off
+    unsigned int ReadImagesThreadCount = 0;  // 0 means the calling thread only
 }
 
 // objc's key for pthread_getspecific
@@ -374,6 +380,55 @@ void SetPageCountWarning(const char* envvar) {
     }
 }
 
+/***********************************************************************
+* NumericSettings
+* Options whose value is a number rather than YES. A value outside 
+* [min, max] is ignored. An accepted value also sets the option's 
+* OPTION() flag so OBJC_PRINT_OPTIONS lists it.
+**********************************************************************/
+struct numeric_option_t {
+    bool* var;
+    const char *env;
+    unsigned int *value;
+    long min;
+    long max;
+    size_t envlen;
+};
+
+static const numeric_option_t NumericSettings[] = {
+#define NUMERIC_OPTION(var, env, value, min, max) \
+    numeric_option_t{&var, #env, &value, min, max, strlen(#env)},
+    // StripedMap rounds the stripe count up to a power of two and clamps it.
+    NUMERIC_OPTION(SideTableStripes,    OBJC_SIDE_TABLE_STRIPES,            objc::SideTableStripeCount,        1, INT_MAX)
+    NUMERIC_OPTION(PoolPageCache,       OBJC_POOL_PAGE_CACHE,               objc::PoolPageCacheLimit,          0, 65536)
+    NUMERIC_OPTION(PoolFreePages,       OBJC_POOL_FREE_PAGES,               objc::PoolFreePageLimit,           0, 1048576)
+    NUMERIC_OPTION(CoalescingWindow,    OBJC_AUTORELEASE_COALESCING_WINDOW, objc::AutoreleaseCoalescingWindow, 1, 8)
+    NUMERIC_OPTION(SampleRetainRelease, OBJC_SAMPLE_RETAIN_RELEASE,         objc::RetainReleaseSamplePeriod,   0, 1<<20)
+    NUMERIC_OPTION(ReadImagesThreads,   OBJC_READ_IMAGES_THREADS,           objc::ReadImagesThreadCount,       0, 64)
+#undef NUMERIC_OPTION
+};
+
+/***********************************************************************
+* SetNumericOption
+* If envvar names one of NumericSettings, parse its value and return true.
+**********************************************************************/
+static bool SetNumericOption(const char *envvar, const char *value) {
+    for (size_t i = 0; i < sizeof(NumericSettings)/sizeof(NumericSettings[0]); i++) {
+        const numeric_option_t *opt = &NumericSettings[i];
+        if ((size_t)(value - envvar) == 1+opt->envlen  &&  
+            0 == strncmp(envvar, opt->env, opt->envlen))
+        {
+            long result = strtol(value, NULL, 10);
+            if (result >= opt->min && result <= opt->max) {
+                *opt->value = (unsigned int)result;
+                *opt->var = true;
+            }
+            return true;
+        }
+    }
+    return false;
+}
+
 /***********************************************************************
 * environ_init
 * Read environment variables that affect the runtime.
@@ -437,6 +492,8 @@ void environ_init(void)
         const char *value = strchr(*p, '=');
         if (!*value) continue;
         value++;
+
+        if (SetNumericOption(*p, value)) continue;
         
         for (size_t i = 0; i < sizeof(Settings)/sizeof(Settings[0]); i++) {
             const option_t *opt = &Settings[i];
@@ -580,6 +637,7 @@ void _objc_pthread_destroyspecific(void *arg)
             }
         }
         free(data->classNameLookups);
+        _destroyRetainReleaseSampler(data->rrSampler);
 
         // add further cleanup here...
 
@@ -0,0 +1,213 @@
+/*
+ * Copyright (c) 2021 Apple Inc.  All Rights Reserved.
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ *
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this
+ * file.
+ *
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ *
+ * @APPLE_LICENSE_HEADER_END@
+ */
+
+/**
+ * @file objc-sel-table.h
+ *
+ * The table of selectors registered at runtime, keyed by name.
+ *
+ * Lookups take no lock. Inserts are serialized by the caller (selLock).
+ * Selectors are never removed, so a reader only has to cope with
+ * entries appearing and with the table being replaced when it grows.
+ */
+
+#ifndef _OBJC_SEL_TABLE_H
+#define _OBJC_SEL_TABLE_H
+
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <atomic>
+
+namespace objc {
+
+class SelectorTable {
+    static constexpr auto relaxed = std::memory_order_relaxed;
+    static constexpr auto acquire = std::memory_order_acquire;
+    static constexpr auto release = std::memory_order_release;
+
+    // An entry's hash is written before its name. A reader that sees
+    // the name also sees the hash, and only compares strings whose
+    // whole 64-bit hash matches.
+    struct Entry {
+        std::atomic<const char *> name;  // nullptr if empty
+        std::atomic<uint64_t> hash;
+    };
+
+    struct Table {
+        uint32_t mask;
+        uint32_t occupied;
+        Table *retired;  // the table this one replaced
+        Entry entries[0];
+
+        static Table *create(uint32_t capacity) {
+            Table *t = (Table *)
+                calloc(1, sizeof(Table) + capacity * sizeof(Entry));
+            t->mask = capacity - 1;
+            return t;
+        }
+
+        // Writer only.
+        void add(const char *name, uint64_t hash) {
+            uint32_t i = (uint32_t)hash & mask;
+            while (entries[i].name.load(relaxed)) i = (i + 1) & mask;
+            entries[i].hash.store(hash, relaxed);
+            entries[i].name.store(name, release);
+            occupied++;
+        }
+    };
+
+    std::atomic<Table *> _table;
+
+    static uint32_t capacityFor(uint32_t count) {
+        // At most 3/4 full.
+        uint32_t capacity = 16;
+        while (capacity / 4 * 3 < count) capacity *= 2;
+        return capacity;
+    }
+
+    // Replace the table with one big enough for count names. Readers
+    // may still be probing the old table, so it is never freed.
+    void grow(uint32_t count) {
+        Table *old = _table.load(relaxed);
+        Table *t = Table::create(capacityFor(count));
+        if (old) {
+            for (uint32_t i = 0; i <= old->mask; i++) {
+                Entry& e = old->entries[i];
+                if (const char *name = e.name.load(relaxed)) {
+                    t->add(name, e.hash.load(relaxed));
+                }
+            }
+        }
+        t->retired = old;
+        _table.store(t, release);
+    }
+
+public:
+    constexpr SelectorTable() : _table(nullptr) { }
+
+    // FNV-1a over the whole name. Callers hash once and pass the
+    // result to find() and insert().
+    static uint64_t hash(const char *name) {
+        uint64_t h = 0xcbf29ce484222325ull;
+        for (const unsigned char *p = (const unsigned char *)name; *p; p++) {
+            h = (h ^ *p) * 0x100000001b3ull;
+        }
+        return h;
+    }
+
+    // Writer only. Presize for count names.
+    void init(uint32_t count) {
+        Table *t = _table.load(relaxed);
+        if (!t  ||  capacityFor(count) > t->mask + 1) grow(count);
+    }
+
+    // Returns the registered copy of name, or nullptr. Safe without
+    // the lock, but may miss a name inserted concurrently.
+    const char *find(const char *name, uint64_t h) const {
+        Table *t = _table.load(acquire);
+        if (!t) return nullptr;
+        for (uint32_t i = (uint32_t)h & t->mask, probes = 0;
+             probes <= t->mask;
+             i = (i + 1) & t->mask, probes++)
+        {
+            const Entry& e = t->entries[i];
+            const char *entryName = e.name.load(acquire);
+            if (!entryName) return nullptr;
+            if (e.hash.load(relaxed) == h  &&
+                (entryName == name  ||  0 == strcmp(entryName, name)))
+            {
+                return entryName;
+            }
+        }
+        return nullptr;
+    }
+
+    // Writer only. name must not be present already.
+    void insert(const char *name, uint64_t h) {
+        Table *t = _table.load(relaxed);
+        if (!t  ||  (t->occupied + 1) > (t->mask + 1) / 4 * 3) {
+            grow(t ? t->occupied + 1 : 1);
+            t = _table.load(relaxed);
+        }
+        t->add(name, h);
+    }
+
+    // Writer only.
+    uint32_t count() const {
+        Table *t = _table.load(relaxed);
+        return t ? t->occupied : 0;
+    }
+
+    // Writer only.
+    uint32_t capacity() const {
+        Table *t = _table.load(relaxed);
+        return t ? t->mask + 1 : 0;
+    }
+
+    // Writer only. Replace each of names[0..n) with its registered copy,
+    // as registering them one at a time would. builtin(name) returns a
+    // name registered elsewhere or nullptr; alloc(name) returns the copy
+    // to insert for a new name. Returns the number of names inserted.
+    // If hashes is not null, hashes[i] must be hash(names[i]).
+    //
+    // The table grows only when new names fill it. It then grows for
+    // the rest of the batch at the rate new names have come so far, so
+    // a batch is usually rehashed once, and a batch that is mostly
+    // registered already doesn't leave behind an oversized table, which
+    // would be kept for good since retired tables are never freed.
+    template <typename Builtin, typename Alloc>
+    size_t insertAll(const char **names, size_t n,
+                     const Builtin& builtin, const Alloc& alloc,
+                     const uint64_t *hashes = nullptr)
+    {
+        Table *t = _table.load(relaxed);
+        size_t added = 0;
+        for (size_t i = 0; i < n; i++) {
+            const char *name = names[i];
+            uint64_t h = hashes ? hashes[i] : hash(name);
+            const char *registered = find(name, h);
+            if (!registered) registered = builtin(name);
+            if (!registered) {
+                if (!t  ||  t->occupied + 1 > (t->mask + 1) / 4 * 3) {
+                    // names[i..n) at the rate of names[0..i], this one
+                    // counted as new, rounded up.
+                    uint64_t expected =
+                        ((uint64_t)(n - i) * (added + 1) + i) / (i + 1);
+                    grow((t ? t->occupied : 0) + (uint32_t)expected);
+                    t = _table.load(relaxed);
+                }
+                registered = alloc(name);
+                t->add(registered, h);
+                added++;
+            }
+            // Don't dirty the page if the name is already the one.
+            if (name != registered) names[i] = registered;
+        }
+        return added;
+    }
+};
+
+} // namespace objc
+
+#endif
@@ -24,9 +24,9 @@
 #if __OBJC2__
 
 #include "objc-private.h"
-#include "DenseMapExtras.h"
+#include "objc-sel-table.h"
 
-static objc::ExplicitInitDenseSet<const char *> namedSelectors;
+static objc::SelectorTable namedSelectors;
 static SEL search_builtins(const char *key);
 
 
@@ -42,14 +42,14 @@ void sel_init(size_t selrefCount)
         _objc_inform("PREOPTIMIZATION: using dyld selector opt");
     }
 #endif
-  // 初始化sel 表,根据 sel 数量
-  namedSelectors.init((unsigned)selrefCount);
+    // 加锁
+    mutex_locker_t lock(selLock);
+
+    // 初始化sel 表,根据 sel 数量
+    namedSelectors.init((uint32_t)selrefCount);
 
     // Register selectors used by libobjc
     // 注册被 libobjc 使用的 sels
-    
-    // 加锁
-    mutex_locker_t lock(selLock);
     // 注册c++构造函数
     SEL_cxx_construct = sel_registerNameNoLock(".cxx_construct", NO);
     // 注册c++析构函数
@@ -89,9 +89,7 @@ BOOL sel_isMapped(SEL sel)
 
     if (sel == search_builtins(name)) return YES;
 
-    mutex_locker_t lock(selLock);
-    auto it = namedSelectors.get().find(name);
-    return it != namedSelectors.get().end() && (SEL)*it == sel;
+    return namedSelectors.find(name, objc::SelectorTable::hash(name)) == name;
 }
 
 
@@ -116,14 +114,23 @@ static SEL __sel_registerName(const char *name, bool shouldLock, bool copy)
 
     result = search_builtins(name);
     if (result) return result;
-    
+
+    // Names that are already registered need no lock.
+    uint64_t hash = objc::SelectorTable::hash(name);
+    if (const char *found = namedSelectors.find(name, hash)) {
+        return (SEL)found;
+    }
+
+    // Look again with the lock held, in case another thread
+    // registered the name in the meantime.
     conditional_mutex_locker_t lock(selLock, shouldLock);
-	auto it = namedSelectors.get().insert(name);
-	if (it.second) {
-		// No match. Insert.
-		*it.first = (const char *)sel_alloc(name, copy);
-	}
-	return (SEL)*it.first;
+    if (const char *found = namedSelectors.find(name, hash)) {
+        return (SEL)found;
+    }
+    // No match. Insert.
+    result = sel_alloc(name, copy);
+    namedSelectors.insert((const char *)result, hash);
+    return result;
 }
 
 
@@ -135,6 +142,32 @@ SEL sel_registerNameNoLock(const char *name, bool copy) {
     return __sel_registerName(name, 0, copy);  // NO lock, maybe copy
 }
 
+SEL sel_registerNameMaybeCopy(const char *name, bool copy) {
+    return __sel_registerName(name, 1, copy);  // YES lock, maybe copy
+}
+
+
+/***********************************************************************
+* sel_registerImageSelectorsNoLock
+* Register the names of an image's selector references and point each
+* reference at its selector, like sel_registerNameNoLock() on each.
+* hashes, if not nil, holds SelectorTable::hash() of each name.
+* See SelectorTable::insertAll(). Returns the number of new selectors.
+* Locking: selLock must be held by the caller
+**********************************************************************/
+size_t sel_registerImageSelectorsNoLock(SEL *sels, size_t count, bool copy,
+                                        const uint64_t *hashes)
+{
+    selLock.assertLocked();
+    return namedSelectors.insertAll((const char **)sels, count,
+        [](const char *name) {
+            return (const char *)search_builtins(name);
+        },
+        [copy](const char *name) {
+            return (const char *)sel_alloc(name, copy);
+        }, hashes);
+}
+
 
 // 2001/1/24
 // the majority of uses of this function (which used to return NULL if not found)
@@ -24,6 +24,7 @@
 #include "objc-private.h"
 #include "objc-sync.h"
 
+
 //
 // Allocate a lock only when needed.  Since few locks are needed at any point
 // in time, keep them on a single list.
@@ -34,6 +35,7 @@ typedef struct alignas(CacheLineSize) SyncData {
     struct SyncData* nextData;
     DisguisedPtr<objc_object> object;
     int32_t threadCount;  // number of THREADS using this block
+    uint32_t idleWalks;   // reclaim_idle passes that spared this idle block
     recursive_mutex_t mutex;
 } SyncData;
 
@@ -59,15 +61,160 @@ typedef struct SyncCache {
 struct SyncList {
     SyncData *data;
     spinlock_t lock;
-
-    constexpr SyncList() : data(nil), lock(fork_unsafe_lock) { }
+    // objc_getSyncDataStatistics counters, only written with lock held.
+    uint32_t live;
+    uint64_t reused;
+    uint64_t reclaimed;
+
+    constexpr SyncList()
+        : data(nil), lock(fork_unsafe_lock), live(0), reused(0), reclaimed(0)
+    { }
 };
 
+/*
+  Idle SyncData reclamation: a list keeps its first SYNC_IDLE_KEEP idle
+  blocks for reuse. Any other idle block is freed once SYNC_IDLE_WALKS
+  list walks have passed it without it being used, so a burst of
+  simultaneously locked objects does not leave a long list behind.
+  Walks only count while the list has more than SYNC_IDLE_KEEP idle
+  blocks.
+  A block is idle when its threadCount is zero. threadCount only rises
+  from zero with the list lock held, and a thread never touches a block
+  after dropping its threadCount, so an idle block seen with the list
+  lock held can be freed.
+ */
+#define SYNC_IDLE_KEEP 4
+#define SYNC_IDLE_WALKS 16
+
+// A SyncCache shrinks by half when a release leaves it a quarter full,
+// down to SYNC_CACHE_MIN entries.
+#define SYNC_CACHE_MIN 4
+
 // Use multiple parallel lists to decrease contention among unrelated objects.
-#define LOCK_FOR_OBJ(obj) sDataLists[obj].lock
-#define LIST_FOR_OBJ(obj) sDataLists[obj].data
 static StripedMap<SyncList> sDataLists;
 
+/*
+  Thin locks: an object that only one thread synchronizes on at a time
+  never gets a SyncData. Entering CASes the object into a ThinLock word
+  and exiting stores zero. The holder keeps the object and its recursion
+  count in the fast cache, with SYNC_THIN_LOCKED set in the count.
+
+  A thread that finds the object already thin-locked, or whose fast
+  cache is taken, uses a SyncData instead. fatUsers counts the SyncData
+  holds of all objects sharing the word, and no thin lock is taken
+  there while it is nonzero. So a SyncData user first joins fatUsers,
+  then waits for any thin holder of its object to leave, then locks the
+  mutex. The CAS and the fatUsers check are sequentially consistent
+  against the fatUsers increment and the holder check, so at least one
+  side sees the other.
+
+  A thin holder also holds the word's gate from its first enter to its
+  last exit. A SyncData user waits for the holder by locking the gate,
+  so it blocks in the kernel and donates its priority to the holder, as
+  it would waiting on the SyncData mutex. Like that mutex the gate is
+  held across user code, so it is a fork_unsafe_lock: lockdebug does
+  not order it against the runtime's locks, and fork() leaves it alone.
+ */
+struct ThinLock {
+    std::atomic<uintptr_t> holder;  // thin-locked object, or 0
+    std::atomic<uint32_t> fatUsers;
+    mutex_t gate;                   // held by the thin holder
+
+    constexpr ThinLock() : holder(0), fatUsers(0), gate(fork_unsafe_lock) { }
+};
+static StripedMap<ThinLock> ThinLocks;
+
+#if SUPPORT_DIRECT_THREAD_KEYS
+#define SYNC_THIN_LOCKED (1UL << (8*sizeof(uintptr_t) - 1))
+
+// Take obj's thin lock or add a recursion to it.
+// Returns false if obj must use a SyncData.
+static ALWAYS_INLINE bool thin_enter(id obj)
+{
+    uintptr_t lockCount = (uintptr_t)tls_get_direct(SYNC_COUNT_DIRECT_KEY);
+    if (lockCount & SYNC_THIN_LOCKED) {
+        if (tls_get_direct(SYNC_DATA_DIRECT_KEY) != obj) return false;
+        tls_set_direct(SYNC_COUNT_DIRECT_KEY, (void*)(lockCount + 1));
+        return true;
+    }
+    if (tls_get_direct(SYNC_DATA_DIRECT_KEY)) return false;
+
+    ThinLock& thin = ThinLocks[obj];
+    uintptr_t expected = 0;
+    if (!thin.holder.compare_exchange_strong(expected, (uintptr_t)obj)) {
+        return false;
+    }
+    // The gate is only held here by a waiting SyncData user, which
+    // means fatUsers is nonzero.
+    if (slowpath(!thin.gate.tryLock())) {
+        thin.holder.store(0, std::memory_order_release);
+        return false;
+    }
+    if (slowpath(thin.fatUsers.load() != 0)) {
+        thin.gate.unlock();
+        thin.holder.store(0, std::memory_order_release);
+        return false;
+    }
+    tls_set_direct(SYNC_DATA_DIRECT_KEY, obj);
+    tls_set_direct(SYNC_COUNT_DIRECT_KEY, (void*)(SYNC_THIN_LOCKED | 1));
+    return true;
+}
+
+// Drop one recursion of obj's thin lock.
+// Returns false if this thread does not hold obj's thin lock.
+static ALWAYS_INLINE bool thin_exit(id obj)
+{
+    uintptr_t lockCount = (uintptr_t)tls_get_direct(SYNC_COUNT_DIRECT_KEY);
+    if (!(lockCount & SYNC_THIN_LOCKED)  ||
+        tls_get_direct(SYNC_DATA_DIRECT_KEY) != obj)
+    {
+        return false;
+    }
+    lockCount--;
+    if (lockCount != SYNC_THIN_LOCKED) {
+        tls_set_direct(SYNC_COUNT_DIRECT_KEY, (void*)lockCount);
+        return true;
+    }
+    tls_set_direct(SYNC_DATA_DIRECT_KEY, NULL);
+    tls_set_direct(SYNC_COUNT_DIRECT_KEY, (void*)0);
+    // Unlocking wakes any SyncData user waiting on the gate. Clearing
+    // holder after it keeps a new thin holder from finding the gate
+    // still locked.
+    ThinLock& thin = ThinLocks[obj];
+    thin.gate.unlock();
+    thin.holder.store(0, std::memory_order_release);
+    return true;
+}
+#endif
+
+// Join obj's fatUsers and wait for its thin holder, if any, to leave.
+// The wait blocks on the word's gate, which the holder owns, so the
+// holder runs with this thread's priority until it leaves. Once
+// fatUsers is nonzero a new thin lock on the word is given up as soon
+// as it is taken, so the loop only goes around again for one of those
+// or when the gate is unlocked a moment before holder is cleared.
+// With wait == false gives up instead of waiting.
+static bool fat_begin(id obj, bool wait = true)
+{
+    ThinLock& thin = ThinLocks[obj];
+    thin.fatUsers.fetch_add(1);
+    while (thin.holder.load() == (uintptr_t)obj) {
+        if (!wait) {
+            thin.fatUsers.fetch_sub(1, std::memory_order_release);
+            return false;
+        }
+        thin.gate.lock();
+        thin.gate.unlock();
+    }
+    return true;
+}
+
+// Leave obj's fatUsers after unlocking its SyncData.
+static void fat_end(id obj)
+{
+    ThinLocks[obj].fatUsers.fetch_sub(1, std::memory_order_release);
+}
+
 
 enum usage { ACQUIRE, RELEASE, CHECK };
 
@@ -82,7 +229,7 @@ static SyncCache *fetch_cache(bool create)
         if (!create) {
             return NULL;
         } else {
-            int count = 4;
+            int count = SYNC_CACHE_MIN;
             data->syncCache = (SyncCache *)
                 calloc(1, sizeof(SyncCache) + count*sizeof(SyncCacheItem));
             data->syncCache->allocated = count;
@@ -101,6 +248,50 @@ static SyncCache *fetch_cache(bool create)
 }
 
 
+// Shrink the current thread's cache after removing an entry.
+static void shrink_cache(SyncCache *cache)
+{
+    if (cache->allocated <= SYNC_CACHE_MIN  ||
+        cache->used > cache->allocated / 4)
+    {
+        return;
+    }
+
+    _objc_pthread_data *data = _objc_fetch_pthread_data(NO);
+    ASSERT(data  &&  data->syncCache == cache);
+    cache->allocated /= 2;
+    data->syncCache = (SyncCache *)
+        realloc(cache, sizeof(SyncCache)
+                + cache->allocated * sizeof(SyncCacheItem));
+}
+
+
+// Free idle blocks past the first SYNC_IDLE_KEEP that have been idle for
+// SYNC_IDLE_WALKS list walks. keep is about to be reused and is skipped.
+// Locking: list.lock must be held.
+static void reclaim_idle(SyncList& list, SyncData *keep)
+{
+    unsigned int kept = 0;
+    SyncData **pp = &list.data;
+    while (SyncData *p = *pp) {
+        if (p->threadCount != 0  ||  p == keep) {
+            pp = &p->nextData;
+            continue;
+        }
+        if (kept < SYNC_IDLE_KEEP  ||  ++p->idleWalks <= SYNC_IDLE_WALKS) {
+            kept++;
+            pp = &p->nextData;
+            continue;
+        }
+        *pp = p->nextData;
+        p->mutex.~recursive_mutex_t();
+        free(p);
+        list.live--;
+        list.reclaimed++;
+    }
+}
+
+
 void _destroySyncCache(struct SyncCache *cache)
 {
     if (cache) free(cache);
@@ -109,8 +300,9 @@ void _destroySyncCache(struct SyncCache *cache)
 
 static SyncData* id2data(id object, enum usage why)
 {
-    spinlock_t *lockp = &LOCK_FOR_OBJ(object);
-    SyncData **listp = &LIST_FOR_OBJ(object);
+    SyncList& list = sDataLists[object];
+    spinlock_t *lockp = &list.lock;
+    SyncData **listp = &list.data;
     SyncData* result = NULL;
 
 #if SUPPORT_DIRECT_THREAD_KEYS
@@ -120,7 +312,10 @@ static SyncData* id2data(id object, enum usage why)
     if (data) {
         fastCacheOccupied = YES;
 
-        if (data->object == object) {
+        // A thin lock in the fast cache has no SyncData.
+        if (((uintptr_t)tls_get_direct(SYNC_COUNT_DIRECT_KEY) & SYNC_THIN_LOCKED) == 0  &&
+            data->object == object)
+        {
             // Found a match in fast cache.
             uintptr_t lockCount;
 
@@ -137,6 +332,9 @@ static SyncData* id2data(id object, enum usage why)
                 break;
             }
             case RELEASE:
+                // Unlock before dropping threadCount, after which the
+                // block may be reclaimed.
+                if (!result->mutex.tryUnlock()) return nil;
                 lockCount--;
                 tls_set_direct(SYNC_COUNT_DIRECT_KEY, (void*)lockCount);
                 if (lockCount == 0) {
@@ -175,12 +373,16 @@ static SyncData* id2data(id object, enum usage why)
                 item->lockCount++;
                 break;
             case RELEASE:
+                // Unlock before dropping threadCount, after which the
+                // block may be reclaimed.
+                if (!result->mutex.tryUnlock()) return nil;
                 item->lockCount--;
                 if (item->lockCount == 0) {
                     // remove from per-thread cache
                     cache->list[i] = cache->list[--cache->used];
                     // atomic because may collide with concurrent ACQUIRE
                     OSAtomicDecrement32Barrier(&result->threadCount);
+                    shrink_cache(cache);
                 }
                 break;
             case CHECK:
@@ -204,26 +406,38 @@ static SyncData* id2data(id object, enum usage why)
     {
         SyncData* p;
         SyncData* firstUnused = NULL;
+        unsigned int idle = 0;
         for (p = *listp; p != NULL; p = p->nextData) {
             if ( p->object == object ) {
                 result = p;
-                // atomic because may collide with concurrent RELEASE
-                OSAtomicIncrement32Barrier(&result->threadCount);
+                // A thread that does not hold the lock gets nothing,
+                // so only ACQUIRE counts as a use.
+                if (why == ACQUIRE) {
+                    result->idleWalks = 0;
+                    // atomic because may collide with concurrent RELEASE
+                    OSAtomicIncrement32Barrier(&result->threadCount);
+                }
                 goto done;
             }
-            if ( (firstUnused == NULL) && (p->threadCount == 0) )
-                firstUnused = p;
+            if (p->threadCount == 0) {
+                idle++;
+                if (firstUnused == NULL) firstUnused = p;
+            }
         }
     
         // no SyncData currently associated with object
         if ( (why == RELEASE) || (why == CHECK) )
             goto done;
+
+        if (idle > SYNC_IDLE_KEEP) reclaim_idle(list, firstUnused);
     
         // an unused one was found, use it
         if ( firstUnused != NULL ) {
             result = firstUnused;
             result->object = (objc_object *)object;
             result->threadCount = 1;
+            result->idleWalks = 0;
+            list.reused++;
             goto done;
         }
     }
@@ -231,13 +445,15 @@ static SyncData* id2data(id object, enum usage why)
     // Allocate a new SyncData and add to list.
     // XXX allocating memory with a global lock held is bad practice,
     // might be worth releasing the lock, allocating, and searching again.
-    // But since we never free these guys we won't be stuck in allocation very often.
+    // But since idle blocks are reused first we won't be stuck in allocation very often.
     posix_memalign((void **)&result, alignof(SyncData), sizeof(SyncData));
     result->object = (objc_object *)object;
     result->threadCount = 1;
+    result->idleWalks = 0;
     new (&result->mutex) recursive_mutex_t(fork_unsafe_lock);
     result->nextData = *listp;
     *listp = result;
+    list.live++;
     
  done:
     lockp->unlock();
@@ -273,6 +489,42 @@ static SyncData* id2data(id object, enum usage why)
 }
 
 
+// Undo id2data(obj, ACQUIRE) for a lock this thread failed to take.
+// The mutex is recursive, so the thread did not already hold it, and
+// the acquire made a new cache entry with a lockCount of 1. Dropping
+// the entry and its threadCount lets the record be reclaimed.
+static void id2data_abandon(SyncData *data)
+{
+#if SUPPORT_DIRECT_THREAD_KEYS
+    if (tls_get_direct(SYNC_DATA_DIRECT_KEY) == data) {
+        uintptr_t lockCount = (uintptr_t)tls_get_direct(SYNC_COUNT_DIRECT_KEY);
+        if (lockCount != 1) _objc_fatal("id2data fastcache is buggy");
+        tls_set_direct(SYNC_DATA_DIRECT_KEY, NULL);
+        tls_set_direct(SYNC_COUNT_DIRECT_KEY, (void*)0);
+        // atomic because may collide with concurrent ACQUIRE
+        OSAtomicDecrement32Barrier(&data->threadCount);
+        return;
+    }
+#endif
+
+    SyncCache *cache = fetch_cache(NO);
+    if (cache) {
+        for (unsigned int i = 0; i < cache->used; i++) {
+            if (cache->list[i].data != data) continue;
+            if (cache->list[i].lockCount != 1) {
+                _objc_fatal("id2data cache is buggy");
+            }
+            cache->list[i] = cache->list[--cache->used];
+            // atomic because may collide with concurrent ACQUIRE
+            OSAtomicDecrement32Barrier(&data->threadCount);
+            shrink_cache(cache);
+            return;
+        }
+    }
+    _objc_fatal("id2data is buggy");
+}
+
+
 BREAKPOINT_FUNCTION(
     void objc_sync_nil(void)
 );
@@ -286,6 +538,10 @@ int objc_sync_enter(id obj)
     int result = OBJC_SYNC_SUCCESS;
 
     if (obj) {
+#if SUPPORT_DIRECT_THREAD_KEYS
+        if (fastpath(thin_enter(obj))) return result;
+#endif
+        fat_begin(obj);
         SyncData* data = id2data(obj, ACQUIRE);
         ASSERT(data);
         data->mutex.lock();
@@ -305,9 +561,17 @@ BOOL objc_sync_try_enter(id obj)
     BOOL result = YES;
 
     if (obj) {
+#if SUPPORT_DIRECT_THREAD_KEYS
+        if (fastpath(thin_enter(obj))) return result;
+#endif
+        if (!fat_begin(obj, false)) return NO;
         SyncData* data = id2data(obj, ACQUIRE);
         ASSERT(data);
         result = data->mutex.tryLock();
+        if (!result) {
+            id2data_abandon(data);
+            fat_end(obj);
+        }
     } else {
         // @synchronized(nil) does nothing
         if (DebugNilSync) {
@@ -327,14 +591,15 @@ int objc_sync_exit(id obj)
     int result = OBJC_SYNC_SUCCESS;
     
     if (obj) {
+#if SUPPORT_DIRECT_THREAD_KEYS
+        if (fastpath(thin_exit(obj))) return result;
+#endif
+        // id2data unlocks the mutex.
         SyncData* data = id2data(obj, RELEASE); 
         if (!data) {
             result = OBJC_SYNC_NOT_OWNING_THREAD_ERROR;
         } else {
-            bool okay = data->mutex.tryUnlock();
-            if (!okay) {
-                result = OBJC_SYNC_NOT_OWNING_THREAD_ERROR;
-            }
+            fat_end(obj);
         }
     } else {
         // @synchronized(nil) does nothing
@@ -344,3 +609,66 @@ int objc_sync_exit(id obj)
     return result;
 }
 
+
+/***********************************************************************
+* objc_getSyncDataStatistics
+* Copies the SyncData counters of up to count sDataLists stripes into
+* outStripes and returns the number of stripes.
+* Locking: acquires each list lock in turn
+**********************************************************************/
+unsigned int
+objc_getSyncDataStatistics(objc_sync_data_stats *outStripes,
+                           unsigned int count)
+{
+    unsigned int stripes = sDataLists.stripeCount();
+    if (!outStripes) return stripes;
+
+    for (unsigned int i = 0; i < stripes && i < count; i++) {
+        SyncList& list = sDataLists.stripe(i);
+        list.lock.lock();
+        uint32_t idle = 0;
+        for (SyncData *p = list.data; p; p = p->nextData) {
+            if (p->threadCount == 0) idle++;
+        }
+        outStripes[i].live = list.live;
+        outStripes[i].idle = idle;
+        outStripes[i].reused = list.reused;
+        outStripes[i].reclaimed = list.reclaimed;
+        list.lock.unlock();
+    }
+    return stripes;
+}
+
+
+/***********************************************************************
+* objc_dumpSyncDataStatistics
+* Logs the SyncData counters of every stripe that has allocated any,
+* then the totals.
+* Locking: acquires each list lock in turn
+**********************************************************************/
+void
+objc_dumpSyncDataStatistics(void)
+{
+    unsigned int stripes = objc_getSyncDataStatistics(nil, 0);
+    objc_sync_data_stats *stats = (objc_sync_data_stats *)
+        calloc(stripes, sizeof(objc_sync_data_stats));
+    objc_getSyncDataStatistics(stats, stripes);
+
+    uint64_t live = 0, idle = 0, reused = 0, reclaimed = 0;
+    _objc_inform("SYNC DATA: %u stripes", stripes);
+    for (unsigned int i = 0; i < stripes; i++) {
+        if (stats[i].live == 0  &&  stats[i].reclaimed == 0) continue;
+        live += stats[i].live;
+        idle += stats[i].idle;
+        reused += stats[i].reused;
+        reclaimed += stats[i].reclaimed;
+        _objc_inform("SYNC DATA: stripe %4u: %u live, %u idle, "
+                     "%llu reused, %llu reclaimed", i,
+                     stats[i].live, stats[i].idle,
+                     stats[i].reused, stats[i].reclaimed);
+    }
+    _objc_inform("SYNC DATA: total: %llu live, %llu idle, "
+                 "%llu reused, %llu reclaimed",
+                 live, idle, reused, reclaimed);
+    free(stats);
+}
@@ -92,6 +92,28 @@ typedef DisguisedPtr<objc_object *> weak_referrer_t;
  */
 #define REFERRERS_OUT_OF_LINE 2 // 二进制表示 0010
 
+/**
+ * Out-of-line referrers are kept in chunks: small open-addressed hash
+ * sets reached through a directory indexed by the low bits of the
+ * referrer's hash (extendible hashing). A chunk with depth d holds
+ * referrers whose hashes share their low d bits, and appears in every
+ * directory slot whose index has those low bits.
+ *
+ * A full chunk splits in two instead of every referrer being rehashed,
+ * and a chunk that empties out merges back into its buddy, so memory
+ * and the cost of clearing follow the number of referrers rather than
+ * the largest number there ever was.
+ */
+#define WEAK_CHUNK_SIZE 64
+
+struct weak_referrer_chunk_t {
+    uint8_t  depth;             // low hash bits shared by every referrer here
+    uint8_t  max_displacement;  // longest probe from a referrer's home slot
+    uint16_t capacity;          // power of two, at most WEAK_CHUNK_SIZE
+    uint32_t count;
+    weak_referrer_t referrers[0];  // variable-size
+};
+
 /*
  weak_entry_t 的功能是保存所有指向某个对象的弱引用变量的地址
  
@@ -108,15 +130,15 @@ struct weak_entry_t {
     // 共用 32 个字节内存空间的联合体
     union {
         struct {
-            weak_referrer_t *referrers; // 保存 weak_referrer_t 的哈希数组
+            // Directory of chunks while mask != 0
+            weak_referrer_chunk_t **chunks;
             // out_of_line_ness 和 num_refs 两者加起来一起共用 64bit 的空间
             uintptr_t        out_of_line_ness : 2; // 标记使用哈希数组还是 inline_referent 保存 weak_referrer_t
             uintptr_t        num_refs : PTR_MINUS_2; // 当前 referrers 内保存的 weak_referrer_t的数量
-            uintptr_t        mask; // referrers 哈希数组总长度减一,会参数哈希函数计算
-            
-            // 可能会发生 hash 冲突的最大数,用于判断是否出现了逻辑错误(hash表中冲突次数绝对不会超过该值
-            // 该值在新建 weak_referrer_t 和插入新的 weak_referrer_t 时会被更新, 它一直记录的都是最大偏移值
-            uintptr_t        max_hash_displacement;
+            uintptr_t        mask; // directory size - 1
+            // The whole directory while mask == 0. Not pointed to by
+            // chunks, because weak_entry_t is moved with memcpy.
+            weak_referrer_chunk_t *first_chunk;
         };
         struct {
             // out_of_line_ness field is low bits of inline_referrers[1]
@@ -181,6 +203,35 @@ struct weak_table_t {
     // 因为会有 hash 碰撞的情况，而 weak_table_t 采用了开放寻址法来解决，
     // 所以某个 weak_entry_t 实际存储的位置并不一定是 hash 函数计算出来的位置。
     uintptr_t max_hash_displacement;
+    // Entries detached by weak_detach_no_lock and still being cleared.
+    struct weak_clearing_t *clearing;
+};
+
+/**
+ * An entry with many referrers, detached from its weak_table_t by
+ * weak_detach_no_lock() so a deallocating object's weak variables can
+ * be cleared without holding the SideTable lock. It stays on the
+ * table's clearing list until weak_release_detached_no_lock(), and
+ * weak_unregister_no_lock() still finds it there.
+ *
+ * The table lock protects the list; lock protects the entry's
+ * referrers. Take lock after the table lock, never before it.
+ */
+struct weak_clearing_t {
+    weak_entry_t entry;
+    spinlock_t lock;
+    weak_clearing_t *next;
+
+    // lock is fork-unsafe so lockdebug doesn't track it: a record is
+    // freed by every large detach, and lockdebug would keep the address
+    // and expect it locked at fork. It is only ever held for a bounded
+    // stretch of clearing or unregistering, by a thread that owns the
+    // deallocating object or holds the table lock, and the record is
+    // freed under the table lock once clearing is done, so no one can be
+    // holding it then. A fork in the middle of a clear leaves the object
+    // mid-dealloc in the child whatever this lock's state.
+    weak_clearing_t(const weak_entry_t& e)
+        : entry(e), lock(fork_unsafe_lock), next(nil) { }
 };
 
 enum WeakRegisterDeallocatingOptions {
@@ -201,9 +252,27 @@ void weak_unregister_no_lock(weak_table_t *weak_table, id referent, id *referrer
 bool weak_is_registered_no_lock(weak_table_t *weak_table, id referent);
 #endif
 
+/// Bytes allocated for referent's weak pointers beyond its entry, for
+/// memory reports.
+size_t weak_referrer_bytes_no_lock(weak_table_t *weak_table, id referent);
+
 /// Called on object destruction. Sets all remaining weak pointers to nil.
 void weak_clear_no_lock(weak_table_t *weak_table, id referent);
 
+/// Called on object destruction instead of weak_clear_no_lock.
+/// Clears a referent with few weak pointers in place and returns nil.
+/// Otherwise removes its entry from the table and returns it: the caller
+/// drops the table lock, calls weak_clear_detached(), and retakes the
+/// lock for weak_release_detached_no_lock().
+weak_clearing_t *weak_detach_no_lock(weak_table_t *weak_table, id referent);
+
+/// Sets a detached entry's weak pointers to nil. Call without the table lock.
+void weak_clear_detached(weak_clearing_t *clearing);
+
+/// Unlinks and frees a detached entry after weak_clear_detached().
+void weak_release_detached_no_lock(weak_table_t *weak_table,
+                                   weak_clearing_t *clearing);
+
 __END_DECLS
 
 #endif /* _OBJC_WEAK_H_ */
@@ -98,54 +98,195 @@ static inline uintptr_t w_hash_pointer(objc_object **key) {
     return ptr_hash((uintptr_t)key);
 }
 
-/** 
- * Grow the entry's hash table of referrers. Rehashes each
- * of the referrers.
- * 
- * @param entry Weak pointer hash set for a particular object.
+/*
+ * Referrer chunks. See weak_referrer_chunk_t in objc-weak.h.
  *
- * 对 weak_entry_t 的哈希数组进行扩容,并插入一个新的 new_referrer,原有数据重新哈希化放在新空间内
+ * The directory index is the low bits of the referrer's hash and the
+ * probe start within a chunk is the top bits, so the two stay
+ * independent until a directory of 2^26 slots.
  */
-__attribute__((noinline, used))
-static void grow_refs_and_insert(weak_entry_t *entry, 
-                                 objc_object **new_referrer)
+#define WEAK_CHUNK_HOME_SHIFT 26
+
+// A chunk at this count or above is full: it grows or splits.
+#define WEAK_CHUNK_FULL(chunk) ((chunk)->count >= (chunk)->capacity * 3/4)
+
+// Buddies merge when they hold this many referrers between them.
+#define WEAK_CHUNK_MERGE (WEAK_CHUNK_SIZE / 4)
+
+static weak_referrer_chunk_t **referrer_directory(weak_entry_t *entry)
 {
-    // DEBUG 模式下的断言,确保当前 weak_entry_t 使用的是哈希数组
     ASSERT(entry->out_of_line());
+    return entry->mask ? entry->chunks : &entry->first_chunk;
+}
 
-    // 新容量是为旧容量的 2 倍
-    size_t old_size = TABLE_SIZE(entry);
-    size_t new_size = old_size ? old_size * 2 : 8;
+static size_t referrer_depth(weak_entry_t *entry)
+{
+    return __builtin_popcountl(entry->mask);
+}
 
-    // 记录当前已使用的容量
-    size_t num_refs = entry->num_refs;
-    // 记录旧哈希数组的起始地址,在最后进行释放
-    weak_referrer_t *old_refs = entry->referrers;
-    // mask 依然是总容量-1
-    entry->mask = new_size - 1;
-    
-    // 为新哈希数组申请空间
-    // 长度为总容量 * sizeof(weak_referrer_t)(8)个字节
-    entry->referrers = (weak_referrer_t *)
-        calloc(TABLE_SIZE(entry), sizeof(weak_referrer_t));
-    
-    // 默认为 0
-    entry->num_refs = 0;
-    entry->max_hash_displacement = 0;
-    
-    for (size_t i = 0; i < old_size && num_refs > 0; i++) {
-        if (old_refs[i] != nil) {
-            // 把旧哈希数组里的数据放到新哈希数组里
-            append_referrer(entry, old_refs[i]);
-            // 旧哈希数组的长度自减
-            num_refs--;
+static weak_referrer_chunk_t *new_chunk(size_t capacity, uint32_t depth)
+{
+    weak_referrer_chunk_t *chunk = (weak_referrer_chunk_t *)
+        calloc(1, sizeof(weak_referrer_chunk_t) +
+                  capacity * sizeof(weak_referrer_t));
+    chunk->depth = (uint8_t)depth;
+    chunk->capacity = (uint16_t)capacity;
+    return chunk;
+}
+
+static size_t chunk_bytes(weak_referrer_chunk_t *chunk)
+{
+    return sizeof(weak_referrer_chunk_t) +
+        chunk->capacity * sizeof(weak_referrer_t);
+}
+
+// Every chunk is full size once there is more than one, so probing
+// needn't wait for the chunk's header to load.
+static inline size_t chunk_capacity(weak_entry_t *entry,
+                                    weak_referrer_chunk_t *chunk)
+{
+    return entry->mask ? WEAK_CHUNK_SIZE : chunk->capacity;
+}
+
+static inline size_t chunk_home(size_t capacity, uintptr_t hash)
+{
+    return (hash >> WEAK_CHUNK_HOME_SHIFT) & (capacity - 1);
+}
+
+// Calls fn(chunk) once for each of entry's chunks, at the chunk's
+// first directory slot: the one whose index is below 1 << depth.
+// Walks backwards so that slot is the chunk's last, and fn may free it.
+template <typename Fn>
+static void for_each_chunk(weak_entry_t *entry, const Fn& fn)
+{
+    weak_referrer_chunk_t **directory = referrer_directory(entry);
+    for (size_t i = entry->mask + 1; i-- > 0; ) {
+        weak_referrer_chunk_t *chunk = directory[i];
+        if (i < ((size_t)1 << chunk->depth)) fn(chunk);
+    }
+}
+
+// Points every directory slot of the chunk at directory[index], with
+// the given depth, to chunk.
+static void set_chunk(weak_entry_t *entry, size_t index, uint32_t depth,
+                      weak_referrer_chunk_t *chunk)
+{
+    weak_referrer_chunk_t **directory = referrer_directory(entry);
+    size_t step = (size_t)1 << depth;
+    for (size_t i = index & (step - 1); i <= entry->mask; i += step) {
+        directory[i] = chunk;
+    }
+}
+
+static void chunk_insert(weak_referrer_chunk_t *chunk, size_t capacity,
+                         objc_object **new_referrer, uintptr_t hash)
+{
+    ASSERT(chunk->count < capacity);
+    size_t mask = capacity - 1;
+    size_t index = chunk_home(capacity, hash);
+    size_t displacement = 0;
+    while (chunk->referrers[index] != nil) {
+        index = (index+1) & mask;
+        displacement++;
+    }
+    chunk->referrers[index] = new_referrer;
+    chunk->count++;
+    if (displacement > chunk->max_displacement) {
+        chunk->max_displacement = (uint8_t)displacement;
+    }
+}
+
+// Moves every referrer in from into to.
+static void chunk_move(weak_referrer_chunk_t *to, weak_referrer_chunk_t *from)
+{
+    for (size_t i = 0; i < from->capacity; i++) {
+        objc_object **referrer = from->referrers[i];
+        if (referrer) {
+            chunk_insert(to, to->capacity, referrer, w_hash_pointer(referrer));
         }
     }
-    // Insert
-    // 然后把入参传入的 new_referrer 插入新的哈希数组中,签名的铺垫都是数据转移
-    append_referrer(entry, new_referrer);
-    // 释放旧哈希数组
-    if (old_refs) free(old_refs);
+}
+
+// Replaces the small chunk at directory[index] with one twice the size.
+static void grow_chunk(weak_entry_t *entry, size_t index)
+{
+    weak_referrer_chunk_t *old_chunk = referrer_directory(entry)[index];
+    weak_referrer_chunk_t *chunk =
+        new_chunk(old_chunk->capacity * 2, old_chunk->depth);
+    chunk_move(chunk, old_chunk);
+    set_chunk(entry, index, chunk->depth, chunk);
+    free(old_chunk);
+}
+
+// Splits the full chunk at directory[index] on its next hash bit,
+// doubling the directory first if the chunk uses all of its bits.
+static void split_chunk(weak_entry_t *entry, size_t index)
+{
+    weak_referrer_chunk_t *chunk = referrer_directory(entry)[index];
+    uint32_t depth = chunk->depth;
+
+    if (depth == referrer_depth(entry)) {
+        if (depth >= WEAK_CHUNK_HOME_SHIFT) bad_weak_table(entry);
+        size_t old_size = entry->mask + 1;
+        weak_referrer_chunk_t **old_directory = referrer_directory(entry);
+        weak_referrer_chunk_t **directory = (weak_referrer_chunk_t **)
+            malloc(old_size * 2 * sizeof(weak_referrer_chunk_t *));
+        memcpy(directory, old_directory, old_size * sizeof(*directory));
+        memcpy(directory + old_size, old_directory, old_size * sizeof(*directory));
+        if (entry->mask) free(old_directory);
+        entry->chunks = directory;
+        entry->mask = old_size * 2 - 1;
+    }
+
+    // chunk keeps the referrers whose next bit is 0.
+    weak_referrer_t referrers[WEAK_CHUNK_SIZE];
+    memcpy(referrers, chunk->referrers, sizeof(referrers));
+    bzero(chunk->referrers, sizeof(referrers));
+    chunk->count = 0;
+    chunk->max_displacement = 0;
+    chunk->depth = (uint8_t)(depth + 1);
+    weak_referrer_chunk_t *high = new_chunk(WEAK_CHUNK_SIZE, depth + 1);
+
+    for (size_t i = 0; i < WEAK_CHUNK_SIZE; i++) {
+        objc_object **referrer = referrers[i];
+        if (!referrer) continue;
+        uintptr_t hash = w_hash_pointer(referrer);
+        chunk_insert((hash >> depth) & 1 ? high : chunk, WEAK_CHUNK_SIZE,
+                     referrer, hash);
+    }
+    size_t base = index & (((size_t)1 << depth) - 1);
+    set_chunk(entry, base | ((size_t)1 << depth), depth + 1, high);
+}
+
+// Merges the chunk at directory[index] into its buddy if together they
+// are mostly empty.
+static void merge_chunk_maybe(weak_entry_t *entry, size_t index)
+{
+    weak_referrer_chunk_t **directory = referrer_directory(entry);
+    weak_referrer_chunk_t *chunk = directory[index];
+    uint32_t depth = chunk->depth;
+    if (depth == 0  ||  chunk->count > WEAK_CHUNK_MERGE) return;
+
+    size_t buddy_index = index ^ ((size_t)1 << (depth - 1));
+    weak_referrer_chunk_t *buddy = directory[buddy_index];
+    if (buddy->depth != depth) return;
+    if (chunk->count + buddy->count > WEAK_CHUNK_MERGE) return;
+
+    chunk_move(buddy, chunk);
+    buddy->depth = (uint8_t)(depth - 1);
+    set_chunk(entry, index, depth, buddy);
+    free(chunk);
+}
+
+/** 
+ * Free the out-of-line referrer chunks and their directory.
+ */
+static void free_referrers(weak_entry_t *entry)
+{
+    for_each_chunk(entry, [](weak_referrer_chunk_t *chunk) {
+        free(chunk);
+    });
+    if (entry->mask) free(entry->chunks);
 }
 
 /** 
@@ -157,96 +298,62 @@ static void grow_refs_and_insert(weak_entry_t *entry,
  *
  * @param entry The entry holding the set of weak pointers. 
  * @param new_referrer The new weak pointer to be added.
- *
- * 添加给定的 referrer 到 weak_entry_t 的哈希数组（或定长为 4 的内部数组）。
  */
 static void append_referrer(weak_entry_t *entry, objc_object **new_referrer)
 {
     if (! entry->out_of_line()) {
         // Try to insert inline.
-        // 如果 weak_entry_t 尚未使用哈希数组,走这里
         for (size_t i = 0; i < WEAK_INLINE_COUNT; i++) {
-            // 找到空位,把 weak_entry_t 放进去
             if (entry->inline_referrers[i] == nil) {
                 entry->inline_referrers[i] = new_referrer;
                 return;
             }
         }
 
-        // Couldn't insert inline. Allocate out of line.
-        // 如果 inline_referrers 存满了,则要转到 referrers 哈希数组
-        // 这里是为哈希数组申请空间
-        weak_referrer_t *new_referrers = (weak_referrer_t *)
-            calloc(WEAK_INLINE_COUNT, sizeof(weak_referrer_t));
-        // This constructed table is invalid, but grow_refs_and_insert
-        // will fix it and rehash it.
-        // 此构造的 table 无效, grow_refs_and_insert 将修复它并重新哈希
-        
-        // 把 inline_referrers 内部的数据放进哈希数组
-        // 这里看似是直接循环按下标存放,其实后面会进行扩容和哈希化
+        // Couldn't insert inline. Move the inline referrers to a
+        // first chunk of 8.
+        weak_referrer_chunk_t *chunk = new_chunk(8, 0);
         for (size_t i = 0; i < WEAK_INLINE_COUNT; i++) {
-            new_referrers[i] = entry->inline_referrers[i];
+            objc_object **referrer = entry->inline_referrers[i];
+            chunk_insert(chunk, 8, referrer, w_hash_pointer(referrer));
         }
-        
-        // 给 referrers 赋值
-        entry->referrers = new_referrers;
-        // 表示目前弱引用是 4
+
+        // This overwrites inline_referrers[].
+        entry->chunks = nil;
         entry->num_refs = WEAK_INLINE_COUNT;
-        // out_of_line_ness 置为 REFERRERS_OUT_OF_LINE
-        // 标记 weak_entry_t 开始使用哈希数组保存弱引用的指针
         entry->out_of_line_ness = REFERRERS_OUT_OF_LINE;
-        // 看到这里有一个减一的操作
-        // mask 赋值,总容量 - 1
-        entry->mask = WEAK_INLINE_COUNT-1;
-        // 此时哈希冲突偏移为 0
-        entry->max_hash_displacement = 0;
+        entry->mask = 0;
+        entry->first_chunk = chunk;
     }
-    // 对于哈希数组的扩容处理
-    // DEBUG 下,断言:此处使用的一定是哈希数组
     ASSERT(entry->out_of_line());
 
-    // #define TABLE_SIZE(entry) (entry->mask ? entry->mask + 1 : 0)
-    // mask 又加了 1
-    // 如果已存放弱引用数量大于总容量的 3/4
-    if (entry->num_refs >= TABLE_SIZE(entry) * 3/4) {
-        // weak_entry_t 哈希数组扩容并插入 new_referrer
-        return grow_refs_and_insert(entry, new_referrer);
-    }
-    // 不需要扩容,则进行正常插入
-    size_t begin = w_hash_pointer(new_referrer) & (entry->mask);
-    size_t index = begin;
-    size_t hash_displacement = 0;
-    while (entry->referrers[index] != nil) {
-        hash_displacement++;
-        index = (index+1) & entry->mask;
-        
-        // 在 index == beigin 之前一定能找到空位置,因为前面有了一个超过 3/4 占用的扩容机制
-        if (index == begin) bad_weak_table(entry);
+    uintptr_t hash = w_hash_pointer(new_referrer);
+    size_t index;
+    weak_referrer_chunk_t *chunk;
+    while (1) {
+        index = hash & entry->mask;
+        chunk = referrer_directory(entry)[index];
+        if (!WEAK_CHUNK_FULL(chunk)) break;
+        if (chunk->capacity < WEAK_CHUNK_SIZE) grow_chunk(entry, index);
+        else split_chunk(entry, index);
     }
-    // 更新最大偏移值
-    if (hash_displacement > entry->max_hash_displacement) {
-        entry->max_hash_displacement = hash_displacement;
-    }
-    // 找到空位置插入弱引用指针
-    weak_referrer_t &ref = entry->referrers[index];
-    ref = new_referrer;
-    // 已存弱引用数量自增
+    chunk_insert(chunk, chunk_capacity(entry, chunk), new_referrer, hash);
     entry->num_refs++;
 }
 
-/**  从 weak_entry_t 的哈希数组（或定长为 4 的内部数组）中删除弱引用的地址。
+/**  从 weak_entry_t 的哈希数组（或定长为 4 的内部数组）中删除弱引用的地址。
  * Remove old_referrer from set of referrers, if it's present.
  * 如果 old_referrer 存在,从 referrers 中删除它.
  * Does not remove duplicates, because duplicates should not exist. 
  * 不删除重复项,因为这里就不应该存在重复先
  *
- * @todo this is slow if old_referrer is not present. Is this ever the case? 
- * 如果 old_referrer 不存在，这会很慢。 情况是否如此？
- *
  * @param entry The entry holding the referrers.
  * @param old_referrer The referrer to remove. 
+ * @param compact Whether a mostly empty chunk may merge with its buddy.
+ *   Not while weak_clear_detached() is walking the chunks.
  */
-static void remove_referrer(weak_entry_t *entry, objc_object **old_referrer)
+static void remove_referrer(weak_entry_t *entry, objc_object **old_referrer,
+                            bool compact = true)
 {
     // 如果目前使用的是定长 4 的内部数组
     if (! entry->out_of_line()) {
@@ -267,15 +374,18 @@ static void remove_referrer(weak_entry_t *entry, objc_object **old_referrer)
         objc_weak_error();
         return;
     }
-    // 从哈希数组中找到 old_referrer,并置为 nil(移除old_referrer)
-    size_t begin = w_hash_pointer(old_referrer) & (entry->mask);
-    size_t index = begin;
-    size_t hash_displacement = 0;
-    while (entry->referrers[index] != old_referrer) {
-        index = (index+1) & entry->mask;
-        if (index == begin) bad_weak_table(entry);
-        hash_displacement++;
-        if (hash_displacement > entry->max_hash_displacement) {
+
+    uintptr_t hash = w_hash_pointer(old_referrer);
+    size_t chunk_index = hash & entry->mask;
+    weak_referrer_chunk_t *chunk = referrer_directory(entry)[chunk_index];
+    size_t capacity = chunk_capacity(entry, chunk);
+    size_t mask = capacity - 1;
+    size_t index = chunk_home(capacity, hash);
+    size_t displacement = 0;
+    while (chunk->referrers[index] != old_referrer) {
+        index = (index+1) & mask;
+        displacement++;
+        if (displacement > chunk->max_displacement) {
             _objc_inform("Attempted to unregister unknown __weak variable "
                          "at %p. This is probably incorrect use of "
                          "objc_storeWeak() and objc_loadWeak(). "
@@ -285,9 +395,11 @@ static void remove_referrer(weak_entry_t *entry, objc_object **old_referrer)
             return;
         }
     }
-    // 把old_referrer所在的位置置为 nil,已存弱引用数量递减
-    entry->referrers[index] = nil;
+
+    chunk->referrers[index] = nil;
+    chunk->count--;
     entry->num_refs--;
+    if (compact) merge_chunk_maybe(entry, chunk_index);
 }
 
 /** 
@@ -454,7 +566,7 @@ static void weak_entry_remove(weak_table_t *weak_table, weak_entry_t *entry)
 {
     // remove entry
     // 如果 weak_entry_t 当前使用的是哈希数组,则释放其内存
-    if (entry->out_of_line()) free(entry->referrers);
+    if (entry->out_of_line()) free_referrers(entry);
     // 把从 entry 开始的sizeof(*entry)个字节空间置为 0
     bzero(entry, sizeof(*entry));
     // num_entries 自减
@@ -507,6 +619,22 @@ weak_entry_for_referent(weak_table_t *weak_table, objc_object *referent)
     return &weak_table->weak_entries[index];
 }
 
+/**
+ * Return the detached entry for referent while weak_clear_detached()
+ * runs, or nil. The clearing list is almost always empty.
+ */
+static weak_clearing_t *
+weak_clearing_for_referent(weak_table_t *weak_table, objc_object *referent)
+{
+    for (weak_clearing_t *clearing = weak_table->clearing;
+         clearing;
+         clearing = clearing->next)
+    {
+        if (clearing->entry.referent == referent) return clearing;
+    }
+    return nil;
+}
+
 /** 
  * Unregister an already-registered weak reference.
  * This is used when referrer's storage is about to go away, but referent
@@ -569,6 +697,17 @@ weak_unregister_no_lock(weak_table_t *weak_table, id referent_id,
             weak_entry_remove(weak_table, entry);
         }
     }
+    else if (slowpath(weak_table->clearing)) {
+        // referent is deallocating and its entry is being cleared
+        // outside the table lock. The clearer frees the entry.
+        weak_clearing_t *clearing =
+            weak_clearing_for_referent(weak_table, referent);
+        if (clearing) {
+            clearing->lock.lock();
+            remove_referrer(&clearing->entry, referrer, false);
+            clearing->lock.unlock();
+        }
+    }
 
     // Do not set *referrer = nil. objc_storeWeak() requires that the 
     // value not change.
@@ -607,6 +746,7 @@ weak_register_no_lock(weak_table_t *weak_table, id referent_id,
         if (!referent->ISA()->hasCustomRR()) {
             deallocating = referent->rootIsDeallocating();
         }
+#if !OBJC_HOST_BUILD
         else {
             // Use lookUpImpOrForward so we can avoid the assert in
             // class_getInstanceMethod, since we intentionally make this
@@ -622,6 +762,12 @@ weak_register_no_lock(weak_table_t *weak_table, id referent_id,
             deallocating =
             ! (*allowsWeakReference)(referent, @selector(allowsWeakReference));
         }
+#else
+        else {
+            // Host objects never have custom retain/release.
+            deallocating = false;
+        }
+#endif
         // 如果对象正在进行释放或者对象不能进行 weak 引用,且 CrashIfDeallocating 为 true,则抛出 crash
         if (deallocating) {
             if (deallocatingOptions == CrashIfDeallocating) {
@@ -642,6 +788,13 @@ weak_register_no_lock(weak_table_t *weak_table, id referent_id,
         // 如果找到了,调用append_referrer,把__weak变量的地址放进哈希数组
         append_referrer(entry, referrer);
     } 
+    else if (slowpath(weak_table->clearing)  &&
+             weak_clearing_for_referent(weak_table, referent))
+    {
+        // Deallocating, whatever deallocatingOptions said. An entry
+        // added now would never be cleared.
+        return nil;
+    }
     else {
         // 如果没有找到 weak_entry_t,则创建一个新的
         weak_entry_t new_entry(referent, referrer);
@@ -688,12 +841,74 @@ bool
 weak_is_registered_no_lock(weak_table_t *weak_table, id referent_id) 
 {
     // 调用 weak_entry_for_referent 判断对象是否存在对应的 entry
-    return weak_entry_for_referent(weak_table, (objc_object *)referent_id);
+    return weak_entry_for_referent(weak_table, (objc_object *)referent_id)  ||
+        weak_clearing_for_referent(weak_table, (objc_object *)referent_id);
     // 此函数借助 weak_entry_for_referent 判断一个对象是否注册到 weak_table_t 中。
 }
 #endif
 
 
+/**
+ * Sets each of count weak variables that still points to referent to nil.
+ */
+static void clear_referrers(weak_referrer_t *referrers, size_t count,
+                            objc_object *referent)
+{
+    for (size_t i = 0; i < count; ++i) {
+        // weak 变量的指针的指针
+        objc_object **referrer = referrers[i];
+        if (referrer) {
+            // 如果 weak 变量指向 referent,则把其指向置为nil
+            if (*referrer == referent) {
+                *referrer = nil;
+            }
+            else if (*referrer) {
+                // 如果 weak_entry_t 里面存放的 weak 变量指向的对象不是 referent,可能是错误调用 objc_storeWeak 和 objc_loadWeak 函数导致.
+                // 执行 objc_weak_error
+                _objc_inform("__weak variable at %p holds %p instead of %p. "
+                             "This is probably incorrect use of "
+                             "objc_storeWeak() and objc_loadWeak(). "
+                             "Break on objc_weak_error to debug.\n", 
+                             referrer, (void*)*referrer, (void*)referent);
+                objc_weak_error();
+            }
+        }
+    }
+}
+
+/**
+ * Sets each of entry's weak variables that still points to referent to nil.
+ */
+static void clear_entry_referrers(weak_entry_t *entry, objc_object *referent)
+{
+    if (!entry->out_of_line()) {
+        clear_referrers(entry->inline_referrers, WEAK_INLINE_COUNT, referent);
+        return;
+    }
+    for_each_chunk(entry, [=](weak_referrer_chunk_t *chunk) {
+        clear_referrers(chunk->referrers, chunk->capacity, referent);
+    });
+}
+
+/**
+ * Bytes allocated for referent's out-of-line referrers: its chunks and,
+ * once there is more than one chunk, their directory.
+ */
+size_t
+weak_referrer_bytes_no_lock(weak_table_t *weak_table, id referent_id)
+{
+    weak_entry_t *entry =
+        weak_entry_for_referent(weak_table, (objc_object *)referent_id);
+    if (!entry  ||  !entry->out_of_line()) return 0;
+
+    size_t bytes = 0;
+    if (entry->mask) bytes += (entry->mask + 1) * sizeof(*entry->chunks);
+    for_each_chunk(entry, [&](weak_referrer_chunk_t *chunk) {
+        bytes += chunk_bytes(chunk);
+    });
+    return bytes;
+}
+
 /** 
  * Called by dealloc; nils out all weak pointers that point to the 
  * provided object so that they can no longer be used.
@@ -720,47 +935,8 @@ weak_clear_no_lock(weak_table_t *weak_table, id referent_id)
     }
 
     // zero out references
-    // 用于记录 weak_referrer_t,DisguisedPtr<objc_object *>
-    weak_referrer_t *referrers;
-    size_t count;
-    
-    // 如果目前 weak_entry_t 使用的是哈希数组
-    if (entry->out_of_line()) {
-        // 记录哈希数组入口
-        referrers = entry->referrers;
-        // 记录总长度
-        count = TABLE_SIZE(entry);
-    } 
-    else {
-        // 如果目前对象弱引用的数量不超过 4,则使用inline_referrers数组记录弱引用的指针
-        
-        // 记录inline_referrers的入口
-        referrers = entry->inline_referrers;
-        // count = 4
-        count = WEAK_INLINE_COUNT;
-    }
-    
-    // 循环把inline_referrers数组或者哈希数组中的 weak 变量指向 nil
-    for (size_t i = 0; i < count; ++i) {
-        // weak 变量的指针的指针
-        objc_object **referrer = referrers[i];
-        if (referrer) {
-            // 如果 weak 变量指向 referent,则把其指向置为nil
-            if (*referrer == referent) {
-                *referrer = nil;
-            }
-            else if (*referrer) {
-                // 如果 weak_entry_t 里面存放的 weak 变量指向的对象不是 referent,可能是错误调用 objc_storeWeak 和 objc_loadWeak 函数导致.
-                // 执行 objc_weak_error
-                _objc_inform("__weak variable at %p holds %p instead of %p. "
-                             "This is probably incorrect use of "
-                             "objc_storeWeak() and objc_loadWeak(). "
-                             "Break on objc_weak_error to debug.\n", 
-                             referrer, (void*)*referrer, (void*)referent);
-                objc_weak_error();
-            }
-        }
-    }
+    // 循环把inline_referrers数组或者各个 chunk 中的 weak 变量指向 nil
+    clear_entry_referrers(entry, referent);
     
     // 最后把entry 从 weak_table_t 哈希数组中移除
     weak_entry_remove(weak_table, entry);
@@ -769,3 +945,86 @@ weak_clear_no_lock(weak_table_t *weak_table, id referent_id)
      */
 }
 
+
+// Referents with at least this many weak variables are cleared outside
+// the table lock by weak_clear_detached(). Below this a plain
+// weak_clear_no_lock() is shorter than the detach and relock.
+#define WEAK_DETACH_THRESHOLD 256
+
+/**
+ * Called by dealloc instead of weak_clear_no_lock(). Clears referent's
+ * weak variables now if it has few, or detaches its entry for
+ * weak_clear_detached() if it has many.
+ *
+ * Detaching is safe because referent is already deallocating: loading
+ * one of its weak variables fails to retain it, and registering a new
+ * one fails in weak_register_no_lock(). Only weak_unregister_no_lock()
+ * still touches the entry, under the entry's own lock.
+ *
+ * @param weak_table
+ * @param referent The object being deallocated.
+ *
+ * @return The detached entry, or nil if there is nothing left to clear.
+ */
+weak_clearing_t *
+weak_detach_no_lock(weak_table_t *weak_table, id referent_id)
+{
+    objc_object *referent = (objc_object *)referent_id;
+    weak_entry_t *entry = weak_entry_for_referent(weak_table, referent);
+    if (entry == nil) return nil;
+
+    if (!entry->out_of_line()  ||  entry->num_refs < WEAK_DETACH_THRESHOLD) {
+        clear_entry_referrers(entry, referent);
+        weak_entry_remove(weak_table, entry);
+        return nil;
+    }
+
+    // Move the entry out of the table. Its chunks now belong to the
+    // clearing entry.
+    weak_clearing_t *clearing = new weak_clearing_t(*entry);
+    bzero(entry, sizeof(*entry));
+    weak_table->num_entries--;
+    weak_compact_maybe(weak_table);
+
+    clearing->next = weak_table->clearing;
+    weak_table->clearing = clearing;
+    return clearing;
+}
+
+/**
+ * Sets all of a detached entry's weak variables to nil. Called without
+ * the table lock, so other referents in the same table are not held up.
+ * Takes the entry's lock one chunk at a time, so weak_unregister_no_lock()
+ * for the same referent waits for one chunk rather than the whole clear.
+ */
+void
+weak_clear_detached(weak_clearing_t *clearing)
+{
+    objc_object *referent = clearing->entry.referent;
+
+    // Nothing adds or merges chunks while the entry is detached.
+    for_each_chunk(&clearing->entry, [=](weak_referrer_chunk_t *chunk) {
+        clearing->lock.lock();
+        clear_referrers(chunk->referrers, chunk->capacity, referent);
+        clearing->lock.unlock();
+    });
+}
+
+/**
+ * Removes a cleared entry from the table's clearing list and frees it.
+ * Anyone else using it held the table lock, so it is idle now.
+ */
+void
+weak_release_detached_no_lock(weak_table_t *weak_table,
+                              weak_clearing_t *clearing)
+{
+    weak_clearing_t **link = &weak_table->clearing;
+    while (*link != clearing) {
+        ASSERT(*link);
+        link = &(*link)->next;
+    }
+    *link = clearing->next;
+
+    free_referrers(&clearing->entry);
+    delete clearing;
+}
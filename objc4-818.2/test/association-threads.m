@@ -0,0 +1,84 @@
+// TEST_CONFIG MEM=mrc
+
+#include "test.h"
+#include "testroot.i"
+
+#include <pthread.h>
+#include <objc/runtime.h>
+#include <mach/mach_time.h>
+
+// associated object stress test and benchmark
+// Every thread sets, reads and removes associations on its own objects
+// and reads one association of an object shared by all threads. Checks
+// that no association is lost or over-released, and with VERBOSE=2
+// prints the time per operation for each thread count.
+
+#define MAXTHREADS 16
+#define OBJECTS 64
+#define ROUNDS 2000
+
+static const char key1 = 0, key2 = 0, sharedKey = 0;
+
+static id shared;
+static id sharedValue;
+
+static void *threadfn(void *arg __unused)
+{
+    id objs[OBJECTS];
+    id value = [TestRoot new];
+    for (int i = 0; i < OBJECTS; i++) objs[i] = [TestRoot new];
+
+    for (int r = 0; r < ROUNDS; r++) {
+        for (int i = 0; i < OBJECTS; i++) {
+            id obj = objs[i];
+            objc_setAssociatedObject(obj, &key1, value, OBJC_ASSOCIATION_RETAIN);
+            objc_setAssociatedObject(obj, &key2, value, OBJC_ASSOCIATION_ASSIGN);
+            testassert(objc_getAssociatedObject(obj, &key1) == value);
+            testassert(objc_getAssociatedObject(shared, &sharedKey) == sharedValue);
+            objc_setAssociatedObject(obj, &key2, nil, OBJC_ASSOCIATION_ASSIGN);
+            testassert(objc_getAssociatedObject(obj, &key2) == nil);
+            objc_removeAssociatedObjects(obj);
+            testassert(objc_getAssociatedObject(obj, &key1) == nil);
+        }
+    }
+
+    for (int i = 0; i < OBJECTS; i++) [objs[i] release];
+    testassert([value retainCount] == 1);
+    [value release];
+    return NULL;
+}
+
+int main()
+{
+    shared = [TestRoot new];
+    sharedValue = [TestRoot new];
+    objc_setAssociatedObject(shared, &sharedKey, sharedValue, OBJC_ASSOCIATION_RETAIN);
+
+    mach_timebase_info_data_t tb;
+    mach_timebase_info(&tb);
+
+    for (int threadCount = 1; threadCount <= MAXTHREADS; threadCount *= 2) {
+        pthread_t threads[MAXTHREADS];
+
+        uint64_t start = mach_absolute_time();
+        for (int t = 0; t < threadCount; t++) {
+            pthread_create(&threads[t], NULL, &threadfn, NULL);
+        }
+        for (int t = 0; t < threadCount; t++) {
+            pthread_join(threads[t], NULL);
+        }
+        uint64_t ns = (mach_absolute_time() - start) * tb.numer / tb.denom;
+
+        // 8 association calls per object per round
+        double ops = (double)threadCount * ROUNDS * OBJECTS * 8;
+        testprintf("threads %2d: %6.1f ns per call, %6.1f M calls/s\n",
+                   threadCount, ns / ops, ops / ns * 1000);
+    }
+
+    testassert([sharedValue retainCount] == 2);
+    [shared release];
+    testassert([sharedValue retainCount] == 1);
+    [sharedValue release];
+
+    succeed(__FILE__);
+}
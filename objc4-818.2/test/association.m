@@ -182,6 +182,50 @@ void TestReleaseLaterRemoveAssociations(void) {
     testassertequal(laterDeallocs, 1);
 }
 
+// An object's first association is stored inline and the rest in a
+// map. Move between the two and check nothing is lost or leaked.
+void TestInlineAndMap(void) {
+    char keys[3];
+    __block int deallocs = 0;
+
+    @autoreleasepool {
+        id target = [NSObject new];
+        id values[3];
+        for (int i = 0; i < 3; i++) {
+            values[i] = [[CallOnDealloc alloc] initWithBlock: ^{ deallocs++; }];
+        }
+
+        // nil key, inline
+        objc_setAssociatedObject(target, NULL, values[0], OBJC_ASSOCIATION_RETAIN);
+        testassert(objc_getAssociatedObject(target, NULL) == values[0]);
+        testassert(objc_getAssociatedObject(target, &keys[0]) == nil);
+        objc_setAssociatedObject(target, NULL, nil, OBJC_ASSOCIATION_RETAIN);
+        testassert(objc_getAssociatedObject(target, NULL) == nil);
+
+        // replace the inline association
+        objc_setAssociatedObject(target, &keys[0], values[0], OBJC_ASSOCIATION_RETAIN);
+        objc_setAssociatedObject(target, &keys[0], values[1], OBJC_ASSOCIATION_RETAIN);
+        testassert(objc_getAssociatedObject(target, &keys[0]) == values[1]);
+
+        // grow into a map, then shrink back to one association
+        objc_setAssociatedObject(target, &keys[1], values[0], OBJC_ASSOCIATION_RETAIN);
+        objc_setAssociatedObject(target, &keys[2], values[2], OBJC_ASSOCIATION_RETAIN);
+        void *first = (__bridge void *)values[0];
+        for (int i = 0; i < 3; i++) RELEASE_VAR(values[i]);
+        testassertequal(deallocs, 0);
+        objc_setAssociatedObject(target, &keys[0], nil, OBJC_ASSOCIATION_RETAIN);
+        testassertequal(deallocs, 1);
+        objc_setAssociatedObject(target, &keys[2], nil, OBJC_ASSOCIATION_RETAIN);
+        testassertequal(deallocs, 2);
+        testassert(objc_getAssociatedObject(target, &keys[0]) == nil);
+        testassert((__bridge void *)objc_getAssociatedObject(target, &keys[1]) == first);
+
+        RELEASE_VALUE(target);
+    }
+
+    testassertequal(deallocs, 3);
+}
+
 int main()
 {
     testonthread(^{
@@ -226,6 +270,7 @@ int main()
 
     TestReleaseLater();
     TestReleaseLaterRemoveAssociations();
+    TestInlineAndMap();
 
     succeed(__FILE__);
 }
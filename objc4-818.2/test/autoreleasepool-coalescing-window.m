@@ -0,0 +1,73 @@
+//TEST_CONFIG MEM=mrc ARCH=x86_64,ARM64,ARM64e
+//TEST_ENV OBJC_DISABLE_AUTORELEASE_COALESCING=NO OBJC_DISABLE_AUTORELEASE_COALESCING_LRU=NO OBJC_AUTORELEASE_COALESCING_WINDOW=8 OBJC_RECORD_AUTORELEASE_COALESCING=YES
+
+#include "test.h"
+#include <objc/objc-internal.h>
+#import <Foundation/NSObject.h>
+
+// OBJC_AUTORELEASE_COALESCING_WINDOW and the coalescing counters.
+// With a window of 8, up to 8 objects autoreleased round robin share
+// one pool entry each; a 9th pushes every object out of the window.
+
+#define WINDOW 8
+
+// Autorelease objCount objects autoreleaseCount times each, round robin.
+// Verify the gap between pool pointers and the counters.
+static void test(int objCount, int autoreleaseCount, int expectedGap)
+{
+    testprintf("Testing %d objects, %d autoreleases, expecting gap of %d\n",
+               objCount, autoreleaseCount, expectedGap);
+
+    id objs[objCount];
+    for (int i = 0; i < objCount; i++) {
+        objs[i] = [NSObject new];
+        for (int j = 0; j < autoreleaseCount; j++) [objs[i] retain];
+    }
+
+    objc_autorelease_pool_page_stats before, after;
+    objc_getAutoreleasePoolPageStatistics(&before);
+
+    void *outer = objc_autoreleasePoolPush();
+    for (int j = 0; j < autoreleaseCount; j++)
+        for (int i = 0; i < objCount; i++)
+            [objs[i] autorelease];
+    void *inner = objc_autoreleasePoolPush();
+
+    objc_getAutoreleasePoolPageStatistics(&after);
+    uint64_t autoreleases = after.autoreleases - before.autoreleases;
+    uint64_t coalesced = after.coalesced - before.coalesced;
+    testprintf("autoreleases=%llu coalesced=%llu\n", autoreleases, coalesced);
+    testassertequal(autoreleases, (uint64_t)objCount * autoreleaseCount);
+    testassertequal(coalesced, autoreleases - (expectedGap - 1));
+    testassertequal(after.bytesSaved - before.bytesSaved,
+                    coalesced * sizeof(id));
+
+    objc_autoreleasePoolPop(inner);
+    objc_autoreleasePoolPop(outer);
+
+    intptr_t gap = (uintptr_t)inner - (uintptr_t)outer;
+    testprintf("gap=%ld\n", gap);
+    testassertequal(gap, expectedGap * sizeof(id));
+
+    for (int i = 0; i < objCount; i++) {
+        testassertequal([objs[i] retainCount], 1);
+        [objs[i] release];
+    }
+}
+
+int main()
+{
+    // Push a pool here so test() doesn't see a placeholder.
+    objc_autoreleasePoolPush();
+
+    for (int objCount = 1; objCount <= WINDOW; objCount++) {
+        test(objCount, 1, objCount + 1);
+        test(objCount, 2, objCount + 1);
+        test(objCount, 100, objCount + 1);
+    }
+
+    test(WINDOW + 1, 1, WINDOW + 2);
+    test(WINDOW + 1, 2, 2 * (WINDOW + 1) + 1);
+
+    succeed(__FILE__);
+}
@@ -0,0 +1,64 @@
+// TEST_CONFIG MEM=mrc
+// TEST_ENV OBJC_POOL_FREE_PAGES=4
+
+#include "test.h"
+#include "testroot.i"
+
+#include <objc/objc-internal.h>
+
+// OBJC_POOL_FREE_PAGES. Popping a deep pool frees most of its pages;
+// only a few stay on the free list. Slabs whose pages are all freed
+// go back to the system, and are reused before any new slab is mapped.
+
+#define SLAB_SIZE (2*1024*1024)
+#define OBJECTS (4 * SLAB_SIZE / sizeof(id))
+// More distinct objects than the widest coalescing window,
+// so every autorelease takes its own entry.
+#define DISTINCT 16
+
+static id objs[DISTINCT];
+
+static void fill(objc_autorelease_pool_page_stats *outStats)
+{
+    void *pool = objc_autoreleasePoolPush();
+    for (size_t i = 0; i < OBJECTS; i++) {
+        [[objs[i % DISTINCT] retain] autorelease];
+    }
+    objc_getAutoreleasePoolPageStatistics(outStats);
+    objc_autoreleasePoolPop(pool);
+}
+
+int main()
+{
+    for (int i = 0; i < DISTINCT; i++) {
+        objs[i] = [TestRoot new];
+    }
+
+    objc_autorelease_pool_page_stats before, during, after, during2, again;
+    objc_getAutoreleasePoolPageStatistics(&before);
+
+    fill(&during);
+    objc_getAutoreleasePoolPageStatistics(&after);
+    uint64_t pages = after.allocated - before.allocated;
+    testprintf("%llu pages, %llu kept, %llu returned, %llu -> %llu bytes\n",
+               pages, after.freePages, after.returned - before.returned,
+               during.bytesHeld, after.bytesHeld);
+    testassert(pages > 8);
+    testassert(after.freePages < pages);
+    // Every slab but the ones the pool started and ended in is returned.
+    testassert(after.returned > before.returned);
+    testassert(during.bytesHeld - after.bytesHeld >= 2 * SLAB_SIZE);
+
+    // The kept pages and the returned slabs are used first next time.
+    fill(&during2);
+    objc_getAutoreleasePoolPageStatistics(&again);
+    testassert(again.recycled - after.recycled >= after.freePages);
+    testassert(during2.bytesHeld <= during.bytesHeld);
+
+    for (int i = 0; i < DISTINCT; i++) {
+        testassert([objs[i] retainCount] == 1);
+        [objs[i] release];
+    }
+
+    succeed(__FILE__);
+}
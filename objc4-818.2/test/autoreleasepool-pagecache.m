@@ -0,0 +1,86 @@
+// TEST_CONFIG MEM=mrc
+// TEST_ENV OBJC_POOL_PAGE_CACHE=64
+
+#include "test.h"
+#include "testroot.i"
+
+#include <pthread.h>
+#include <mach/mach_time.h>
+#include <objc/objc-internal.h>
+
+// OBJC_POOL_PAGE_CACHE and the autorelease pool page counters.
+// A thread that repeatedly fills many pool pages keeps them, and the
+// pages of a thread that exits are handed to the next thread.
+
+#define OBJECTS 16000
+#define ROUNDS 100
+
+static id objs[OBJECTS];
+
+static void fill(void)
+{
+    void *pool = objc_autoreleasePoolPush();
+    for (int i = 0; i < OBJECTS; i++) {
+        [[objs[i] retain] autorelease];
+    }
+    objc_autoreleasePoolPop(pool);
+}
+
+static void *threadfn(void *arg __unused)
+{
+    fill();
+    return NULL;
+}
+
+static void runThread(void)
+{
+    pthread_t th;
+    pthread_create(&th, NULL, &threadfn, NULL);
+    pthread_join(th, NULL);
+}
+
+int main()
+{
+    for (int i = 0; i < OBJECTS; i++) objs[i] = [TestRoot new];
+
+    objc_autorelease_pool_page_stats start, first, rounds, thread1, thread2;
+    objc_getAutoreleasePoolPageStatistics(&start);
+
+    fill();
+    objc_getAutoreleasePoolPageStatistics(&first);
+    uint64_t pages = first.allocated - start.allocated;
+    testprintf("%llu pages for %d objects\n", pages, OBJECTS);
+    testassert(pages > 1);
+    testassert(first.bytesHeld > 0);
+
+    // Every later round reuses the pages this thread kept.
+    mach_timebase_info_data_t tb;
+    mach_timebase_info(&tb);
+    uint64_t t0 = mach_absolute_time();
+    for (int r = 0; r < ROUNDS; r++) fill();
+    uint64_t ns = (mach_absolute_time() - t0) * tb.numer / tb.denom;
+    testprintf("%.1f ns per autorelease and release\n",
+               (double)ns / ROUNDS / OBJECTS);
+    objc_getAutoreleasePoolPageStatistics(&rounds);
+    testassert(rounds.allocated == first.allocated);
+    testassert(rounds.reused - first.reused >= (pages - 1) * ROUNDS);
+
+    // A thread's pages are freed when it exits...
+    runThread();
+    objc_getAutoreleasePoolPageStatistics(&thread1);
+    testassert(thread1.allocated - rounds.allocated >= pages);
+
+    // ...and recycled by the next thread without mapping more slabs.
+    runThread();
+    objc_getAutoreleasePoolPageStatistics(&thread2);
+    testassert(thread2.allocated - thread1.allocated ==
+               thread2.recycled - thread1.recycled);
+    testassert(thread2.bytesHeld == thread1.bytesHeld);
+
+    for (int i = 0; i < OBJECTS; i++) {
+        testassert([objs[i] retainCount] == 1);
+        [objs[i] release];
+    }
+
+    succeed(__FILE__);
+}
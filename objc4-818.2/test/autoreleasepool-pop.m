@@ -0,0 +1,69 @@
+// TEST_CONFIG MEM=mrc
+
+#include "test.h"
+#include "testroot.i"
+
+#include <mach/mach_time.h>
+#include <Foundation/NSObject.h>
+
+// Popping large autorelease pools of mixed objects.
+// Objects with fast retain/release, objects with custom retain/release,
+// repeated autoreleases of one object and nested pool boundaries.
+// Checks that every object is released exactly as often as it was
+// autoreleased, and with VERBOSE=2 prints the time per entry popped.
+
+static int CountedDealloc;
+
+@interface Counted : NSObject @end
+@implementation Counted
+-(void)dealloc {
+    CountedDealloc++;
+    [super dealloc];
+}
+@end
+
+static void test(int count)
+{
+    id *objs = (id *)calloc(count, sizeof(id));
+    int counted = 0, roots = 0;
+    for (int i = 0; i < count; i++) {
+        if (i % 3 == 2) {
+            objs[i] = [TestRoot new];
+            roots++;
+        } else {
+            objs[i] = [Counted new];
+            counted++;
+        }
+    }
+
+    CountedDealloc = 0;
+    TestRootDealloc = 0;
+
+    void *pool = objc_autoreleasePoolPush();
+    for (int i = 0; i < count; i++) {
+        if (i % 1000 == 999) objc_autoreleasePoolPush();
+        [objs[i] autorelease];
+        // Repeated autoreleases of one object are coalesced.
+        if (i % 8 == 0) [[objs[i] retain] autorelease];
+    }
+
+    mach_timebase_info_data_t tb;
+    mach_timebase_info(&tb);
+    uint64_t start = mach_absolute_time();
+    objc_autoreleasePoolPop(pool);
+    uint64_t ns = (mach_absolute_time() - start) * tb.numer / tb.denom;
+    testprintf("%7d objects: %.2f ms, %.1f ns per object\n",
+               count, ns / 1e6, (double)ns / count);
+
+    testassert(CountedDealloc == counted);
+    testassert(TestRootDealloc == roots);
+    free(objs);
+}
+
+int main()
+{
+    for (int count = 1000; count <= 1000000; count *= 10) {
+        test(count);
+    }
+    succeed(__FILE__);
+}
@@ -0,0 +1,128 @@
+// TEST_CONFIG
+
+#include "test.h"
+#include "testroot.i"
+
+#include <stdlib.h>
+#include <pthread.h>
+#include <objc/runtime.h>
+#include <objc/message.h>
+#include <mach/mach_time.h>
+
+// method cache fill stress test and benchmark
+// Modeled on cacheflush.m, but with many threads missing at once.
+// Each round flushes the class's cache, then every thread sends the same
+// SELS messages (in a different order per thread) so that all of them
+// miss together. Checks that every send reaches the right method, and
+// with VERBOSE=2 prints the average miss latency per thread count.
+
+#if defined(__arm__)
+#define MAXTHREADS 16
+#define ROUNDS 16
+#else
+#define MAXTHREADS 64
+#define ROUNDS 32
+#endif
+#define SELS 256
+
+@interface Filled : TestRoot @end
+@implementation Filled @end
+
+static id obj;
+static SEL sels[SELS];
+
+typedef uintptr_t (*send_t)(id, SEL);
+
+static pthread_mutex_t gateLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t gateCond = PTHREAD_COND_INITIALIZER;
+static int gateWaiting;
+static int gateGeneration;
+static int threadCount;
+
+// Block until threadCount threads plus the main thread have arrived.
+static void gate(void)
+{
+    pthread_mutex_lock(&gateLock);
+    int generation = gateGeneration;
+    if (++gateWaiting == threadCount + 1) {
+        gateWaiting = 0;
+        gateGeneration++;
+        pthread_cond_broadcast(&gateCond);
+    } else {
+        while (generation == gateGeneration) {
+            pthread_cond_wait(&gateCond, &gateLock);
+        }
+    }
+    pthread_mutex_unlock(&gateLock);
+}
+
+static uint64_t missTime[MAXTHREADS];
+
+static void *threadfn(void *arg)
+{
+    int t = (int)(intptr_t)arg;
+
+    for (int round = 0; round < ROUNDS; round++) {
+        gate();  // cache flushed
+
+        uint64_t start = mach_absolute_time();
+        for (int i = 0; i < SELS; i++) {
+            int s = (i + t * 7) % SELS;
+            uintptr_t result = ((send_t)objc_msgSend)(obj, sels[s]);
+            testassert(result == (uintptr_t)s);
+        }
+        missTime[t] += mach_absolute_time() - start;
+
+        gate();  // round done
+    }
+
+    return NULL;
+}
+
+int main()
+{
+    for (int i = 0; i < SELS; i++) {
+        char *name;
+        asprintf(&name, "cachefill%d", i);
+        sels[i] = sel_registerName(name);
+        free(name);
+        uintptr_t value = i;
+        IMP imp = imp_implementationWithBlock(^uintptr_t(id self __unused) {
+            return value;
+        });
+        testassert(class_addMethod([Filled class], sels[i], imp, "L@:"));
+    }
+    obj = [Filled new];
+
+    mach_timebase_info_data_t tb;
+    mach_timebase_info(&tb);
+
+    for (threadCount = 1; threadCount <= MAXTHREADS; threadCount *= 2) {
+        pthread_t threads[MAXTHREADS];
+        bzero(missTime, sizeof(missTime));
+
+        for (int t = 0; t < threadCount; t++) {
+            pthread_create(&threads[t], NULL, &threadfn, (void*)(intptr_t)t);
+        }
+
+        for (int round = 0; round < ROUNDS; round++) {
+            _objc_flush_caches([Filled class]);
+            gate();  // start the round
+            gate();  // wait for the round to finish
+        }
+
+        for (int t = 0; t < threadCount; t++) {
+            pthread_join(threads[t], NULL);
+        }
+
+        uint64_t total = 0;
+        for (int t = 0; t < threadCount; t++) total += missTime[t];
+        uint64_t ns = total * tb.numer / tb.denom;
+        testprintf("threads %2d: %6llu ns per first send (%d sends)\n",
+                   threadCount,
+                   ns / ((uint64_t)threadCount * ROUNDS * SELS),
+                   threadCount * ROUNDS * SELS);
+    }
+
+    succeed(__FILE__);
+}
@@ -0,0 +1,108 @@
+// TEST_CONFIG
+
+#include "test.h"
+#include "testroot.i"
+
+#include <stdlib.h>
+#include <pthread.h>
+#include <objc/runtime.h>
+#include <objc/message.h>
+#include <objc/objc-internal.h>
+#include <mach/mach_time.h>
+
+// method cache garbage collection stress test and benchmark
+// Worker threads keep missing in a class's cache while the main thread
+// keeps flushing it, so every flush turns a table into garbage while
+// concurrent fills may still be writing to it. Checks that all garbage
+// is reclaimed once the workers stop, and with VERBOSE=2 prints the
+// garbage bytes held and the time a full collection takes for each
+// thread count.
+
+#if defined(__arm__)
+#define MAXTHREADS 16
+#define FLUSHES 512
+#else
+#define MAXTHREADS 64
+#define FLUSHES 2048
+#endif
+#define SELS 64
+
+@interface Garbage : TestRoot @end
+@implementation Garbage @end
+
+static id obj;
+static SEL sels[SELS];
+static volatile int stop;
+
+typedef uintptr_t (*send_t)(id, SEL);
+
+static void *threadfn(void *arg)
+{
+    int t = (int)(intptr_t)arg;
+
+    for (int i = 0; !stop; i++) {
+        int s = (i + t * 7) % SELS;
+        uintptr_t result = ((send_t)objc_msgSend)(obj, sels[s]);
+        testassert(result == (uintptr_t)s);
+    }
+
+    return NULL;
+}
+
+int main()
+{
+    for (int i = 0; i < SELS; i++) {
+        char *name;
+        asprintf(&name, "cachegarbage%d", i);
+        sels[i] = sel_registerName(name);
+        free(name);
+        uintptr_t value = i;
+        IMP imp = imp_implementationWithBlock(^uintptr_t(id self __unused) {
+            return value;
+        });
+        testassert(class_addMethod([Garbage class], sels[i], imp, "L@:"));
+    }
+    obj = [Garbage new];
+
+    mach_timebase_info_data_t tb;
+    mach_timebase_info(&tb);
+
+    for (int threadCount = 1; threadCount <= MAXTHREADS; threadCount *= 2) {
+        pthread_t threads[MAXTHREADS];
+        stop = 0;
+
+        for (int t = 0; t < threadCount; t++) {
+            pthread_create(&threads[t], NULL, &threadfn, (void*)(intptr_t)t);
+        }
+
+        // Garbage held while flushes race with fills.
+        size_t peak = 0;
+        size_t total = 0;
+        for (int i = 0; i < FLUSHES; i++) {
+            _objc_flush_caches([Garbage class]);
+            size_t bytes = objc_cache_garbageByteSize();
+            if (bytes > peak) peak = bytes;
+            total += bytes;
+        }
+
+        // Time to reclaim everything while fills are still running.
+        uint64_t start = mach_absolute_time();
+        _objc_flush_caches(nil);
+        uint64_t ns = (mach_absolute_time() - start) * tb.numer / tb.denom;
+
+        stop = 1;
+        for (int t = 0; t < threadCount; t++) {
+            pthread_join(threads[t], NULL);
+        }
+
+        testprintf("threads %2d: garbage peak %7zu bytes, mean %7zu bytes, "
+                   "full collection %8llu ns\n",
+                   threadCount, peak, total / FLUSHES, ns);
+
+        // Nothing is filling now, so a full collection empties the garbage.
+        _objc_flush_caches(nil);
+        testassert(objc_cache_garbageByteSize() == 0);
+    }
+
+    succeed(__FILE__);
+}
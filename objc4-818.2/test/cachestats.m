@@ -0,0 +1,104 @@
+// TEST_CONFIG
+// TEST_ENV OBJC_RECORD_CACHE_STATISTICS=YES OBJC_ADAPTIVE_CACHE_GROWTH=YES
+
+#include "test.h"
+#include "testroot.i"
+
+#include <objc/runtime.h>
+#include <objc/message.h>
+#include <objc/objc-internal.h>
+
+// Per-class method cache statistics and adaptive cache growth.
+
+#define SELS 300
+
+@interface Stats : TestRoot @end
+@implementation Stats @end
+
+@interface SubStats : Stats @end
+@implementation SubStats @end
+
+@interface GrowOnly : TestRoot @end
+@implementation GrowOnly @end
+
+static SEL sels[SELS];
+
+typedef uintptr_t (*send_t)(id, SEL);
+
+static void sendAll(id obj)
+{
+    for (int i = 0; i < SELS; i++) {
+        testassert(((send_t)objc_msgSend)(obj, sels[i]) == (uintptr_t)i);
+    }
+}
+
+int main()
+{
+    for (int i = 0; i < SELS; i++) {
+        char *name;
+        asprintf(&name, "cachestats%d", i);
+        sels[i] = sel_registerName(name);
+        free(name);
+        uintptr_t value = i;
+        IMP imp = imp_implementationWithBlock(^uintptr_t(id self __unused) {
+            return value;
+        });
+        testassert(class_addMethod([Stats class], sels[i], imp, "L@:"));
+        testassert(class_addMethod([GrowOnly class], sels[i], imp, "L@:"));
+    }
+
+    objc_imp_cache_stats stats;
+
+    // A cache that only ever grows is not flushed, so it never reaches
+    // the two flushes that turn on adaptive growth.
+    id grow = [GrowOnly new];
+    sendAll(grow);
+    sendAll(grow);
+    testassert(class_getImpCacheStatistics([GrowOnly class], &stats));
+    testprintf("grow only: %llu misses, %llu flushes, %llu growths, "
+               "capacity %u\n",
+               stats.misses, stats.flushes, stats.growths, stats.capacity);
+    testassert(stats.growths >= 2);  // grew from INIT_CACHE_SIZE
+    testassert(stats.flushes == 0);
+    testassert(stats.workingSet > 0);
+
+    id obj = [Stats new];
+    sendAll(obj);
+    sendAll(obj);
+
+    testassert(class_getImpCacheStatistics([Stats class], &stats));
+    testprintf("first fill: %llu misses, %llu growths, %llu probes (max %u), "
+               "working set %u, capacity %u\n",
+               stats.misses, stats.growths, stats.probes, stats.maxProbe,
+               stats.workingSet, stats.capacity);
+    testassert(stats.misses >= SELS);
+    testassert(stats.growths >= 2);
+    testassert(stats.flushes == 0);
+    testassert(stats.capacity > SELS);
+    uint64_t firstGrowths = stats.growths;
+
+    // Flushes count separately from growth. A flushed cache keeps its 
+    // capacity, so refilling it never has to grow.
+    for (int round = 1; round <= 2; round++) {
+        _objc_flush_caches([Stats class]);
+        sendAll(obj);
+        testassert(class_getImpCacheStatistics([Stats class], &stats));
+        testprintf("refill %d: %llu misses, %llu flushes, %llu growths, "
+                   "capacity %u\n", round,
+                   stats.misses, stats.flushes, stats.growths, stats.capacity);
+        testassert(stats.flushes == (uint64_t)round);
+        testassert(stats.growths == firstGrowths);
+    }
+
+    // The subclass finds the methods in its superclass's cache.
+    id sub = [SubStats new];
+    sendAll(sub);
+    testassert(class_getImpCacheStatistics([Stats class], &stats));
+    testassert(stats.hits >= SELS);
+    testassert(class_getImpCacheStatistics([SubStats class], &stats));
+    testassert(stats.misses >= SELS);
+
+    if (testverbose()) objc_dumpImpCacheStatistics();
+
+    succeed(__FILE__);
+}
@@ -0,0 +1,82 @@
+/*
+TEST_BUILD
+    $C{COMPILE} $DIR/categorybatch.m -o categorybatch.exe -framework Foundation
+    $C{COMPILE} -bundle -bundle_loader categorybatch.exe -framework Foundation $DIR/categorybatch_category.m -DIMAGE=1 -o categorybatch1.bundle
+    $C{COMPILE} -bundle -bundle_loader categorybatch.exe -framework Foundation $DIR/categorybatch_category.m -DIMAGE=2 -o categorybatch2.bundle
+END
+*/
+
+#include "test.h"
+#include <objc/runtime.h>
+#include <dlfcn.h>
+#include <string.h>
+#import <Foundation/Foundation.h>
+
+// Categories loaded onto a realized class. Each image brings more than
+// 64 categories, which are attached in one batch. The second image's
+// batch grows the class's method list array again.
+
+#define CATS 70
+
+@interface CatTarget : NSObject
+- (int) which;
+@end
+
+@implementation CatTarget
+- (int) which { return 0; }
+- (void) base { }
+@end
+
+static int indexOfMethod(Method *methods, unsigned count, const char *name)
+{
+    for (unsigned i = 0; i < count; i++) {
+        if (0 == strcmp(sel_getName(method_getName(methods[i])), name)) {
+            return (int)i;
+        }
+    }
+    fail("method %s not found", name);
+}
+
+int main()
+{
+    // Realize the class and cache -which before any category arrives.
+    CatTarget *obj = [CatTarget new];
+    testassert([obj which] == 0);
+
+    void *dl = dlopen("categorybatch1.bundle", RTLD_LAZY);
+    testassert(dl);
+    testassert([obj which] == 1000 + CATS - 1);
+
+    dl = dlopen("categorybatch2.bundle", RTLD_LAZY);
+    testassert(dl);
+    testassert([obj which] == 2000 + CATS - 1);
+
+    // Method lists are listed front to back: the newest image first,
+    // each image's last category first, and the class's own methods
+    // last.
+    unsigned count;
+    Method *methods = class_copyMethodList([CatTarget class], &count);
+    testassert(count == 2 + 2*2*CATS);
+
+    int last = -1;
+    for (int image = 2; image >= 1; image--) {
+        for (int n = CATS - 1; n >= 0; n--) {
+            char name[32];
+            snprintf(name, sizeof(name), "image%d_%d", image, n);
+            int index = indexOfMethod(methods, count, name);
+            testassert(index > last);
+            last = index;
+        }
+    }
+    testassert(indexOfMethod(methods, count, "base") > last);
+
+    // The first -which, from the newest category, is the one called.
+    int first = indexOfMethod(methods, count, "which");
+    testassert(first < indexOfMethod(methods, count, "image2_68"));
+    testassert(method_getImplementation(methods[first]) ==
+               class_getMethodImplementation([CatTarget class],
+                                             @selector(which)));
+    free(methods);
+
+    succeed(__FILE__);
+}
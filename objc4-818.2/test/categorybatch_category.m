@@ -0,0 +1,33 @@
+// Categories on CatTarget for categorybatch.m, built once with IMAGE=1
+// and once with IMAGE=2. Each category overrides -which and adds one
+// method of its own.
+
+#include <objc/runtime.h>
+#import <Foundation/Foundation.h>
+
+@interface CatTarget : NSObject
+@end
+
+#define CAT2(img, n)                                    \
+    @interface CatTarget (Image##img##_##n) @end        \
+    @implementation CatTarget (Image##img##_##n)        \
+    - (int) which { return img*1000 + n; }              \
+    - (void) image##img##_##n { }                       \
+    @end
+#define CAT(img, n) CAT2(img, n)
+
+#define CAT10(tens)                                     \
+    CAT(IMAGE, tens##0) CAT(IMAGE, tens##1)             \
+    CAT(IMAGE, tens##2) CAT(IMAGE, tens##3)             \
+    CAT(IMAGE, tens##4) CAT(IMAGE, tens##5)             \
+    CAT(IMAGE, tens##6) CAT(IMAGE, tens##7)             \
+    CAT(IMAGE, tens##8) CAT(IMAGE, tens##9)
+
+// 70 categories, Image<IMAGE>_0 to Image<IMAGE>_69.
+CAT10()
+CAT10(1)
+CAT10(2)
+CAT10(3)
+CAT10(4)
+CAT10(5)
+CAT10(6)
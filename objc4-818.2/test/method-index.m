@@ -0,0 +1,112 @@
+// TEST_CONFIG MEM=mrc
+// TEST_ENV OBJC_METHOD_INDEX=YES
+
+#include "test.h"
+#include "testroot.i"
+#include <objc/runtime.h>
+#include <objc/message.h>
+
+// OBJC_METHOD_INDEX. Method lookups in a deep hierarchy find the most
+// derived implementation, and see methods added to or replaced in any
+// class of the chain after the leaf class's index has been built.
+
+#define DEPTH 12
+#define METHODS 40
+
+typedef long (*Getter)(id, SEL);
+
+static Class classes[DEPTH];
+static SEL sels[METHODS];
+
+static long call(id obj, SEL sel)
+{
+    return ((Getter)objc_msgSend)(obj, sel);
+}
+
+static void addValue(Class cls, SEL sel, long value)
+{
+    IMP imp = imp_implementationWithBlock(^(id self __unused) {
+        return value;
+    });
+    testassert(class_addMethod(cls, sel, imp, "l@:"));
+}
+
+@interface Dynamic : TestRoot @end
+@implementation Dynamic
++(BOOL)resolveInstanceMethod:(SEL)sel
+{
+    if (0 == strcmp(sel_getName(sel), "resolvedMethod")) {
+        IMP imp = imp_implementationWithBlock(^(id self __unused) {
+            return 1234L;
+        });
+        class_addMethod(self, sel, imp, "l@:");
+        return YES;
+    }
+    return NO;
+}
+@end
+
+int main()
+{
+    char name[64];
+    for (int i = 0; i < METHODS; i++) {
+        snprintf(name, sizeof(name), "methodIndexValue%d", i);
+        sels[i] = sel_registerName(name);
+    }
+
+    // Class d implements every selector whose number is a multiple of
+    // d+1, returning d, so the most derived class wins. The topmost
+    // class implements them all.
+    Class superclass = [Dynamic class];
+    for (int d = DEPTH - 1; d >= 0; d--) {
+        snprintf(name, sizeof(name), "MethodIndexClass%d", d);
+        Class cls = objc_allocateClassPair(superclass, name, 0);
+        for (int i = 0; i < METHODS; i++) {
+            if (i % (d + 1) == 0  ||  d == DEPTH - 1) addValue(cls, sels[i], d);
+        }
+        objc_registerClassPair(cls);
+        classes[d] = cls;
+        superclass = cls;
+    }
+    Class leaf = classes[0];
+    id obj = [leaf new];
+
+    // Every selector is a first lookup, so the leaf class's index is
+    // built after a few of them and used for the rest.
+    for (int i = 0; i < METHODS; i++) {
+        testassertequal(call(obj, sels[i]), 0);
+    }
+    id mid = [classes[DEPTH / 2] new];
+    for (int i = 0; i < METHODS; i++) {
+        long expected = DEPTH / 2;
+        while (i % (expected + 1) != 0  &&  expected != DEPTH - 1) expected++;
+        testassertequal(call(mid, sels[i]), expected);
+    }
+
+    // A method added to a superclass is seen by lookups for subclasses.
+    SEL added = sel_registerName("methodIndexAdded");
+    addValue(classes[DEPTH - 1], added, 99);
+    testassertequal(call(obj, added), 99);
+    testassertequal(call(mid, added), 99);
+
+    // So is an override added in the middle of the chain.
+    addValue(classes[DEPTH / 2], added, 50);
+    testassertequal(call(obj, added), 50);
+    testassertequal(call(mid, added), 50);
+
+    // Replacing an implementation needs no rebuild.
+    Method m = class_getInstanceMethod(classes[DEPTH - 1], sels[1]);
+    IMP imp = imp_implementationWithBlock(^(id self __unused) {
+        return 77L;
+    });
+    method_setImplementation(m, imp);
+    testassertequal(call(mid, sels[1]), 77);
+
+    // Selectors nobody implements still reach the resolver.
+    testassertequal(call(obj, sel_registerName("resolvedMethod")), 1234);
+    testassert(!class_respondsToSelector(leaf, sel_registerName("noSuchMethod")));
+
+    [obj release];
+    [mid release];
+    succeed(__FILE__);
+}
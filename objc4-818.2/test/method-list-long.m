@@ -0,0 +1,56 @@
+// TEST_CONFIG MEM=mrc
+
+#include "test.h"
+#include "testroot.i"
+#include <objc/runtime.h>
+#include <objc/message.h>
+#include <objc/objc-internal.h>
+
+// Lookups in a method list long enough to be searched without branches
+// (METHOD_LIST_BRANCHLESS_MIN) find every method in it, and miss
+// selectors it does not contain.
+
+#define METHODS 3000
+
+typedef long (*Getter)(id, SEL);
+
+@interface Long : TestRoot @end
+@implementation Long @end
+
+int main()
+{
+    static SEL names[METHODS];
+    static IMP imps[METHODS];
+    static const char *types[METHODS];
+    char name[64];
+
+    for (int i = 0; i < METHODS; i++) {
+        snprintf(name, sizeof(name), "longListMethod%d", i);
+        names[i] = sel_registerName(name);
+        imps[i] = imp_implementationWithBlock(^(id self __unused) {
+            return (long)i;
+        });
+        types[i] = "l@:";
+    }
+
+    uint32_t failed = 1;
+    SEL *failures = class_addMethodsBulk([Long class], names, imps, types,
+                                         METHODS, &failed);
+    testassert(failures == NULL);
+    testassertequal(failed, 0);
+
+    id obj = [Long new];
+    for (int i = 0; i < METHODS; i++) {
+        testassert(class_getInstanceMethod([Long class], names[i]));
+        testassertequal(((Getter)objc_msgSend)(obj, names[i]), i);
+    }
+
+    for (int i = 0; i < 100; i++) {
+        snprintf(name, sizeof(name), "longListMissing%d", i);
+        SEL missing = sel_registerName(name);
+        testassert(!class_respondsToSelector([Long class], missing));
+    }
+
+    [obj release];
+    succeed(__FILE__);
+}
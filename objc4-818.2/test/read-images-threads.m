@@ -0,0 +1,37 @@
+// TEST_CONFIG MEM=mrc
+// TEST_ENV OBJC_READ_IMAGES_THREADS=4
+
+#include "test.h"
+#include <string.h>
+#include <objc/runtime.h>
+
+// OBJC_READ_IMAGES_THREADS. This image has more selector references than
+// ParallelSelectorRefsMin, so _read_images hashes their names on worker
+// threads before registering them. Every reference must still be the
+// registered selector for its name.
+
+#define S1(p) @selector(p##0), @selector(p##1), @selector(p##2), \
+    @selector(p##3), @selector(p##4), @selector(p##5), @selector(p##6), \
+    @selector(p##7), @selector(p##8), @selector(p##9)
+#define S2(p) S1(p##0), S1(p##1), S1(p##2), S1(p##3), S1(p##4), \
+    S1(p##5), S1(p##6), S1(p##7), S1(p##8), S1(p##9)
+#define S3(p) S2(p##0), S2(p##1), S2(p##2), S2(p##3), S2(p##4), \
+    S2(p##5), S2(p##6), S2(p##7), S2(p##8), S2(p##9)
+#define S4(p) S3(p##0), S3(p##1), S3(p##2), S3(p##3), S3(p##4), \
+    S3(p##5), S3(p##6), S3(p##7), S3(p##8), S3(p##9)
+
+#define COUNT 10000
+
+int main()
+{
+    SEL sels[COUNT] = { S4(readImagesSelector) };
+
+    char name[64];
+    for (int i = 0; i < COUNT; i++) {
+        snprintf(name, sizeof(name), "readImagesSelector%04d", i);
+        testassert(sels[i] == sel_registerName(name));
+        testassert(0 == strcmp(sel_getName(sels[i]), name));
+    }
+
+    succeed(__FILE__);
+}
@@ -0,0 +1,107 @@
+// TEST_CONFIG MEM=mrc
+
+#include "test.h"
+#include "testroot.i"
+#include <pthread.h>
+#include <sched.h>
+#include <objc/runtime.h>
+
+// Threads realize the classes of separate and shared hierarchies at the
+// same time. Method lists are fixed up without runtimeLock before each
+// class is realized; every lookup must still find the most derived
+// method, and all threads must see the same classes.
+
+#define THREADS 8
+#define CHAINS 16
+
+#define LEVEL(h, n, super)                                      \
+    @interface Chain##h##Class##n : super @end                  \
+    @implementation Chain##h##Class##n                          \
+    -(long)value { return h * 100 + n; }                        \
+    -(long)level##n { return n; }                               \
+    -(long)a##n { return n; } -(long)b##n { return n; }         \
+    -(long)c##n { return n; } -(long)d##n { return n; }         \
+    +(long)classValue { return h * 100 + n; }                   \
+    @end
+
+#define CHAIN(h)                                                \
+    LEVEL(h, 0, TestRoot)                                       \
+    LEVEL(h, 1, Chain##h##Class0)                               \
+    LEVEL(h, 2, Chain##h##Class1)                               \
+    LEVEL(h, 3, Chain##h##Class2)                               \
+    @interface Chain##h##Leaf : Chain##h##Class3 @end           \
+    @implementation Chain##h##Leaf                              \
+    -(long)chain { return h; }                                  \
+    @end
+
+CHAIN(0)  CHAIN(1)  CHAIN(2)  CHAIN(3)
+CHAIN(4)  CHAIN(5)  CHAIN(6)  CHAIN(7)
+CHAIN(8)  CHAIN(9)  CHAIN(10) CHAIN(11)
+CHAIN(12) CHAIN(13) CHAIN(14) CHAIN(15)
+
+@interface TestRoot (Chains)
+-(long)value;
+-(long)chain;
+-(long)level0;
+-(long)level3;
++(long)classValue;
+@end
+
+static volatile int ready;
+static Class realized[THREADS][CHAINS];
+
+static void *threadfn(void *arg)
+{
+    intptr_t t = (intptr_t)arg;
+    char name[64];
+    // Start together.
+    __sync_fetch_and_add(&ready, 1);
+    while (ready < THREADS) sched_yield();
+
+    // Each thread starts with a chain of its own, then goes through
+    // every chain, so most chains are raced for.
+    for (int i = 0; i < CHAINS; i++) {
+        int h = (int)((i + t * 2) % CHAINS);
+        snprintf(name, sizeof(name), "Chain%dLeaf", h);
+        Class cls = objc_getClass(name);
+        testassert(cls);
+        id obj = [cls new];
+        testassertequal([obj value], h * 100 + 3);
+        testassertequal([obj chain], h);
+        testassertequal([obj level0], 0);
+        testassertequal([obj level3], 3);
+        testassertequal([cls classValue], h * 100 + 3);
+        [obj release];
+        realized[t][h] = cls;
+    }
+    return NULL;
+}
+
+int main()
+{
+    pthread_t threads[THREADS];
+    for (intptr_t t = 0; t < THREADS; t++) {
+        pthread_create(&threads[t], NULL, &threadfn, (void *)t);
+    }
+    for (int t = 0; t < THREADS; t++) {
+        pthread_join(threads[t], NULL);
+    }
+
+    char name[64];
+    for (int h = 0; h < CHAINS; h++) {
+        for (int t = 1; t < THREADS; t++) {
+            testassert(realized[t][h] == realized[0][h]);
+        }
+        // Every class got all of its methods.
+        snprintf(name, sizeof(name), "Chain%dClass2", h);
+        Class cls = objc_getClass(name);
+        unsigned int count;
+        Method *methods = class_copyMethodList(cls, &count);
+        testassertequal(count, 6);
+        free(methods);
+        snprintf(name, sizeof(name), "Chain%dClass3", h);
+        testassert(class_getSuperclass(realized[0][h]) == objc_getClass(name));
+    }
+
+    succeed(__FILE__);
+}
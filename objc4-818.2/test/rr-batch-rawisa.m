@@ -0,0 +1,7 @@
+// TEST_CONFIG MEM=mrc
+// TEST_ENV OBJC_DISABLE_NONPOINTER_ISA=YES
+
+// objc_retainN and objc_releaseN with every retain count in the
+// side tables, so the stripe-grouped path handles all of them.
+
+#include "rr-batch.m"
@@ -0,0 +1,109 @@
+// TEST_CONFIG MEM=mrc
+
+#include "test.h"
+
+#include <objc/NSObject.h>
+#include <objc/objc-internal.h>
+#include <mach/mach_time.h>
+
+// objc_retainN and objc_releaseN test and benchmark
+// Checks that the batched calls retain and release exactly like a loop
+// of objc_retain and objc_release, including nil entries, duplicates,
+// and deallocation. With VERBOSE=2 prints the time per object of both
+// for 16 to 1M objects. rr-batch-rawisa.m runs this with raw isa,
+// where every count lives in the side tables.
+
+#define MAXCOUNT (1024*1024)
+
+static int Deallocs;
+
+@interface Counted : NSObject @end
+@implementation Counted
+-(void)dealloc {
+    Deallocs++;
+    [super dealloc];
+}
+@end
+
+static id objs[MAXCOUNT];
+
+static void checkCounts(id *list, int count, uintptr_t expected)
+{
+    for (int i = 0; i < count; i++) {
+        if (list[i]) testassert([list[i] retainCount] == expected);
+    }
+}
+
+int main()
+{
+    mach_timebase_info_data_t tb;
+    mach_timebase_info(&tb);
+
+    // nil entries and duplicates
+    {
+        id list[100];
+        for (int i = 0; i < 100; i++) {
+            list[i] = (i % 10 == 9) ? nil : [Counted new];
+        }
+
+        objc_retainN(list, 100);
+        checkCounts(list, 100, 2);
+        objc_retainN(list, 100);
+        objc_retainN(list, 100);
+        checkCounts(list, 100, 4);
+        objc_releaseN(list, 100);
+        objc_releaseN(list, 100);
+        checkCounts(list, 100, 2);
+
+        // Each object twice in one call, in the same batch.
+        id twice[200];
+        for (int i = 0; i < 100; i++) {
+            twice[i*2] = twice[i*2+1] = list[i];
+        }
+        objc_retainN(twice, 200);
+        checkCounts(list, 100, 4);
+        objc_releaseN(twice, 200);
+        checkCounts(list, 100, 2);
+
+        objc_releaseN(list, 100);
+        checkCounts(list, 100, 1);
+        testassert(Deallocs == 0);
+        objc_releaseN(list, 100);
+        testassert(Deallocs == 90);
+        objc_releaseN(list, 0);
+    }
+
+    for (int i = 0; i < MAXCOUNT; i++) {
+        objs[i] = [Counted new];
+    }
+
+    for (int count = 16; count <= MAXCOUNT; count *= 4) {
+        int rounds = MAXCOUNT / count;
+        if (rounds > 1024) rounds = 1024;
+
+        uint64_t start = mach_absolute_time();
+        for (int r = 0; r < rounds; r++) {
+            for (int i = 0; i < count; i++) objc_retain(objs[i]);
+            for (int i = 0; i < count; i++) objc_release(objs[i]);
+        }
+        uint64_t loop = mach_absolute_time() - start;
+
+        start = mach_absolute_time();
+        for (int r = 0; r < rounds; r++) {
+            objc_retainN(objs, count);
+            objc_releaseN(objs, count);
+        }
+        uint64_t batch = mach_absolute_time() - start;
+
+        checkCounts(objs, count, 1);
+
+        double perObject = (double)tb.numer / tb.denom / rounds / count / 2;
+        testprintf("%8d objects: loop %6.2f ns, batch %6.2f ns per retain or release\n",
+                   count, loop * perObject, batch * perObject);
+    }
+
+    objc_releaseN(objs, MAXCOUNT);
+    testassert(Deallocs == 90 + MAXCOUNT);
+
+    succeed(__BASE_FILE__);  // rr-batch-rawisa.m includes this file
+}
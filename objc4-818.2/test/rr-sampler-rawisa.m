@@ -0,0 +1,53 @@
+// TEST_CONFIG MEM=mrc
+// TEST_ENV OBJC_DISABLE_NONPOINTER_ISA=YES OBJC_SAMPLE_RETAIN_RELEASE=1
+
+#include "test.h"
+
+#include <objc/objc-internal.h>
+#include <Foundation/NSObject.h>
+
+// Side table retains and releases made in batches, by objc_retainN and
+// by popping an autorelease pool, are sampled like single ones.
+
+#define OBJECTS 1000
+
+@interface RawSampled : NSObject @end
+@implementation RawSampled @end
+
+static id objs[OBJECTS];
+
+static objc_retain_release_samples samplesFor(Class cls)
+{
+    objc_retain_release_samples result = {};
+    unsigned int count = objc_getRetainReleaseSamples(NULL, 0);
+    objc_retain_release_samples *samples = (objc_retain_release_samples *)
+        calloc(count, sizeof(*samples));
+    count = objc_getRetainReleaseSamples(samples, count);
+    for (unsigned int i = 0; i < count; i++) {
+        if (samples[i].cls == cls) result = samples[i];
+    }
+    free(samples);
+    return result;
+}
+
+int main()
+{
+    for (int i = 0; i < OBJECTS; i++) objs[i] = [RawSampled new];
+    objc_retain_release_samples before = samplesFor([RawSampled class]);
+
+    objc_retainN(objs, OBJECTS);
+    void *pool = objc_autoreleasePoolPush();
+    for (int i = 0; i < OBJECTS; i++) [objs[i] autorelease];
+    objc_autoreleasePoolPop(pool);
+
+    objc_retain_release_samples after = samplesFor([RawSampled class]);
+    testassert(after.sidetableRetains - before.sidetableRetains >= OBJECTS);
+    testassert(after.sidetableReleases - before.sidetableReleases >= OBJECTS);
+
+    for (int i = 0; i < OBJECTS; i++) {
+        testassert([objs[i] retainCount] == 1);
+        [objs[i] release];
+    }
+
+    succeed(__FILE__);
+}
@@ -0,0 +1,98 @@
+// TEST_CONFIG MEM=mrc
+// TEST_ENV OBJC_SAMPLE_RETAIN_RELEASE=1
+
+#include "test.h"
+
+#include <pthread.h>
+#include <objc/objc-internal.h>
+#include <Foundation/NSObject.h>
+
+// OBJC_SAMPLE_RETAIN_RELEASE and objc_getRetainReleaseSamples.
+// With a period of 1 every event is counted. Counts from a thread that
+// has exited are still reported, and classes come busiest first.
+
+#define MAIN_AUTORELEASES 3000
+#define THREAD_AUTORELEASES 1000
+#define RETAINS (1 << 20)
+
+@interface MainSampled : NSObject @end
+@implementation MainSampled @end
+
+@interface ThreadSampled : NSObject @end
+@implementation ThreadSampled @end
+
+static void autoreleaseMany(Class cls, int count)
+{
+    id obj = [cls new];
+    void *pool = objc_autoreleasePoolPush();
+    for (int i = 0; i < count; i++) {
+        [[obj retain] autorelease];
+    }
+    objc_autoreleasePoolPop(pool);
+    [obj release];
+}
+
+static void *threadfn(void *arg __unused)
+{
+    autoreleaseMany([ThreadSampled class], THREAD_AUTORELEASES);
+    return NULL;
+}
+
+static objc_retain_release_samples *
+find(objc_retain_release_samples *samples, unsigned int count, Class cls)
+{
+    for (unsigned int i = 0; i < count; i++) {
+        if (samples[i].cls == cls) return &samples[i];
+    }
+    return NULL;
+}
+
+int main()
+{
+    autoreleaseMany([MainSampled class], MAIN_AUTORELEASES);
+
+    pthread_t th;
+    pthread_create(&th, NULL, &threadfn, NULL);
+    pthread_join(th, NULL);
+
+    // Enough retains to overflow the inline retain count.
+    id obj = [MainSampled new];
+    for (int i = 0; i < RETAINS; i++) [obj retain];
+    for (int i = 0; i < RETAINS; i++) [obj release];
+    testassert([obj retainCount] == 1);
+    [obj release];
+
+    unsigned int count = objc_getRetainReleaseSamples(NULL, 0);
+    testassert(count >= 2);
+    objc_retain_release_samples *samples = (objc_retain_release_samples *)
+        calloc(count, sizeof(*samples));
+    testassert(objc_getRetainReleaseSamples(samples, count) >= count);
+
+    objc_retain_release_samples *mainSamples =
+        find(samples, count, [MainSampled class]);
+    objc_retain_release_samples *threadSamples =
+        find(samples, count, [ThreadSampled class]);
+    testassert(mainSamples);
+    testassert(threadSamples);
+    testassertequal(mainSamples->autoreleases, (uint64_t)MAIN_AUTORELEASES);
+    testassertequal(threadSamples->autoreleases, (uint64_t)THREAD_AUTORELEASES);
+#if __LP64__
+    testassert(mainSamples->retainOverflows > 0);
+    testassert(mainSamples->releaseUnderflows > 0);
+#endif
+
+    for (unsigned int i = 1; i < count; i++) {
+        uint64_t prev = samples[i-1].retainOverflows +
+            samples[i-1].releaseUnderflows + samples[i-1].sidetableRetains +
+            samples[i-1].sidetableReleases + samples[i-1].autoreleases;
+        uint64_t cur = samples[i].retainOverflows +
+            samples[i].releaseUnderflows + samples[i].sidetableRetains +
+            samples[i].sidetableReleases + samples[i].autoreleases;
+        testassert(prev >= cur);
+    }
+    free(samples);
+
+    if (testverbose()) objc_dumpRetainReleaseSamples();
+
+    succeed(__FILE__);
+}
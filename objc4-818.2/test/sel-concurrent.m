@@ -0,0 +1,63 @@
+// TEST_CONFIG
+
+#include "test.h"
+#include <string.h>
+#include <pthread.h>
+#include <objc/runtime.h>
+
+// Threads register overlapping sets of new selector names while others
+// look them up. Every thread must get the same SEL for the same name,
+// including across the selector table growing underneath the lookups.
+
+#define THREADS 8
+#define NAMES 20000
+
+static SEL sels[THREADS][NAMES];
+
+static void makeName(char *buf, size_t size, int i)
+{
+    snprintf(buf, size, "concurrentSelector%d:with:", i);
+}
+
+static void *threadfn(void *arg)
+{
+    intptr_t t = (intptr_t)arg;
+    char buf[64];
+    // Each thread starts at a different point so every name is
+    // registered by one thread while others race to look it up.
+    for (int n = 0; n < NAMES; n++) {
+        int i = (n + (int)t * (NAMES / THREADS)) % NAMES;
+        makeName(buf, sizeof(buf), i);
+        SEL sel = (t & 1) ? sel_getUid(buf) : sel_registerName(buf);
+        testassert(sel);
+        testassert(0 == strcmp(sel_getName(sel), buf));
+        sels[t][i] = sel;
+    }
+    return NULL;
+}
+
+int main()
+{
+    pthread_t threads[THREADS];
+    for (intptr_t t = 0; t < THREADS; t++) {
+        pthread_create(&threads[t], NULL, &threadfn, (void *)t);
+    }
+    for (int t = 0; t < THREADS; t++) {
+        pthread_join(threads[t], NULL);
+    }
+
+    char buf[64];
+    for (int i = 0; i < NAMES; i++) {
+        for (int t = 1; t < THREADS; t++) {
+            testassert(sels[t][i] == sels[0][i]);
+        }
+        makeName(buf, sizeof(buf), i);
+        testassert(sel_registerName(buf) == sels[0][i]);
+        testassert(sel_isMapped(sels[0][i]));
+    }
+
+    // A different pointer with a registered name is not a mapped selector.
+    testassert(!sel_isMapped((SEL)(void *)buf));
+
+    succeed(__FILE__);
+}
@@ -0,0 +1,61 @@
+// TEST_CONFIG MEM=mrc
+// TEST_ENV OBJC_SIDE_TABLE_STRIPES=1000 OBJC_PROFILE_SIDE_TABLES=YES
+
+#include "test.h"
+#include "testroot.i"
+
+#include <objc/runtime.h>
+#include <objc/objc-internal.h>
+
+// OBJC_SIDE_TABLE_STRIPES and the OBJC_PROFILE_SIDE_TABLES counters.
+
+#define OBJECTS 4096
+
+static id objs[OBJECTS];
+static id vars[OBJECTS];
+
+int main()
+{
+    // 1000 rounds up to 1024.
+    unsigned int stripes = objc_getSideTableContention(NULL, 0);
+    testassert(stripes == 1024);
+
+    objc_side_table_contention *before = (objc_side_table_contention *)
+        calloc(stripes, sizeof(*before));
+    objc_side_table_contention *after = (objc_side_table_contention *)
+        calloc(stripes, sizeof(*after));
+    testassert(objc_getSideTableContention(before, stripes) == stripes);
+
+    // Weak references always go through the side tables.
+    for (int i = 0; i < OBJECTS; i++) {
+        objs[i] = [TestRoot new];
+        objc_initWeak(&vars[i], objs[i]);
+    }
+    for (int i = 0; i < OBJECTS; i++) {
+        testassert(objc_loadWeak(&vars[i]) == objs[i]);
+        objc_destroyWeak(&vars[i]);
+        [objs[i] release];
+    }
+
+    testassert(objc_getSideTableContention(after, stripes) == stripes);
+    uint64_t acquires = 0;
+    unsigned int used = 0;
+    for (unsigned int i = 0; i < stripes; i++) {
+        testassert(after[i].acquires >= before[i].acquires);
+        testassert(after[i].contended <= after[i].acquires);
+        uint64_t delta = after[i].acquires - before[i].acquires;
+        acquires += delta;
+        if (delta) used++;
+    }
+    testprintf("%llu acquires over %u of %u stripes\n",
+               acquires, used, stripes);
+    testassert(acquires >= OBJECTS * 2);
+    // The hash spreads the objects over most of the stripes.
+    testassert(used > stripes / 2);
+
+    if (testverbose()) objc_dumpSideTableContention();
+
+    free(before);
+    free(after);
+    succeed(__FILE__);
+}
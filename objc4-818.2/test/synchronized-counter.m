@@ -7,6 +7,7 @@
 #include <objc/runtime.h>
 #include <objc/objc-sync.h>
 #include <Foundation/NSObject.h>
+#include <mach/mach_time.h>
 #include <System/pthread_machdep.h>
 
 // synchronized stress test
@@ -21,6 +22,9 @@
 #define COUNT 1024*24
 #endif
 
+// Thread t locks 1 + t%4 deep.
+#define PAIRS ((double)COUNT * THREADS / 4 * (1+2+3+4))
+
 static id lock;
 static int count;
 
@@ -68,6 +72,10 @@ int main()
     testassert(pthread_getspecific(__PTK_FRAMEWORK_OBJC_KEY0));
 #endif
 
+    mach_timebase_info_data_t tb;
+    mach_timebase_info(&tb);
+    uint64_t start = mach_absolute_time();
+
     // Start the threads
     for (t = 0; t < THREADS; t++) {
         pthread_create(&threads[t], NULL, &threadfn, (void*)(intptr_t)t);
@@ -77,6 +85,9 @@ int main()
     for (t = 0; t < THREADS; t++) {
         pthread_join(threads[t], NULL);
     }
+
+    uint64_t ns = (mach_absolute_time() - start) * tb.numer / tb.denom;
+    testprintf("%.1f ns per enter/exit pair\n", ns / PAIRS);
     
     // Verify lock: should be available
     // Verify count: should be THREADS*COUNT
@@ -7,6 +7,7 @@
 #include <objc/runtime.h>
 #include <objc/objc-sync.h>
 #include <Foundation/NSObject.h>
+#include <mach/mach_time.h>
 
 // synchronized stress test
 // 2-D grid of counters and locks. 
@@ -31,6 +32,9 @@
 #define COUNT 1024*8
 #endif
 
+// Thread t locks 1 + t%4 deep, and locks [r][0..c] for every [r][c].
+#define PAIRS ((double)COUNT * THREADS / 4 * (1+2+3+4) * ROWS * COLS*(COLS+1)/2)
+
 static id locks[ROWS][COLS];
 static int counts[ROWS][COLS];
 
@@ -88,6 +92,10 @@ int main()
         }
     }
 
+    mach_timebase_info_data_t tb;
+    mach_timebase_info(&tb);
+    uint64_t start = mach_absolute_time();
+
     // Start the threads
     for (t = 0; t < THREADS; t++) {
         pthread_create(&threads[t], NULL, &threadfn, (void*)(intptr_t)t);
@@ -97,6 +105,9 @@ int main()
     for (t = 0; t < THREADS; t++) {
         pthread_join(threads[t], NULL);
     }
+
+    uint64_t ns = (mach_absolute_time() - start) * tb.numer / tb.denom;
+    testprintf("%.1f ns per enter/exit pair\n", ns / PAIRS);
     
     // Verify locks: all should be available
     // Verify counts: all should be THREADS*COUNT
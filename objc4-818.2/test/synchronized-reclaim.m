@@ -0,0 +1,154 @@
+// TEST_CONFIG MEM=mrc
+
+#include "test.h"
+
+#include <objc/runtime.h>
+#include <objc/objc-sync.h>
+#include <objc/objc-internal.h>
+#include <Foundation/NSObject.h>
+#include <mach/mach.h>
+#include <pthread.h>
+
+// SyncData reclamation and objc_getSyncDataStatistics.
+// A burst of simultaneously locked objects leaves many idle SyncData
+// records behind. Locking short-lived objects afterwards reuses some
+// and frees the rest.
+
+#define BURST 1024
+#define CHURN 20000
+
+#define TRIES 100
+
+// Must match objc-sync.mm.
+#define SYNC_IDLE_KEEP 4
+
+static id objs[BURST];
+static id contended;
+static semaphore_t go;
+static semaphore_t stop;
+
+static void totals(unsigned int stripes, objc_sync_data_stats *total)
+{
+    objc_sync_data_stats *stats = (objc_sync_data_stats *)
+        calloc(stripes, sizeof(*stats));
+    testassert(objc_getSyncDataStatistics(stats, stripes) == stripes);
+    bzero(total, sizeof(*total));
+    for (unsigned int i = 0; i < stripes; i++) {
+        testassert(stats[i].idle <= stats[i].live);
+        total->live += stats[i].live;
+        total->idle += stats[i].idle;
+        total->reused += stats[i].reused;
+        total->reclaimed += stats[i].reclaimed;
+    }
+    free(stats);
+}
+
+static void burst(void)
+{
+    for (int i = 0; i < BURST; i++) {
+        objs[i] = [NSObject new];
+        testassert(objc_sync_enter(objs[i]) == OBJC_SYNC_SUCCESS);
+    }
+    for (int i = 0; i < BURST; i++) {
+        testassert(objc_sync_exit(objs[i]) == OBJC_SYNC_SUCCESS);
+        testassert(objc_sync_exit(objs[i]) == OBJC_SYNC_NOT_OWNING_THREAD_ERROR);
+        [objs[i] release];
+    }
+}
+
+// Hold contended through a SyncData: the thread's fast cache is
+// taken by another lock first.
+static void *holder(void *arg __unused)
+{
+    id other = [NSObject new];
+    testassert(objc_sync_enter(other) == OBJC_SYNC_SUCCESS);
+    testassert(objc_sync_enter(contended) == OBJC_SYNC_SUCCESS);
+    semaphore_signal(go);
+    semaphore_wait(stop);
+    testassert(objc_sync_exit(contended) == OBJC_SYNC_SUCCESS);
+    testassert(objc_sync_exit(other) == OBJC_SYNC_SUCCESS);
+    [other release];
+    return NULL;
+}
+
+// A failed objc_sync_try_enter leaves nothing behind: once the holder
+// leaves, contended's record is idle, and this thread holds nothing.
+static void tryEnterFails(unsigned int stripes)
+{
+    objc_sync_data_stats stats;
+
+    contended = [NSObject new];
+    semaphore_create(mach_task_self(), &go, 0, 0);
+    semaphore_create(mach_task_self(), &stop, 0, 0);
+    pthread_t th;
+    pthread_create(&th, NULL, &holder, NULL);
+    semaphore_wait(go);
+
+    for (int i = 0; i < TRIES; i++) {
+        testassert(!objc_sync_try_enter(contended));
+    }
+    testassert(objc_sync_exit(contended) == OBJC_SYNC_NOT_OWNING_THREAD_ERROR);
+
+    semaphore_signal(stop);
+    pthread_join(th, NULL);
+    totals(stripes, &stats);
+    testprintf("after failed tries: %u live, %u idle\n",
+               stats.live, stats.idle);
+    testassert(stats.idle == stats.live);
+
+    // The lock can be taken and released normally afterwards.
+    testassert(objc_sync_try_enter(contended));
+    testassert(objc_sync_exit(contended) == OBJC_SYNC_SUCCESS);
+    testassert(objc_sync_exit(contended) == OBJC_SYNC_NOT_OWNING_THREAD_ERROR);
+    [contended release];
+}
+
+int main()
+{
+    unsigned int stripes = objc_getSyncDataStatistics(NULL, 0);
+    testassert(stripes > 0);
+    objc_sync_data_stats before, afterBurst, afterChurn;
+    totals(stripes, &before);
+
+    // Hold one object throughout so every other one needs a SyncData.
+    id anchor = [NSObject new];
+    testassert(objc_sync_enter(anchor) == OBJC_SYNC_SUCCESS);
+
+    burst();
+    totals(stripes, &afterBurst);
+    testprintf("after burst: %u live, %u idle\n",
+               afterBurst.live, afterBurst.idle);
+    testassert(afterBurst.live >= before.live - before.idle + BURST);
+    testassert(afterBurst.idle == afterBurst.live);
+
+    // Keep the churn objects alive until the end so each has its own
+    // address. A lock on a reused address would find the old record.
+    id *churn = (id *)calloc(CHURN, sizeof(id));
+    for (int i = 0; i < CHURN; i++) {
+        churn[i] = [NSObject new];
+        testassert(objc_sync_enter(churn[i]) == OBJC_SYNC_SUCCESS);
+        testassert(objc_sync_exit(churn[i]) == OBJC_SYNC_SUCCESS);
+    }
+    for (int i = 0; i < CHURN; i++) [churn[i] release];
+    free(churn);
+    totals(stripes, &afterChurn);
+    testprintf("after churn: %u live, %u idle, %llu reused, %llu reclaimed\n",
+               afterChurn.live, afterChurn.idle,
+               afterChurn.reused, afterChurn.reclaimed);
+    testassert(afterChurn.reused >= afterBurst.reused + CHURN - BURST);
+    testassert(afterChurn.live <= stripes * (SYNC_IDLE_KEEP + 1));
+    testassert(afterChurn.reclaimed - afterBurst.reclaimed >=
+               afterBurst.live - afterChurn.live);
+
+    // Locking still works after reclamation.
+    burst();
+
+    testassert(objc_sync_exit(anchor) == OBJC_SYNC_SUCCESS);
+    [anchor release];
+
+    tryEnterFails(stripes);
+
+    if (testverbose()) objc_dumpSyncDataStatistics();
+
+    succeed(__FILE__);
+}
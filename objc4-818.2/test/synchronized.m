@@ -74,6 +74,25 @@ int main()
     err = objc_sync_exit(obj);
     testassert(err == OBJC_SYNC_NOT_OWNING_THREAD_ERROR);
 
+    // nested sync_enter of two objects, sync_exit out of order
+    id obj2 = [[NSObject alloc] init];
+    err = objc_sync_enter(obj);
+    testassert(err == OBJC_SYNC_SUCCESS);
+    err = objc_sync_enter(obj2);
+    testassert(err == OBJC_SYNC_SUCCESS);
+    err = objc_sync_enter(obj);
+    testassert(err == OBJC_SYNC_SUCCESS);
+    err = objc_sync_exit(obj);
+    testassert(err == OBJC_SYNC_SUCCESS);
+    err = objc_sync_exit(obj);
+    testassert(err == OBJC_SYNC_SUCCESS);
+    err = objc_sync_exit(obj);
+    testassert(err == OBJC_SYNC_NOT_OWNING_THREAD_ERROR);
+    err = objc_sync_exit(obj2);
+    testassert(err == OBJC_SYNC_SUCCESS);
+    err = objc_sync_exit(obj2);
+    testassert(err == OBJC_SYNC_NOT_OWNING_THREAD_ERROR);
+
     semaphore_create(mach_task_self(), &go, 0, 0);
     semaphore_create(mach_task_self(), &stop, 0, 0);
     pthread_create(&th, NULL, &thread, NULL);
@@ -0,0 +1,89 @@
+// TEST_CONFIG MEM=mrc
+// TEST_ENV OBJC_SIDE_TABLE_STRIPES=2
+
+#include "test.h"
+#include "testroot.i"
+
+#include <objc/runtime.h>
+
+// An object with many weak variables is cleared outside the side table
+// lock. Re-point, move and destroy its weak variables from other
+// threads while it deallocates, and use other objects' weak variables
+// in the same two side tables meanwhile.
+
+#define VARCOUNT 10000
+#define CYCLES 20
+
+static id obj;
+static id other;
+static id vars[VARCOUNT];
+static id moved[VARCOUNT];
+static semaphore_t go;
+static semaphore_t done;
+static volatile bool stop;
+
+void *repointer(void *arg __unused)
+{
+    while (1) {
+        semaphore_wait(go);
+        for (int i = 0; i < VARCOUNT; i += 3) {
+            objc_storeWeak(&vars[i], other);
+        }
+        for (int i = 1; i < VARCOUNT; i += 3) {
+            objc_moveWeak(&moved[i], &vars[i]);
+        }
+        semaphore_signal(done);
+    }
+}
+
+void *bystander(void *arg __unused)
+{
+    id mine = [TestRoot new];
+    while (!stop) {
+        id var;
+        objc_initWeak(&var, mine);
+        testassert(objc_loadWeak(&var) == mine);
+        objc_destroyWeak(&var);
+    }
+    [mine release];
+    return NULL;
+}
+
+int main()
+{
+    semaphore_create(mach_task_self(), &go, 0, 0);
+    semaphore_create(mach_task_self(), &done, 0, 0);
+
+    pthread_t th[2];
+    pthread_create(&th[0], NULL, repointer, NULL);
+    pthread_create(&th[1], NULL, bystander, NULL);
+
+    other = [TestRoot new];
+    for (int c = 0; c < CYCLES; c++) {
+        obj = [TestRoot new];
+        for (int i = 0; i < VARCOUNT; i++) {
+            objc_initWeak(&vars[i], obj);
+            moved[i] = nil;
+        }
+
+        semaphore_signal(go);
+        sched_yield();
+        [obj release];
+        semaphore_wait(done);
+
+        // Re-pointed variables hold other, the rest are nil.
+        for (int i = 0; i < VARCOUNT; i++) {
+            id value = objc_loadWeak(&vars[i]);
+            if (i % 3 == 0) testassert(value == other);
+            else testassert(value == nil);
+            testassert(objc_loadWeak(&moved[i]) == nil);
+            objc_destroyWeak(&vars[i]);
+        }
+    }
+
+    stop = true;
+    pthread_join(th[1], NULL);
+    [other release];
+
+    succeed(__FILE__);
+}